@@ -1,5 +1,8 @@
 #include "project_defs.h"
 #include "alarm.h"
+#include "alarm_scheduler.h"
+#include "alarm_occurrence.h"
+#include "alarm_history.h"
 #include "ObjectManager.h"
 #include "ObjectTransfer_attr_ids.h"
 #include "ObjectTransfer_defs.h"
@@ -9,6 +12,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 
 #include "esp_err.h"
 #include "esp_log.h"
@@ -17,6 +21,7 @@
 #include <time.h>
 
 #include "driver/gptimer.h"
+#include "esp_timer.h"
 
 static const char* TAG = "ALARM";
 
@@ -28,6 +33,26 @@ uint64_t next_alarm_id = 0;
 bool next_alarm_enabled = false;
 time_t next_alarm_interval = 0;
 
+/* The next alarm is anchored to its wall clock target. The timer runs in slices of at most
+ * ALARM_SLICE_MAX_US, each one recomputed from the system time by the alarm task, so neither
+ * the timer drift nor settimeofday from the RTC and SNTP can move the firing moment.
+ * Alarms due in the same window fire together as one ring event and the timer is armed for the
+ * next alarm right away, the player takes the events from alarm_ring_queue.
+ */
+static volatile bool next_alarm_armed = false;
+static int64_t next_alarm_target_us = 0;
+static uint64_t next_alarm_ringtone_id = 0;
+static uint32_t next_alarm_generation = 0;  // changes whenever the armed alarm does, invalidates a prefetched ringtone
+static time_t fired_until = 0;
+static SemaphoreHandle_t alarm_timer_mutex = NULL;
+static TaskHandle_t alarm_task_hdl = NULL;
+static QueueHandle_t alarm_ring_queue = NULL;
+static esp_timer_handle_t ring_deadline_timer = NULL;
+static alarm_ring_event_t ringing;      // event the player took last
+static time_t ring_started = 0;
+static uint8_t ring_stop_reason = ALARM_STOP_NONE;
+static alarm_ring_stop_cb_t ring_stop_cb = NULL;
+
 #define ALARM_LOG
 
 static bool IRAM_ATTR alarm_timer_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_data)
@@ -35,17 +60,210 @@ static bool IRAM_ATTR alarm_timer_cb(gptimer_handle_t timer, const gptimer_alarm
     gptimer_stop(timer);
     gptimer_set_raw_count(timer, 0);
 
+    if (!next_alarm_armed)
+    {
+        return false;
+    }
+
+    // Wall clock can't be read here, the alarm task decides between firing and another slice
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(alarm_task_hdl, &woken);
+    return woken == pdTRUE;
+}
+
+/* Every way a ring ends goes through here, the player is told right away instead of polling the mode */
+static void ring_stopped(uint8_t reason)
+{
+    ring_stop_reason = reason;
+    set_device_mode(DEFAULT_MODE);
+
+    if (ring_stop_cb)
+    {
+        ring_stop_cb();
+    }
+}
+
+static void ring_deadline_cb(void *arg)
+{
     if (get_device_mode() == ALARM_RING_MODE)
     {
-        set_device_mode(DEFAULT_MODE);
+        ESP_LOGI(TAG, "Ring deadline reached");
+        ring_stopped(ALARM_STOP_TIMEOUT);
+    }
+}
+
+static int64_t alarm_wall_time_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void alarm_timer_arm(uint64_t us)
+{
+    gptimer_stop(alarm_timer);
+    gptimer_set_raw_count(alarm_timer, 0);
+
+    gptimer_alarm_config_t alarm_config = {
+        .alarm_count = us,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = false
+    };
+
+    gptimer_set_alarm_action(alarm_timer, &alarm_config);
+    gptimer_start(alarm_timer);
+}
+
+/* Arms the slice towards the target, returns false when the target is already reached.
+ * Long slices stop ALARM_SLICE_GUARD_US short of the target, the last one is short enough
+ * for the oscillator drift not to matter.
+ */
+static bool alarm_timer_arm_slice(void)
+{
+    int64_t remaining = next_alarm_target_us - alarm_wall_time_us();
+
+    if (remaining <= ALARM_FIRE_TOLERANCE_US)
+    {
+        return false;
+    }
+
+    int64_t slice = remaining;
+    if (remaining > ALARM_SLICE_GUARD_US)
+    {
+        slice = remaining - ALARM_SLICE_GUARD_US;
+        if (slice > ALARM_SLICE_MAX_US) slice = ALARM_SLICE_MAX_US;
+    }
+
+    alarm_timer_arm(slice);
+    return true;
+}
+
+static void disable_current_alarm_locked()
+{
+    gptimer_stop(alarm_timer);
+    gptimer_set_raw_count(alarm_timer, 0);
+
+    next_alarm_armed = false;
+    next_alarm_enabled = false;
+    next_alarm_interval = 0;
+    next_alarm_id = 0;
+}
+
+/* Re-arming is frequent, every alarm change and every fired ring does it. The generation changes
+ * only when the armed alarm, its fire time or its ringtone does, so a prefetched ringtone survives
+ * re-arming for the same ring.
+ */
+static void set_next_alarm_locked(time_t after)
+{
+    uint64_t id;
+    time_t fire;
+    alarm_mode_args_t armed;
+    bool was_armed = next_alarm_armed;
+    uint64_t was_id = next_alarm_id;
+    int64_t was_target_us = next_alarm_target_us;
+    uint64_t was_ringtone_id = next_alarm_ringtone_id;
+
+    disable_current_alarm_locked();
+
+    if (!alarm_scheduler_next(after, &id, &fire))
+    {
+        if (was_armed) next_alarm_generation++;
+        ESP_LOGI(TAG, "No enabled alarm to be set");
+        return;
+    }
+
+    next_alarm_enabled = true;
+    next_alarm_id = id;
+    next_alarm_interval = (fire > after) ? fire - after : 0;
+    next_alarm_target_us = (int64_t)fire * 1000000;
+    next_alarm_ringtone_id = alarm_scheduler_get(id, &armed) ? armed.ringtone_id : 0;
+    next_alarm_armed = true;
+
+    if (!was_armed || id != was_id || next_alarm_target_us != was_target_us || next_alarm_ringtone_id != was_ringtone_id)
+    {
+        next_alarm_generation++;
+    }
+
+    if (!alarm_timer_arm_slice())
+    {
+        xTaskNotifyGive(alarm_task_hdl);
+    }
+
+    ESP_LOGI(TAG, "Next alarm ID: %" PRIx64, id);
+    ESP_LOGI(TAG, "Next alarm interval: %" PRIu64 " sec", (uint64_t)next_alarm_interval);
+}
+
+/* Collects every alarm due in the window starting at the target into one ring event.
+ * The event rings with the loudest volume and the ringtone of the first alarm which has one.
+ */
+static void alarm_fire_locked(void)
+{
+    alarm_ring_event_t event = {0};
+    time_t target = next_alarm_target_us / 1000000;
+    time_t until = target + ALARM_COALESCE_WINDOW_SEC - 1;
+
+    event.fire = target;
+    event.generation = next_alarm_generation;
+    event.count = alarm_scheduler_due(until, event.ids, ALARM_RING_IDS_MAX);
+
+    for (uint8_t i = 0; i < event.count; i++)
+    {
+        alarm_mode_args_t due;
+        if (!alarm_scheduler_get(event.ids[i], &due))
+        {
+            continue;
+        }
+
+        if (due.volume > event.volume) event.volume = due.volume;
+        if (due.ring_duration > event.duration) event.duration = due.ring_duration;
+        if (event.ringtone_id == 0) event.ringtone_id = due.ringtone_id;
+        if (due.rise != ALARM_RISE_NONE && due.rise_time > event.rise_time)
+        {
+            event.rise = due.rise;
+            event.rise_time = due.rise_time;
+        }
+    }
+
+    // Armed alarm was removed or disabled since the timer was set, nothing is left to ring
+    if (event.count == 0)
+    {
+        ESP_LOGI(TAG, "No alarm due at the target anymore");
+    }
+    else if (xQueueSend(alarm_ring_queue, &event, 0) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Ring queue full, ring of %u alarms dropped", event.count);
+
+        time_t now = alarm_wall_time_us() / 1000000;
+        for (uint8_t i = 0; i < event.count; i++)
+        {
+            alarm_history_append(event.ids[i], event.fire, now, now, ALARM_STOP_DROPPED);
+        }
     }
     else
     {
-        set_device_mode(ALARM_RING_MODE);
-        set_play_alarm_flag(true);
+        ESP_LOGI(TAG, "Ring of %u alarms, first %" PRIx64 ", latency %" PRId64 " us",
+            event.count, event.ids[0], alarm_wall_time_us() - next_alarm_target_us);
+    }
+
+    fired_until = until;
+    set_next_alarm_locked(until + 1);
+}
+
+static void alarm_task_main(void *arg)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        xSemaphoreTake(alarm_timer_mutex, portMAX_DELAY);
+
+        if (next_alarm_armed && !alarm_timer_arm_slice())
+        {
+            alarm_fire_locked();
+        }
+
+        xSemaphoreGive(alarm_timer_mutex);
     }
-    
-    return false;
 }
 
 esp_err_t alarm_init()
@@ -67,49 +285,102 @@ esp_err_t alarm_init()
     ESP_LOGI(TAG, "Enable alarm timer");
     gptimer_enable(alarm_timer);
 
+    esp_timer_create_args_t deadline_args = {
+        .callback = ring_deadline_cb,
+        .name = "ring deadline"
+    };
+    esp_timer_create(&deadline_args, &ring_deadline_timer);
+
+    if (alarm_history_init() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Alarm history unavailable");
+    }
+
+    alarm_ring_queue = xQueueCreate(ALARM_RING_QUEUE_LEN, sizeof(alarm_ring_event_t));
+    alarm_timer_mutex = xSemaphoreCreateMutex();
+    BaseType_t res = xTaskCreate(alarm_task_main, "ALARM", 3072, NULL, 5, &alarm_task_hdl);
+    if (res != pdPASS)
+    {
+        ESP_LOGE(TAG, "Creating alarm task failed");
+        return ESP_FAIL;
+    }
+
     return ESP_OK;
 }
 
-uint8_t set_alarm_values(uint8_t *payload, uint16_t payload_len)
+/* Optional trailer after the mode fields: nothing, ringtone ID, ringtone ID with group tag, that with
+ * snooze settings, that with an exception calendar ID, or all of that with the volume rise
+ */
+static bool alarm_trailer_valid(uint16_t payload_len, uint16_t fields_len)
 {
+    return payload_len == fields_len
+        || payload_len == fields_len + ALARM_RINGTONE_ID_SIZE
+        || payload_len == fields_len + ALARM_RINGTONE_ID_SIZE + ALARM_GROUP_SIZE
+        || payload_len == fields_len + ALARM_RINGTONE_ID_SIZE + ALARM_GROUP_SIZE + ALARM_SNOOZE_SIZE
+        || payload_len == fields_len + ALARM_RINGTONE_ID_SIZE + ALARM_GROUP_SIZE + ALARM_SNOOZE_SIZE + ALARM_CALENDAR_ID_SIZE
+        || payload_len == fields_len + ALARM_RINGTONE_ID_SIZE + ALARM_GROUP_SIZE + ALARM_SNOOZE_SIZE + ALARM_CALENDAR_ID_SIZE + ALARM_RISE_SIZE;
+}
+
+// Length of the payload up to the trailer, 0 for an unknown mode
+uint16_t alarm_payload_fields_len(const uint8_t *payload)
+{
+    static const uint8_t mode_len[ALARM_MODES_NUM] = {
+        ALARM_MODE_SINGLE_PAYLOAD_SIZE_MIN,
+        ALARM_MODE_WEEKLY_PAYLOAD_SIZE_MIN,
+        ALARM_MODE_MONTHLY_PAYLOAD_SIZE_MIN,
+        ALARM_MODE_YEARLY_PAYLOAD_SIZE_MIN
+    };
+
+    if (payload[0] >= ALARM_MODES_NUM)
+    {
+        return 0;
+    }
+
+    return mode_len[payload[0]] + payload[2];
+}
+
+uint8_t parse_alarm_values(uint8_t *payload, uint16_t payload_len, alarm_mode_args_t *alarm_p)
+{
+    uint8_t *payload_start = payload;
+
     if((payload_len < ALARM_MODE_PAYLOAD_SIZE_MIN || payload_len > ALARM_MODE_PAYLOAD_SIZE_MAX))
     {
         ESP_LOGE(TAG, "Wrong Alarm Length 1");
         return INVALID_ATTR_VAL_LENGTH;
     }
 
-    alarm.mode = *payload;
+    alarm_p->mode = *payload;
     payload += ALARM_FIELD_SIZE;
 
-    alarm.enable = *payload;
+    alarm_p->enable = *payload;
     payload += ALARM_FIELD_SIZE;
 
-    alarm.desc_len = *payload;
+    alarm_p->desc_len = *payload;
     payload += ALARM_FIELD_SIZE;
 
-    if(alarm.mode >= ALARM_MODES_NUM)
+    if(alarm_p->mode >= ALARM_MODES_NUM)
     {
         ESP_LOGE(TAG, "Wrong Alarm Mode");
         return WRITE_REQUEST_REJECTED;
     }
 
-    if(alarm.enable > 1)
+    if(alarm_p->enable > 1)
     {
         ESP_LOGE(TAG, "Wrong Alarm Enable value");
         return WRITE_REQUEST_REJECTED;
     }
     
-    if(alarm.desc_len > ALARM_DESC_LEN_MAX)
+    if(alarm_p->desc_len > ALARM_DESC_LEN_MAX)
     {
         ESP_LOGE(TAG, "Wrong Alarm Enable value");
         return WRITE_REQUEST_REJECTED;
     }
 
-    switch(alarm.mode) 
+    switch(alarm_p->mode) 
     {
         case ALARM_SINGLE_MODE:
         {
-            if (payload_len != ALARM_MODE_SINGLE_PAYLOAD_SIZE_MIN + alarm.desc_len ) 
+            if (!alarm_trailer_valid(payload_len, ALARM_MODE_SINGLE_PAYLOAD_SIZE_MIN + alarm_p->desc_len)) 
             {
                 ESP_LOGE(TAG, "Wrong Alarm Length 2");
                 return INVALID_ATTR_VAL_LENGTH;
@@ -120,7 +391,7 @@ uint8_t set_alarm_values(uint8_t *payload, uint16_t payload_len)
 
         case ALARM_WEEKLY_MODE:
         {
-            if (payload_len != ALARM_MODE_WEEKLY_PAYLOAD_SIZE_MIN + alarm.desc_len ) 
+            if (!alarm_trailer_valid(payload_len, ALARM_MODE_WEEKLY_PAYLOAD_SIZE_MIN + alarm_p->desc_len)) 
             {
                 ESP_LOGE(TAG, "Wrong Alarm Length 3");
                 return INVALID_ATTR_VAL_LENGTH;
@@ -131,7 +402,7 @@ uint8_t set_alarm_values(uint8_t *payload, uint16_t payload_len)
 
         case ALARM_MONTHLY_MODE:
         {
-            if (payload_len != ALARM_MODE_MONTHLY_PAYLOAD_SIZE_MIN + alarm.desc_len ) 
+            if (!alarm_trailer_valid(payload_len, ALARM_MODE_MONTHLY_PAYLOAD_SIZE_MIN + alarm_p->desc_len)) 
             {
                 ESP_LOGE(TAG, "Wrong Alarm Length 4");
                 return INVALID_ATTR_VAL_LENGTH;
@@ -142,7 +413,7 @@ uint8_t set_alarm_values(uint8_t *payload, uint16_t payload_len)
 
         case ALARM_YEARLY_MODE:
         {
-            if (payload_len != ALARM_MODE_YEARLY_PAYLOAD_SIZE_MIN + alarm.desc_len ) 
+            if (!alarm_trailer_valid(payload_len, ALARM_MODE_YEARLY_PAYLOAD_SIZE_MIN + alarm_p->desc_len)) 
             {
                 ESP_LOGE(TAG, "Wrong Alarm Length 5");
                 return INVALID_ATTR_VAL_LENGTH;
@@ -151,27 +422,27 @@ uint8_t set_alarm_values(uint8_t *payload, uint16_t payload_len)
         }
     }
     
-    memcpy((uint8_t*)alarm.desc, payload, alarm.desc_len);
-    alarm.desc[alarm.desc_len] = '\0';
-    payload += alarm.desc_len;
+    memcpy((uint8_t*)alarm_p->desc, payload, alarm_p->desc_len);
+    alarm_p->desc[alarm_p->desc_len] = '\0';
+    payload += alarm_p->desc_len;
 
-    alarm.hour = *payload;
+    alarm_p->hour = *payload;
     payload += ALARM_FIELD_SIZE;
 
-    alarm.minute = *payload;
+    alarm_p->minute = *payload;
     payload += ALARM_FIELD_SIZE;
 
-    switch(alarm.mode) 
+    switch(alarm_p->mode) 
     {
         case ALARM_SINGLE_MODE:
         {
-            alarm.args.single_alarm_args.day = *payload;
+            alarm_p->args.single_alarm_args.day = *payload;
             payload += ALARM_FIELD_SIZE;
 
-            alarm.args.single_alarm_args.month = *payload;
+            alarm_p->args.single_alarm_args.month = *payload;
             payload += ALARM_FIELD_SIZE;
 
-            alarm.args.single_alarm_args.year = *payload;
+            alarm_p->args.single_alarm_args.year = *payload;
             payload += ALARM_FIELD_SIZE;
 
             break;
@@ -180,7 +451,7 @@ uint8_t set_alarm_values(uint8_t *payload, uint16_t payload_len)
 
         case ALARM_WEEKLY_MODE:
         {
-            alarm.args.days = *payload;
+            alarm_p->args.days = *payload;
             payload += ALARM_FIELD_SIZE;
             break;
         }
@@ -188,7 +459,7 @@ uint8_t set_alarm_values(uint8_t *payload, uint16_t payload_len)
 
         case ALARM_MONTHLY_MODE:
         {
-            alarm.args.day = *payload;
+            alarm_p->args.day = *payload;
             payload += ALARM_FIELD_SIZE;
             break;
         }
@@ -196,112 +467,150 @@ uint8_t set_alarm_values(uint8_t *payload, uint16_t payload_len)
 
         case ALARM_YEARLY_MODE:
         {
-            alarm.args.yearly_alarm_args.day = *payload;
+            alarm_p->args.yearly_alarm_args.day = *payload;
             payload += ALARM_FIELD_SIZE;
 
-            alarm.args.yearly_alarm_args.month = *payload;
+            alarm_p->args.yearly_alarm_args.month = *payload;
             payload += ALARM_FIELD_SIZE;
             break;
         }
     }
 
-    alarm.volume = *payload;
+    alarm_p->volume = *payload;
+    payload += ALARM_VOLUME_SIZE;
 
-    if(alarm.volume > ALARM_VOLUME_MAX)
+    if(alarm_p->volume > ALARM_VOLUME_MAX)
     {
         ESP_LOGE(TAG, "Wrong Volume value");
         return WRITE_REQUEST_REJECTED;
     }
 
-    return STATUS_OK;
-}
+    // Ringtone object ID is optional, alarm without it plays the default ringtone
+    alarm_p->ringtone_id = 0;
+    alarm_p->group = ALARM_GROUP_NONE;
+    alarm_p->nap = 0;
+    alarm_p->nap_repeats = 0;
+    alarm_p->ring_duration = 0;
+    alarm_p->calendar_id = 0;
+    alarm_p->rise = ALARM_RISE_NONE;
+    alarm_p->rise_time = 0;
+    if(payload_len - (payload - payload_start) >= ALARM_RINGTONE_ID_SIZE)
+    {
+        memcpy(&alarm_p->ringtone_id, payload, ALARM_RINGTONE_ID_SIZE);
 
-esp_err_t get_alarm_from_file(uint64_t id, alarm_mode_args_t *alarm_p)
-{
-    FILE* f = ObjectManager_open_file("r", id);
+        char path[CONTENT_PATH_LEN_MAX];
+        uint32_t size;
+        if(alarm_p->ringtone_id && ObjectManager_get_ringtone_path(alarm_p->ringtone_id, path, &size) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Wrong Ringtone ID: %" PRIx64, alarm_p->ringtone_id);
+            return WRITE_REQUEST_REJECTED;
+        }
+        payload += ALARM_RINGTONE_ID_SIZE;
 
-    if(f == NULL)
-    {
-        return ESP_ERR_NOT_FOUND;
-    }
+        // Group tag follows the ringtone ID, which is then sent as 0 for the default ringtone
+        if(payload_len - (payload - payload_start) >= ALARM_GROUP_SIZE)
+        {
+            alarm_p->group = *payload;
+            payload += ALARM_GROUP_SIZE;
+        }
 
-    fpos_t pos;
-    bool found = seekfor(f, "ALARM PROPERTIES\n", &pos);
+        if(payload_len - (payload - payload_start) >= ALARM_SNOOZE_SIZE)
+        {
+            alarm_p->nap = payload[0];
+            alarm_p->nap_repeats = payload[1];
+            alarm_p->ring_duration = payload[2];
 
-    if(!found)
-    {
-        return ESP_ERR_NOT_FOUND;
-    }
+            if(alarm_p->nap > ALARM_NAP_MAX || alarm_p->ring_duration > ALARM_RING_DURATION_MAX)
+            {
+                ESP_LOGE(TAG, "Wrong Snooze values");
+                return WRITE_REQUEST_REJECTED;
+            }
+            payload += ALARM_SNOOZE_SIZE;
+        }
 
-    char line[70];
-    char *ptr;
+        if(payload_len - (payload - payload_start) >= ALARM_CALENDAR_ID_SIZE)
+        {
+            memcpy(&alarm_p->calendar_id, payload, ALARM_CALENDAR_ID_SIZE);
 
-    fgets(line, sizeof(line), f);
-    alarm_p->mode = strtol(&line[strlen("Mode: ") ], &ptr, 16);
+            char path[CONTENT_PATH_LEN_MAX];
+            uint32_t size;
+            if(alarm_p->calendar_id && ObjectManager_get_calendar_path(alarm_p->calendar_id, path, &size) != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Wrong Calendar ID: %" PRIx64, alarm_p->calendar_id);
+                return WRITE_REQUEST_REJECTED;
+            }
+            payload += ALARM_CALENDAR_ID_SIZE;
+        }
 
-    fgets(line, sizeof(line), f);
-    alarm_p->enable = strtol(&line[strlen("Enable: ") ], &ptr, 16);
+        if(payload_len - (payload - payload_start) == ALARM_RISE_SIZE)
+        {
+            alarm_p->rise = payload[0];
+            alarm_p->rise_time = payload[1];
 
-    fgets(line, sizeof(line), f);
-    alarm_p->desc_len = strtol(&line[strlen("Description length: ") ], &ptr, 16);
+            if(alarm_p->rise > ALARM_RISE_EXPONENTIAL || (alarm_p->rise != ALARM_RISE_NONE && alarm_p->rise_time == 0))
+            {
+                ESP_LOGE(TAG, "Wrong Rise values");
+                return WRITE_REQUEST_REJECTED;
+            }
+        }
+    }
 
-    fgets(line, sizeof(line), f);
-    strncpy((char*)alarm_p->desc, (char*)&line[strlen("Description: ")], alarm_p->desc_len);
-    alarm_p->desc[alarm_p->desc_len] = '\0';
+    return STATUS_OK;
+}
 
-    fgets(line, sizeof(line), f);
-    alarm_p->hour = strtol(&line[strlen("Hour: ") ], &ptr, 16);
+/* Inverse of parse_alarm_values, always with the whole trailer */
+uint16_t pack_alarm_values(const alarm_mode_args_t *alarm_p, uint8_t *payload)
+{
+    uint8_t *payload_start = payload;
 
-    fgets(line, sizeof(line), f);
-    alarm_p->minute = strtol(&line[strlen("Minute: ") ], &ptr, 16);
+    *payload++ = alarm_p->mode;
+    *payload++ = alarm_p->enable;
+    *payload++ = alarm_p->desc_len;
+    memcpy(payload, alarm_p->desc, alarm_p->desc_len);
+    payload += alarm_p->desc_len;
+    *payload++ = alarm_p->hour;
+    *payload++ = alarm_p->minute;
 
-    switch(alarm_p->mode) 
+    switch(alarm_p->mode)
     {
         case ALARM_SINGLE_MODE:
-        {
-            fgets(line, sizeof(line), f);
-            alarm_p->args.single_alarm_args.day = strtol(&line[strlen("Day: ") ], &ptr, 16);
-
-            fgets(line, sizeof(line), f);
-            alarm_p->args.single_alarm_args.month = strtol(&line[strlen("Month: ") ], &ptr, 16);
-
-            fgets(line, sizeof(line), f);
-            alarm_p->args.single_alarm_args.year = strtol(&line[strlen("Year: ") ], &ptr, 16);
+            *payload++ = alarm_p->args.single_alarm_args.day;
+            *payload++ = alarm_p->args.single_alarm_args.month;
+            *payload++ = alarm_p->args.single_alarm_args.year;
             break;
-        }
-            
+
         case ALARM_WEEKLY_MODE:
-        {
-            fgets(line, sizeof(line), f);
-            alarm_p->args.days = strtol(&line[strlen("Days: ") ], &ptr, 16);
+            *payload++ = alarm_p->args.days;
             break;
-        }
-            
+
         case ALARM_MONTHLY_MODE:
-        {
-            fgets(line, sizeof(line), f);
-            alarm_p->args.day = strtol(&line[strlen("Day: ") ], &ptr, 16);
+            *payload++ = alarm_p->args.day;
             break;
-        }
-            
-        case ALARM_YEARLY_MODE:
-        {
-            fgets(line, sizeof(line), f);
-            alarm_p->args.yearly_alarm_args.day = strtol(&line[strlen("Day: ") ], &ptr, 16);
 
-            fgets(line, sizeof(line), f);
-            alarm_p->args.yearly_alarm_args.month = strtol(&line[strlen("Month: ") ], &ptr, 16);
-            
+        case ALARM_YEARLY_MODE:
+            *payload++ = alarm_p->args.yearly_alarm_args.day;
+            *payload++ = alarm_p->args.yearly_alarm_args.month;
             break;
-        }
     }
 
-    fgets(line, sizeof(line), f);
-    alarm_p->volume = strtol(&line[strlen("Volume: ") ], &ptr, 16);
-    
-    fclose(f);
+    *payload++ = alarm_p->volume;
+    memcpy(payload, &alarm_p->ringtone_id, ALARM_RINGTONE_ID_SIZE);
+    payload += ALARM_RINGTONE_ID_SIZE;
+    *payload++ = alarm_p->group;
+    *payload++ = alarm_p->nap;
+    *payload++ = alarm_p->nap_repeats;
+    *payload++ = alarm_p->ring_duration;
+    memcpy(payload, &alarm_p->calendar_id, ALARM_CALENDAR_ID_SIZE);
+    payload += ALARM_CALENDAR_ID_SIZE;
+    *payload++ = alarm_p->rise;
+    *payload++ = alarm_p->rise_time;
+
+    return payload - payload_start;
+}
 
-    return ESP_OK;
+uint8_t set_alarm_values(uint8_t *payload, uint16_t payload_len)
+{
+    return parse_alarm_values(payload, payload_len, &alarm);
 }
 
 alarm_mode_args_t get_alarm_values()
@@ -314,317 +623,204 @@ alarm_mode_args_t* get_alarm_pointer()
     return &alarm;
 }
 
-uint8_t get_days_to_next_monthly(uint8_t year, uint8_t month)
+bool get_alarm_state()
 {
-    switch(month)
-    {
-        case 0:
-            return 31;
-
-        case 1:
-            if ( ( year % 4 == 0 && year % 100 != 0 ) || ( year % 400 == 0 ) )
-            {
-                return 29;
-            }
-            else
-            {
-                return 28;
-            }
-            
-            return 31;
-
-        case 2:
-            return 31;
-
-        case 3:
-            return 30;
-
-        case 4:
-            return 31;
-
-        case 5:
-            return 30;
+    return next_alarm_enabled;
+}
 
-        case 6:
-            return 31;
+uint64_t get_current_active_alarm_id()
+{
+    return next_alarm_id;
+}
 
-        case 7:
-            return 31;
+void disable_current_alarm()
+{
+    if (alarm_timer_mutex == NULL)
+    {
+        return;
+    }
 
-        case 8:
-            return 30;
+    xSemaphoreTake(alarm_timer_mutex, portMAX_DELAY);
+    if (next_alarm_armed) next_alarm_generation++;
+    disable_current_alarm_locked();
+    xSemaphoreGive(alarm_timer_mutex);
+}
 
-        case 9:
-            return 31;
+/* Stops the ring after its duration, independent of the next alarm timer */
+void set_timer_for_playing_alarm(uint8_t duration)
+{
+    uint64_t timeout = duration ? duration * 60ull * 1000000ull : ALARM_RING_TIMEOUT_US;
 
-        case 10:
-            return 30;
+    esp_timer_stop(ring_deadline_timer);
+    esp_timer_start_once(ring_deadline_timer, timeout);
+}
 
-        case 11:
-            return 31;
+bool alarm_ring_receive(alarm_ring_event_t *event, uint32_t wait_ms)
+{
+    if (xQueueReceive(alarm_ring_queue, event, pdMS_TO_TICKS(wait_ms)) != pdTRUE)
+    {
+        return false;
     }
 
-    return 0;
+    xSemaphoreTake(alarm_timer_mutex, portMAX_DELAY);
+    ringing = *event;
+    ring_started = alarm_wall_time_us() / 1000000;
+    ring_stop_reason = ALARM_STOP_NONE;
+    xSemaphoreGive(alarm_timer_mutex);
+
+    return true;
 }
 
-uint16_t get_days_to_next_yearly(uint8_t year)
+/* Armed alarm with the ringtone it would ring with on its own, false when none is armed */
+bool alarm_get_next_ring(alarm_next_ring_t *next)
 {
-    uint16_t next_year = year + 1;
-    if ( ( next_year % 4 == 0 && next_year % 100 != 0 ) || ( next_year % 400 == 0 ) )
+    alarm_mode_args_t alarm;
+
+    if (alarm_timer_mutex == NULL)
     {
-        return 366;
+        return false;
     }
-    else
+
+    xSemaphoreTake(alarm_timer_mutex, portMAX_DELAY);
+    bool armed = next_alarm_armed && alarm_scheduler_get(next_alarm_id, &alarm);
+    if (armed)
     {
-        return 365;
+        next->fire = next_alarm_target_us / 1000000;
+        next->ringtone_id = alarm.ringtone_id;
+        next->generation = next_alarm_generation;
     }
-}
+    xSemaphoreGive(alarm_timer_mutex);
 
-bool get_alarm_state()
-{
-    return next_alarm_enabled;
+    return armed;
 }
 
-uint64_t get_current_active_alarm_id()
+/* Stops the ring, the reason goes to the history when the player finishes it */
+void alarm_ring_stop(uint8_t reason)
 {
-    return next_alarm_id;
+    if (get_device_mode() != ALARM_RING_MODE)
+    {
+        return;
+    }
+
+    esp_timer_stop(ring_deadline_timer);
+    ring_stopped(reason);
 }
 
-void disable_current_alarm()
+void alarm_ring_set_stop_cb(alarm_ring_stop_cb_t cb)
 {
-    gptimer_stop(alarm_timer);
-    gptimer_set_raw_count(alarm_timer, 0);
-
-    next_alarm_enabled = false;
-    next_alarm_interval = 0;
-    next_alarm_id = 0;
+    ring_stop_cb = cb;
 }
 
-void set_timer_for_playing_alarm()
+/* Called by the player once the ring is over, records one history entry per alarm of it */
+void alarm_ring_end(void)
 {
-    disable_current_alarm();
-    gptimer_alarm_config_t alarm_config = {
-        .alarm_count = 300000000,
-        .reload_count = 0,
-        .flags.auto_reload_on_alarm = false
-    };
+    time_t now = alarm_wall_time_us() / 1000000;
 
-    gptimer_set_alarm_action(alarm_timer, &alarm_config);
-    gptimer_start(alarm_timer);
+    xSemaphoreTake(alarm_timer_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < ringing.count; i++)
+    {
+        alarm_history_append(ringing.ids[i], ringing.fire, ring_started, now, ring_stop_reason);
+    }
+    xSemaphoreGive(alarm_timer_mutex);
 }
 
-void set_next_alarm()
+/* Stops the ring and schedules the alarms of it which allow a nap once more. Works on the
+ * in-memory scheduler only, so the timer is re-armed without any SD card access.
+ */
+bool alarm_snooze()
 {
-    alarm_mode_args_t next_alarm;
-    object_id_list_t* object_p =  ObjectManager_list_first_elem();
-    esp_err_t ret;
+    if (alarm_timer_mutex == NULL || get_device_mode() != ALARM_RING_MODE)
+    {
+        return false;
+    }
 
     time_t now;
-    struct tm timeinfo;
-
     time(&now);
-    localtime_r(&now, &timeinfo);
-    disable_current_alarm();
 
-    if ( object_p == NULL )
+    xSemaphoreTake(alarm_timer_mutex, portMAX_DELAY);
+
+    uint8_t snoozed = 0;
+    for (uint8_t i = 0; i < ringing.count; i++)
     {
-        ESP_LOGI(TAG, "No alarm created");
-        return;
+        if (alarm_scheduler_snooze(ringing.ids[i], now)) snoozed++;
     }
 
-    while ( object_p )
+    if (snoozed)
     {
-        ret = get_alarm_from_file(object_p->id, &next_alarm);
-
-        if (!ret && next_alarm.enable)
-        {
-            struct tm tm;
-            tm.tm_hour 	= next_alarm.hour;
-            tm.tm_min 	= next_alarm.minute;
-            tm.tm_sec 	= 0;
-            tm.tm_isdst = -1;
+        esp_timer_stop(ring_deadline_timer);
+        ring_stopped(ALARM_STOP_SNOOZE);
+        set_next_alarm_locked(now > fired_until ? now : fired_until + 1);
+    }
 
-            time_t t;
-            bool should_check = false;
+    xSemaphoreGive(alarm_timer_mutex);
 
-            switch (next_alarm.mode)
-            {
-                case ALARM_SINGLE_MODE:
-                {
-                    tm.tm_year 	= next_alarm.args.single_alarm_args.year + 100;
-                    tm.tm_mon 	= next_alarm.args.single_alarm_args.month - 1;
-                    tm.tm_mday 	= next_alarm.args.single_alarm_args.day;
-                    t = mktime(&tm);
-
-                    if (t < now)
-                    {
-                        break;
-                    }
-
-                    should_check = true;
-
-                    // #ifdef ALARM_LOG
-                    // ESP_LOGI(TAG, "Next single time: %02d:%02d:%02d, %02d.%02d.%04d", tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900);
-                    // ESP_LOGI(TAG, "Now timestamp: %" PRIu64 " alarm timetamp: %" PRIu64, (uint64_t)now, (uint64_t)t);
-                    // ESP_LOGI(TAG, "Diff time: %f", difftime(t, now));
-                    // #endif
-
-                    break;
-                }
-                        
-                case ALARM_WEEKLY_MODE:
-                {
-                    tm.tm_year 	= timeinfo.tm_year;
-                    tm.tm_mon 	= timeinfo.tm_mon;
-                    tm.tm_mday 	= timeinfo.tm_mday;
-                    t = mktime(&tm);
-
-                    uint8_t day = timeinfo.tm_wday;
-                    if (day == 0) day = 6;
-                    else day--;
-
-                    if ( (next_alarm.args.days & ( 1<<day )) && ( next_alarm.hour * 60 + next_alarm.minute > timeinfo.tm_hour * 60 + timeinfo.tm_min ) )
-                    {   //same day as current one and later hour
-                        should_check = true;
-                    }
-                    else
-                    {
-                        uint8_t days_remaining = 1;
-                        bool found = false;
-                        for ( uint8_t i = day + 1; i < 7; i++, days_remaining++ )
-                        {
-                            if ( next_alarm.args.days & ( 1<<i ) )
-                            {
-                                found = true;
-                                break;
-                            }
-                        }
-
-                        if ( found == false )
-                        {
-                            for ( uint8_t i = 0; i <= day; i++, days_remaining++ )
-                            {
-                                if ( next_alarm.args.days & ( 1<<i ) )
-                                {
-                                    found = true;
-                                    break;
-                                }
-                            }
-                        }
-
-                        if ( found )
-                        {
-                            t = t + DAYS_TO_SEC(days_remaining);
-                            should_check = true;
-                        }
-                    }
-
-                    // #ifdef ALARM_LOG
-                    // if (should_check)
-                    // {
-                    //     struct tm weekly_time_info;
-                    //     localtime_r(&t, &weekly_time_info);
-                    //     ESP_LOGI(TAG, "Next weekly time: %02d:%02d:%02d, %02d.%02d.%04d", weekly_time_info.tm_hour, weekly_time_info.tm_min, weekly_time_info.tm_sec, weekly_time_info.tm_mday, weekly_time_info.tm_mon + 1, weekly_time_info.tm_year + 1900);
-                    //     ESP_LOGI(TAG, "Now timestamp: %" PRIu64 " alarm timetamp: %" PRIu64, (uint64_t)now, (uint64_t)t);
-                    //     ESP_LOGI(TAG, "Diff time: %f", difftime(t, now));
-                    // }
-                    // #endif
-
-                    break;
-                }
-                        
-                case ALARM_MONTHLY_MODE:
-                {
-                    tm.tm_year 	= timeinfo.tm_year;
-                    tm.tm_mon 	= timeinfo.tm_mon;
-                    tm.tm_mday 	= next_alarm.args.day;
-                    t = mktime(&tm);
-
-                    if ( t < now )
-                    {
-                        t = t + DAYS_TO_SEC(get_days_to_next_monthly(tm.tm_year, tm.tm_mon));
-                    }
-                    should_check = true;
-
-                    // #ifdef ALARM_LOG
-                    // struct tm monthly_time_info;
-                    // localtime_r(&t, &monthly_time_info);
-                    // ESP_LOGI(TAG, "Next monthly time: %02d:%02d:%02d, %02d.%02d.%04d", monthly_time_info.tm_hour, monthly_time_info.tm_min, monthly_time_info.tm_sec, monthly_time_info.tm_mday, monthly_time_info.tm_mon + 1, monthly_time_info.tm_year + 1900);
-                    // ESP_LOGI(TAG, "Now timestamp: %" PRIu64 " alarm timetamp: %" PRIu64, (uint64_t)now, (uint64_t)t);
-                    // ESP_LOGI(TAG, "Diff time: %f", difftime(t, now));
-                    // #endif
-
-                    break;
-                }
-                        
-                case ALARM_YEARLY_MODE:
-                {
-                    tm.tm_year 	= timeinfo.tm_year;
-                    tm.tm_mon 	= next_alarm.args.yearly_alarm_args.month - 1;
-                    tm.tm_mday 	= next_alarm.args.yearly_alarm_args.day;
-                    t = mktime(&tm);
-
-                    if ( t < now )
-                    {
-                        t = t + DAYS_TO_SEC(get_days_to_next_yearly(tm.tm_year));
-                    }
-                    should_check = true;
-
-                    // #ifdef ALARM_LOG
-                    // struct tm yearly_time_info;
-                    // localtime_r(&t, &yearly_time_info);
-                    // ESP_LOGI(TAG, "Next yearly time: %02d:%02d:%02d, %02d.%02d.%04d", yearly_time_info.tm_hour, yearly_time_info.tm_min, yearly_time_info.tm_sec, yearly_time_info.tm_mday, yearly_time_info.tm_mon + 1, yearly_time_info.tm_year + 1900);
-                    // ESP_LOGI(TAG, "Now timestamp: %" PRIu64 " alarm timetamp: %" PRIu64, (uint64_t)now, (uint64_t)t);
-                    // ESP_LOGI(TAG, "Diff time: %f", difftime(t, now));
-                    // #endif
-
-                    break;
-                }
-            }
+    ESP_LOGI(TAG, "Snoozed %u of %u alarms", snoozed, ringing.count);
 
-            if ( should_check )
-            {
-                if ( next_alarm_enabled )
-                {
-                    time_t new_next_alarm_interval = t - now;
-                    if (new_next_alarm_interval < next_alarm_interval)
-                    {
-                        next_alarm_interval = new_next_alarm_interval;
-                        next_alarm_id = object_p->id;
-                    }
-                }
-                else
-                {
-                    next_alarm_enabled = true;
-                    next_alarm_interval = t - now;
-                    next_alarm_id = object_p->id;
-                }
-            }
-        }
+    return snoozed > 0;
+}
 
-        object_p = object_p->next;
-    }
+/* Next occurrence of the alarm at or after now, false when it never fires again */
+bool get_alarm_next_fire(const alarm_mode_args_t *next_alarm, const alarm_occurrence_calendar_t *calendar, time_t now, const struct tm *timeinfo, time_t *fire)
+{
+    alarm_occurrence_rule_t rule = {
+        .mode = next_alarm->mode,
+        .hour = next_alarm->hour,
+        .minute = next_alarm->minute,
+        .skip = calendar
+    };
 
-    if (next_alarm_enabled)
+    switch (next_alarm->mode)
     {
-        ESP_LOGI(TAG, "Next alarm ID: %" PRIx64, next_alarm_id);
-        ESP_LOGI(TAG, "Next alarm interval: %" PRIu64 " sec", (uint64_t)next_alarm_interval);
+        case ALARM_SINGLE_MODE:
+            rule.year = next_alarm->args.single_alarm_args.year + 2000;
+            rule.month = next_alarm->args.single_alarm_args.month;
+            rule.day = next_alarm->args.single_alarm_args.day;
+            break;
 
-        gptimer_stop(alarm_timer);
-        gptimer_set_raw_count(alarm_timer, 0);
+        case ALARM_WEEKLY_MODE:
+            rule.days = next_alarm->args.days;
+            break;
 
-        gptimer_alarm_config_t alarm_config = {
-            .alarm_count = (uint64_t)(next_alarm_interval * 1000000),
-            .reload_count = 0,
-            .flags.auto_reload_on_alarm = false
-        };
+        case ALARM_MONTHLY_MODE:
+            rule.day = next_alarm->args.day;
+            break;
 
-        gptimer_set_alarm_action(alarm_timer, &alarm_config);
-        gptimer_start(alarm_timer);
+        case ALARM_YEARLY_MODE:
+            rule.month = next_alarm->args.yearly_alarm_args.month;
+            rule.day = next_alarm->args.yearly_alarm_args.day;
+            break;
     }
-    else
+
+    return alarm_occurrence_next(&rule, now, timeinfo, fire);
+}
+
+/* Wall clock was set from the RTC, SNTP or by hand. Every fire time is recomputed before the
+ * timer is re-armed, the scheduler's own jump check only catches jumps between two lookups.
+ */
+void alarm_time_changed(void)
+{
+    if (alarm_timer_mutex == NULL)
     {
-        disable_current_alarm();
-        ESP_LOGI(TAG, "No enabled alarm to be set");
+        return;
     }
-}
\ No newline at end of file
+
+    alarm_scheduler_time_changed();
+    set_next_alarm();
+}
+
+void set_next_alarm()
+{
+    // RTC task starts before alarm_init, the object list isn't loaded yet either
+    if (alarm_timer_mutex == NULL)
+    {
+        return;
+    }
+
+    time_t now;
+    time(&now);
+
+    xSemaphoreTake(alarm_timer_mutex, portMAX_DELAY);
+    // Alarms of the last ring stay due until its window passes
+    set_next_alarm_locked(now > fired_until ? now : fired_until + 1);
+    xSemaphoreGive(alarm_timer_mutex);
+}
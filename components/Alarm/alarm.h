@@ -8,6 +8,8 @@
 #include  <stdbool.h>
 
 #include "esp_err.h"
+#include "alarm_occurrence.h"
+#include <time.h>
 
 typedef struct
 {
@@ -39,17 +41,62 @@ typedef struct
     } args;
 
     uint8_t volume;
+    uint64_t ringtone_id;   // 0 - default ringtone
+    uint8_t group;          // 0 - not in any group
+    uint8_t nap;            // snooze length in minutes, 0 - snooze disabled
+    uint8_t nap_repeats;    // snoozes allowed in a row, ALARM_NAP_REPEATS_ALWAYS - no limit
+    uint8_t ring_duration;  // minutes, 0 - ALARM_RING_TIMEOUT_US
+    uint64_t calendar_id;   // exception calendar, 0 - no days skipped
+    uint8_t rise;           // ALARM_RISE_*, volume rises from silence at the start of the ring
+    uint8_t rise_time;      // seconds the rise takes
 }alarm_mode_args_t;
 
+#define ALARM_RING_IDS_MAX          8
+#define ALARM_RING_QUEUE_LEN        4
+#define ALARM_COALESCE_WINDOW_SEC   60      // alarms are set to the minute, so this joins alarms of the same minute
+
+typedef struct
+{
+    uint64_t ids[ALARM_RING_IDS_MAX];
+    uint8_t count;
+    uint8_t volume;         // loudest of the alarms
+    uint64_t ringtone_id;   // first alarm with a ringtone, 0 - default ringtone
+    uint8_t duration;       // longest ring duration of the alarms, in minutes
+    uint8_t rise;           // rise of the alarm with the longest one
+    uint8_t rise_time;
+    time_t fire;
+    uint32_t generation;    // of the armed alarm which fired
+}alarm_ring_event_t;
+
+typedef struct
+{
+    time_t fire;
+    uint64_t ringtone_id;
+    uint32_t generation;    // changes when the armed alarm, its fire time or ringtone does
+}alarm_next_ring_t;
+
+typedef void (*alarm_ring_stop_cb_t)(void);     // runs in the task or timer which stopped the ring, must not block
+
 esp_err_t alarm_init();
 uint8_t set_alarm_values(uint8_t *payload, uint16_t payload_len);
+uint8_t parse_alarm_values(uint8_t *payload, uint16_t payload_len, alarm_mode_args_t *alarm_p);
+uint16_t pack_alarm_values(const alarm_mode_args_t *alarm_p, uint8_t *payload);
 alarm_mode_args_t get_alarm_values();
 alarm_mode_args_t* get_alarm_pointer();
 void set_next_alarm();
+void alarm_time_changed(void);
+bool get_alarm_next_fire(const alarm_mode_args_t *next_alarm, const alarm_occurrence_calendar_t *calendar, time_t now, const struct tm *timeinfo, time_t *fire);
 void disable_current_alarm();
 uint64_t get_current_active_alarm_id();
 bool get_alarm_state();
-void set_timer_for_playing_alarm();
+void set_timer_for_playing_alarm(uint8_t duration);
+bool alarm_ring_receive(alarm_ring_event_t *event, uint32_t wait_ms);
+bool alarm_get_next_ring(alarm_next_ring_t *next);
+bool alarm_snooze();
+void alarm_ring_stop(uint8_t reason);
+void alarm_ring_set_stop_cb(alarm_ring_stop_cb_t cb);
+void alarm_ring_end(void);
+uint16_t alarm_payload_fields_len(const uint8_t *payload);
 
 #define ALARM_SINGLE_MODE   0
 #define ALARM_WEEKLY_MODE   1
@@ -61,6 +108,22 @@ void set_timer_for_playing_alarm();
 #define ALARM_MODE_SIZE         1
 #define ALARM_DESC_LEN_SIZE     1
 #define ALARM_VOLUME_SIZE  1
+#define ALARM_RINGTONE_ID_SIZE  6
+#define ALARM_GROUP_SIZE        1
+#define ALARM_SNOOZE_SIZE       3       // nap, nap repeats, ring duration
+#define ALARM_CALENDAR_ID_SIZE  6
+#define ALARM_RISE_SIZE         2       // rise, rise time
+
+#define ALARM_GROUP_NONE        0
+
+#define ALARM_NAP_MAX               60
+#define ALARM_NAP_REPEATS_ALWAYS    0xFF
+#define ALARM_RING_DURATION_MAX     60
+
+#define ALARM_RISE_NONE             0
+#define ALARM_RISE_LINEAR           1
+#define ALARM_RISE_EXPONENTIAL      2   // constant dB per second, closer to how loudness is heard
+#define ALARM_SNOOZE_ID_FLAG        (1ull << 63)    // transient scheduler entry of a snoozed alarm
 
 #define ALARM_MODES_NUM         4
 
@@ -77,12 +140,17 @@ void set_timer_for_playing_alarm();
 #define ALARM_MODE_YEARLY_PAYLOAD_SIZE_MAX         48
 
 #define ALARM_MODE_PAYLOAD_SIZE_MIN                ALARM_MODE_WEEKLY_PAYLOAD_SIZE_MIN
-#define ALARM_MODE_PAYLOAD_SIZE_MAX                ALARM_MODE_SINGLE_PAYLOAD_SIZE_MAX
+#define ALARM_MODE_PAYLOAD_SIZE_MAX                (ALARM_MODE_SINGLE_PAYLOAD_SIZE_MAX + ALARM_RINGTONE_ID_SIZE + ALARM_GROUP_SIZE + ALARM_SNOOZE_SIZE + ALARM_CALENDAR_ID_SIZE + ALARM_RISE_SIZE)
 
 #define ALARM_DESC_LEN_MAX                         40
 #define ALARM_VOLUME_MAX                      100
 
 
+#define ALARM_SLICE_MAX_US          (3600ll * 1000000ll)    // longest timer run before the target is checked against system time
+#define ALARM_SLICE_GUARD_US        (2ll * 1000000ll)       // long slices end this much before the target
+#define ALARM_FIRE_TOLERANCE_US     1000
+#define ALARM_RING_TIMEOUT_US       (300ll * 1000000ll)
+
 #define ONE_WEEK_IN_SEC     604800
 #define DAYS_TO_SEC(x)     ( (x) * 24ll * 60ll * 60ll )
 
@@ -0,0 +1,251 @@
+#include "alarm_history.h"
+#include "alarm.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char* TAG = "ALARM HISTORY";
+
+#define ALARM_HISTORY_SECTORS           (ALARM_HISTORY_SIZE / ALARM_HISTORY_SECTOR_SIZE)
+#define ALARM_HISTORY_SECTOR_RECORDS    (ALARM_HISTORY_SECTOR_SIZE / ALARM_HISTORY_RECORD_SIZE)
+
+_Static_assert(sizeof(alarm_history_record_t) == ALARM_HISTORY_RECORD_SIZE, "history record size");
+_Static_assert(ALARM_HISTORY_SECTORS <= 32, "dirty sector mask");
+
+static alarm_history_record_t history[ALARM_HISTORY_RECORDS];
+static uint16_t history_head = 0;       // slot of the next record
+static uint8_t history_lap = 1;
+static bool history_full = false;
+static uint32_t history_dirty = 0;      // bit n - sector n changed since the last write
+static SemaphoreHandle_t history_mutex = NULL;
+static TaskHandle_t history_task_hdl = NULL;
+
+static uint16_t alarm_history_saturate(time_t seconds)
+{
+    if (seconds < 0)
+    {
+        return 0;
+    }
+
+    return seconds > UINT16_MAX ? UINT16_MAX : seconds;
+}
+
+/* Head is the first slot whose lap differs from the lap of slot 0, all slots before it were
+ * written in the current lap. With no such slot the ring is empty or a lap just completed.
+ */
+static void alarm_history_find_head(void)
+{
+    uint8_t lap = history[0].lap;
+    uint16_t head = 1;
+
+    while (head < ALARM_HISTORY_RECORDS && history[head].lap == lap)
+    {
+        head++;
+    }
+
+    if (lap == 0)
+    {
+        history_head = 0;
+        history_lap = 1;
+        history_full = false;
+    }
+    else if (head == ALARM_HISTORY_RECORDS)
+    {
+        history_head = 0;
+        history_lap = (lap == UINT8_MAX) ? 1 : lap + 1;
+        history_full = true;
+    }
+    else
+    {
+        history_head = head;
+        history_lap = lap;
+        history_full = (history[head].lap != 0);
+    }
+}
+
+static void alarm_history_write_sectors(uint32_t dirty, const uint8_t *data)
+{
+    int fd = open(ALARM_HISTORY_PATH, O_WRONLY);
+    if (fd < 0)
+    {
+        ESP_LOGE(TAG, "Failed to open history file");
+        return;
+    }
+
+    for (uint8_t sector = 0; sector < ALARM_HISTORY_SECTORS; sector++)
+    {
+        if ((dirty & (1u << sector)) == 0)
+        {
+            continue;
+        }
+
+        off_t pos = sector * ALARM_HISTORY_SECTOR_SIZE;
+        if (lseek(fd, pos, SEEK_SET) != pos ||
+            write(fd, &data[pos], ALARM_HISTORY_SECTOR_SIZE) != ALARM_HISTORY_SECTOR_SIZE)
+        {
+            ESP_LOGE(TAG, "Failed to write history sector %u", sector);
+        }
+    }
+
+    fsync(fd);
+    close(fd);
+}
+
+/* Waits for the batch window after the first append, then writes what changed in it.
+ * Runs at the lowest priority, so the card is never written from the ringing path.
+ */
+static void alarm_history_task_main(void *arg)
+{
+    static uint8_t copy[ALARM_HISTORY_SIZE];
+
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(ALARM_HISTORY_BATCH_MS));
+        ulTaskNotifyTake(pdTRUE, 0);
+
+        xSemaphoreTake(history_mutex, portMAX_DELAY);
+        uint32_t dirty = history_dirty;
+        history_dirty = 0;
+        for (uint8_t sector = 0; sector < ALARM_HISTORY_SECTORS; sector++)
+        {
+            if (dirty & (1u << sector))
+            {
+                memcpy(&copy[sector * ALARM_HISTORY_SECTOR_SIZE], (uint8_t*)history + sector * ALARM_HISTORY_SECTOR_SIZE, ALARM_HISTORY_SECTOR_SIZE);
+            }
+        }
+        xSemaphoreGive(history_mutex);
+
+        if (dirty)
+        {
+            alarm_history_write_sectors(dirty, copy);
+        }
+    }
+}
+
+esp_err_t alarm_history_init(void)
+{
+    memset(history, 0, sizeof(history));
+
+    struct stat st;
+    if (stat(ALARM_HISTORY_PATH, &st) != 0 || st.st_size != ALARM_HISTORY_SIZE)
+    {
+        // Whole ring is allocated up front, later writes never change the file size
+        ESP_LOGI(TAG, "Creating history file");
+        FILE *f = fopen(ALARM_HISTORY_PATH, "w");
+        if (f == NULL || fwrite(history, 1, sizeof(history), f) != sizeof(history))
+        {
+            ESP_LOGE(TAG, "Failed to create history file");
+            if (f) fclose(f);
+            return ESP_FAIL;
+        }
+        fclose(f);
+    }
+    else
+    {
+        FILE *f = fopen(ALARM_HISTORY_PATH, "r");
+        if (f == NULL || fread(history, 1, sizeof(history), f) != sizeof(history))
+        {
+            ESP_LOGE(TAG, "Failed to read history file");
+            memset(history, 0, sizeof(history));
+        }
+        if (f) fclose(f);
+    }
+
+    alarm_history_find_head();
+    ESP_LOGI(TAG, "History: %" PRIu32 " records, lap %u", alarm_history_size() / ALARM_HISTORY_RECORD_SIZE, history_lap);
+
+    history_mutex = xSemaphoreCreateMutex();
+    BaseType_t res = xTaskCreate(alarm_history_task_main, "ALARM HISTORY", 2560, NULL, 1, &history_task_hdl);
+    if (res != pdPASS)
+    {
+        ESP_LOGE(TAG, "Creating history task failed");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+void alarm_history_append(uint64_t id, time_t scheduled, time_t started, time_t stopped, uint8_t reason)
+{
+    if (history_mutex == NULL)
+    {
+        return;
+    }
+
+    id &= ~ALARM_SNOOZE_ID_FLAG;
+
+    alarm_history_record_t record = {
+        .scheduled = (uint32_t)scheduled,
+        .delay = alarm_history_saturate(started - scheduled),
+        .duration = alarm_history_saturate(stopped - started),
+        .reason = reason,
+    };
+    memcpy(record.id, &id, sizeof(record.id));
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+
+    record.lap = history_lap;
+    history[history_head] = record;
+    history_dirty |= 1u << (history_head / ALARM_HISTORY_SECTOR_RECORDS);
+
+    if (++history_head == ALARM_HISTORY_RECORDS)
+    {
+        history_head = 0;
+        history_full = true;
+        history_lap = (history_lap == UINT8_MAX) ? 1 : history_lap + 1;
+    }
+
+    xSemaphoreGive(history_mutex);
+
+    xTaskNotifyGive(history_task_hdl);
+}
+
+uint32_t alarm_history_size(void)
+{
+    return (history_full ? ALARM_HISTORY_RECORDS : history_head) * ALARM_HISTORY_RECORD_SIZE;
+}
+
+/* Records oldest first, the range is taken from the RAM mirror */
+int32_t alarm_history_read(uint32_t offset, uint8_t *buf, uint32_t len)
+{
+    if (history_mutex == NULL)
+    {
+        return -1;
+    }
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+
+    uint32_t size = alarm_history_size();
+    uint32_t start = history_full ? history_head * ALARM_HISTORY_RECORD_SIZE : 0;
+    uint32_t copied = 0;
+
+    if (offset < size)
+    {
+        len = (len < size - offset) ? len : size - offset;
+        while (copied < len)
+        {
+            uint32_t pos = (start + offset + copied) % ALARM_HISTORY_SIZE;
+            uint32_t chunk = ALARM_HISTORY_SIZE - pos;
+            chunk = (chunk < len - copied) ? chunk : len - copied;
+
+            memcpy(&buf[copied], (uint8_t*)history + pos, chunk);
+            copied += chunk;
+        }
+    }
+
+    xSemaphoreGive(history_mutex);
+
+    return copied;
+}
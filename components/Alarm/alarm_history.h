@@ -0,0 +1,43 @@
+#ifndef __ALARM_HISTORY_H__
+#define __ALARM_HISTORY_H__
+
+#include "project_defs.h"
+#include "esp_err.h"
+#include <stdint.h>
+#include <time.h>
+
+/* Fixed size ring of ring records on the SD card, mirrored in RAM. Appends change only the
+ * mirror, a low priority task writes the changed sectors in batches, one sector write each.
+ * The lap byte of a record tells the newest records from the ones of the previous lap, so the
+ * head is found again after a restart without a separate index.
+ */
+#define ALARM_HISTORY_PATH          MOUNT_POINT "/history.bin"
+#define ALARM_HISTORY_RECORDS       256
+#define ALARM_HISTORY_RECORD_SIZE   16
+#define ALARM_HISTORY_SECTOR_SIZE   512
+#define ALARM_HISTORY_SIZE          (ALARM_HISTORY_RECORDS * ALARM_HISTORY_RECORD_SIZE)
+#define ALARM_HISTORY_BATCH_MS      5000    // appends within this time go out in one write per sector
+
+#define ALARM_STOP_NONE             0       // ring ended without a stop request
+#define ALARM_STOP_BUTTON           1
+#define ALARM_STOP_SNOOZE           2
+#define ALARM_STOP_TIMEOUT          3
+#define ALARM_STOP_DROPPED          4       // ring queue was full, the alarm did not ring
+#define ALARM_STOP_FAILED           5       // nothing playable, not even the built-in ringtone
+
+typedef struct __attribute__((packed))
+{
+    uint8_t id[6];
+    uint32_t scheduled;     // epoch seconds
+    uint16_t delay;         // seconds from the scheduled time to the start of the ring, saturated
+    uint16_t duration;      // seconds the ring lasted, saturated
+    uint8_t reason;         // ALARM_STOP_*
+    uint8_t lap;            // 1-255, 0 - empty slot
+} alarm_history_record_t;
+
+esp_err_t alarm_history_init(void);
+void alarm_history_append(uint64_t id, time_t scheduled, time_t started, time_t stopped, uint8_t reason);
+uint32_t alarm_history_size(void);
+int32_t alarm_history_read(uint32_t offset, uint8_t *buf, uint32_t len);
+
+#endif
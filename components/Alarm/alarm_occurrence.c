@@ -0,0 +1,273 @@
+#include "alarm_occurrence.h"
+#include "pp_timebase.h"
+
+#include <string.h>
+
+static bool alarm_occurrence_leap(int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
+}
+
+uint8_t alarm_occurrence_days_in_month(int year, uint8_t month)
+{
+    static const uint8_t days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    if (month < 1 || month > 12)
+    {
+        return 0;
+    }
+
+    if (month == 2 && alarm_occurrence_leap(year))
+    {
+        return 29;
+    }
+
+    return days[month - 1];
+}
+
+/* Wall time of the rule on the given local date, mday may run past the end of the month */
+static time_t alarm_occurrence_at(const alarm_occurrence_rule_t *rule, int year, int month, int mday)
+{
+    struct tm tm = {0};
+    tm.tm_year  = year - 1900;
+    tm.tm_mon   = month - 1;
+    tm.tm_mday  = mday;
+    tm.tm_hour  = rule->hour;
+    tm.tm_min   = rule->minute;
+
+    return pp_timebase_mktime(&tm);
+}
+
+static time_t alarm_occurrence_at_clamped(const alarm_occurrence_rule_t *rule, int year, int month)
+{
+    uint8_t last = alarm_occurrence_days_in_month(year, month);
+    return alarm_occurrence_at(rule, year, month, rule->day < last ? rule->day : last);
+}
+
+static const uint32_t* alarm_occurrence_calendar_year(const alarm_occurrence_calendar_t *calendar, int year)
+{
+    for (uint8_t i = 0; i < calendar->years; i++)
+    {
+        if (calendar->year[i].year == year)
+        {
+            return calendar->year[i].skip;
+        }
+    }
+
+    return NULL;
+}
+
+static uint16_t alarm_occurrence_yday(int year, uint8_t month, uint8_t day)
+{
+    return pp_timebase_days_from_civil(year, month, day) - pp_timebase_days_from_civil(year, 1, 1);
+}
+
+static void alarm_occurrence_set_day(uint32_t *days, uint16_t yday)
+{
+    days[yday / 32] |= 1u << (yday % 32);
+}
+
+/* Days of the year the rule falls on, in the layout of the calendar bitmap */
+static void alarm_occurrence_year_days(const alarm_occurrence_rule_t *rule, int year, uint32_t *days)
+{
+    memset(days, 0, OCCURRENCE_CALENDAR_WORDS * sizeof(uint32_t));
+
+    switch (rule->mode)
+    {
+        case OCCURRENCE_SINGLE:
+            if (year == rule->year)
+            {
+                alarm_occurrence_set_day(days, alarm_occurrence_yday(year, rule->month, rule->day));
+            }
+            break;
+
+        case OCCURRENCE_WEEKLY:
+        {
+            // 1 January 1970 was a Thursday, weekday 3 counted from Monday
+            int32_t jan1 = pp_timebase_days_from_civil(year, 1, 1);
+            uint8_t first = ((jan1 % 7) + 7 + 3) % 7;
+            uint16_t mask = rule->days & OCCURRENCE_WEEK_MASK;
+            uint64_t week = ((mask | (mask << 7)) >> first) & OCCURRENCE_WEEK_MASK;
+
+            // Nine copies of the week starting on 1 January, each word is a window into it at its phase
+            uint64_t weeks = week * 0x0102040810204081ull;
+            for (uint8_t w = 0; w < OCCURRENCE_CALENDAR_WORDS; w++)
+            {
+                days[w] = (uint32_t)(weeks >> ((w * 32) % 7));
+            }
+
+            uint16_t year_len = alarm_occurrence_leap(year) ? 366 : 365;
+            days[OCCURRENCE_CALENDAR_WORDS - 1] &= (1u << (year_len - (OCCURRENCE_CALENDAR_WORDS - 1) * 32)) - 1;
+            break;
+        }
+
+        case OCCURRENCE_MONTHLY:
+            for (uint8_t month = 1; month <= 12; month++)
+            {
+                uint8_t last = alarm_occurrence_days_in_month(year, month);
+                alarm_occurrence_set_day(days, alarm_occurrence_yday(year, month, rule->day < last ? rule->day : last));
+            }
+            break;
+
+        case OCCURRENCE_YEARLY:
+        {
+            uint8_t last = alarm_occurrence_days_in_month(year, rule->month);
+            alarm_occurrence_set_day(days, alarm_occurrence_yday(year, rule->month, rule->day < last ? rule->day : last));
+            break;
+        }
+    }
+}
+
+/* First day of the rule from the given day of the year on which the calendar does not exclude.
+ * Days are taken a word at a time, the rule's days masked by the excluded ones and the lowest
+ * remaining bit found with a count of trailing zeros. The year after the last one listed has
+ * no exceptions, the search ends there.
+ */
+static bool alarm_occurrence_skip(const alarm_occurrence_rule_t *rule, int year, uint16_t from, time_t *fire)
+{
+    int last = year;
+    for (uint8_t i = 0; i < rule->skip->years; i++)
+    {
+        if (rule->skip->year[i].year > last)
+        {
+            last = rule->skip->year[i].year;
+        }
+    }
+
+    uint32_t days[OCCURRENCE_CALENDAR_WORDS];
+
+    for (; year <= last + 1; year++, from = 0)
+    {
+        alarm_occurrence_year_days(rule, year, days);
+        const uint32_t *skip = alarm_occurrence_calendar_year(rule->skip, year);
+
+        for (uint8_t w = from / 32; w < OCCURRENCE_CALENDAR_WORDS; w++)
+        {
+            uint32_t word = days[w];
+            if (skip)
+            {
+                word &= ~skip[w];
+            }
+            if (w == from / 32)
+            {
+                word &= ~0u << (from % 32);
+            }
+
+            if (word)
+            {
+                *fire = alarm_occurrence_at(rule, year, 1, w * 32 + __builtin_ctz(word) + 1);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/* Every mode needs at most two wall time conversions: the candidate in the current period and,
+ * when that one already passed, the candidate in the following one.
+ */
+bool alarm_occurrence_next(const alarm_occurrence_rule_t *rule, time_t now, const struct tm *local_now, time_t *fire)
+{
+    int year = local_now->tm_year + 1900;
+    int month = local_now->tm_mon + 1;
+    time_t t;
+
+    if (rule->hour > 23 || rule->minute > 59)
+    {
+        return false;
+    }
+
+    switch (rule->mode)
+    {
+        case OCCURRENCE_SINGLE:
+        {
+            if (rule->day == 0 || rule->day > alarm_occurrence_days_in_month(rule->year, rule->month))
+            {
+                return false;
+            }
+
+            t = alarm_occurrence_at(rule, rule->year, rule->month, rule->day);
+            if (t < now)
+            {
+                return false;
+            }
+            break;
+        }
+
+        case OCCURRENCE_WEEKLY:
+        {
+            uint8_t mask = rule->days & OCCURRENCE_WEEK_MASK;
+            if (mask == 0)
+            {
+                return false;
+            }
+
+            // Two weeks of days shifted so bit 0 is today, the lowest set bits are the next two candidates
+            uint8_t today = (local_now->tm_wday + 6) % 7;
+            uint16_t ahead = ((uint16_t)mask | ((uint16_t)mask << 7)) >> today;
+
+            t = alarm_occurrence_at(rule, year, month, local_now->tm_mday + __builtin_ctz(ahead));
+            if (t < now)
+            {
+                ahead &= ahead - 1;
+                t = alarm_occurrence_at(rule, year, month, local_now->tm_mday + __builtin_ctz(ahead));
+            }
+            break;
+        }
+
+        case OCCURRENCE_MONTHLY:
+        {
+            if (rule->day == 0 || rule->day > 31)
+            {
+                return false;
+            }
+
+            t = alarm_occurrence_at_clamped(rule, year, month);
+            if (t < now)
+            {
+                if (++month > 12)
+                {
+                    month = 1;
+                    year++;
+                }
+                t = alarm_occurrence_at_clamped(rule, year, month);
+            }
+            break;
+        }
+
+        case OCCURRENCE_YEARLY:
+        {
+            if (rule->day == 0 || rule->day > alarm_occurrence_days_in_month(2000, rule->month))
+            {
+                return false;
+            }
+
+            t = alarm_occurrence_at_clamped(rule, year, rule->month);
+            if (t < now)
+            {
+                t = alarm_occurrence_at_clamped(rule, year + 1, rule->month);
+            }
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    if (rule->skip)
+    {
+        // Days after the candidate's day all fire later than it, so the search needs no time check
+        struct tm local;
+        pp_timebase_localtime(t, &local);
+        const uint32_t *skip = alarm_occurrence_calendar_year(rule->skip, local.tm_year + 1900);
+
+        if (skip && (skip[local.tm_yday / 32] & (1u << (local.tm_yday % 32))))
+        {
+            return alarm_occurrence_skip(rule, local.tm_year + 1900, local.tm_yday + 1, fire);
+        }
+    }
+
+    *fire = t;
+    return true;
+}
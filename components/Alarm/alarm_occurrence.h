@@ -0,0 +1,50 @@
+#ifndef __ALARM_OCCURRENCE_H__
+#define __ALARM_OCCURRENCE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+/* Next occurrence of an alarm rule in local time. Plain C on top of pp_timebase, no ESP-IDF dependencies.
+ * Modes use the ALARM_*_MODE values. Days missing in a month (31st, 29th of February) fall on the
+ * last day of that month. A wall time skipped by a DST change is read as standard time, a repeated
+ * one fires once, at its first instant. An occurrence on a day excluded by the rule's calendar moves
+ * on to the next one which is not.
+ */
+#define OCCURRENCE_SINGLE       0
+#define OCCURRENCE_WEEKLY       1
+#define OCCURRENCE_MONTHLY      2
+#define OCCURRENCE_YEARLY       3
+
+#define OCCURRENCE_WEEK_MASK    0x7F    // bit 0 - Monday ... bit 6 - Sunday
+
+#define OCCURRENCE_CALENDAR_YEARS_MAX   8
+#define OCCURRENCE_CALENDAR_WORDS       12      // 366 day bits, bit n - day n of the year counted from 0
+
+/* Days on which the rules using the calendar do not fire. Years not listed have no exceptions. */
+typedef struct
+{
+    uint8_t years;
+    struct
+    {
+        uint16_t year;
+        uint32_t skip[OCCURRENCE_CALENDAR_WORDS];
+    } year[OCCURRENCE_CALENDAR_YEARS_MAX];
+} alarm_occurrence_calendar_t;
+
+typedef struct
+{
+    uint8_t mode;
+    uint8_t hour;
+    uint8_t minute;
+    uint16_t year;      // single, full year
+    uint8_t month;      // single, yearly: 1-12
+    uint8_t day;        // single, monthly, yearly: 1-31
+    uint8_t days;       // weekly
+    const alarm_occurrence_calendar_t *skip;    // NULL - no excluded days
+} alarm_occurrence_rule_t;
+
+uint8_t alarm_occurrence_days_in_month(int year, uint8_t month);
+bool alarm_occurrence_next(const alarm_occurrence_rule_t *rule, time_t now, const struct tm *local_now, time_t *fire);
+
+#endif
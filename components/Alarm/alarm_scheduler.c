@@ -0,0 +1,850 @@
+#include "alarm_scheduler.h"
+#include "ObjectManager.h"
+#include "ObjectManagerIdList.h"
+#include "pp_timebase.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+static const char* TAG = "ALARM_SCHEDULER";
+
+/* Alarm records are cached in a hash table keyed by object ID. Enabled alarms which fire again
+ * are also kept in a binary min-heap of table indices ordered by the next fire time, so the next
+ * alarm is the heap root and an edit only sifts one entry. Fire times are computed again for all
+ * alarms only when the wall clock jumps.
+ * A snoozed alarm gets a transient entry under its ID with ALARM_SNOOZE_ID_FLAG, fixed to one
+ * fire time, never written to the SD card and dropped once it fired.
+ * Exception calendars are shared by many alarms, all of them are decoded into memory when the
+ * scheduler is built and again whenever one changes, so no fire time needs the SD card.
+ * Every change of a fire time bumps the generation, the timeline of upcoming firings is kept
+ * until it does.
+ */
+typedef struct {
+    uint64_t id;            // 0 - free slot
+    alarm_mode_args_t alarm;
+    time_t fire;
+    int16_t heap_index;     // -1 - not scheduled
+    bool transient;
+    uint8_t snoozes;        // snoozes in a row of the alarm, counted on its own entry
+} alarm_entry_t;
+
+static alarm_entry_t *table = NULL;
+static uint16_t table_cap = 0;
+static uint16_t table_used = 0;
+
+static uint16_t *heap = NULL;
+static uint16_t heap_len = 0;
+
+static bool built = false;
+static uint32_t generation = 0;
+static time_t last_wall = 0;
+static int64_t last_mono = 0;
+
+static SemaphoreHandle_t scheduler_mutex = NULL;
+
+typedef struct {
+    uint64_t id;            // 0 - free slot
+    alarm_occurrence_calendar_t calendar;
+} alarm_calendar_entry_t;
+
+static alarm_calendar_entry_t *calendars = NULL;
+static uint16_t calendars_len = 0;
+static uint16_t calendars_cap = 0;
+
+typedef struct {
+    time_t fire;
+    uint16_t slot;
+} alarm_merge_t;
+
+static alarm_timeline_entry_t timeline[ALARM_TIMELINE_LEN];
+static uint8_t timeline_len = 0;
+static bool timeline_valid = false;
+static uint32_t timeline_generation = 0;
+
+static uint16_t alarm_scheduler_hash(uint64_t id)
+{
+    return (uint16_t)((id ^ (id >> 16)) & (table_cap - 1));
+}
+
+static int alarm_scheduler_find(uint64_t id)
+{
+    if (table_cap == 0)
+    {
+        return -1;
+    }
+
+    for (uint16_t i = alarm_scheduler_hash(id); table[i].id; i = (i + 1) & (table_cap - 1))
+    {
+        if (table[i].id == id)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void alarm_scheduler_heap_set(uint16_t pos, uint16_t slot)
+{
+    heap[pos] = slot;
+    table[slot].heap_index = pos;
+}
+
+static void alarm_scheduler_sift_up(uint16_t pos)
+{
+    uint16_t slot = heap[pos];
+
+    while (pos > 0)
+    {
+        uint16_t parent = (pos - 1) / 2;
+        if (table[heap[parent]].fire <= table[slot].fire)
+        {
+            break;
+        }
+        alarm_scheduler_heap_set(pos, heap[parent]);
+        pos = parent;
+    }
+
+    alarm_scheduler_heap_set(pos, slot);
+}
+
+static void alarm_scheduler_sift_down(uint16_t pos)
+{
+    uint16_t slot = heap[pos];
+
+    while (true)
+    {
+        uint16_t child = 2 * pos + 1;
+        if (child >= heap_len)
+        {
+            break;
+        }
+        if (child + 1 < heap_len && table[heap[child + 1]].fire < table[heap[child]].fire)
+        {
+            child++;
+        }
+        if (table[slot].fire <= table[heap[child]].fire)
+        {
+            break;
+        }
+        alarm_scheduler_heap_set(pos, heap[child]);
+        pos = child;
+    }
+
+    alarm_scheduler_heap_set(pos, slot);
+}
+
+static void alarm_scheduler_heap_remove(uint16_t slot)
+{
+    int16_t pos = table[slot].heap_index;
+    if (pos < 0)
+    {
+        return;
+    }
+
+    table[slot].heap_index = -1;
+    heap_len--;
+
+    if (pos < heap_len)
+    {
+        uint16_t moved = heap[heap_len];
+        alarm_scheduler_heap_set(pos, moved);
+        alarm_scheduler_sift_down(pos);
+        if (table[moved].heap_index == pos)
+        {
+            alarm_scheduler_sift_up(pos);
+        }
+    }
+}
+
+/* Decoded calendar of an alarm, a search in memory only. A missing calendar skips no days. */
+static const alarm_occurrence_calendar_t* alarm_scheduler_calendar(uint64_t id)
+{
+    if (id == 0)
+    {
+        return NULL;
+    }
+
+    for (uint16_t i = 0; i < calendars_len; i++)
+    {
+        if (calendars[i].id == id)
+        {
+            return &calendars[i].calendar;
+        }
+    }
+
+    return NULL;
+}
+
+static void alarm_scheduler_calendar_drop(uint64_t id)
+{
+    for (uint16_t i = 0; i < calendars_len; i++)
+    {
+        if (calendars[i].id == id)
+        {
+            calendars[i] = calendars[--calendars_len];
+            return;
+        }
+    }
+}
+
+/* Decodes the content of a calendar object into memory */
+static void alarm_scheduler_calendar_load(const object_t *object)
+{
+    if (calendars_len == calendars_cap)
+    {
+        uint16_t new_cap = calendars_cap ? calendars_cap * 2 : ALARM_SCHEDULER_CALENDARS_MIN;
+        alarm_calendar_entry_t *new_calendars = realloc(calendars, new_cap * sizeof(alarm_calendar_entry_t));
+        if (new_calendars == NULL)
+        {
+            ESP_LOGE(TAG, "No memory for %u calendars", new_cap);
+            return;
+        }
+        calendars = new_calendars;
+        calendars_cap = new_cap;
+    }
+
+    char path[CONTENT_PATH_LEN_MAX];
+    ObjectManager_content_path(path, object->id);
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot open calendar %" PRIx64, object->id);
+        return;
+    }
+
+    alarm_calendar_entry_t *entry = &calendars[calendars_len];
+    entry->calendar.years = 0;
+
+    uint8_t record[ALARM_CALENDAR_RECORD_SIZE];
+    for (uint32_t pos = 0; pos + ALARM_CALENDAR_RECORD_SIZE <= object->size && entry->calendar.years < OCCURRENCE_CALENDAR_YEARS_MAX; pos += ALARM_CALENDAR_RECORD_SIZE)
+    {
+        if (fread(record, 1, ALARM_CALENDAR_RECORD_SIZE, f) != ALARM_CALENDAR_RECORD_SIZE)
+        {
+            break;
+        }
+
+        uint8_t n = entry->calendar.years++;
+        memcpy(&entry->calendar.year[n].year, record, ALARM_CALENDAR_YEAR_SIZE);
+        memset(entry->calendar.year[n].skip, 0, sizeof(entry->calendar.year[n].skip));
+        memcpy(entry->calendar.year[n].skip, &record[ALARM_CALENDAR_YEAR_SIZE], ALARM_CALENDAR_DAYS_SIZE);
+    }
+    fclose(f);
+
+    entry->id = object->id;
+    calendars_len++;
+
+    ESP_LOGI(TAG, "Calendar %" PRIx64 " loaded, %u years", object->id, entry->calendar.years);
+}
+
+/* Places the entry in the heap according to its fire time computed for now */
+static void alarm_scheduler_evaluate(uint16_t slot, time_t now, const struct tm *timeinfo)
+{
+    alarm_entry_t *entry = &table[slot];
+    time_t fire = entry->fire;
+    bool scheduled;
+
+    generation++;
+
+    if (entry->transient)
+    {
+        scheduled = fire >= now;
+    }
+    else
+    {
+        scheduled = entry->alarm.enable && get_alarm_next_fire(&entry->alarm, alarm_scheduler_calendar(entry->alarm.calendar_id), now, timeinfo, &fire);
+    }
+
+    if (!scheduled)
+    {
+        alarm_scheduler_heap_remove(slot);
+        return;
+    }
+
+    time_t old_fire = entry->fire;
+    entry->fire = fire;
+
+    if (entry->heap_index < 0)
+    {
+        heap_len++;
+        alarm_scheduler_heap_set(heap_len - 1, slot);
+        alarm_scheduler_sift_up(heap_len - 1);
+    }
+    else if (fire < old_fire)
+    {
+        alarm_scheduler_sift_up(entry->heap_index);
+    }
+    else
+    {
+        alarm_scheduler_sift_down(entry->heap_index);
+    }
+}
+
+static void alarm_scheduler_evaluate_all(void)
+{
+    time_t now;
+    struct tm timeinfo;
+    time(&now);
+    pp_timebase_localtime(now, &timeinfo);
+
+    heap_len = 0;
+    for (uint16_t i = 0; i < table_cap; i++)
+    {
+        if (table[i].id)
+        {
+            table[i].heap_index = -1;
+            alarm_scheduler_evaluate(i, now, &timeinfo);
+        }
+    }
+
+    last_wall = now;
+    last_mono = esp_timer_get_time();
+}
+
+static bool alarm_scheduler_grow(void)
+{
+    uint16_t new_cap = table_cap ? table_cap * 2 : ALARM_SCHEDULER_CAPACITY_MIN;
+
+    alarm_entry_t *new_table = calloc(new_cap, sizeof(alarm_entry_t));
+    uint16_t *new_heap = malloc(new_cap * sizeof(uint16_t));
+    if (new_table == NULL || new_heap == NULL)
+    {
+        free(new_table);
+        free(new_heap);
+        ESP_LOGE(TAG, "No memory for %u alarms", new_cap);
+        return false;
+    }
+
+    alarm_entry_t *old_table = table;
+    uint16_t old_cap = table_cap;
+
+    table = new_table;
+    table_cap = new_cap;
+    free(heap);
+    heap = new_heap;
+    heap_len = 0;
+
+    for (uint16_t i = 0; i < old_cap; i++)
+    {
+        if (old_table[i].id == 0)
+        {
+            continue;
+        }
+
+        uint16_t slot = alarm_scheduler_hash(old_table[i].id);
+        while (table[slot].id)
+        {
+            slot = (slot + 1) & (table_cap - 1);
+        }
+        table[slot] = old_table[i];
+    }
+    free(old_table);
+
+    // Heap held indices of the old table, it is refilled from the kept fire times
+    for (uint16_t i = 0; i < table_cap; i++)
+    {
+        if (table[i].id && table[i].heap_index >= 0)
+        {
+            heap_len++;
+            alarm_scheduler_heap_set(heap_len - 1, i);
+            alarm_scheduler_sift_up(heap_len - 1);
+        }
+    }
+
+    return true;
+}
+
+static int alarm_scheduler_slot(uint64_t id)
+{
+    int slot = alarm_scheduler_find(id);
+
+    if (slot < 0)
+    {
+        // Load factor kept at one half, so probe sequences stay short
+        if ((table_used + 1) * 2 > table_cap && !alarm_scheduler_grow())
+        {
+            return -1;
+        }
+
+        slot = alarm_scheduler_hash(id);
+        while (table[slot].id)
+        {
+            slot = (slot + 1) & (table_cap - 1);
+        }
+
+        table[slot].id = id;
+        table[slot].fire = 0;
+        table[slot].heap_index = -1;
+        table[slot].transient = false;
+        table[slot].snoozes = 0;
+        table_used++;
+    }
+
+    return slot;
+}
+
+static void alarm_scheduler_put(uint64_t id, const alarm_mode_args_t *alarm, time_t now, const struct tm *timeinfo)
+{
+    int slot = alarm_scheduler_slot(id);
+    if (slot < 0)
+    {
+        return;
+    }
+
+    table[slot].alarm = *alarm;
+    alarm_scheduler_evaluate(slot, now, timeinfo);
+}
+
+static void alarm_scheduler_lock(void)
+{
+    if (scheduler_mutex == NULL)
+    {
+        scheduler_mutex = xSemaphoreCreateMutex();
+    }
+    xSemaphoreTake(scheduler_mutex, portMAX_DELAY);
+}
+
+static void alarm_scheduler_unlock(void)
+{
+    xSemaphoreGive(scheduler_mutex);
+}
+
+static void alarm_scheduler_rebuild_locked(void)
+{
+    free(table);
+    free(heap);
+    table = NULL;
+    heap = NULL;
+    table_cap = 0;
+    table_used = 0;
+    heap_len = 0;
+    calendars_len = 0;
+    generation++;
+
+    object_t object;
+    alarm_mode_args_t alarm;
+
+    // Fire times are computed only once every calendar is in memory
+    for (object_id_list_t *elem = ObjectManager_list_first_elem(); elem != NULL; elem = elem->next)
+    {
+        if (ObjectManager_read_object(elem->id, &object, &alarm) != ESP_OK)
+        {
+            continue;
+        }
+
+        uint8_t type = ObjectManager_check_type(object.type.uuid.uuid128);
+        if (type == CALENDAR_TYPE)
+        {
+            alarm_scheduler_calendar_load(&object);
+        }
+        else if (type == ALARM_TYPE && object.set_custom_object)
+        {
+            int slot = alarm_scheduler_slot(elem->id);
+            if (slot >= 0)
+            {
+                table[slot].alarm = alarm;
+            }
+        }
+    }
+
+    alarm_scheduler_evaluate_all();
+    built = true;
+
+    ESP_LOGI(TAG, "Scheduler built: %u alarms, %u scheduled, %u calendars", table_used, heap_len, calendars_len);
+}
+
+void alarm_scheduler_rebuild(void)
+{
+    alarm_scheduler_lock();
+    alarm_scheduler_rebuild_locked();
+    alarm_scheduler_unlock();
+}
+
+static void alarm_scheduler_remove_locked(uint64_t id)
+{
+    int slot = alarm_scheduler_find(id);
+    if (slot < 0)
+    {
+        return;
+    }
+
+    alarm_scheduler_heap_remove(slot);
+    table[slot].id = 0;
+    table_used--;
+    generation++;
+
+    // Backward shift keeps the probe sequences of the following entries unbroken
+    uint16_t hole = slot;
+    for (uint16_t i = (hole + 1) & (table_cap - 1); table[i].id; i = (i + 1) & (table_cap - 1))
+    {
+        uint16_t home = alarm_scheduler_hash(table[i].id);
+        bool movable = (hole <= i) ? (home <= hole || home > i) : (home <= hole && home > i);
+        if (!movable)
+        {
+            continue;
+        }
+
+        table[hole] = table[i];
+        if (table[hole].heap_index >= 0)
+        {
+            heap[table[hole].heap_index] = hole;
+        }
+        table[i].id = 0;
+        hole = i;
+    }
+}
+
+void alarm_scheduler_update(uint64_t id, const alarm_mode_args_t *alarm)
+{
+    alarm_scheduler_lock();
+
+    if (built)
+    {
+        time_t now;
+        struct tm timeinfo;
+        time(&now);
+        pp_timebase_localtime(now, &timeinfo);
+
+        alarm_scheduler_put(id, alarm, now, &timeinfo);
+        // A nap of the old settings is not taken over by the edited alarm
+        alarm_scheduler_remove_locked(id | ALARM_SNOOZE_ID_FLAG);
+    }
+
+    alarm_scheduler_unlock();
+}
+
+/* Computes the alarms using the calendar again, after its decoded copy was dropped or replaced */
+static void alarm_scheduler_calendar_evaluate(uint64_t id)
+{
+    if (!built)
+    {
+        return;
+    }
+
+    time_t now;
+    struct tm timeinfo;
+    time(&now);
+    pp_timebase_localtime(now, &timeinfo);
+
+    for (uint16_t i = 0; i < table_cap; i++)
+    {
+        if (table[i].id && !table[i].transient && table[i].alarm.calendar_id == id)
+        {
+            alarm_scheduler_evaluate(i, now, &timeinfo);
+        }
+    }
+}
+
+void alarm_scheduler_remove(uint64_t id)
+{
+    alarm_scheduler_lock();
+    alarm_scheduler_remove_locked(id);
+    alarm_scheduler_remove_locked(id | ALARM_SNOOZE_ID_FLAG);
+    alarm_scheduler_calendar_drop(id);
+    alarm_scheduler_calendar_evaluate(id);
+    alarm_scheduler_unlock();
+}
+
+/* Decodes the new content of a calendar, the content of other objects is used by no alarm */
+void alarm_scheduler_calendar_changed(uint64_t id)
+{
+    alarm_scheduler_lock();
+
+    alarm_scheduler_calendar_drop(id);
+
+    object_t object;
+    alarm_mode_args_t alarm;
+    if (built && ObjectManager_read_object(id, &object, &alarm) == ESP_OK
+        && ObjectManager_check_type(object.type.uuid.uuid128) == CALENDAR_TYPE)
+    {
+        alarm_scheduler_calendar_load(&object);
+    }
+
+    alarm_scheduler_calendar_evaluate(id);
+
+    alarm_scheduler_unlock();
+}
+
+/* Schedules the ringing alarm again after its nap. A ring of a snooze entry counts towards
+ * the repeats, a ring of the alarm itself starts counting from zero. The snooze entry is gone
+ * by then, so the alarm's own entry keeps the count.
+ */
+bool alarm_scheduler_snooze(uint64_t id, time_t now)
+{
+    bool snoozed = false;
+
+    alarm_scheduler_lock();
+
+    int slot = alarm_scheduler_find(id & ~ALARM_SNOOZE_ID_FLAG);
+    if (slot >= 0)
+    {
+        alarm_mode_args_t alarm = table[slot].alarm;
+        uint8_t snoozes = 1;
+        if (id & ALARM_SNOOZE_ID_FLAG)
+        {
+            // Saturates below the no limit value, the count only matters against smaller limits
+            snoozes = (table[slot].snoozes < ALARM_NAP_REPEATS_ALWAYS - 1) ? table[slot].snoozes + 1 : table[slot].snoozes;
+        }
+
+        if (alarm.nap && (alarm.nap_repeats == ALARM_NAP_REPEATS_ALWAYS || snoozes <= alarm.nap_repeats))
+        {
+            table[slot].snoozes = snoozes;
+            int snooze_slot = alarm_scheduler_slot(id | ALARM_SNOOZE_ID_FLAG);
+            if (snooze_slot >= 0)
+            {
+                struct tm timeinfo;
+                pp_timebase_localtime(now, &timeinfo);
+                table[snooze_slot].alarm = alarm;
+                table[snooze_slot].transient = true;
+                alarm_scheduler_heap_remove(snooze_slot);
+                table[snooze_slot].fire = now + alarm.nap * 60;
+                alarm_scheduler_evaluate(snooze_slot, now, &timeinfo);
+                snoozed = true;
+            }
+        }
+    }
+
+    alarm_scheduler_unlock();
+
+    return snoozed;
+}
+
+void alarm_scheduler_time_changed(void)
+{
+    alarm_scheduler_lock();
+    if (built)
+    {
+        alarm_scheduler_evaluate_all();
+    }
+    alarm_scheduler_unlock();
+}
+
+bool alarm_scheduler_get(uint64_t id, alarm_mode_args_t *alarm)
+{
+    alarm_scheduler_lock();
+
+    int slot = alarm_scheduler_find(id);
+    if (slot >= 0)
+    {
+        *alarm = table[slot].alarm;
+    }
+
+    alarm_scheduler_unlock();
+
+    return slot >= 0;
+}
+
+static void alarm_scheduler_check_jump(time_t now)
+{
+    // Settimeofday from SNTP or the RTC moves the wall clock but not the monotonic one
+    int64_t mono_elapsed = (esp_timer_get_time() - last_mono) / 1000000;
+    int64_t wall_elapsed = (int64_t)(now - last_wall);
+    if (llabs(wall_elapsed - mono_elapsed) > ALARM_SCHEDULER_JUMP_SEC)
+    {
+        ESP_LOGI(TAG, "Time jumped by %" PRId64 " s, recomputing all alarms", wall_elapsed - mono_elapsed);
+        alarm_scheduler_evaluate_all();
+    }
+    last_wall = now;
+    last_mono = esp_timer_get_time();
+}
+
+/* Earliest alarm firing at or after the given time, alarms due before it move on to their next occurrence */
+bool alarm_scheduler_next(time_t after, uint64_t *id, time_t *fire)
+{
+    alarm_scheduler_lock();
+
+    if (!built)
+    {
+        alarm_scheduler_rebuild_locked();
+    }
+
+    time_t now;
+    struct tm timeinfo;
+    time(&now);
+    pp_timebase_localtime(now, &timeinfo);
+
+    alarm_scheduler_check_jump(now);
+
+    if (after != now)
+    {
+        pp_timebase_localtime(after, &timeinfo);
+    }
+
+    while (heap_len && table[heap[0]].fire < after)
+    {
+        uint16_t slot = heap[0];
+        alarm_scheduler_evaluate(slot, after, &timeinfo);
+
+        if (table[slot].heap_index == 0 && table[slot].fire < after)
+        {
+            alarm_scheduler_heap_remove(slot);
+        }
+
+        // A fired snooze entry is not needed anymore, its ring keeps the ID
+        if (table[slot].transient && table[slot].heap_index < 0)
+        {
+            alarm_scheduler_remove_locked(table[slot].id);
+        }
+    }
+
+    bool found = heap_len > 0;
+    if (found)
+    {
+        *id = table[heap[0]].id;
+        *fire = table[heap[0]].fire;
+    }
+
+    alarm_scheduler_unlock();
+
+    return found;
+}
+
+static uint8_t alarm_scheduler_collect(uint16_t pos, time_t until, uint64_t *ids, uint8_t count, uint8_t max)
+{
+    if (pos >= heap_len || count == max || table[heap[pos]].fire > until)
+    {
+        return count;
+    }
+
+    ids[count++] = table[heap[pos]].id;
+    count = alarm_scheduler_collect(2 * pos + 1, until, ids, count, max);
+    return alarm_scheduler_collect(2 * pos + 2, until, ids, count, max);
+}
+
+/* Alarms scheduled at or before until, subtrees of the heap past it are skipped */
+uint8_t alarm_scheduler_due(time_t until, uint64_t *ids, uint8_t max)
+{
+    alarm_scheduler_lock();
+    uint8_t count = alarm_scheduler_collect(0, until, ids, 0, max);
+    alarm_scheduler_unlock();
+
+    return count;
+}
+
+static void alarm_scheduler_merge_sift_down(alarm_merge_t *merge, uint16_t len, uint16_t pos)
+{
+    alarm_merge_t item = merge[pos];
+
+    while (true)
+    {
+        uint16_t child = 2 * pos + 1;
+        if (child >= len)
+        {
+            break;
+        }
+        if (child + 1 < len && merge[child + 1].fire < merge[child].fire)
+        {
+            child++;
+        }
+        if (item.fire <= merge[child].fire)
+        {
+            break;
+        }
+        merge[pos] = merge[child];
+        pos = child;
+    }
+
+    merge[pos] = item;
+}
+
+/* K-way merge of the alarms' occurrence sequences. Each alarm is a generator whose head is its
+ * next fire time; the smallest head is taken and replaced by the following occurrence of the
+ * same alarm. The scheduler heap is ordered by the same key, so its copy starts as a valid heap.
+ */
+static void alarm_scheduler_timeline_build(time_t now)
+{
+    timeline_len = 0;
+    timeline_valid = true;
+    timeline_generation = generation;
+
+    if (heap_len == 0)
+    {
+        return;
+    }
+
+    alarm_merge_t *merge = malloc(heap_len * sizeof(alarm_merge_t));
+    if (merge == NULL)
+    {
+        timeline_valid = false;
+        return;
+    }
+
+    uint16_t len = heap_len;
+    for (uint16_t i = 0; i < len; i++)
+    {
+        merge[i].fire = table[heap[i]].fire;
+        merge[i].slot = heap[i];
+
+        // Every calendar is decoded at the build, a miss means a deleted calendar or a stale cache, never a load
+        const alarm_mode_args_t *alarm = &table[heap[i]].alarm;
+        if (alarm->calendar_id && alarm_scheduler_calendar(alarm->calendar_id) == NULL)
+        {
+            ESP_LOGE(TAG, "Calendar %" PRIx64 " of alarm %" PRIx64 " not in memory, its days are not skipped", alarm->calendar_id, table[heap[i]].id);
+        }
+    }
+
+    while (len && timeline_len < ALARM_TIMELINE_LEN)
+    {
+        alarm_entry_t *entry = &table[merge[0].slot];
+
+        // Heads the scheduler did not move past yet are advanced without being listed
+        time_t after = merge[0].fire + 1;
+        if (merge[0].fire < now)
+        {
+            after = now;
+        }
+        else
+        {
+            timeline[timeline_len].id = entry->id & ~ALARM_SNOOZE_ID_FLAG;
+            timeline[timeline_len].fire = merge[0].fire;
+            timeline_len++;
+        }
+
+        struct tm timeinfo;
+        pp_timebase_localtime(after, &timeinfo);
+        if (entry->transient || !get_alarm_next_fire(&entry->alarm, alarm_scheduler_calendar(entry->alarm.calendar_id), after, &timeinfo, &merge[0].fire))
+        {
+            merge[0] = merge[--len];
+        }
+        alarm_scheduler_merge_sift_down(merge, len, 0);
+    }
+
+    free(merge);
+}
+
+/* Next firings of all alarms in time order, built from the alarms and calendars in memory only */
+uint8_t alarm_scheduler_timeline(alarm_timeline_entry_t *entries, uint8_t max)
+{
+    alarm_scheduler_lock();
+
+    if (!built)
+    {
+        alarm_scheduler_rebuild_locked();
+    }
+
+    time_t now;
+    time(&now);
+
+    // A jump moves all fire times and with them the generation
+    alarm_scheduler_check_jump(now);
+
+    if (!timeline_valid || timeline_generation != generation || (timeline_len && timeline[0].fire < now))
+    {
+        alarm_scheduler_timeline_build(now);
+    }
+
+    uint8_t count = (timeline_len < max) ? timeline_len : max;
+    memcpy(entries, timeline, count * sizeof(alarm_timeline_entry_t));
+
+    alarm_scheduler_unlock();
+
+    return count;
+}
@@ -0,0 +1,36 @@
+#ifndef __ALARM_SCHEDULER_H__
+#define __ALARM_SCHEDULER_H__
+
+#include "alarm.h"
+#include <stdbool.h>
+#include <time.h>
+
+#define ALARM_SCHEDULER_CAPACITY_MIN    16
+#define ALARM_SCHEDULER_JUMP_SEC        2       // wall clock moved against the monotonic one by more than this
+#define ALARM_SCHEDULER_CALENDARS_MIN   4       // exception calendars room is allocated for first
+#define ALARM_TIMELINE_LEN              20      // upcoming firings kept for the timeline
+
+/* Exception calendar content: records of [year (2 bytes), day bitmap (46 bytes)], little endian.
+ * Bit n of the bitmap is day n of the year counted from 0, a set bit excludes the day.
+ */
+#define ALARM_CALENDAR_YEAR_SIZE        2
+#define ALARM_CALENDAR_DAYS_SIZE        46
+#define ALARM_CALENDAR_RECORD_SIZE      (ALARM_CALENDAR_YEAR_SIZE + ALARM_CALENDAR_DAYS_SIZE)
+
+typedef struct {
+    uint64_t id;            // alarm object, also for a snoozed ring
+    time_t fire;
+} alarm_timeline_entry_t;
+
+void alarm_scheduler_rebuild(void);
+void alarm_scheduler_update(uint64_t id, const alarm_mode_args_t *alarm);
+void alarm_scheduler_remove(uint64_t id);
+void alarm_scheduler_calendar_changed(uint64_t id);
+bool alarm_scheduler_snooze(uint64_t id, time_t now);
+void alarm_scheduler_time_changed(void);
+bool alarm_scheduler_get(uint64_t id, alarm_mode_args_t *alarm);
+bool alarm_scheduler_next(time_t after, uint64_t *id, time_t *fire);
+uint8_t alarm_scheduler_due(time_t until, uint64_t *ids, uint8_t max);
+uint8_t alarm_scheduler_timeline(alarm_timeline_entry_t *entries, uint8_t max);
+
+#endif
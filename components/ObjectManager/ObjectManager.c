@@ -1,7 +1,11 @@
 #include "ObjectManager.h"
 #include "ObjectManagerIdList.h"
+#include "ObjectManagerCatalog.h"
+#include "ObjectManagerContentStore.h"
 #include "ObjectTransfer_defs.h"
+#include "ObjectTransfer_stream.h"
 #include "FilterOrder.h"
+#include "alarm_scheduler.h"
 #include "project_defs.h"
 
 #include <string.h>
@@ -13,14 +17,20 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "FreeRTOSConfig.h"
+#include "ff.h"
+#include "esp_rom_crc.h"
 
 #include "time.h"
 #include <sys/stat.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #define OBJECT_TAG "FILESYSTEM"
+#define UPLOAD_LOG_FILE_TYPE ".upl"
 #define MAX_FILES_NUMBER 5
+#define BULK_TEMP_PATH MOUNT_POINT "/bulk%" PRIx64
+#define BULK_PATH_LEN 32
 
 static object_t *current_object = NULL;
     
@@ -31,10 +41,14 @@ static file_transfer_t file_transfer = {
 
 uint8_t alarm_type_uuid[ESP_UUID_LEN_128] = {0x02, 0x00, 0x12, 0xAC, 0x42, 0x02, 0x61, 0xA2, 0xED, 0x11, 0xBA, 0x29, 0xB8, 0x13, 0x08, 0xCC};
 uint8_t ringtone_type_uuid[ESP_UUID_LEN_128] = {0x03, 0x00, 0x12, 0xAC, 0x42, 0x02, 0x61, 0xA2, 0xED, 0x11, 0xBA, 0x29, 0xB8, 0x13, 0x08, 0xCC};
+uint8_t calendar_type_uuid[ESP_UUID_LEN_128] = {0x06, 0x00, 0x12, 0xAC, 0x42, 0x02, 0x61, 0xA2, 0xED, 0x11, 0xBA, 0x29, 0xB8, 0x13, 0x08, 0xCC};
 static char* id_to_string(char* bfr, uint64_t id);
 static void ObjectManager_print_file();
 static void ObjectManager_print_current_object();
 static void ObjectManager_set_current_object_from_file(uint64_t id);
+static esp_err_t ObjectManager_preallocate_content(uint64_t id, uint32_t alloc_size);
+static esp_err_t ObjectManager_content_detach(uint64_t id, bool keep_data);
+static void ObjectManager_content_release(uint64_t id);
 
 static esp_err_t ObjectManager_init_list()
 {
@@ -65,7 +79,12 @@ static esp_err_t ObjectManager_init_list()
 
 esp_err_t ObjectManager_init(void)
 {   
-    
+    struct stat st;
+    if(stat(RIGNTONES_PATH, &st) != 0 && mkdir(RIGNTONES_PATH, 0777) != 0)
+    {
+        ESP_LOGE(OBJECT_TAG, "Cannot create ringtones directory");
+    }
+
     esp_err_t ret = ObjectManager_init_list();
     if (ret)
     {
@@ -112,6 +131,10 @@ esp_err_t ObjectManager_create_object(uint32_t size, esp_bt_uuid_t type, oacp_op
             ESP_LOGI(OBJECT_TAG, "Requested object type: Ringtone file");
             break;
 
+        case CALENDAR_TYPE:
+            ESP_LOGI(OBJECT_TAG, "Requested object type: Calendar file");
+            break;
+
         default:
             ESP_LOGE(OBJECT_TAG, "Unsupported object type with 128-bit UUID");
             *result = OACP_RES_UNSUPPORTED_TYPE;
@@ -130,7 +153,7 @@ esp_err_t ObjectManager_create_object(uint32_t size, esp_bt_uuid_t type, oacp_op
     }
 
     current_object->size = 0;
-    current_object->alloc_size = 0;
+    current_object->alloc_size = ObjectManager_type_has_content(ret_type) ? size : 0;
     current_object->name[0] = '\0';
     current_object->name_len = 0;
     current_object->type.len = ESP_UUID_LEN_128;
@@ -141,8 +164,8 @@ esp_err_t ObjectManager_create_object(uint32_t size, esp_bt_uuid_t type, oacp_op
     ESP_LOGI(OBJECT_TAG, "Creating file on SD Card");
     FILE* f = ObjectManager_open_file("w+", object->id);
 
-    fprintf(f, "Size: %x\n", current_object->size);
-    fprintf(f, "Allocated size: %x\n", current_object->alloc_size);
+    fprintf(f, "Size: %08x\n", current_object->size);
+    fprintf(f, "Allocated size: %08x\n", current_object->alloc_size);
     fprintf(f, "Name length: 0\n");
     fprintf(f, "Name: \n");
     fprintf(f, "UUID type: %u\n", 128);
@@ -157,6 +180,12 @@ esp_err_t ObjectManager_create_object(uint32_t size, esp_bt_uuid_t type, oacp_op
     fclose(f);
     ESP_LOGI(OBJECT_TAG, "File created: %" PRIx64, object->id);
 
+    if(ObjectManager_type_has_content(ret_type))
+    {
+        ringtone_properties_t props = {0};
+        ObjectManager_set_ringtone_properties(object->id, &props);
+    }
+
     
     f = fopen(FILE_LIST_NAME, "a+");
 
@@ -171,7 +200,9 @@ esp_err_t ObjectManager_create_object(uint32_t size, esp_bt_uuid_t type, oacp_op
             break;
 
         case RINGTONE_TYPE:
-            ESP_LOGI(OBJECT_TAG, "Ringtone files not supported yet");
+        case CALENDAR_TYPE:
+            current_object->set_custom_object = false;
+            ObjectManager_preallocate_content(object->id, size);
             break;
     }
 
@@ -199,14 +230,16 @@ esp_err_t ObjectManager_delete_object(oacp_op_code_result_t *result)
         return ESP_OK;
     }
 
-    char file[20];
-    strcpy(file, MOUNT_POINT);
-    strcat(file, "/");
-    itoa(current_object->id, &file[8], 16);
-    ESP_LOGI(OBJECT_TAG, "File to remove: %s", file);
-    remove(file);
-    ESP_LOGI(OBJECT_TAG, "File removed");
+    ObjectManager_remove_object(current_object);
+    *result = OACP_RES_SUCCESS;
 
+    FilterOrder_make_list();
+
+    return ESP_OK;
+}
+
+esp_err_t ObjectManager_remove_object(object_t *object)
+{
     ESP_LOGI(OBJECT_TAG, "Deleting id from id file list");
     FILE* file_src = fopen(FILE_LIST_NAME, "r");
 
@@ -218,7 +251,7 @@ esp_err_t ObjectManager_delete_object(oacp_op_code_result_t *result)
     while(fgets(line, sizeof(line), file_src))
     {
         line_number++;
-        if (current_object->id == strtol(line, &ptr, 16))
+        if (object->id == strtol(line, &ptr, 16))
         {
             ESP_LOGI(OBJECT_TAG, "Line number: %u", line_number);
             break;
@@ -242,18 +275,314 @@ esp_err_t ObjectManager_delete_object(oacp_op_code_result_t *result)
     remove(FILE_LIST_NAME);
     rename(TEMP_FILE_PATH, FILE_LIST_NAME);
 
+    ObjectManager_discard_object(object);
+
+    return ESP_OK;
+}
+
+/* Drops the content, the metadata file and the list entry of an object. The ID list file is left to the caller. */
+void ObjectManager_discard_object(object_t *object)
+{
+    // Content location is kept in the metadata, so it goes first
+    if(ObjectManager_has_content(object))
+    {
+        ObjectManager_content_release(object->id);
+    }
+
+    char file[20];
+    strcpy(file, MOUNT_POINT);
+    strcat(file, "/");
+    itoa(object->id, &file[8], 16);
+    ESP_LOGI(OBJECT_TAG, "File to remove: %s", file);
+    remove(file);
+
+    ESP_LOGI(OBJECT_TAG, "ID to remove from list: %llx", object->id);
+    ObjectManager_list_delete_by_id(object->id);
+    alarm_scheduler_remove(object->id);
+}
+
+esp_err_t ObjectManager_add_object(object_t *object)
+{
+    object_id_list_t* list_object = ObjectManager_list_add();
+    object->id = list_object->id;
+    ESP_LOGI(OBJECT_TAG, "Object created, ID: %" PRIx64, object->id);
+
+    FILE* f = fopen(FILE_LIST_NAME, "a+");
+    if(f == NULL)
+    {
+        ObjectManager_list_delete_by_id(object->id);
+        return ESP_FAIL;
+    }
+
+    char id_string[20];
+    fprintf(f, "%s\n", id_to_string(id_string, object->id));
+    fclose(f);
+
+    return ESP_OK;
+}
+
+/* Writes the ID list file to path from the list in memory, leaving out the removed IDs */
+esp_err_t ObjectManager_stage_list(const char *path, const uint64_t *removed, uint8_t removed_count)
+{
+    FILE* f = fopen(path, "w");
+    if(f == NULL) return ESP_FAIL;
+
+    char id_string[20];
+    for(object_id_list_t *elem = ObjectManager_list_first_elem(); elem != NULL; elem = elem->next)
+    {
+        bool keep = true;
+        for(uint8_t i=0; i<removed_count; i++)
+        {
+            if(removed[i] == elem->id) keep = false;
+        }
+
+        if(keep) fprintf(f, "%s\n", id_to_string(id_string, elem->id));
+    }
+
+    bool failed = ferror(f);
+    if(fclose(f) != 0 || failed)
+    {
+        remove(path);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t ObjectManager_install_list(const char *path)
+{
+    remove(FILE_LIST_NAME);
+    if(rename(path, FILE_LIST_NAME) != 0)
+    {
+        ESP_LOGE(OBJECT_TAG, "ID list not written");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/* Rewrites the whole metadata file in one go - the name is padded and the properties zero filled
+ * the same way the in-place writers leave them. Other sections of non-alarm objects are carried over.
+ */
+esp_err_t ObjectManager_write_object(object_t *object, alarm_mode_args_t *alarm)
+{
+    esp_err_t ret = ObjectManager_stage_object(object, alarm, TEMP_FILE_PATH);
+    if(ret) return ret;
+
+    return ObjectManager_install_object(object, alarm, TEMP_FILE_PATH);
+}
+
+/* Writes the metadata file of an object to path, the object itself is not touched yet */
+esp_err_t ObjectManager_stage_object(object_t *object, alarm_mode_args_t *alarm, const char *path)
+{
+    FILE* src = ObjectManager_open_file("r", object->id);
+    FILE* f = fopen(path, "w");
+    if(f == NULL)
+    {
+        if(src) fclose(src);
+        return ESP_FAIL;
+    }
+
+    fprintf(f, "Size: %08x\n", object->size);
+    fprintf(f, "Allocated size: %08x\n", object->alloc_size);
+    fprintf(f, "Name: %s", object->name);
+    for(uint8_t i=0; i<NAME_LEN_MAX-object->name_len-1; i++)
+    {
+        fputc('*', f);
+    }
+    fprintf(f, "\n");
+    fprintf(f, "Name length: %02u\n", object->name_len);
+    fprintf(f, "UUID type: %u\n", 128);
+    fprintf(f, "UUID: ");
+
+    for(int i=15; i>=0; i--)
+    {
+        fprintf(f, "%02x", object->type.uuid.uuid128[i]);
+    }
+    fprintf(f, "\n");
+    fprintf(f, "Properties: %08" PRIx32 "\n", object->properties);
+
+    if(alarm != NULL)
+    {
+        fprintf(f, "\n");
+        fprintf(f, "ALARM PROPERTIES\n");
+        fprintf(f, "Mode: %02x\n", alarm->mode);
+        fprintf(f, "Enable: %02x\n", alarm->enable);
+        fprintf(f, "Description length: %01x\n", alarm->desc_len);
+        fprintf(f, "Description: %s\n", alarm->desc);
+        fprintf(f, "Hour: %02x\n", alarm->hour);
+        fprintf(f, "Minute: %02x\n", alarm->minute);
+
+        switch(alarm->mode)
+        {
+            case ALARM_SINGLE_MODE:
+                fprintf(f, "Day: %02x\n", alarm->args.single_alarm_args.day);
+                fprintf(f, "Month: %02x\n", alarm->args.single_alarm_args.month);
+                fprintf(f, "Year: %02x\n", alarm->args.single_alarm_args.year);
+                break;
+
+            case ALARM_WEEKLY_MODE:
+                fprintf(f, "Days: %02x\n", alarm->args.days);
+                break;
+
+            case ALARM_MONTHLY_MODE:
+                fprintf(f, "Day: %02x\n", alarm->args.day);
+                break;
+
+            case ALARM_YEARLY_MODE:
+                fprintf(f, "Day: %02x\n", alarm->args.yearly_alarm_args.day);
+                fprintf(f, "Month: %02x\n", alarm->args.yearly_alarm_args.month);
+                break;
+        }
+
+        fprintf(f, "Volume: %02x\n", alarm->volume);
+        fprintf(f, "Ringtone: %" PRIx64 "\n", alarm->ringtone_id);
+        fprintf(f, "Group: %02x\n", alarm->group);
+        fprintf(f, "Nap: %02x\n", alarm->nap);
+        fprintf(f, "Nap repeats: %02x\n", alarm->nap_repeats);
+        fprintf(f, "Ring duration: %02x\n", alarm->ring_duration);
+        fprintf(f, "Calendar: %" PRIx64 "\n", alarm->calendar_id);
+        fprintf(f, "Rise: %02x\n", alarm->rise);
+        fprintf(f, "Rise time: %02x\n", alarm->rise_time);
+    }
+    else if(src != NULL)
+    {
+        char line[70];
+        for(uint8_t i=0; i<7 && fgets(line, sizeof(line), src); i++);
+
+        while(fgets(line, sizeof(line), src))
+        {
+            fputs(line, f);
+        }
+    }
+
+    if(src) fclose(src);
+
+    bool failed = ferror(f);
+    if(fclose(f) != 0 || failed)
+    {
+        ESP_LOGE(OBJECT_TAG, "Metadata of %" PRIx64 " not staged", object->id);
+        remove(path);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/* Replaces the metadata file of an object with the one staged at path */
+esp_err_t ObjectManager_install_object(object_t *object, alarm_mode_args_t *alarm, const char *path)
+{
+    char file[20];
+    strcpy(file, MOUNT_POINT);
+    strcat(file, "/");
+    itoa(object->id, &file[8], 16);
+    remove(file);
+    if(rename(path, file) != 0)
+    {
+        ESP_LOGE(OBJECT_TAG, "Metadata of %" PRIx64 " not written", object->id);
+        return ESP_FAIL;
+    }
+
+    if(alarm) alarm_scheduler_update(object->id, alarm);
+    else alarm_scheduler_remove(object->id);
+
+    return ESP_OK;
+}
+
+/* Alarm of the bulk scope whose Enable differs, read into object and alarm */
+static bool ObjectManager_bulk_match(uint64_t id, uint8_t scope, uint8_t group, uint8_t enable, object_t *object, alarm_mode_args_t *alarm)
+{
+    if(ObjectManager_read_object(id, object, alarm) != ESP_OK) return false;
+    if(ObjectManager_check_type(object->type.uuid.uuid128) != ALARM_TYPE || !object->set_custom_object) return false;
+    if(scope == BULK_SCOPE_GROUP && alarm->group != group) return false;
+
+    return alarm->enable != enable;
+}
+
+static void ObjectManager_bulk_temp_path(char *path, uint64_t id)
+{
+    snprintf(path, BULK_PATH_LEN, BULK_TEMP_PATH, id);
+}
+
+/* Sets Enable of every configured alarm in the scope - all objects, one group tag or the current filter result.
+ * Only alarms whose state actually changes get their metadata rewritten. All of them are staged first and
+ * installed only once every one was written, a failed stage leaves every alarm as it was.
+ */
+esp_err_t ObjectManager_bulk_enable(uint8_t scope, uint8_t group, uint8_t enable, uint16_t *changed, oacp_op_code_result_t *result)
+{
+    *changed = 0;
+
+    if(scope > BULK_SCOPE_FILTER || enable > 1)
+    {
+        *result = OACP_RES_INVALID_PAR;
+        return ESP_OK;
+    }
+
+    object_id_list_t *first = (scope == BULK_SCOPE_FILTER) ? ObjectManager_sort_list_first_elem() : ObjectManager_list_first_elem();
+    object_id_list_t *elem;
+
+    object_t object;
+    alarm_mode_args_t alarm;
+    char path[BULK_PATH_LEN];
+    uint16_t staged = 0;
+
     *result = OACP_RES_SUCCESS;
 
-    ESP_LOGI(OBJECT_TAG, "ID to remove from list: %llx", current_object->id);
-    ObjectManager_list_delete_by_id(current_object->id);
-    ESP_LOGI(OBJECT_TAG, "ID removed from list");
-    FilterOrder_make_list();
+    for(elem = first; elem != NULL; elem = elem->next)
+    {
+        if(!ObjectManager_bulk_match(elem->id, scope, group, enable, &object, &alarm)) continue;
+
+        alarm.enable = enable;
+        ObjectManager_bulk_temp_path(path, object.id);
+        if(ObjectManager_stage_object(&object, &alarm, path) != ESP_OK)
+        {
+            *result = OACP_RES_OPERATION_FAILED;
+            break;
+        }
+        staged++;
+    }
+
+    // Nothing is installed yet, so the same alarms still match and their temporary files can be found again
+    for(elem = first; elem != NULL && staged; elem = elem->next)
+    {
+        if(!ObjectManager_bulk_match(elem->id, scope, group, enable, &object, &alarm)) continue;
+
+        ObjectManager_bulk_temp_path(path, object.id);
+        staged--;
+
+        if(*result != OACP_RES_SUCCESS)
+        {
+            remove(path);
+            continue;
+        }
+
+        alarm.enable = enable;
+        if(ObjectManager_install_object(&object, &alarm, path) != ESP_OK)
+        {
+            remove(path);
+            *result = OACP_RES_OPERATION_FAILED;
+            continue;
+        }
+        (*changed)++;
+
+        if(current_object != NULL && current_object->id == object.id)
+        {
+            get_alarm_pointer()->enable = enable;
+        }
+    }
+
+    ESP_LOGI(OBJECT_TAG, "Bulk enable %u, scope %u, group %u: %u alarms changed", enable, scope, group, *changed);
 
     return ESP_OK;
 }
 
 esp_err_t ObjectManager_change_name_in_file()
 {
+    if(ObjectManager_catalog_is_synthetic(current_object->id))
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
     FILE* f = ObjectManager_open_file("r+", current_object->id);
 
     char line[70];
@@ -390,6 +719,21 @@ esp_err_t ObjectManager_previous_object(olcp_op_code_result_t *result)
 
 esp_err_t ObjectManager_goto_object(uint64_t id, olcp_op_code_result_t *result)
 {
+    // Synthetic objects are not listed, they can be reached only by their well-known IDs
+    if(ObjectManager_catalog_is_synthetic(id))
+    {
+        if(current_object == NULL)
+        {
+            current_object = (object_t*)malloc(sizeof(object_t));
+        }
+
+        ObjectManager_catalog_describe(id, current_object);
+        *result = OLCP_RES_SUCCESS;
+
+        ObjectManager_print_current_object();
+        return ESP_OK;
+    }
+
     object_id_list_t *object = ObjectManager_sort_list_first_elem();
     if(object == NULL)
     {
@@ -481,6 +825,11 @@ esp_err_t ObjectManager_clear_marking(olcp_op_code_result_t *result)
 
 esp_err_t ObjectManager_change_properties_in_file()
 {
+    if(ObjectManager_catalog_is_synthetic(current_object->id))
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
     FILE* f = ObjectManager_open_file("r+", current_object->id);
 
     fseek(f, 0, SEEK_SET);
@@ -559,11 +908,20 @@ esp_err_t ObjectManager_change_alarm_data_in_file(alarm_mode_args_t alarm)
     }
 
     fprintf(f, "Volume: %02x\n", alarm.volume);
+    fprintf(f, "Ringtone: %" PRIx64 "\n", alarm.ringtone_id);
+    fprintf(f, "Group: %02x\n", alarm.group);
+    fprintf(f, "Nap: %02x\n", alarm.nap);
+    fprintf(f, "Nap repeats: %02x\n", alarm.nap_repeats);
+    fprintf(f, "Ring duration: %02x\n", alarm.ring_duration);
+    fprintf(f, "Calendar: %" PRIx64 "\n", alarm.calendar_id);
+    fprintf(f, "Rise: %02x\n", alarm.rise);
+    fprintf(f, "Rise time: %02x\n", alarm.rise_time);
 
     uint32_t truncate_offset = ftell(f);
     fseek(f, 0, SEEK_SET);
     fclose(f);
     ObjectManager_truncate_rest(current_object->id, truncate_offset);
+    alarm_scheduler_update(current_object->id, &alarm);
 
     ObjectManager_print_current_object();
     ObjectManager_print_file();
@@ -571,71 +929,811 @@ esp_err_t ObjectManager_change_alarm_data_in_file(alarm_mode_args_t alarm)
     return ESP_OK;
 }
 
-static char* id_to_string(char* bfr, uint64_t id)
+esp_err_t ObjectManager_change_size_in_file(uint64_t id, uint32_t size, uint32_t alloc_size)
 {
-    char number[20];
-
-    if(strcmp(itoa(id>>32, number, 16), "0"))
+    FILE* f = ObjectManager_open_file("r", id);
+    if(f == NULL)
     {
-        strcat(bfr, itoa(id>>32, number, 16));
+        ESP_LOGE(OBJECT_TAG, "Object file not found");
+        return ESP_ERR_NOT_FOUND;
     }
 
-    strcpy(bfr, itoa((uint32_t)id, number, 16));
+    char line[70];
 
-    return bfr;
-}
+    fgets(line, sizeof(line), f);
+    fgets(line, sizeof(line), f);
+    long rest_offset = ftell(f);
+    fseek(f, 0, SEEK_END);
+    long rest_len = ftell(f) - rest_offset;
 
-static void ObjectManager_print_file()
-{
-    // if(current_object == NULL)
-    // {
-    //     return;
-    // }
+    char *rest = (char*)malloc(rest_len);
+    if(rest == NULL)
+    {
+        fclose(f);
+        return ESP_ERR_NO_MEM;
+    }
 
-    // FILE* f = ObjectManager_open_file("r", current_object->id);
+    fseek(f, rest_offset, SEEK_SET);
+    fread(rest, 1, rest_len, f);
+    fclose(f);
 
-    // char line[70];
+    // Size lines are fixed width from now on, so later updates never shift the rest of the file
+    f = ObjectManager_open_file("w", id);
+    fprintf(f, "Size: %08" PRIx32 "\n", size);
+    fprintf(f, "Allocated size: %08" PRIx32 "\n", alloc_size);
+    fwrite(rest, 1, rest_len, f);
+    fclose(f);
+    free(rest);
 
-    // while(fgets(line, sizeof(line), f))
-    // {
-    //     printf("%s", line);
-    // }
+    if(current_object && current_object->id == id)
+    {
+        current_object->size = size;
+        current_object->alloc_size = alloc_size;
+    }
 
-    // fclose(f);
+    return ESP_OK;
 }
 
-void ObjectManager_printf_alarm_info()
+/* Calendars share the content store with ringtones, including deduplication */
+bool ObjectManager_type_has_content(int type)
 {
-    // if(current_object == NULL) return;
+    return type == RINGTONE_TYPE || type == CALENDAR_TYPE;
+}
 
-    // FILE* f = ObjectManager_open_file("r", current_object->id);
-    // fpos_t pos;
-    // bool found = seekfor(f, "ALARM PROPERTIES\n", &pos);
-    // fclose(f);
+bool ObjectManager_has_content(object_t *object)
+{
+    return ObjectManager_type_has_content(ObjectManager_check_type(object->type.uuid.uuid128)) || ObjectManager_catalog_is_synthetic(object->id);
+}
 
-    // if(found)
-    // {
-    //     alarm_mode_args_t alarm = get_alarm_values();
-    //     printf("State: %s\n", alarm.enable?"enabled":"disabled");
+char* ObjectManager_content_path(char* bfr, uint64_t id)
+{
+    if(id == CATALOG_IMPORT_ID)
+    {
+        return strcpy(bfr, CATALOG_IMPORT_PATH);
+    }
 
-    //     switch(alarm.mode)
-    //     {
-    //         case ALARM_SINGLE_MODE:
-    //             printf("Mode: single\n");
-    //             break;
+    ringtone_properties_t props;
+    ObjectManager_get_ringtone_properties(id, &props);
 
-    //         case ALARM_WEEKLY_MODE:
-    //             printf("Mode: weekly\n");
-    //             break;
+    if(props.content_key[0])
+    {
+        sprintf(bfr, RIGNTONES_PATH "/%s" RINGTONE_FILE_TYPE, props.content_key);
+    }
+    else
+    {
+        sprintf(bfr, RIGNTONES_PATH "/%" PRIx64 RINGTONE_FILE_TYPE, id);
+    }
 
-    //         case ALARM_MONTHLY_MODE:
-    //             printf("Mode: monthly\n");
-    //             break;
+    return bfr;
+}
 
-    //         case ALARM_YEARLY_MODE:
-    //             printf("Mode: yearly\n");
-    //             break;
-    //     }
+static void ObjectManager_hash_to_string(char *bfr, const uint8_t *hash)
+{
+    for(int i=0; i<CONTENT_HASH_SIZE; i++)
+    {
+        sprintf(&bfr[i*2], "%02x", hash[i]);
+    }
+}
+
+esp_err_t ObjectManager_create_object_by_hash(uint32_t size, esp_bt_uuid_t type, const uint8_t *hash, bool *shared, oacp_op_code_result_t *result)
+{
+    *shared = false;
+
+    esp_err_t ret = ObjectManager_create_object(size, type, result);
+    if(ret || *result != OACP_RES_SUCCESS || !ObjectManager_has_content(current_object))
+    {
+        return ret;
+    }
+
+    char key[CONTENT_KEY_LEN_MAX];
+    uint32_t content_size;
+    if(!ObjectManager_store_reference(RIGNTONES_PATH, hash, key, &content_size))
+    {
+        ESP_LOGI(OBJECT_TAG, "Content not known, upload needed");
+        return ESP_OK;
+    }
+
+    // Identical content is already on the card, the new object only references it
+    char file[CONTENT_PATH_LEN_MAX];
+    sprintf(file, RIGNTONES_PATH "/%" PRIx64 RINGTONE_FILE_TYPE, current_object->id);
+    remove(file);
+
+    ringtone_properties_t props;
+    ObjectManager_get_ringtone_properties(current_object->id, &props);
+    props.hash_valid = true;
+    memcpy(props.hash, hash, CONTENT_HASH_SIZE);
+    strcpy(props.content_key, key);
+    ObjectManager_set_ringtone_properties(current_object->id, &props);
+
+    ObjectManager_change_size_in_file(current_object->id, content_size, content_size);
+    *shared = true;
+
+    ESP_LOGI(OBJECT_TAG, "Object %" PRIx64 " shares content %s", current_object->id, key);
+
+    return ESP_OK;
+}
+
+esp_err_t ObjectManager_content_written(uint64_t id, const uint8_t *hash)
+{
+    if(ObjectManager_catalog_is_synthetic(id))
+    {
+        return ESP_OK;
+    }
+
+    ringtone_properties_t props;
+    ObjectManager_get_ringtone_properties(id, &props);
+    if(props.content_key[0])
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char own_file[CONTENT_PATH_LEN_MAX];
+    sprintf(own_file, RIGNTONES_PATH "/%" PRIx64 RINGTONE_FILE_TYPE, id);
+
+    FILE* f = ObjectManager_open_file("r", id);
+    if(f == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    char line[50];
+    char *ptr;
+    fgets(line, sizeof(line), f);
+    uint32_t content_size = strtol(&line[6], &ptr, 16);
+    fclose(f);
+
+    char key[CONTENT_KEY_LEN_MAX];
+    props.hash_valid = true;
+    memcpy(props.hash, hash, CONTENT_HASH_SIZE);
+
+    switch(ObjectManager_store_add(RIGNTONES_PATH, own_file, hash, content_size, key))
+    {
+        case CONTENT_STORE_ADDED:
+        case CONTENT_STORE_SHARED:
+            strcpy(props.content_key, key);
+            ESP_LOGI(OBJECT_TAG, "Object %" PRIx64 " content stored as %s", id, key);
+            break;
+
+        case CONTENT_STORE_COLLISION:
+            ESP_LOGW(OBJECT_TAG, "Content key %s taken by other content", key);
+            break;
+
+        default:
+            ESP_LOGE(OBJECT_TAG, "Cannot store content of object %" PRIx64 " as %s", id, key);
+            return ESP_FAIL;
+    }
+
+    return ObjectManager_set_ringtone_properties(id, &props);
+}
+
+/* Gives the object its own content file before a write, so objects sharing the content stay intact.
+ * Rewriting from scratch just drops the reference, keeping the data is possible only for the last reference.
+ */
+static esp_err_t ObjectManager_content_detach(uint64_t id, bool keep_data)
+{
+    ringtone_properties_t props;
+    ObjectManager_get_ringtone_properties(id, &props);
+    if(props.content_key[0] == '\0')
+    {
+        return ESP_OK;
+    }
+
+    char own_file[CONTENT_PATH_LEN_MAX];
+    sprintf(own_file, RIGNTONES_PATH "/%" PRIx64 RINGTONE_FILE_TYPE, id);
+
+    content_store_result_t res = ObjectManager_store_detach(RIGNTONES_PATH, props.content_key, own_file, keep_data);
+    if(res == CONTENT_STORE_SHARED_BUSY)
+    {
+        ESP_LOGE(OBJECT_TAG, "Content %s shared by other objects", props.content_key);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    else if(res != CONTENT_STORE_DETACHED)
+    {
+        ESP_LOGE(OBJECT_TAG, "Cannot detach content %s", props.content_key);
+        return ESP_FAIL;
+    }
+
+    if(!keep_data)
+    {
+        ObjectManager_preallocate_content(id, current_object->alloc_size);
+    }
+
+    props.hash_valid = false;
+    props.content_key[0] = '\0';
+
+    return ObjectManager_set_ringtone_properties(id, &props);
+}
+
+static void ObjectManager_content_release(uint64_t id)
+{
+    ObjectManager_upload_end(id);
+
+    ringtone_properties_t props;
+    ObjectManager_get_ringtone_properties(id, &props);
+
+    if(props.content_key[0] == '\0')
+    {
+        char file[CONTENT_PATH_LEN_MAX];
+        sprintf(file, RIGNTONES_PATH "/%" PRIx64 RINGTONE_FILE_TYPE, id);
+        ESP_LOGI(OBJECT_TAG, "Content to remove: %s", file);
+        remove(file);
+        return;
+    }
+
+    ESP_LOGI(OBJECT_TAG, "Content %s reference dropped", props.content_key);
+    ObjectManager_store_release(RIGNTONES_PATH, props.content_key);
+}
+
+/* Upload log - binary list of upload_chunk_t records, appended only after the described data was synced
+ * to the card. End of the last record is the committed watermark a broken upload can be resumed from.
+ */
+static char* ObjectManager_upload_log_path(char *bfr, uint64_t id)
+{
+    sprintf(bfr, RIGNTONES_PATH "/%" PRIx64 UPLOAD_LOG_FILE_TYPE, id);
+    return bfr;
+}
+
+esp_err_t ObjectManager_upload_begin(uint64_t id, bool restart)
+{
+    char file[CONTENT_PATH_LEN_MAX];
+    FILE* f = fopen(ObjectManager_upload_log_path(file, id), restart ? "w" : "a");
+    if(f == NULL)
+    {
+        ESP_LOGE(OBJECT_TAG, "Cannot open upload log");
+        return ESP_FAIL;
+    }
+
+    fclose(f);
+    return ESP_OK;
+}
+
+esp_err_t ObjectManager_upload_commit(uint64_t id, upload_chunk_t *chunks, uint32_t count)
+{
+    char file[CONTENT_PATH_LEN_MAX];
+    FILE* f = fopen(ObjectManager_upload_log_path(file, id), "a");
+    if(f == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    fwrite(chunks, sizeof(upload_chunk_t), count, f);
+    fflush(f);
+    fsync(fileno(f));
+    fclose(f);
+
+    return ESP_OK;
+}
+
+esp_err_t ObjectManager_upload_end(uint64_t id)
+{
+    char file[CONTENT_PATH_LEN_MAX];
+    remove(ObjectManager_upload_log_path(file, id));
+    return ESP_OK;
+}
+
+static bool ObjectManager_upload_chunk_valid(uint64_t id, upload_chunk_t *chunk)
+{
+    uint8_t *bfr = malloc(chunk->len);
+    if(bfr == NULL)
+    {
+        return false;
+    }
+
+    bool valid = false;
+    int fd = ObjectManager_open_content(id, O_RDONLY);
+    if(fd >= 0)
+    {
+        if(lseek(fd, chunk->offset, SEEK_SET) >= 0 && read(fd, bfr, chunk->len) == chunk->len)
+        {
+            valid = (esp_rom_crc32_le(0, bfr, chunk->len) == chunk->crc);
+        }
+        close(fd);
+    }
+
+    free(bfr);
+    return valid;
+}
+
+esp_err_t ObjectManager_upload_watermark(uint32_t *watermark, oacp_op_code_result_t *result)
+{
+    if(current_object == NULL)
+    {
+        ESP_LOGE(OBJECT_TAG, "Invalid current object");
+        *result = OACP_RES_INVALID_OBJECT;
+        return ESP_OK;
+    }
+
+    if(!ObjectManager_has_content(current_object))
+    {
+        ESP_LOGE(OBJECT_TAG, "Procedure not permitted");
+        *result = OACP_RES_PROCEDURE_NOT_PERMIT;
+        return ESP_OK;
+    }
+
+    *result = OACP_RES_SUCCESS;
+
+    char file[CONTENT_PATH_LEN_MAX];
+    FILE* f = fopen(ObjectManager_upload_log_path(file, current_object->id), "r+");
+    if(f == NULL)
+    {
+        // No upload in progress, the whole object is committed
+        *watermark = current_object->size;
+        return ESP_OK;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long records = ftell(f) / sizeof(upload_chunk_t);
+    *watermark = 0;
+
+    // Torn write at power loss can only hit the newest chunks, older ones are trusted
+    upload_chunk_t chunk;
+    bool found = false;
+    for(int i=0; i<UPLOAD_VERIFY_STEPS_MAX && records > 0; i++)
+    {
+        fseek(f, (records - 1) * sizeof(upload_chunk_t), SEEK_SET);
+        fread(&chunk, sizeof(upload_chunk_t), 1, f);
+
+        if(ObjectManager_upload_chunk_valid(current_object->id, &chunk))
+        {
+            *watermark = chunk.offset + chunk.len;
+            found = true;
+            break;
+        }
+
+        ESP_LOGW(OBJECT_TAG, "Chunk at %" PRIu32 " does not match its CRC", chunk.offset);
+        records--;
+    }
+
+    if(!found)
+    {
+        records = 0;
+    }
+
+    fclose(f);
+    truncate(file, records * sizeof(upload_chunk_t));
+
+    ESP_LOGI(OBJECT_TAG, "Object %" PRIx64 " upload watermark: %" PRIu32, current_object->id, *watermark);
+
+    return ESP_OK;
+}
+
+/* Allocated size of a ringtone is reserved as one contiguous cluster run, so reading it back
+ * during playback or checksum calculation is a sequential multi-block transfer.
+ * FatFs sets the file length to the reserved size, the object size is kept in the metadata only.
+ */
+static esp_err_t ObjectManager_preallocate_content(uint64_t id, uint32_t alloc_size)
+{
+    char file[CONTENT_PATH_LEN_MAX];
+    sprintf(file, FATFS_DRIVE RINGTONES_DIR "/%" PRIx64 RINGTONE_FILE_TYPE, id);
+
+    FIL fp;
+    FRESULT res = f_open(&fp, file, FA_WRITE | FA_CREATE_ALWAYS);
+    if(res != FR_OK)
+    {
+        ESP_LOGE(OBJECT_TAG, "Cannot create content file, err: %d", res);
+        return ESP_FAIL;
+    }
+
+    if(alloc_size)
+    {
+        res = f_expand(&fp, alloc_size, 1);
+        if(res != FR_OK)
+        {
+            // Not enough contiguous space, the content grows cluster by cluster as it is written
+            ESP_LOGW(OBJECT_TAG, "Cannot preallocate %" PRIu32 " bytes, err: %d", alloc_size, res);
+        }
+    }
+
+    f_close(&fp);
+
+    return (res == FR_OK) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static esp_err_t ObjectManager_get_typed_content_path(uint64_t id, int type, char *bfr, uint32_t *size)
+{
+    if(id == 0 || ObjectManager_list_search(false, id) == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    FILE* f = ObjectManager_open_file("r", id);
+    if(f == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char line[50];
+    char *ptr;
+
+    fgets(line, sizeof(line), f);
+    *size = strtol(&line[6], &ptr, 16);
+
+    for(int i=0; i<5; i++)
+    {
+        fgets(line, sizeof(line), f);
+    }
+
+    char uuid_str[ESP_UUID_LEN_128 * 2 + 1];
+    strncpy(uuid_str, &line[6], sizeof(uuid_str) - 1);
+    uuid_str[sizeof(uuid_str) - 1] = '\0';
+    fclose(f);
+
+    uint8_t uuid[ESP_UUID_LEN_128];
+    char uuid_byte_str[3];
+    for(int i=15; i>=0; i--)
+    {
+        strncpy(uuid_byte_str, &uuid_str[(15-i)*2], 2);
+        uuid_byte_str[2] = '\0';
+        uuid[i] = strtol(uuid_byte_str, &ptr, 16);
+    }
+
+    if(ObjectManager_check_type(uuid) != type)
+    {
+        ESP_LOGE(OBJECT_TAG, "Object %" PRIx64 " is not of type %d", id, type);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ObjectManager_content_path(bfr, id);
+
+    return ESP_OK;
+}
+
+esp_err_t ObjectManager_get_ringtone_path(uint64_t id, char *bfr, uint32_t *size)
+{
+    return ObjectManager_get_typed_content_path(id, RINGTONE_TYPE, bfr, size);
+}
+
+esp_err_t ObjectManager_get_calendar_path(uint64_t id, char *bfr, uint32_t *size)
+{
+    return ObjectManager_get_typed_content_path(id, CALENDAR_TYPE, bfr, size);
+}
+
+int ObjectManager_open_content(uint64_t id, int flags)
+{
+    char file[CONTENT_PATH_LEN_MAX];
+    ObjectManager_content_path(file, id);
+    ESP_LOGI(OBJECT_TAG, "Opened content path: %s", file);
+
+    return open(file, flags, 0666);
+}
+
+esp_err_t ObjectManager_prepare_read(uint32_t offset, uint32_t length, oacp_op_code_result_t *result)
+{
+    if(current_object == NULL)
+    {
+        ESP_LOGE(OBJECT_TAG, "Invalid current object");
+        *result = OACP_RES_INVALID_OBJECT;
+        return ESP_OK;
+    }
+
+    if(!ObjectManager_has_content(current_object) || (current_object->properties & PROPERTY_READ) == 0)
+    {
+        ESP_LOGE(OBJECT_TAG, "Procedure not permitted");
+        *result = OACP_RES_PROCEDURE_NOT_PERMIT;
+        return ESP_OK;
+    }
+
+    if(offset > current_object->size || length > current_object->size - offset)
+    {
+        ESP_LOGE(OBJECT_TAG, "Read outside of the object, offset: %" PRIu32 " length: %" PRIu32, offset, length);
+        *result = OACP_RES_INVALID_PAR;
+        return ESP_OK;
+    }
+
+    *result = OACP_RES_SUCCESS;
+    return ESP_OK;
+}
+
+esp_err_t ObjectManager_prepare_write(uint32_t offset, uint32_t length, uint8_t mode, oacp_op_code_result_t *result)
+{
+    if(current_object == NULL)
+    {
+        ESP_LOGE(OBJECT_TAG, "Invalid current object");
+        *result = OACP_RES_INVALID_OBJECT;
+        return ESP_OK;
+    }
+
+    bool truncate_rest = mode & OACP_WRITE_MODE_TRUNCATE;
+    uint32_t properties = current_object->properties;
+
+    if(!ObjectManager_has_content(current_object) || (properties & PROPERTY_WRITE) == 0)
+    {
+        ESP_LOGE(OBJECT_TAG, "Procedure not permitted");
+        *result = OACP_RES_PROCEDURE_NOT_PERMIT;
+        return ESP_OK;
+    }
+
+    if(offset > current_object->size || (uint64_t)offset + length > UINT32_MAX)
+    {
+        ESP_LOGE(OBJECT_TAG, "Write outside of the object, offset: %" PRIu32 " length: %" PRIu32, offset, length);
+        *result = OACP_RES_INVALID_PAR;
+        return ESP_OK;
+    }
+
+    if(truncate_rest && (properties & PROPERTY_TRUNCATE) == 0)
+    {
+        ESP_LOGE(OBJECT_TAG, "Truncate not permitted");
+        *result = OACP_RES_PROCEDURE_NOT_PERMIT;
+        return ESP_OK;
+    }
+
+    // Rewriting the whole object from the start with truncation is a replace, not a patch
+    if(offset < current_object->size && (properties & PROPERTY_PATCH) == 0 && !(offset == 0 && truncate_rest))
+    {
+        ESP_LOGE(OBJECT_TAG, "Patch not permitted");
+        *result = OACP_RES_PROCEDURE_NOT_PERMIT;
+        return ESP_OK;
+    }
+
+    if(offset + length > current_object->size && (properties & PROPERTY_APPEND) == 0)
+    {
+        ESP_LOGE(OBJECT_TAG, "Append not permitted");
+        *result = OACP_RES_PROCEDURE_NOT_PERMIT;
+        return ESP_OK;
+    }
+
+    if(ObjectManager_content_detach(current_object->id, !(offset == 0 && truncate_rest)) != ESP_OK)
+    {
+        *result = OACP_RES_PROCEDURE_NOT_PERMIT;
+        return ESP_OK;
+    }
+
+    *result = OACP_RES_SUCCESS;
+    return ESP_OK;
+}
+
+esp_err_t ObjectManager_finish_write(uint64_t id, uint32_t end_offset, bool truncate_rest)
+{
+    if(id == CATALOG_IMPORT_ID)
+    {
+        if(current_object != NULL && current_object->id == id)
+        {
+            current_object->size = ObjectTransfer_stream_end_size(current_object->size, end_offset, false);
+        }
+
+        if(!truncate_rest)
+        {
+            return ESP_OK;
+        }
+
+        // Archive is complete, apply it and drop the received copy
+        truncate(CATALOG_IMPORT_PATH, end_offset);
+        esp_err_t ret = ObjectManager_catalog_import(CATALOG_IMPORT_PATH, end_offset);
+        remove(CATALOG_IMPORT_PATH);
+
+        if(current_object != NULL && current_object->id == id)
+        {
+            current_object->size = 0;
+        }
+
+        return ret;
+    }
+
+    FILE* f = ObjectManager_open_file("r", id);
+    if(f == NULL)
+    {
+        ESP_LOGE(OBJECT_TAG, "Object file not found");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char line[50];
+    char *ptr;
+
+    fgets(line, sizeof(line), f);
+    uint32_t size = strtol(&line[6], &ptr, 16);
+
+    fgets(line, sizeof(line), f);
+    uint32_t alloc_size = strtol(&line[16], &ptr, 16);
+    fclose(f);
+
+    size = ObjectTransfer_stream_end_size(size, end_offset, truncate_rest);
+    if(size > alloc_size)
+    {
+        alloc_size = size;
+    }
+
+    if(truncate_rest)
+    {
+        // Truncation gives the preallocated clusters past the new end back to the card
+        alloc_size = size;
+
+        char file[CONTENT_PATH_LEN_MAX];
+        ObjectManager_content_path(file, id);
+        truncate(file, size);
+    }
+
+    ESP_LOGI(OBJECT_TAG, "Object %" PRIx64 " written, size: %" PRIu32, id, size);
+
+    esp_err_t ret = ObjectManager_change_size_in_file(id, size, alloc_size);
+    if(ret) return ret;
+
+    // Content changed, the cached checksum no longer describes it
+    ringtone_properties_t props;
+    ObjectManager_get_ringtone_properties(id, &props);
+    props.checksum_valid = false;
+    props.hash_valid = false;
+
+    ret = ObjectManager_set_ringtone_properties(id, &props);
+
+    // Alarms skipping days of a calendar move with its new content, other objects are used by no alarm
+    alarm_scheduler_calendar_changed(id);
+
+    return ret;
+}
+
+esp_err_t ObjectManager_prepare_checksum(uint32_t offset, uint32_t length, oacp_op_code_result_t *result)
+{
+    if(current_object == NULL)
+    {
+        ESP_LOGE(OBJECT_TAG, "Invalid current object");
+        *result = OACP_RES_INVALID_OBJECT;
+        return ESP_OK;
+    }
+
+    if(!ObjectManager_has_content(current_object))
+    {
+        ESP_LOGE(OBJECT_TAG, "Procedure not permitted");
+        *result = OACP_RES_PROCEDURE_NOT_PERMIT;
+        return ESP_OK;
+    }
+
+    if(offset > current_object->size || length > current_object->size - offset)
+    {
+        ESP_LOGE(OBJECT_TAG, "Checksum outside of the object, offset: %" PRIu32 " length: %" PRIu32, offset, length);
+        *result = OACP_RES_INVALID_PAR;
+        return ESP_OK;
+    }
+
+    *result = OACP_RES_SUCCESS;
+    return ESP_OK;
+}
+
+esp_err_t ObjectManager_get_ringtone_properties(uint64_t id, ringtone_properties_t *props)
+{
+    memset(props, 0, sizeof(ringtone_properties_t));
+
+    FILE* f = ObjectManager_open_file("r", id);
+    if(f == NULL)
+    {
+        ESP_LOGE(OBJECT_TAG, "Object file not found");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    fpos_t pos;
+    if(!seekfor(f, "RINGTONE PROPERTIES\n", &pos))
+    {
+        fclose(f);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char line[100];
+    char *ptr;
+
+    fgets(line, sizeof(line), f);
+    props->checksum_valid = strtol(&line[strlen("Checksum valid: ")], &ptr, 16);
+
+    fgets(line, sizeof(line), f);
+    props->checksum = strtoul(&line[strlen("Checksum: ")], &ptr, 16);
+
+    // Objects written before deduplication have no hash lines
+    if(fgets(line, sizeof(line), f))
+    {
+        props->hash_valid = strtol(&line[strlen("Hash valid: ")], &ptr, 16);
+
+        fgets(line, sizeof(line), f);
+        char hash_byte_str[3];
+        for(int i=0; i<CONTENT_HASH_SIZE; i++)
+        {
+            strncpy(hash_byte_str, &line[strlen("Hash: ") + i*2], 2);
+            hash_byte_str[2] = '\0';
+            props->hash[i] = strtol(hash_byte_str, &ptr, 16);
+        }
+
+        fgets(line, sizeof(line), f);
+        sscanf(&line[strlen("Content: ")], "%19s", props->content_key);
+    }
+
+    fclose(f);
+
+    return ESP_OK;
+}
+
+esp_err_t ObjectManager_set_ringtone_properties(uint64_t id, ringtone_properties_t *props)
+{
+    FILE* f = ObjectManager_open_file("r+", id);
+    if(f == NULL)
+    {
+        ESP_LOGE(OBJECT_TAG, "Object file not found");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    fseek(f, 0, SEEK_SET);
+    fpos_t ringtonePosition;
+    bool found = seekfor(f, "RINGTONE PROPERTIES\n", &ringtonePosition);
+    fsetpos(f, &ringtonePosition);
+
+    if(!found) fprintf(f, "\n");
+    fprintf(f, "RINGTONE PROPERTIES\n");
+    fprintf(f, "Checksum valid: %01x\n", props->checksum_valid);
+    fprintf(f, "Checksum: %08" PRIx32 "\n", props->checksum);
+
+    char hash_str[CONTENT_HASH_SIZE * 2 + 1];
+    ObjectManager_hash_to_string(hash_str, props->hash);
+    fprintf(f, "Hash valid: %01x\n", props->hash_valid);
+    fprintf(f, "Hash: %s\n", hash_str);
+    fprintf(f, "Content: %s\n", props->content_key);
+
+    uint32_t truncate_offset = ftell(f);
+    fclose(f);
+    ObjectManager_truncate_rest(id, truncate_offset);
+
+    return ESP_OK;
+}
+
+static char* id_to_string(char* bfr, uint64_t id)
+{
+    char number[20];
+
+    if(strcmp(itoa(id>>32, number, 16), "0"))
+    {
+        strcat(bfr, itoa(id>>32, number, 16));
+    }
+
+    strcpy(bfr, itoa((uint32_t)id, number, 16));
+
+    return bfr;
+}
+
+static void ObjectManager_print_file()
+{
+    // if(current_object == NULL)
+    // {
+    //     return;
+    // }
+
+    // FILE* f = ObjectManager_open_file("r", current_object->id);
+
+    // char line[70];
+
+    // while(fgets(line, sizeof(line), f))
+    // {
+    //     printf("%s", line);
+    // }
+
+    // fclose(f);
+}
+
+void ObjectManager_printf_alarm_info()
+{
+    // if(current_object == NULL) return;
+
+    // FILE* f = ObjectManager_open_file("r", current_object->id);
+    // fpos_t pos;
+    // bool found = seekfor(f, "ALARM PROPERTIES\n", &pos);
+    // fclose(f);
+
+    // if(found)
+    // {
+    //     alarm_mode_args_t alarm = get_alarm_values();
+    //     printf("State: %s\n", alarm.enable?"enabled":"disabled");
+
+    //     switch(alarm.mode)
+    //     {
+    //         case ALARM_SINGLE_MODE:
+    //             printf("Mode: single\n");
+    //             break;
+
+    //         case ALARM_WEEKLY_MODE:
+    //             printf("Mode: weekly\n");
+    //             break;
+
+    //         case ALARM_MONTHLY_MODE:
+    //             printf("Mode: monthly\n");
+    //             break;
+
+    //         case ALARM_YEARLY_MODE:
+    //             printf("Mode: yearly\n");
+    //             break;
+    //     }
 
     //     printf("Description length: %u\n", alarm.desc_len);
     //     printf("Description: %s\n", alarm.desc);
@@ -698,32 +1796,42 @@ static void ObjectManager_set_current_object_from_file(uint64_t id)
         current_object = (object_t*)malloc(sizeof(object_t));
     }
 
+    ObjectManager_read_object(id, current_object, get_alarm_pointer());
+}
+
+esp_err_t ObjectManager_read_object(uint64_t id, object_t *object, alarm_mode_args_t *alarm_p)
+{
     FILE* f = ObjectManager_open_file("r", id);
+    if(f == NULL)
+    {
+        ESP_LOGE(OBJECT_TAG, "No metadata for object %" PRIx64, id);
+        return ESP_ERR_NOT_FOUND;
+    }
 
     char line[50];
     char *ptr;
 
     fgets(line, sizeof(line), f);
     uint32_t size = strtol(&line[6], &ptr, 16);
-    current_object->size = size;
+    object->size = size;
 
     fgets(line, sizeof(line), f);
     uint32_t alloc_size = strtol(&line[16], &ptr, 16);
-    current_object->alloc_size = alloc_size;
+    object->alloc_size = alloc_size;
 
     fgets(line, sizeof(line), f);
 
     char name_len_str[20];
     fgets(name_len_str, sizeof(name_len_str), f);
     uint8_t name_len = atoi(&name_len_str[13]);
-    current_object->name_len = name_len;
+    object->name_len = name_len;
 
-    strncpy(current_object->name, &line[6], name_len);
-    current_object->name[name_len] = '\0';
+    strncpy(object->name, &line[6], name_len);
+    object->name[name_len] = '\0';
 
     fgets(line, sizeof(line), f);
     uint8_t uuid_type = atoi(&line[11]);
-    current_object->type.len = uuid_type;
+    object->type.len = uuid_type;
 
     fgets(line, sizeof(line), f);
     char uuid_byte_str[3];
@@ -733,30 +1841,29 @@ static void ObjectManager_set_current_object_from_file(uint64_t id)
         strncpy(uuid_byte_str, &line[6+(15-i)*2], 2);
         uuid_byte_str[2] = '\0';
         uuid_byte = strtol(uuid_byte_str, &ptr, 16);
-        current_object->type.uuid.uuid128[i] = uuid_byte;
+        object->type.uuid.uuid128[i] = uuid_byte;
     }
 
     fgets(line, sizeof(line), f);
-    current_object->properties = strtol(&line[12], &ptr, 16);
+    object->properties = strtol(&line[12], &ptr, 16);
 
-    current_object->id = id;
+    object->id = id;
 
-    int ret_type = ObjectManager_check_type(current_object->type.uuid.uuid128);
+    int ret_type = ObjectManager_check_type(object->type.uuid.uuid128);
 
     switch(ret_type)
     {
         case ALARM_TYPE:
         {
-            alarm_mode_args_t * alarm_p = get_alarm_pointer();
             fpos_t pos;
             bool found = seekfor(f, "ALARM PROPERTIES\n", &pos);
             if(!found)
             {
-                current_object->set_custom_object = false;
+                object->set_custom_object = false;
                 break;
             }
 
-            current_object->set_custom_object = true;
+            object->set_custom_object = true;
 
             char line[70];
             char *ptr;
@@ -823,16 +1930,64 @@ static void ObjectManager_set_current_object_from_file(uint64_t id)
 
             fgets(line, sizeof(line), f);
             alarm_p->volume = strtol(&line[strlen("Volume: ") ], &ptr, 16);
+
+            alarm_p->ringtone_id = 0;
+            alarm_p->group = ALARM_GROUP_NONE;
+            alarm_p->nap = 0;
+            alarm_p->nap_repeats = 0;
+            alarm_p->ring_duration = 0;
+            alarm_p->calendar_id = 0;
+            alarm_p->rise = ALARM_RISE_NONE;
+            alarm_p->rise_time = 0;
+            if(fgets(line, sizeof(line), f))
+            {
+                alarm_p->ringtone_id = strtoull(&line[strlen("Ringtone: ") ], &ptr, 16);
+            }
+            if(fgets(line, sizeof(line), f))
+            {
+                alarm_p->group = strtol(&line[strlen("Group: ") ], &ptr, 16);
+            }
+            if(fgets(line, sizeof(line), f))
+            {
+                alarm_p->nap = strtol(&line[strlen("Nap: ") ], &ptr, 16);
+            }
+            if(fgets(line, sizeof(line), f))
+            {
+                alarm_p->nap_repeats = strtol(&line[strlen("Nap repeats: ") ], &ptr, 16);
+            }
+            if(fgets(line, sizeof(line), f))
+            {
+                alarm_p->ring_duration = strtol(&line[strlen("Ring duration: ") ], &ptr, 16);
+            }
+            if(fgets(line, sizeof(line), f))
+            {
+                alarm_p->calendar_id = strtoull(&line[strlen("Calendar: ") ], &ptr, 16);
+            }
+            if(fgets(line, sizeof(line), f))
+            {
+                alarm_p->rise = strtol(&line[strlen("Rise: ") ], &ptr, 16);
+            }
+            if(fgets(line, sizeof(line), f))
+            {
+                alarm_p->rise_time = strtol(&line[strlen("Rise time: ") ], &ptr, 16);
+            }
             
             break;
         }
 
         case RINGTONE_TYPE:
             ESP_LOGI(OBJECT_TAG, "Requested object type: Ringtone file");
+            object->set_custom_object = false;
+            break;
+
+        case CALENDAR_TYPE:
+            object->set_custom_object = false;
             break;
     }
 
     fclose(f);
+
+    return ESP_OK;
 }
 
 bool seekfor(FILE *stream, const char* str, fpos_t *pos)
@@ -877,6 +2032,7 @@ int ObjectManager_check_type(uint8_t *uuid)
 {
     if(memcmp(uuid, alarm_type_uuid, ESP_UUID_LEN_128) == 0) return ALARM_TYPE;
     else if(memcmp(uuid, ringtone_type_uuid, ESP_UUID_LEN_128) == 0) return RINGTONE_TYPE;
+    else if(memcmp(uuid, calendar_type_uuid, ESP_UUID_LEN_128) == 0) return CALENDAR_TYPE;
     else return -1;
 }
 
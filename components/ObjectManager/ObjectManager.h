@@ -5,10 +5,13 @@
 #include "esp_gatts_api.h"
 #include "ObjectTransfer_defs.h"
 #include "alarm.h"
+#include "ObjectManagerContentStore.h"
 
 #define DATA_LEN_MAX 2000
 #define NAME_LEN_MAX 32
 #define FLASH_PAGE 256
+#define CONTENT_PATH_LEN_MAX 48
+#define UPLOAD_VERIFY_STEPS_MAX 4
 
 #define PROPERTY_DELETE             (1<<0)
 #define PROPERTY_EXECUTE            (1<<1)
@@ -23,6 +26,12 @@
 
 #define TYPE_UNSPECIFIED_    0xCA2A    //inversed of little endian
 
+#define OACP_WRITE_MODE_TRUNCATE    (1<<1)
+
+#define BULK_SCOPE_ALL      0
+#define BULK_SCOPE_GROUP    1
+#define BULK_SCOPE_FILTER   2
+
 typedef enum {
     WAIT_FOR_ACTION = 0,
     WAIT_FOR_FILE_TYPE,
@@ -48,12 +57,45 @@ typedef struct object{
 
 #define ALARM_TYPE 0
 #define RINGTONE_TYPE 1
+#define CALENDAR_TYPE 2     // exception calendar, content described in alarm_scheduler.h
+
+typedef struct ringtone_properties{
+    bool checksum_valid;
+    uint32_t checksum;
+    bool hash_valid;
+    uint8_t hash[CONTENT_HASH_SIZE];     // SHA-256 of the content
+    char content_key[CONTENT_KEY_LEN_MAX];  // shared content file, empty - object owns <id>.wav
+} ringtone_properties_t;
+
+typedef struct upload_chunk{
+    uint32_t offset;
+    uint32_t len;
+    uint32_t crc;
+} upload_chunk_t;
 
 esp_err_t ObjectManager_init(void);
 object_t* ObjectManager_get_object(void);
 void ObjectManager_null_current_object(void);
 esp_err_t ObjectManager_create_object(uint32_t size, esp_bt_uuid_t type, oacp_op_code_result_t *result);
+esp_err_t ObjectManager_get_ringtone_path(uint64_t id, char *bfr, uint32_t *size);
+esp_err_t ObjectManager_get_calendar_path(uint64_t id, char *bfr, uint32_t *size);
+esp_err_t ObjectManager_create_object_by_hash(uint32_t size, esp_bt_uuid_t type, const uint8_t *hash, bool *shared, oacp_op_code_result_t *result);
+esp_err_t ObjectManager_content_written(uint64_t id, const uint8_t *hash);
+esp_err_t ObjectManager_upload_begin(uint64_t id, bool restart);
+esp_err_t ObjectManager_upload_commit(uint64_t id, upload_chunk_t *chunks, uint32_t count);
+esp_err_t ObjectManager_upload_end(uint64_t id);
+esp_err_t ObjectManager_upload_watermark(uint32_t *watermark, oacp_op_code_result_t *result);
 esp_err_t ObjectManager_delete_object(oacp_op_code_result_t *result);
+esp_err_t ObjectManager_add_object(object_t *object);
+esp_err_t ObjectManager_remove_object(object_t *object);
+void ObjectManager_discard_object(object_t *object);
+esp_err_t ObjectManager_read_object(uint64_t id, object_t *object, alarm_mode_args_t *alarm_p);
+esp_err_t ObjectManager_write_object(object_t *object, alarm_mode_args_t *alarm);
+esp_err_t ObjectManager_stage_object(object_t *object, alarm_mode_args_t *alarm, const char *path);
+esp_err_t ObjectManager_install_object(object_t *object, alarm_mode_args_t *alarm, const char *path);
+esp_err_t ObjectManager_stage_list(const char *path, const uint64_t *removed, uint8_t removed_count);
+esp_err_t ObjectManager_install_list(const char *path);
+esp_err_t ObjectManager_bulk_enable(uint8_t scope, uint8_t group, uint8_t enable, uint16_t *changed, oacp_op_code_result_t *result);
 
 esp_err_t ObjectManager_first_object(olcp_op_code_result_t *result);
 esp_err_t ObjectManager_last_object(olcp_op_code_result_t *result);
@@ -67,6 +109,17 @@ esp_err_t ObjectManager_clear_marking(olcp_op_code_result_t *result);
 esp_err_t ObjectManager_change_name_in_file();
 esp_err_t ObjectManager_change_properties_in_file();
 esp_err_t ObjectManager_change_alarm_data_in_file(alarm_mode_args_t alarm);
+esp_err_t ObjectManager_change_size_in_file(uint64_t id, uint32_t size, uint32_t alloc_size);
+esp_err_t ObjectManager_prepare_read(uint32_t offset, uint32_t length, oacp_op_code_result_t *result);
+esp_err_t ObjectManager_prepare_write(uint32_t offset, uint32_t length, uint8_t mode, oacp_op_code_result_t *result);
+esp_err_t ObjectManager_finish_write(uint64_t id, uint32_t end_offset, bool truncate_rest);
+esp_err_t ObjectManager_prepare_checksum(uint32_t offset, uint32_t length, oacp_op_code_result_t *result);
+esp_err_t ObjectManager_get_ringtone_properties(uint64_t id, ringtone_properties_t *props);
+esp_err_t ObjectManager_set_ringtone_properties(uint64_t id, ringtone_properties_t *props);
+bool ObjectManager_has_content(object_t *object);
+bool ObjectManager_type_has_content(int type);
+char* ObjectManager_content_path(char* bfr, uint64_t id);
+int ObjectManager_open_content(uint64_t id, int flags);
 void ObjectManager_printf_alarm_info();
 bool seekfor(FILE *stream, const char* str, fpos_t *pos);
 FILE* ObjectManager_open_file(const char* option,  uint64_t id);
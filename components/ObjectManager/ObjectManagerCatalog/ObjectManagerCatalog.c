@@ -0,0 +1,535 @@
+#include "ObjectManagerCatalog.h"
+#include "ObjectManager.h"
+#include "ObjectManagerIdList.h"
+#include "FilterOrder.h"
+#include "project_defs.h"
+#include "alarm.h"
+#include "alarm_history.h"
+#include "alarm_scheduler.h"
+
+#include "esp_log.h"
+#include "mbedtls/sha256.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define TAG "CATALOG"
+
+#define CATALOG_ID_SIZE         6
+#define CATALOG_HEAD_MAX        160     // object, alarm and content record headers of one object
+#define CATALOG_COPY_CHUNK      4096
+
+static uint8_t catalog_archive_uuid[ESP_UUID_LEN_128] = {0x04, 0x00, 0x12, 0xAC, 0x42, 0x02, 0x61, 0xA2, 0xED, 0x11, 0xBA, 0x29, 0xB8, 0x13, 0x08, 0xCC};
+static uint8_t catalog_history_uuid[ESP_UUID_LEN_128] = {0x07, 0x00, 0x12, 0xAC, 0x42, 0x02, 0x61, 0xA2, 0xED, 0x11, 0xBA, 0x29, 0xB8, 0x13, 0x08, 0xCC};
+static uint8_t catalog_import_uuid[ESP_UUID_LEN_128] = {0x05, 0x00, 0x12, 0xAC, 0x42, 0x02, 0x61, 0xA2, 0xED, 0x11, 0xBA, 0x29, 0xB8, 0x13, 0x08, 0xCC};
+
+/* Archive is generated on every read. Reads arrive in order, so the walk resumes from the
+ * last object which started before the requested offset instead of parsing all metadata again.
+ */
+typedef struct {
+    bool valid;
+    bool with_content;
+    uint8_t phase;
+    uint64_t id;
+    uint32_t pos;
+} catalog_cursor_t;
+
+typedef struct {
+    uint64_t from;
+    uint64_t to;
+} catalog_map_t;
+
+static catalog_cursor_t cursor = {0};
+
+bool ObjectManager_catalog_is_synthetic(uint64_t id)
+{
+    return id == CATALOG_ARCHIVE_ID || id == CATALOG_ARCHIVE_FULL_ID || id == CATALOG_IMPORT_ID || id == CATALOG_HISTORY_ID;
+}
+
+bool ObjectManager_catalog_is_archive(uint64_t id)
+{
+    return id == CATALOG_ARCHIVE_ID || id == CATALOG_ARCHIVE_FULL_ID;
+}
+
+/* Objects without a content file, their bytes come from ObjectManager_catalog_read */
+bool ObjectManager_catalog_is_generated(uint64_t id)
+{
+    return ObjectManager_catalog_is_archive(id) || id == CATALOG_HISTORY_ID;
+}
+
+static uint8_t* ObjectManager_catalog_put_record(uint8_t *p, uint8_t tag, uint32_t len)
+{
+    *p++ = tag;
+    memcpy(p, &len, 4);
+    return p + 4;
+}
+
+static uint16_t ObjectManager_catalog_object_head(uint8_t *head, object_t *object, alarm_mode_args_t *alarm, bool with_content)
+{
+    uint8_t *p = ObjectManager_catalog_put_record(head, CATALOG_REC_OBJECT, CATALOG_ID_SIZE + ESP_UUID_LEN_128 + 4 + 4 + 1 + object->name_len);
+
+    memcpy(p, &object->id, CATALOG_ID_SIZE);
+    p += CATALOG_ID_SIZE;
+    memcpy(p, object->type.uuid.uuid128, ESP_UUID_LEN_128);
+    p += ESP_UUID_LEN_128;
+    memcpy(p, &object->properties, 4);
+    p += 4;
+    uint32_t size = with_content ? object->size : 0;
+    memcpy(p, &size, 4);
+    p += 4;
+    *p++ = object->name_len;
+    memcpy(p, object->name, object->name_len);
+    p += object->name_len;
+
+    if(ObjectManager_check_type(object->type.uuid.uuid128) == ALARM_TYPE && object->set_custom_object)
+    {
+        uint8_t payload[ALARM_MODE_PAYLOAD_SIZE_MAX];
+        uint16_t payload_len = pack_alarm_values(alarm, payload);
+        p = ObjectManager_catalog_put_record(p, CATALOG_REC_ALARM, payload_len);
+        memcpy(p, payload, payload_len);
+        p += payload_len;
+    }
+
+    if(with_content)
+    {
+        p = ObjectManager_catalog_put_record(p, CATALOG_REC_CONTENT, object->size);
+    }
+
+    return p - head;
+}
+
+/* Copies the part of [pos, pos + n) which falls into the requested window */
+static void ObjectManager_catalog_copy(const uint8_t *src, uint32_t n, uint32_t pos, uint32_t offset, uint8_t *buf, uint32_t len, uint32_t *copied)
+{
+    uint32_t start = (pos > offset) ? pos : offset;
+    uint32_t end = (pos + n < offset + len) ? pos + n : offset + len;
+
+    if(start < end)
+    {
+        memcpy(&buf[start - offset], &src[start - pos], end - start);
+        *copied += end - start;
+    }
+}
+
+static esp_err_t ObjectManager_catalog_copy_content(uint64_t id, uint32_t n, uint32_t pos, uint32_t offset, uint8_t *buf, uint32_t len, uint32_t *copied)
+{
+    uint32_t start = (pos > offset) ? pos : offset;
+    uint32_t end = (pos + n < offset + len) ? pos + n : offset + len;
+
+    if(start >= end)
+    {
+        return ESP_OK;
+    }
+
+    int fd = ObjectManager_open_content(id, O_RDONLY);
+    if(fd < 0)
+    {
+        return ESP_FAIL;
+    }
+
+    ssize_t bytes_read = -1;
+    if(lseek(fd, start - pos, SEEK_SET) >= 0)
+    {
+        bytes_read = read(fd, &buf[start - offset], end - start);
+    }
+    close(fd);
+
+    if(bytes_read != end - start)
+    {
+        ESP_LOGE(TAG, "Content of %" PRIx64 " shorter than its size", id);
+        return ESP_FAIL;
+    }
+
+    *copied += end - start;
+    return ESP_OK;
+}
+
+/* Walks the archive layout, copying the window [offset, offset + len) into buf when given.
+ * Without buf the whole layout is walked and the archive size returned in total.
+ */
+static esp_err_t ObjectManager_catalog_walk(bool with_content, uint32_t offset, uint8_t *buf, uint32_t len, uint32_t *copied, uint32_t *total)
+{
+    uint8_t head[CATALOG_HEAD_MAX];
+    uint32_t pos = 0;
+    uint8_t phase = 0;
+    object_t object;
+    alarm_mode_args_t alarm;
+
+    *copied = 0;
+
+    memcpy(head, CATALOG_MAGIC, CATALOG_MAGIC_SIZE);
+    head[CATALOG_MAGIC_SIZE] = CATALOG_VERSION;
+    head[CATALOG_MAGIC_SIZE + 1] = with_content ? CATALOG_FLAG_CONTENT : 0;
+    if(buf) ObjectManager_catalog_copy(head, CATALOG_HEADER_SIZE, pos, offset, buf, len, copied);
+    pos += CATALOG_HEADER_SIZE;
+
+    object_id_list_t *elem = ObjectManager_list_first_elem();
+
+    if(buf && cursor.valid && cursor.with_content == with_content && offset >= cursor.pos)
+    {
+        object_id_list_t *resume = ObjectManager_list_search(false, cursor.id);
+        if(resume)
+        {
+            elem = resume;
+            pos = cursor.pos;
+            phase = cursor.phase;
+        }
+    }
+
+    // Phase 0 emits ringtones and calendars, phase 1 everything else
+    for(; phase < 2; phase++, elem = ObjectManager_list_first_elem())
+    {
+        for(; elem != NULL; elem = elem->next)
+        {
+            if(buf && pos >= offset + len)
+            {
+                return ESP_OK;
+            }
+
+            if(ObjectManager_read_object(elem->id, &object, &alarm) != ESP_OK) continue;
+
+            int type = ObjectManager_check_type(object.type.uuid.uuid128);
+            if(type < 0 || (phase == 0) != ObjectManager_type_has_content(type)) continue;
+
+            if(buf && pos <= offset)
+            {
+                cursor = (catalog_cursor_t){ .valid = true, .with_content = with_content, .phase = phase, .id = elem->id, .pos = pos };
+            }
+
+            bool content = with_content && ObjectManager_type_has_content(type);
+            uint16_t head_len = ObjectManager_catalog_object_head(head, &object, &alarm, content);
+            if(buf) ObjectManager_catalog_copy(head, head_len, pos, offset, buf, len, copied);
+            pos += head_len;
+
+            if(content)
+            {
+                if(buf && ObjectManager_catalog_copy_content(object.id, object.size, pos, offset, buf, len, copied) != ESP_OK)
+                {
+                    return ESP_FAIL;
+                }
+                pos += object.size;
+            }
+        }
+    }
+
+    ObjectManager_catalog_put_record(head, CATALOG_REC_END, 0);
+    if(buf) ObjectManager_catalog_copy(head, CATALOG_REC_HEADER_SIZE, pos, offset, buf, len, copied);
+    pos += CATALOG_REC_HEADER_SIZE;
+
+    if(total) *total = pos;
+
+    return ESP_OK;
+}
+
+esp_err_t ObjectManager_catalog_describe(uint64_t id, object_t *object)
+{
+    memset(object, 0, sizeof(object_t));
+    object->id = id;
+    object->type.len = ESP_UUID_LEN_128;
+
+    if(ObjectManager_catalog_is_archive(id))
+    {
+        uint32_t copied, total = 0;
+        ObjectManager_catalog_walk(id == CATALOG_ARCHIVE_FULL_ID, 0, NULL, 0, &copied, &total);
+        cursor.valid = false;
+
+        strcpy(object->name, (id == CATALOG_ARCHIVE_FULL_ID) ? "catalog_full.nca" : "catalog.nca");
+        memcpy(object->type.uuid.uuid128, catalog_archive_uuid, ESP_UUID_LEN_128);
+        object->size = total;
+        object->properties = PROPERTY_READ;
+    }
+    else if(id == CATALOG_HISTORY_ID)
+    {
+        strcpy(object->name, "history.log");
+        memcpy(object->type.uuid.uuid128, catalog_history_uuid, ESP_UUID_LEN_128);
+        object->size = alarm_history_size();
+        object->properties = PROPERTY_READ;
+    }
+    else if(id == CATALOG_IMPORT_ID)
+    {
+        // A partially received archive stays on the card, so the import can be resumed
+        struct stat st;
+        strcpy(object->name, "import.nca");
+        memcpy(object->type.uuid.uuid128, catalog_import_uuid, ESP_UUID_LEN_128);
+        object->size = (stat(CATALOG_IMPORT_PATH, &st) == 0) ? st.st_size : 0;
+        object->properties = PROPERTY_WRITE | PROPERTY_APPEND | PROPERTY_TRUNCATE | PROPERTY_PATCH;
+    }
+    else
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    object->name_len = strlen(object->name);
+    object->alloc_size = object->size;
+    object->set_custom_object = false;
+
+    return ESP_OK;
+}
+
+int32_t ObjectManager_catalog_read(uint64_t id, uint32_t offset, uint8_t *buf, uint32_t len)
+{
+    if(id == CATALOG_HISTORY_ID)
+    {
+        return alarm_history_read(offset, buf, len);
+    }
+
+    uint32_t copied;
+    if(ObjectManager_catalog_walk(id == CATALOG_ARCHIVE_FULL_ID, offset, buf, len, &copied, NULL) != ESP_OK)
+    {
+        return -1;
+    }
+
+    return copied;
+}
+
+static uint64_t ObjectManager_catalog_map(catalog_map_t *map, uint32_t count, uint64_t from, int type)
+{
+    for(uint32_t i=0; i<count; i++)
+    {
+        if(map[i].from == from) return map[i].to;
+    }
+
+    // Object not in the archive - keep it when this clock has it, otherwise fall back to the default ringtone or no calendar
+    char path[CONTENT_PATH_LEN_MAX];
+    uint32_t size;
+    esp_err_t ret = (type == CALENDAR_TYPE) ? ObjectManager_get_calendar_path(from, path, &size) : ObjectManager_get_ringtone_path(from, path, &size);
+    return (ret == ESP_OK) ? from : 0;
+}
+
+static esp_err_t ObjectManager_catalog_import_content(FILE *src, object_t *object, uint8_t *chunk)
+{
+    object->alloc_size = object->size;
+    if(ObjectManager_add_object(object) != ESP_OK || ObjectManager_write_object(object, NULL) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+
+    ringtone_properties_t props = {0};
+    ObjectManager_set_ringtone_properties(object->id, &props);
+
+    int fd = ObjectManager_open_content(object->id, O_WRONLY | O_CREAT | O_TRUNC);
+    if(fd < 0)
+    {
+        return ESP_FAIL;
+    }
+
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+
+    uint32_t remaining = object->size;
+    while(remaining)
+    {
+        uint32_t n = (remaining > CATALOG_COPY_CHUNK) ? CATALOG_COPY_CHUNK : remaining;
+        if(fread(chunk, 1, n, src) != n || write(fd, chunk, n) != n)
+        {
+            break;
+        }
+        mbedtls_sha256_update(&sha, chunk, n);
+        remaining -= n;
+    }
+    close(fd);
+
+    uint8_t hash[CONTENT_HASH_SIZE];
+    mbedtls_sha256_finish(&sha, hash);
+    mbedtls_sha256_free(&sha);
+
+    if(remaining)
+    {
+        ESP_LOGE(TAG, "Content body of %" PRIx64 " cut short", object->id);
+        return ESP_FAIL;
+    }
+
+    // Same deduplication as for uploaded ringtones
+    ObjectManager_content_written(object->id, hash);
+    // Alarms imported after it use a calendar only once it is decoded in memory
+    alarm_scheduler_calendar_changed(object->id);
+
+    return ESP_OK;
+}
+
+/* Applies a received archive in one pass. Objects are added next to the existing ones with new IDs,
+ * alarm ringtone and calendar references are translated to the IDs the imported objects got.
+ */
+esp_err_t ObjectManager_catalog_import(const char *path, uint32_t size)
+{
+    FILE *f = fopen(path, "r");
+    if(f == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint8_t header[CATALOG_HEADER_SIZE];
+    if(fread(header, 1, CATALOG_HEADER_SIZE, f) != CATALOG_HEADER_SIZE || memcmp(header, CATALOG_MAGIC, CATALOG_MAGIC_SIZE) != 0 || header[CATALOG_MAGIC_SIZE] != CATALOG_VERSION)
+    {
+        ESP_LOGE(TAG, "Not a catalog archive");
+        fclose(f);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t *chunk = malloc(CATALOG_COPY_CHUNK);
+    catalog_map_t *map = NULL;
+    uint32_t map_count = 0;
+    uint32_t imported = 0;
+
+    object_t object;
+    uint64_t archived_id = 0;
+    bool pending = false;
+    esp_err_t ret = (chunk == NULL) ? ESP_ERR_NO_MEM : ESP_OK;
+
+    while(ret == ESP_OK)
+    {
+        uint8_t rec[CATALOG_REC_HEADER_SIZE];
+        if(fread(rec, 1, CATALOG_REC_HEADER_SIZE, f) != CATALOG_REC_HEADER_SIZE)
+        {
+            ESP_LOGE(TAG, "Archive ends without the end record");
+            ret = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+
+        uint32_t rec_len;
+        memcpy(&rec_len, &rec[1], 4);
+
+        // An alarm without alarm record, or an object of other type, is complete once the next record starts
+        if(pending && rec[0] != CATALOG_REC_ALARM && rec[0] != CATALOG_REC_CONTENT)
+        {
+            if(ObjectManager_add_object(&object) == ESP_OK && ObjectManager_write_object(&object, NULL) == ESP_OK) imported++;
+            pending = false;
+        }
+
+        if(rec[0] == CATALOG_REC_END)
+        {
+            break;
+        }
+
+        switch(rec[0])
+        {
+            case CATALOG_REC_OBJECT:
+            {
+                uint8_t *p = chunk;
+                if(rec_len < CATALOG_ID_SIZE + ESP_UUID_LEN_128 + 9 || rec_len > CATALOG_ID_SIZE + ESP_UUID_LEN_128 + 9 + NAME_LEN_MAX - 1 || fread(p, 1, rec_len, f) != rec_len)
+                {
+                    ret = ESP_ERR_INVALID_SIZE;
+                    break;
+                }
+
+                memset(&object, 0, sizeof(object_t));
+                archived_id = 0;
+                memcpy(&archived_id, p, CATALOG_ID_SIZE);
+                p += CATALOG_ID_SIZE;
+                object.type.len = ESP_UUID_LEN_128;
+                memcpy(object.type.uuid.uuid128, p, ESP_UUID_LEN_128);
+                p += ESP_UUID_LEN_128;
+                memcpy(&object.properties, p, 4);
+                p += 4;
+                memcpy(&object.size, p, 4);
+                p += 4;
+                object.name_len = *p++;
+                if(object.name_len != rec_len - (CATALOG_ID_SIZE + ESP_UUID_LEN_128 + 9))
+                {
+                    ret = ESP_ERR_INVALID_SIZE;
+                    break;
+                }
+                memcpy(object.name, p, object.name_len);
+                object.name[object.name_len] = '\0';
+
+                // Ringtones and calendars are created with their body, the ones archived without it are left out
+                pending = (ObjectManager_check_type(object.type.uuid.uuid128) == ALARM_TYPE);
+                break;
+            }
+
+            case CATALOG_REC_ALARM:
+            {
+                alarm_mode_args_t alarm;
+                if(!pending || rec_len > ALARM_MODE_PAYLOAD_SIZE_MAX || rec_len < ALARM_MODE_PAYLOAD_SIZE_MIN || fread(chunk, 1, rec_len, f) != rec_len
+                    || rec_len < alarm_payload_fields_len(chunk) + ALARM_RINGTONE_ID_SIZE)
+                {
+                    ret = ESP_ERR_INVALID_SIZE;
+                    break;
+                }
+
+                // Archives from before the snooze settings end the record with the group tag
+                uint8_t *ringtone = &chunk[alarm_payload_fields_len(chunk)];
+                uint64_t ringtone_id = 0;
+                memcpy(&ringtone_id, ringtone, ALARM_RINGTONE_ID_SIZE);
+                if(ringtone_id)
+                {
+                    ringtone_id = ObjectManager_catalog_map(map, map_count, ringtone_id, RINGTONE_TYPE);
+                    memcpy(ringtone, &ringtone_id, ALARM_RINGTONE_ID_SIZE);
+                }
+
+                // Calendar ID follows the snooze settings, archives from before the volume rise end with it
+                uint16_t calendar_at = alarm_payload_fields_len(chunk) + ALARM_RINGTONE_ID_SIZE + ALARM_GROUP_SIZE + ALARM_SNOOZE_SIZE;
+                if(rec_len >= calendar_at + ALARM_CALENDAR_ID_SIZE)
+                {
+                    uint64_t calendar_id = 0;
+                    memcpy(&calendar_id, &chunk[calendar_at], ALARM_CALENDAR_ID_SIZE);
+                    if(calendar_id)
+                    {
+                        calendar_id = ObjectManager_catalog_map(map, map_count, calendar_id, CALENDAR_TYPE);
+                        memcpy(&chunk[calendar_at], &calendar_id, ALARM_CALENDAR_ID_SIZE);
+                    }
+                }
+
+                if(parse_alarm_values(chunk, rec_len, &alarm) != STATUS_OK)
+                {
+                    ESP_LOGW(TAG, "Alarm '%s' rejected", object.name);
+                    pending = false;
+                    break;
+                }
+
+                object.set_custom_object = true;
+                if(ObjectManager_add_object(&object) == ESP_OK && ObjectManager_write_object(&object, &alarm) == ESP_OK) imported++;
+                pending = false;
+                break;
+            }
+
+            case CATALOG_REC_CONTENT:
+            {
+                if(!ObjectManager_type_has_content(ObjectManager_check_type(object.type.uuid.uuid128)) || rec_len != object.size)
+                {
+                    ret = ESP_ERR_INVALID_SIZE;
+                    break;
+                }
+
+                ret = ObjectManager_catalog_import_content(f, &object, chunk);
+                if(ret != ESP_OK) break;
+                imported++;
+
+                catalog_map_t *grown = realloc(map, (map_count + 1) * sizeof(catalog_map_t));
+                if(grown == NULL)
+                {
+                    ret = ESP_ERR_NO_MEM;
+                    break;
+                }
+                map = grown;
+                map[map_count].from = archived_id;
+                map[map_count].to = object.id;
+                map_count++;
+                break;
+            }
+
+            default:
+                // Records of newer archive versions are skipped
+                fseek(f, rec_len, SEEK_CUR);
+                break;
+        }
+    }
+
+    fclose(f);
+    free(chunk);
+    free(map);
+
+    ESP_LOGI(TAG, "Archive of %" PRIu32 " bytes imported, %" PRIu32 " objects added: %s", size, imported, esp_err_to_name(ret));
+
+    if(imported)
+    {
+        FilterOrder_make_list();
+    }
+
+    return ret;
+}
@@ -0,0 +1,38 @@
+#ifndef __OBJECT_MANAGER_CATALOG_H__
+#define __OBJECT_MANAGER_CATALOG_H__
+
+#include "esp_err.h"
+#include "ObjectManager.h"
+#include <stdbool.h>
+
+/* Synthetic objects, selected with OLCP Go To. Stored objects get IDs from 0x100 up. */
+#define CATALOG_ARCHIVE_ID          0x01    // metadata and alarm records
+#define CATALOG_ARCHIVE_FULL_ID     0x02    // as above plus ringtone and calendar bodies
+#define CATALOG_IMPORT_ID           0x03    // write-only, applied when a truncating write completes
+#define CATALOG_HISTORY_ID          0x04    // alarm history records, oldest first
+
+#define CATALOG_IMPORT_PATH         MOUNT_POINT "/import.nca"
+
+#define CATALOG_MAGIC               "NXCA"
+#define CATALOG_MAGIC_SIZE          4
+#define CATALOG_VERSION             1
+#define CATALOG_FLAG_CONTENT        (1<<0)
+#define CATALOG_HEADER_SIZE         (CATALOG_MAGIC_SIZE + 2)
+
+/* Archive: header [magic, version, flags] followed by records [tag, 4-byte length, payload].
+ * Ringtones and calendars come before alarms, so the IDs alarms refer to are known when they are imported.
+ */
+#define CATALOG_REC_OBJECT          0x01    // ID(6), type UUID(16), properties(4), size(4), name length(1), name
+#define CATALOG_REC_ALARM           0x02    // Alarm Action payload with the whole trailer
+#define CATALOG_REC_CONTENT         0x03    // ringtone or calendar body
+#define CATALOG_REC_END             0xFF
+#define CATALOG_REC_HEADER_SIZE     5
+
+bool ObjectManager_catalog_is_synthetic(uint64_t id);
+bool ObjectManager_catalog_is_archive(uint64_t id);
+bool ObjectManager_catalog_is_generated(uint64_t id);
+esp_err_t ObjectManager_catalog_describe(uint64_t id, object_t *object);
+int32_t ObjectManager_catalog_read(uint64_t id, uint32_t offset, uint8_t *buf, uint32_t len);
+esp_err_t ObjectManager_catalog_import(const char *path, uint32_t size);
+
+#endif
@@ -0,0 +1,191 @@
+#include "ObjectManagerContentStore.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+static void ObjectManager_store_path(char *bfr, const char *dir, const char *key, const char *type)
+{
+    snprintf(bfr, CONTENT_STORE_PATH_LEN_MAX, "%s/%s%s", dir, key, type);
+}
+
+void ObjectManager_store_key(char *key, const uint8_t *hash)
+{
+    key[0] = 'h';
+    for(int i=0; i<8; i++)
+    {
+        sprintf(&key[1 + i*2], "%02x", hash[i]);
+    }
+}
+
+bool ObjectManager_store_read_ref(const char *dir, const char *key, content_ref_t *ref)
+{
+    char file[CONTENT_STORE_PATH_LEN_MAX];
+    ObjectManager_store_path(file, dir, key, CONTENT_STORE_REF_TYPE);
+
+    FILE* f = fopen(file, "r");
+    if(f == NULL)
+    {
+        return false;
+    }
+
+    char hash_str[CONTENT_HASH_SIZE * 2 + 1];
+    int fields = fscanf(f, "References: %" SCNu32 "\nHash: %64s\nSize: %" SCNx32, &ref->refs, hash_str, &ref->size);
+    fclose(f);
+
+    if(fields != 3 || strlen(hash_str) != CONTENT_HASH_SIZE * 2)
+    {
+        return false;
+    }
+
+    for(int i=0; i<CONTENT_HASH_SIZE; i++)
+    {
+        unsigned int byte;
+        if(sscanf(&hash_str[i*2], "%2x", &byte) != 1)
+        {
+            return false;
+        }
+        ref->hash[i] = byte;
+    }
+
+    return true;
+}
+
+// No references left removes the data and the .ref file
+bool ObjectManager_store_write_ref(const char *dir, const char *key, const content_ref_t *ref)
+{
+    char file[CONTENT_STORE_PATH_LEN_MAX];
+
+    if(ref->refs == 0)
+    {
+        ObjectManager_store_path(file, dir, key, CONTENT_STORE_DATA_TYPE);
+        remove(file);
+
+        ObjectManager_store_path(file, dir, key, CONTENT_STORE_REF_TYPE);
+        remove(file);
+        return true;
+    }
+
+    ObjectManager_store_path(file, dir, key, CONTENT_STORE_REF_TYPE);
+    FILE* f = fopen(file, "w");
+    if(f == NULL)
+    {
+        return false;
+    }
+
+    fprintf(f, "References: %" PRIu32 "\n", ref->refs);
+    fprintf(f, "Hash: ");
+    for(int i=0; i<CONTENT_HASH_SIZE; i++)
+    {
+        fprintf(f, "%02x", ref->hash[i]);
+    }
+    fprintf(f, "\nSize: %08" PRIx32 "\n", ref->size);
+
+    bool ok = !ferror(f);
+    return (fclose(f) == 0) && ok;
+}
+
+/* Stores a completely written content, own_file holds it. Key gets the content key the object
+ * refers to from now on, unless the key is taken by different content.
+ */
+content_store_result_t ObjectManager_store_add(const char *dir, const char *own_file, const uint8_t *hash, uint32_t size, char *key)
+{
+    ObjectManager_store_key(key, hash);
+
+    content_ref_t ref;
+    if(ObjectManager_store_read_ref(dir, key, &ref))
+    {
+        if(memcmp(hash, ref.hash, CONTENT_HASH_SIZE) != 0)
+        {
+            return CONTENT_STORE_COLLISION;
+        }
+
+        // Same content uploaded again, keep the stored copy only
+        ref.refs++;
+        if(!ObjectManager_store_write_ref(dir, key, &ref))
+        {
+            return CONTENT_STORE_FAILED;
+        }
+        remove(own_file);
+        return CONTENT_STORE_SHARED;
+    }
+
+    char shared_file[CONTENT_STORE_PATH_LEN_MAX];
+    ObjectManager_store_path(shared_file, dir, key, CONTENT_STORE_DATA_TYPE);
+    if(rename(own_file, shared_file) != 0)
+    {
+        return CONTENT_STORE_FAILED;
+    }
+
+    ref.refs = 1;
+    memcpy(ref.hash, hash, CONTENT_HASH_SIZE);
+    ref.size = size;
+    if(!ObjectManager_store_write_ref(dir, key, &ref))
+    {
+        // Without its .ref file the data would be orphaned, the object keeps it as its own
+        rename(shared_file, own_file);
+        return CONTENT_STORE_FAILED;
+    }
+
+    return CONTENT_STORE_ADDED;
+}
+
+// Adds a reference to an offered hash, false when no identical content is stored
+bool ObjectManager_store_reference(const char *dir, const uint8_t *hash, char *key, uint32_t *size)
+{
+    ObjectManager_store_key(key, hash);
+
+    content_ref_t ref;
+    if(!ObjectManager_store_read_ref(dir, key, &ref) || memcmp(hash, ref.hash, CONTENT_HASH_SIZE) != 0)
+    {
+        return false;
+    }
+
+    ref.refs++;
+    if(!ObjectManager_store_write_ref(dir, key, &ref))
+    {
+        return false;
+    }
+
+    *size = ref.size;
+    return true;
+}
+
+void ObjectManager_store_release(const char *dir, const char *key)
+{
+    content_ref_t ref;
+    if(ObjectManager_store_read_ref(dir, key, &ref) && ref.refs)
+    {
+        ref.refs--;
+        ObjectManager_store_write_ref(dir, key, &ref);
+    }
+}
+
+/* Gives an object its own content before a write. Keeping the data is possible only for the last
+ * reference, the shared file then becomes own_file. Otherwise the reference is just dropped.
+ */
+content_store_result_t ObjectManager_store_detach(const char *dir, const char *key, const char *own_file, bool keep_data)
+{
+    if(!keep_data)
+    {
+        ObjectManager_store_release(dir, key);
+        return CONTENT_STORE_DETACHED;
+    }
+
+    content_ref_t ref;
+    if(ObjectManager_store_read_ref(dir, key, &ref) && ref.refs > 1)
+    {
+        return CONTENT_STORE_SHARED_BUSY;
+    }
+
+    char file[CONTENT_STORE_PATH_LEN_MAX];
+    ObjectManager_store_path(file, dir, key, CONTENT_STORE_DATA_TYPE);
+    if(rename(file, own_file) != 0)
+    {
+        return CONTENT_STORE_FAILED;
+    }
+
+    ObjectManager_store_path(file, dir, key, CONTENT_STORE_REF_TYPE);
+    remove(file);
+    return CONTENT_STORE_DETACHED;
+}
@@ -0,0 +1,44 @@
+#ifndef __OBJECT_MANAGER_CONTENT_STORE_H__
+#define __OBJECT_MANAGER_CONTENT_STORE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Deduplicated ringtone contents. Plain C, no ESP-IDF dependencies, the directory is a parameter.
+ * A content is stored once as <key>.wav, key being h<first 8 bytes of SHA-256>. The <key>.ref
+ * file next to it keeps the reference count together with the full hash and size, so matching
+ * an offered hash does not need to scan the objects. The data goes with the last reference.
+ */
+#define CONTENT_HASH_SIZE           32
+#define CONTENT_KEY_LEN_MAX         20
+#define CONTENT_STORE_PATH_LEN_MAX  128
+#define CONTENT_STORE_DATA_TYPE     ".wav"
+#define CONTENT_STORE_REF_TYPE      ".ref"
+
+typedef enum
+{
+    CONTENT_STORE_ADDED,        // new content, moved to <key>.wav with one reference
+    CONTENT_STORE_SHARED,       // identical content stored already, the own file was dropped
+    CONTENT_STORE_COLLISION,    // key taken by different content, the object keeps its own file
+    CONTENT_STORE_DETACHED,     // object refers to no stored content anymore
+    CONTENT_STORE_SHARED_BUSY,  // content referenced by other objects, can't be taken over
+    CONTENT_STORE_FAILED,
+} content_store_result_t;
+
+typedef struct
+{
+    uint32_t refs;
+    uint8_t hash[CONTENT_HASH_SIZE];
+    uint32_t size;
+} content_ref_t;
+
+void ObjectManager_store_key(char *key, const uint8_t *hash);
+bool ObjectManager_store_read_ref(const char *dir, const char *key, content_ref_t *ref);
+bool ObjectManager_store_write_ref(const char *dir, const char *key, const content_ref_t *ref);
+
+content_store_result_t ObjectManager_store_add(const char *dir, const char *own_file, const uint8_t *hash, uint32_t size, char *key);
+bool ObjectManager_store_reference(const char *dir, const uint8_t *hash, char *key, uint32_t *size);
+void ObjectManager_store_release(const char *dir, const char *key);
+content_store_result_t ObjectManager_store_detach(const char *dir, const char *key, const char *own_file, bool keep_data);
+
+#endif
@@ -59,6 +59,17 @@ enum
     OPT_IDX_CHAR_OBJECT_WIFI_ACTION_VAL,
     OPT_IDX_CHAR_OBJECT_WIFI_ACTION_CFG,
 
+    OPT_IDX_CHAR_OBJECT_CHANNEL,
+    OPT_IDX_CHAR_OBJECT_CHANNEL_VAL,
+    OPT_IDX_CHAR_OBJECT_CHANNEL_CFG,
+
+    OPT_IDX_CHAR_OBJECT_TRANSACTION,
+    OPT_IDX_CHAR_OBJECT_TRANSACTION_VAL,
+    OPT_IDX_CHAR_OBJECT_TRANSACTION_CFG,
+
+    OPT_IDX_CHAR_ALARM_TIMELINE,
+    OPT_IDX_CHAR_ALARM_TIMELINE_VAL,
+
     OPT_IDX_NB,
 };
 
@@ -0,0 +1,581 @@
+#include "ObjectTransfer_channel.h"
+#include "ObjectManager.h"
+#include "ObjectManagerCatalog.h"
+#include "alarm.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define TAG "OBJECT_CHANNEL"
+
+#define CHANNEL_READ_TASK_STACK     4096
+#define CHANNEL_CHECKSUM_TASK_STACK 4096
+#define CHANNEL_CONGEST_TIMEOUT_MS  1000
+
+/* Object Transfer Channel.
+ * Object contents move between the client and the SD card through a staging buffer of whole sectors:
+ * incoming SDUs are packed into the buffer and written out when it is full, outgoing data is read
+ * in sector-aligned chunks and cut into MTU sized notifications. No full-file buffer is ever held.
+ * The chunking itself is ObjectTransfer_stream, test/host drives it in place of the phone.
+ */
+typedef struct {
+    volatile channel_state_t state;
+    volatile bool abort_requested;
+    bool whole_object;
+    bool generated;
+    uint64_t id;
+    int fd;
+    object_stream_t stream;
+    bool truncate_rest;
+    bool hashing;
+    mbedtls_sha256_context sha;
+    upload_chunk_t pending[OBJECT_CHANNEL_COMMIT_CHUNKS];
+    uint32_t pending_count;
+
+    esp_gatt_if_t gatts_if;
+    uint16_t conn_id;
+    uint16_t handle;
+} object_channel_t;
+
+static object_channel_t channel = {
+    .state = CHANNEL_IDLE,
+    .fd = -1,
+};
+
+/* Checksum of a whole object computed by the worker task. The metadata file is written by the Bluetooth
+ * task only, so the cached value is stored there once the client confirms the indication carrying it.
+ */
+typedef struct {
+    volatile bool valid;
+    uint64_t id;
+    uint32_t crc;
+} pending_checksum_t;
+
+static pending_checksum_t pending_checksum;
+
+static uint16_t channel_mtu = OBJECT_CHANNEL_DEFAULT_MTU;
+static volatile bool channel_congested = false;
+static bool channel_notify_enabled = false;
+static SemaphoreHandle_t congest_sem = NULL;
+
+static ssize_t ObjectTransfer_channel_source_read(uint32_t len)
+{
+    // Catalog archive and alarm history have no file behind them, their bytes are produced for the requested range
+    if(channel.generated)
+    {
+        return ObjectManager_catalog_read(channel.id, channel.stream.offset, channel.stream.buffer, len);
+    }
+
+    return read(channel.fd, channel.stream.buffer, len);
+}
+
+static void ObjectTransfer_channel_release(void)
+{
+    if(channel.fd >= 0)
+    {
+        close(channel.fd);
+        channel.fd = -1;
+    }
+
+    if(channel.stream.buffer)
+    {
+        heap_caps_free(channel.stream.buffer);
+        channel.stream.buffer = NULL;
+    }
+
+    if(channel.hashing)
+    {
+        mbedtls_sha256_free(&channel.sha);
+        channel.hashing = false;
+    }
+
+    channel.stream.len = 0;
+    channel.stream.remaining = 0;
+    channel.generated = false;
+    channel.pending_count = 0;
+    channel.abort_requested = false;
+    channel.state = CHANNEL_IDLE;
+}
+
+static bool ObjectTransfer_channel_alloc(uint32_t size, uint32_t offset, uint32_t length)
+{
+    // DMA capable buffer lets the SD driver transfer whole sectors without a bounce copy
+    uint8_t *buffer = heap_caps_malloc(size, MALLOC_CAP_DMA);
+    if(buffer == NULL)
+    {
+        ESP_LOGE(TAG, "Channel buffer allocation failed");
+        return false;
+    }
+
+    ObjectTransfer_stream_init(&channel.stream, buffer, size, offset, length);
+    return true;
+}
+
+void ObjectTransfer_channel_set_mtu(uint16_t mtu)
+{
+    channel_mtu = mtu;
+}
+
+void ObjectTransfer_channel_set_congested(bool congested)
+{
+    channel_congested = congested;
+
+    if(!congested && congest_sem)
+    {
+        xSemaphoreGive(congest_sem);
+    }
+}
+
+void ObjectTransfer_channel_set_notify(bool enable)
+{
+    channel_notify_enabled = enable;
+}
+
+channel_state_t ObjectTransfer_channel_get_state(void)
+{
+    return channel.state;
+}
+
+oacp_op_code_result_t ObjectTransfer_channel_start_read(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t handle, uint64_t id, uint32_t offset, uint32_t length)
+{
+    if(!channel_notify_enabled)
+    {
+        ESP_LOGE(TAG, "Channel not opened by the client");
+        return OACP_RES_CHANNEL_UNAVBL;
+    }
+
+    if(channel.state != CHANNEL_IDLE)
+    {
+        ESP_LOGE(TAG, "Channel busy");
+        return OACP_RES_OBJECT_LOCKED;
+    }
+
+    if(congest_sem == NULL)
+    {
+        congest_sem = xSemaphoreCreateBinary();
+    }
+
+    channel.generated = ObjectManager_catalog_is_generated(id);
+    if(!channel.generated)
+    {
+        channel.fd = ObjectManager_open_content(id, O_RDONLY);
+        if(channel.fd < 0)
+        {
+            ESP_LOGE(TAG, "Cannot open object content");
+            return OACP_RES_OPERATION_FAILED;
+        }
+    }
+
+    if((!channel.generated && lseek(channel.fd, offset, SEEK_SET) < 0) || !ObjectTransfer_channel_alloc(OBJECT_CHANNEL_BUFFER_SIZE, offset, length))
+    {
+        ObjectTransfer_channel_release();
+        return OACP_RES_INSUF_RSR;
+    }
+
+    channel.id = id;
+    channel.gatts_if = gatts_if;
+    channel.conn_id = conn_id;
+    channel.handle = handle;
+    channel.state = CHANNEL_READ;
+
+    ESP_LOGI(TAG, "Read of object %" PRIx64 " prepared, offset: %" PRIu32 " length: %" PRIu32, id, offset, length);
+
+    return OACP_RES_SUCCESS;
+}
+
+static void ObjectTransfer_channel_read_task(void *arg)
+{
+    uint16_t payload_max = ObjectTransfer_stream_payload_max(channel_mtu);
+
+    while(channel.stream.remaining && !channel.abort_requested)
+    {
+        ssize_t bytes_read = ObjectTransfer_channel_source_read(ObjectTransfer_stream_chunk(&channel.stream));
+        if(bytes_read <= 0)
+        {
+            ESP_LOGE(TAG, "Object content read failed at offset %" PRIu32, channel.stream.offset);
+            break;
+        }
+
+        ssize_t sent = 0;
+        while(sent < bytes_read && !channel.abort_requested)
+        {
+            if(channel_congested)
+            {
+                xSemaphoreTake(congest_sem, pdMS_TO_TICKS(CHANNEL_CONGEST_TIMEOUT_MS));
+                continue;
+            }
+
+            uint16_t len = (bytes_read - sent > payload_max) ? payload_max : bytes_read - sent;
+            esp_err_t ret = esp_ble_gatts_send_indicate(channel.gatts_if, channel.conn_id, channel.handle, len, &channel.stream.buffer[sent], false);
+            if(ret)
+            {
+                vTaskDelay(1);
+                continue;
+            }
+            sent += len;
+        }
+
+        ObjectTransfer_stream_advance(&channel.stream, bytes_read);
+    }
+
+    ESP_LOGI(TAG, "Read of object %" PRIx64 " finished, bytes left: %" PRIu32, channel.id, channel.stream.remaining);
+    ObjectTransfer_channel_release();
+
+    vTaskDelete(NULL);
+}
+
+void ObjectTransfer_channel_run_read(void)
+{
+    if(channel.state != CHANNEL_READ)
+    {
+        return;
+    }
+
+    BaseType_t res = xTaskCreate(ObjectTransfer_channel_read_task, "OBJECT CHANNEL", CHANNEL_READ_TASK_STACK, NULL, 1, NULL);
+    if(res != pdPASS)
+    {
+        ESP_LOGE(TAG, "Creating channel read task failed");
+        ObjectTransfer_channel_release();
+    }
+}
+
+oacp_op_code_result_t ObjectTransfer_channel_start_write(uint64_t id, uint32_t offset, uint32_t length, bool truncate_rest)
+{
+    if(channel.state != CHANNEL_IDLE)
+    {
+        ESP_LOGE(TAG, "Channel busy");
+        return OACP_RES_OBJECT_LOCKED;
+    }
+
+    channel.fd = ObjectManager_open_content(id, O_WRONLY | O_CREAT);
+    if(channel.fd < 0)
+    {
+        ESP_LOGE(TAG, "Cannot open object content");
+        return OACP_RES_OPERATION_FAILED;
+    }
+
+    if(lseek(channel.fd, offset, SEEK_SET) < 0 || !ObjectTransfer_channel_alloc(OBJECT_CHANNEL_BUFFER_SIZE, offset, length))
+    {
+        ObjectTransfer_channel_release();
+        return OACP_RES_INSUF_RSR;
+    }
+
+    // Content is about to change, a checksum still waiting for its confirmation is stale
+    pending_checksum.valid = false;
+
+    channel.id = id;
+    channel.truncate_rest = truncate_rest;
+    channel.state = CHANNEL_WRITE;
+
+    // Upload starting from scratch drops the log of a previous one, any other write resumes it
+    ObjectManager_upload_begin(id, offset == 0 && truncate_rest);
+
+    // Content hash is known only when the whole object passes through the channel in order
+    channel.hashing = (offset == 0 && truncate_rest);
+    if(channel.hashing)
+    {
+        mbedtls_sha256_init(&channel.sha);
+        mbedtls_sha256_starts(&channel.sha, 0);
+    }
+
+    ESP_LOGI(TAG, "Write of object %" PRIx64 " started, offset: %" PRIu32 " length: %" PRIu32, id, offset, length);
+
+    if(length == 0)
+    {
+        ObjectManager_finish_write(channel.id, offset, channel.truncate_rest);
+        ObjectTransfer_channel_release();
+    }
+
+    return OACP_RES_SUCCESS;
+}
+
+/* Data is synced to the card before its chunks are logged, so the logged watermark never runs ahead of the content */
+static void ObjectTransfer_channel_commit(void)
+{
+    if(channel.pending_count == 0)
+    {
+        return;
+    }
+
+    fsync(channel.fd);
+    ObjectManager_upload_commit(channel.id, channel.pending, channel.pending_count);
+    channel.pending_count = 0;
+}
+
+static esp_err_t ObjectTransfer_channel_flush(void)
+{
+    object_stream_t *stream = &channel.stream;
+    if(stream->len == 0)
+    {
+        return ESP_OK;
+    }
+
+    if(channel.hashing)
+    {
+        mbedtls_sha256_update(&channel.sha, stream->buffer, stream->len);
+    }
+
+    ssize_t written = write(channel.fd, stream->buffer, stream->len);
+    if(written != stream->len)
+    {
+        ESP_LOGE(TAG, "Object content write failed at offset %" PRIu32, stream->offset);
+        return ESP_FAIL;
+    }
+
+    upload_chunk_t *chunk = &channel.pending[channel.pending_count++];
+    chunk->offset = stream->offset;
+    chunk->len = stream->len;
+    chunk->crc = esp_rom_crc32_le(0, stream->buffer, stream->len);
+
+    if(channel.pending_count == OBJECT_CHANNEL_COMMIT_CHUNKS)
+    {
+        ObjectTransfer_channel_commit();
+    }
+
+    ObjectTransfer_stream_drained(stream);
+
+    return ESP_OK;
+}
+
+static void ObjectTransfer_channel_end_write(void)
+{
+    ObjectTransfer_channel_flush();
+    ObjectTransfer_channel_commit();
+    close(channel.fd);
+    channel.fd = -1;
+
+    // Only the data which reached the card counts, a failed flush does not grow the object
+    bool complete = ObjectTransfer_stream_complete(&channel.stream);
+    bool truncate_rest = channel.truncate_rest && complete;
+    ObjectManager_finish_write(channel.id, channel.stream.offset, truncate_rest);
+
+    // Completed import added alarms, a rewritten calendar may move the alarms using it
+    object_t *object = ObjectManager_get_object();
+    bool calendar = object != NULL && object->id == channel.id && ObjectManager_check_type(object->type.uuid.uuid128) == CALENDAR_TYPE;
+    if((channel.id == CATALOG_IMPORT_ID && truncate_rest) || calendar)
+    {
+        set_next_alarm();
+    }
+
+    if(complete)
+    {
+        ObjectManager_upload_end(channel.id);
+    }
+
+    if(channel.hashing && complete)
+    {
+        uint8_t hash[CONTENT_HASH_SIZE];
+        mbedtls_sha256_finish(&channel.sha, hash);
+        ObjectManager_content_written(channel.id, hash);
+    }
+
+    ObjectTransfer_channel_release();
+}
+
+esp_err_t ObjectTransfer_channel_receive(const uint8_t *data, uint16_t len)
+{
+    if(channel.state != CHANNEL_WRITE)
+    {
+        ESP_LOGE(TAG, "Data received without OACP Write");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if(len > channel.stream.remaining)
+    {
+        ESP_LOGW(TAG, "Data past the requested length dropped: %" PRIu32 " bytes", len - channel.stream.remaining);
+        len = channel.stream.remaining;
+    }
+
+    while(len)
+    {
+        uint32_t chunk = ObjectTransfer_stream_fill(&channel.stream, data, len);
+        data += chunk;
+        len -= chunk;
+
+        if(ObjectTransfer_stream_full(&channel.stream))
+        {
+            if(ObjectTransfer_channel_flush() != ESP_OK)
+            {
+                ObjectTransfer_channel_end_write();
+                return ESP_FAIL;
+            }
+        }
+    }
+
+    if(channel.stream.remaining == 0)
+    {
+        ObjectTransfer_channel_end_write();
+    }
+
+    return ESP_OK;
+}
+
+static void ObjectTransfer_channel_checksum_task(void *arg)
+{
+    uint32_t crc = 0;
+    uint32_t length = channel.stream.remaining;
+    int64_t start = esp_timer_get_time();
+
+    while(channel.stream.remaining && !channel.abort_requested)
+    {
+        // First chunk ends on a sector boundary, every next one is a multi-sector read of the whole buffer
+        ssize_t bytes_read = ObjectTransfer_channel_source_read(ObjectTransfer_stream_chunk(&channel.stream));
+        if(bytes_read <= 0)
+        {
+            ESP_LOGE(TAG, "Object content read failed at offset %" PRIu32, channel.stream.offset);
+            break;
+        }
+
+        crc = esp_rom_crc32_le(crc, channel.stream.buffer, bytes_read);
+        ObjectTransfer_stream_advance(&channel.stream, bytes_read);
+    }
+
+    uint8_t indicate_data[7];
+    indicate_data[0] = OACP_OP_CODE_RESPONSE;
+    indicate_data[1] = OACP_OP_CODE_CALC_SUM;
+    uint8_t indicate_data_len = 3;
+
+    if(channel.stream.remaining == 0)
+    {
+        int64_t elapsed = esp_timer_get_time() - start;
+        ESP_LOGI(TAG, "Checksum of object %" PRIx64 ": %08" PRIx32 ", %" PRIu32 " bytes in %" PRId64 " us", channel.id, crc, length, elapsed);
+
+        indicate_data[2] = OACP_RES_SUCCESS;
+        memcpy(&indicate_data[3], &crc, 4);
+        indicate_data_len = 7;
+
+        if(channel.whole_object && !channel.abort_requested)
+        {
+            pending_checksum.id = channel.id;
+            pending_checksum.crc = crc;
+            pending_checksum.valid = true;
+        }
+    }
+    else
+    {
+        indicate_data[2] = OACP_RES_OPERATION_FAILED;
+    }
+
+    // Aborted calculation was already answered by the Abort procedure
+    if(!channel.abort_requested)
+    {
+        esp_ble_gatts_send_indicate(channel.gatts_if, channel.conn_id, channel.handle, indicate_data_len, indicate_data, true);
+    }
+
+    ObjectTransfer_channel_release();
+
+    vTaskDelete(NULL);
+}
+
+oacp_op_code_result_t ObjectTransfer_channel_start_checksum(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t handle, uint64_t id, uint32_t offset, uint32_t length, bool whole_object)
+{
+    if(channel.state != CHANNEL_IDLE)
+    {
+        ESP_LOGE(TAG, "Channel busy");
+        return OACP_RES_OBJECT_LOCKED;
+    }
+
+    channel.generated = ObjectManager_catalog_is_generated(id);
+    if(!channel.generated)
+    {
+        channel.fd = ObjectManager_open_content(id, O_RDONLY);
+        if(channel.fd < 0)
+        {
+            ESP_LOGE(TAG, "Cannot open object content");
+            return OACP_RES_OPERATION_FAILED;
+        }
+    }
+
+    if((!channel.generated && lseek(channel.fd, offset, SEEK_SET) < 0) || !ObjectTransfer_channel_alloc(OBJECT_CHANNEL_CHECKSUM_CHUNK, offset, length))
+    {
+        ObjectTransfer_channel_release();
+        return OACP_RES_INSUF_RSR;
+    }
+
+    channel.id = id;
+    channel.whole_object = whole_object && !channel.generated;
+    channel.gatts_if = gatts_if;
+    channel.conn_id = conn_id;
+    channel.handle = handle;
+    channel.state = CHANNEL_CHECKSUM;
+
+    // The SD card is read in a separate task, so the Bluetooth task keeps serving other requests
+    BaseType_t res = xTaskCreate(ObjectTransfer_channel_checksum_task, "OBJECT CHECKSUM", CHANNEL_CHECKSUM_TASK_STACK, NULL, 1, NULL);
+    if(res != pdPASS)
+    {
+        ESP_LOGE(TAG, "Creating checksum task failed");
+        ObjectTransfer_channel_release();
+        return OACP_RES_INSUF_RSR;
+    }
+
+    return OACP_RES_SUCCESS;
+}
+
+void ObjectTransfer_channel_indicate_done(bool confirmed)
+{
+    if(!pending_checksum.valid)
+    {
+        return;
+    }
+
+    // Client that didn't confirm may not have the checksum, it is not cached then
+    pending_checksum.valid = false;
+    if(!confirmed)
+    {
+        return;
+    }
+
+    ringtone_properties_t props;
+    if(ObjectManager_get_ringtone_properties(pending_checksum.id, &props) != ESP_OK)
+    {
+        return;
+    }
+
+    props.checksum_valid = true;
+    props.checksum = pending_checksum.crc;
+    ObjectManager_set_ringtone_properties(pending_checksum.id, &props);
+}
+
+oacp_op_code_result_t ObjectTransfer_channel_abort(void)
+{
+    switch(channel.state)
+    {
+        case CHANNEL_CHECKSUM:
+            ESP_LOGI(TAG, "Checksum calculation aborted");
+            channel.abort_requested = true;
+            return OACP_RES_SUCCESS;
+
+        case CHANNEL_READ:
+            ESP_LOGI(TAG, "Read aborted");
+            // The read task notices the request and releases the channel itself
+            channel.abort_requested = true;
+            return OACP_RES_SUCCESS;
+
+        case CHANNEL_WRITE:
+            ESP_LOGI(TAG, "Write aborted, %" PRIu32 " bytes not received", channel.stream.remaining);
+            ObjectTransfer_channel_end_write();
+            return OACP_RES_SUCCESS;
+
+        default:
+            return OACP_RES_OPERATION_FAILED;
+    }
+}
+
+void ObjectTransfer_channel_close(void)
+{
+    ObjectTransfer_channel_abort();
+    channel_notify_enabled = false;
+    channel_congested = false;
+    channel_mtu = OBJECT_CHANNEL_DEFAULT_MTU;
+}
@@ -0,0 +1,37 @@
+#ifndef __OBJECT_TRANSFER_CHANNEL_H__
+#define __OBJECT_TRANSFER_CHANNEL_H__
+
+#include "esp_err.h"
+#include "esp_gatts_api.h"
+#include "ObjectTransfer_defs.h"
+#include "ObjectTransfer_stream.h"
+#include <stdbool.h>
+
+#define OBJECT_CHANNEL_SECTOR_SIZE      OBJECT_STREAM_SECTOR_SIZE
+#define OBJECT_CHANNEL_BUFFER_SIZE      OBJECT_STREAM_BUFFER_SIZE
+#define OBJECT_CHANNEL_DEFAULT_MTU      23
+#define OBJECT_CHANNEL_CHECKSUM_CHUNK   OBJECT_STREAM_CHECKSUM_CHUNK
+#define OBJECT_CHANNEL_COMMIT_CHUNKS    16      // staging buffer flushes between syncs of an upload
+
+typedef enum {
+    CHANNEL_IDLE = 0,
+    CHANNEL_READ,
+    CHANNEL_WRITE,
+    CHANNEL_CHECKSUM,
+} channel_state_t;
+
+void ObjectTransfer_channel_set_mtu(uint16_t mtu);
+void ObjectTransfer_channel_set_congested(bool congested);
+void ObjectTransfer_channel_set_notify(bool enable);
+channel_state_t ObjectTransfer_channel_get_state(void);
+
+oacp_op_code_result_t ObjectTransfer_channel_start_read(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t handle, uint64_t id, uint32_t offset, uint32_t length);
+void ObjectTransfer_channel_run_read(void);
+oacp_op_code_result_t ObjectTransfer_channel_start_write(uint64_t id, uint32_t offset, uint32_t length, bool truncate_rest);
+esp_err_t ObjectTransfer_channel_receive(const uint8_t *data, uint16_t len);
+oacp_op_code_result_t ObjectTransfer_channel_start_checksum(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t handle, uint64_t id, uint32_t offset, uint32_t length, bool whole_object);
+void ObjectTransfer_channel_indicate_done(bool confirmed);
+oacp_op_code_result_t ObjectTransfer_channel_abort(void);
+void ObjectTransfer_channel_close(void);
+
+#endif
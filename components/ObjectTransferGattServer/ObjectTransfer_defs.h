@@ -43,6 +43,9 @@ typedef enum{
 #define OACP_OP_CODE_READ                    ((uint8_t)0x05)
 #define OACP_OP_CODE_WRITE                   ((uint8_t)0x06)
 #define OACP_OP_CODE_ABORT                   ((uint8_t)0x07)
+#define OACP_OP_CODE_CREATE_BY_HASH          ((uint8_t)0x20)    //vendor extension
+#define OACP_OP_CODE_UPLOAD_STATE            ((uint8_t)0x21)    //vendor extension
+#define OACP_OP_CODE_BULK_ENABLE             ((uint8_t)0x22)    //vendor extension
 #define OACP_OP_CODE_RESPONSE                ((uint8_t)0x60)
 
 //OLCP OP CODES
@@ -60,6 +63,18 @@ typedef enum{
 #define DATA_LEN_UUID16                 7
 #define DATA_LEN_UUID32                 9
 #define DATA_LEN_UUID128                21
+#define DATA_LEN_CREATE_BY_HASH         53
+
+//OACP Calculate Checksum/Read/Write data length
+#define DATA_LEN_OACP_CALC_SUM          9
+#define DATA_LEN_OACP_READ              9
+#define DATA_LEN_OACP_WRITE             10
+#define DATA_LEN_OACP_BULK_ENABLE       4
+
+//Alarm Timeline record
+#define ALARM_TIMELINE_ID_SIZE          6
+#define ALARM_TIMELINE_FIRE_SIZE        4
+#define ALARM_TIMELINE_RECORD_SIZE      (ALARM_TIMELINE_ID_SIZE + ALARM_TIMELINE_FIRE_SIZE)
 
 //Filter OP CODES
 #define NO_FILTER                       0x00
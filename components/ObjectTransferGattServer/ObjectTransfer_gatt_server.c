@@ -14,6 +14,7 @@
 #include "ObjectTransfer_attr_ids.h"
 #include "ObjectTransfer_metadata_read.h"
 #include "ObjectTransfer_metadata_write.h"
+#include "ObjectTransfer_channel.h"
 #include "ObjectManager.h"
 #include "pp_nixie_display.h"
 
@@ -105,6 +106,9 @@ static const uint16_t GATTS_CHAR_OBJECT_LIST_FILTER     = 0x2AC7;
 static uint8_t GATTS_CHAR_ALARM_ACTION[16]              = {0x26, 0xab, 0x57, 0xe0, 0x57, 0xab, 0x45, 0x98, 0xaf, 0xf2, 0x06, 0xe5, 0x27, 0x3f, 0x91, 0x9e};
 // static uint8_t GATTS_CHAR_RINGTONE_ACTION[16]           = {0x26, 0xab, 0x57, 0xe0, 0x57, 0xab, 0x45, 0x98, 0xaf, 0xf2, 0x06, 0xe5, 0x27, 0x5c, 0xe5, 0x40};
 static uint8_t GATTS_CHAR_WIFI_ACTION[16]               = {0x26, 0xab, 0x57, 0xe0, 0x57, 0xab, 0x45, 0x98, 0xaf, 0xf2, 0x06, 0xe5, 0x27, 0x2a, 0x14, 0x80};
+static uint8_t GATTS_CHAR_OBJECT_CHANNEL[16]            = {0x26, 0xab, 0x57, 0xe0, 0x57, 0xab, 0x45, 0x98, 0xaf, 0xf2, 0x06, 0xe5, 0x27, 0x7c, 0x0a, 0x35};
+static uint8_t GATTS_CHAR_OBJECT_TRANSACTION[16]        = {0x26, 0xab, 0x57, 0xe0, 0x57, 0xab, 0x45, 0x98, 0xaf, 0xf2, 0x06, 0xe5, 0x27, 0x91, 0x5d, 0x6e};
+static uint8_t GATTS_CHAR_ALARM_TIMELINE[16]            = {0x26, 0xab, 0x57, 0xe0, 0x57, 0xab, 0x45, 0x98, 0xaf, 0xf2, 0x06, 0xe5, 0x27, 0xb4, 0x7e, 0x1d};
 
 static const uint16_t primary_service_uuid          = ESP_GATT_UUID_PRI_SERVICE;
 static const uint16_t char_declaration_uuid         = ESP_GATT_UUID_CHAR_DECLARE;
@@ -113,8 +117,10 @@ static const uint8_t char_prop_read                 = ESP_GATT_CHAR_PROP_BIT_REA
 static const uint8_t char_prop_read_write           = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE;
 static const uint8_t char_prop_write_indicate       = ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_INDICATE;
 static const uint8_t char_prop_read_write_indicate  = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_INDICATE;
+static const uint8_t char_prop_write_nr_notify      = ESP_GATT_CHAR_PROP_BIT_WRITE_NR | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
 
-static const uint8_t OTS_Feature_value[8]      = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30};
+// OACP: Create, Delete, Calculate Checksum, Read, Write, Append, Truncate, Patch, Abort
+static const uint8_t OTS_Feature_value[8]      = {0xF7, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30};
 
 
 /* Full Database Description - Used to add attributes into the database */
@@ -272,6 +278,46 @@ static const esp_gatts_attr_db_t gatt_db[OPT_IDX_NB] =
     /* Object Wifi Action Characteristic Configuration Descriptor */
     [OPT_IDX_CHAR_OBJECT_WIFI_ACTION_CFG]  =
     {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_WRITE,
+      GATTS_DEMO_CHAR_VAL_LEN_MAX, 0, NULL}},
+
+    /* Object Transfer Channel Characteristic Declaration */
+    [OPT_IDX_CHAR_OBJECT_CHANNEL]     =
+    {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&char_declaration_uuid, ESP_GATT_PERM_READ,
+      CHAR_DECLARATION_SIZE, CHAR_DECLARATION_SIZE, (uint8_t *)&char_prop_write_nr_notify}},
+
+    /* Object Transfer Channel Characteristic Value */
+    [OPT_IDX_CHAR_OBJECT_CHANNEL_VAL] =
+    {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_128, GATTS_CHAR_OBJECT_CHANNEL, ESP_GATT_PERM_WRITE,
+      GATTS_DEMO_CHAR_VAL_LEN_MAX, 0, NULL}},
+
+    /* Object Transfer Channel Client Characteristic Configuration Descriptor */
+    [OPT_IDX_CHAR_OBJECT_CHANNEL_CFG]  =
+    {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_WRITE,
+      sizeof(uint16_t),  0, NULL}},
+
+    /* Object Transaction Characteristic Declaration */
+    [OPT_IDX_CHAR_OBJECT_TRANSACTION]     =
+    {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&char_declaration_uuid, ESP_GATT_PERM_READ,
+      CHAR_DECLARATION_SIZE, CHAR_DECLARATION_SIZE, (uint8_t *)&char_prop_write_indicate}},
+
+    /* Object Transaction Characteristic Value */
+    [OPT_IDX_CHAR_OBJECT_TRANSACTION_VAL] =
+    {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_128, GATTS_CHAR_OBJECT_TRANSACTION, ESP_GATT_PERM_WRITE,
+      GATTS_DEMO_CHAR_VAL_LEN_MAX, 0, NULL}},
+
+    /* Object Transaction Client Characteristic Configuration Descriptor */
+    [OPT_IDX_CHAR_OBJECT_TRANSACTION_CFG]  =
+    {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_WRITE,
+      sizeof(uint16_t),  0, NULL}},
+
+    /* Alarm Timeline Characteristic Declaration */
+    [OPT_IDX_CHAR_ALARM_TIMELINE]     =
+    {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&char_declaration_uuid, ESP_GATT_PERM_READ,
+      CHAR_DECLARATION_SIZE, CHAR_DECLARATION_SIZE, (uint8_t *)&char_prop_read}},
+
+    /* Alarm Timeline Characteristic Value */
+    [OPT_IDX_CHAR_ALARM_TIMELINE_VAL] =
+    {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_128, GATTS_CHAR_ALARM_TIMELINE, ESP_GATT_PERM_READ,
       GATTS_DEMO_CHAR_VAL_LEN_MAX, 0, NULL}}
 };
 
@@ -545,11 +591,17 @@ void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts
         case ESP_GATTS_MTU_EVT:
         {
             ESP_LOGD(GATTS_TAG, "ESP_GATTS_MTU_EVT, MTU %d", param->mtu.mtu);
+            ObjectTransfer_channel_set_mtu(param->mtu.mtu);
             break;
         } 
         case ESP_GATTS_CONF_EVT:
         {
             ESP_LOGD(GATTS_TAG, "ESP_GATTS_CONF_EVT, status = %d, attr_handle %d", param->conf.status, param->conf.handle);
+            // Checksum goes with the OACP indication carrying it
+            if(param->conf.handle == OPT_handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL])
+            {
+                ObjectTransfer_channel_indicate_done(param->conf.status == ESP_GATT_OK);
+            }
             break;
         }
         case ESP_GATTS_START_EVT:
@@ -567,6 +619,7 @@ void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts
         case ESP_GATTS_DISCONNECT_EVT:
         {
             ESP_LOGD(GATTS_TAG, "ESP_GATTS_DISCONNECT_EVT, reason = 0x%x", param->disconnect.reason);
+            ObjectTransfer_channel_close();
             esp_ble_gap_ext_adv_start(NUM_EXT_ADV_SET, &ext_adv[0]);
             gpio_set_level(GPIO_OUTPUT_BLUE, 0);
             break;
@@ -590,12 +643,17 @@ void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts
             }
             break;
         }
+        case ESP_GATTS_CONGEST_EVT:
+        {
+            ESP_LOGD(GATTS_TAG, "ESP_GATTS_CONGEST_EVT, congested = %d", param->congest.congested);
+            ObjectTransfer_channel_set_congested(param->congest.congested);
+            break;
+        }
         case ESP_GATTS_STOP_EVT:
         case ESP_GATTS_OPEN_EVT:
         case ESP_GATTS_CANCEL_OPEN_EVT:
         case ESP_GATTS_CLOSE_EVT:
         case ESP_GATTS_LISTEN_EVT:
-        case ESP_GATTS_CONGEST_EVT:
         case ESP_GATTS_UNREG_EVT:
         case ESP_GATTS_DELETE_EVT:
         default:
@@ -2,6 +2,7 @@
 #include "ObjectTransfer_attr_ids.h"
 #include "ObjectManager.h"
 #include "ObjectTransfer_defs.h"
+#include "alarm_scheduler.h"
 #include "FilterOrder.h"
 #include "esp_gatts_api.h"
 #include "esp_err.h"
@@ -19,6 +20,7 @@ static esp_err_t ObjectTransfer_read_properties(esp_gatt_if_t gatts_if, esp_ble_
 static esp_err_t ObjectTransfer_read_list_filter(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
 static esp_err_t ObjectTransfer_read_alarm_action(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
 static esp_err_t ObjectTransfer_read_wifi_action(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+static esp_err_t ObjectTransfer_read_alarm_timeline(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
 
 
 esp_err_t ObjectTranfer_metadata_read_event(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
@@ -31,6 +33,7 @@ esp_err_t ObjectTranfer_metadata_read_event(esp_gatt_if_t gatts_if, esp_ble_gatt
     else if(param->read.handle == handle_table[OPT_IDX_CHAR_OBJECT_LIST_FILTER_VAL]) ObjectTransfer_read_list_filter(gatts_if, param, handle_table);
     else if(param->read.handle == handle_table[OPT_IDX_CHAR_OBJECT_ALARM_ACTION_VAL]) ObjectTransfer_read_alarm_action(gatts_if, param, handle_table);
     else if(param->read.handle == handle_table[OPT_IDX_CHAR_OBJECT_WIFI_ACTION_VAL]) ObjectTransfer_read_wifi_action(gatts_if, param, handle_table);
+    else if(param->read.handle == handle_table[OPT_IDX_CHAR_ALARM_TIMELINE_VAL]) ObjectTransfer_read_alarm_timeline(gatts_if, param, handle_table);
 
     return ESP_OK;
 }                           /*!< Gatt server callback param of ESP_GATTS_READ_EVT */
@@ -324,6 +327,46 @@ static esp_err_t ObjectTransfer_read_alarm_action(esp_gatt_if_t gatts_if, esp_bl
         memcpy(payload, &alarm.volume, ALARM_FIELD_SIZE);
         payload += ALARM_FIELD_SIZE;
 
+        bool rise_set = alarm.rise != ALARM_RISE_NONE;
+        bool calendar_set = alarm.calendar_id != 0 || rise_set;
+        bool snooze_set = alarm.nap || alarm.nap_repeats || alarm.ring_duration || calendar_set;
+
+        if(alarm.ringtone_id || alarm.group != ALARM_GROUP_NONE || snooze_set)
+        {
+            memcpy(payload, &alarm.ringtone_id, ALARM_RINGTONE_ID_SIZE);
+            payload += ALARM_RINGTONE_ID_SIZE;
+            rsp.attr_value.len += ALARM_RINGTONE_ID_SIZE;
+        }
+
+        if(alarm.group != ALARM_GROUP_NONE || snooze_set)
+        {
+            memcpy(payload, &alarm.group, ALARM_GROUP_SIZE);
+            payload += ALARM_GROUP_SIZE;
+            rsp.attr_value.len += ALARM_GROUP_SIZE;
+        }
+
+        if(snooze_set)
+        {
+            *payload++ = alarm.nap;
+            *payload++ = alarm.nap_repeats;
+            *payload++ = alarm.ring_duration;
+            rsp.attr_value.len += ALARM_SNOOZE_SIZE;
+        }
+
+        if(calendar_set)
+        {
+            memcpy(payload, &alarm.calendar_id, ALARM_CALENDAR_ID_SIZE);
+            payload += ALARM_CALENDAR_ID_SIZE;
+            rsp.attr_value.len += ALARM_CALENDAR_ID_SIZE;
+        }
+
+        if(rise_set)
+        {
+            *payload++ = alarm.rise;
+            *payload++ = alarm.rise_time;
+            rsp.attr_value.len += ALARM_RISE_SIZE;
+        }
+
         rsp.attr_value.handle = handle_table[OPT_IDX_CHAR_OBJECT_ALARM_ACTION_VAL];
         rsp.attr_value.offset = 0;
         rsp.attr_value.auth_req = ESP_GATT_AUTH_REQ_NONE;
@@ -366,4 +409,54 @@ static esp_err_t ObjectTransfer_read_wifi_action(esp_gatt_if_t gatts_if, esp_ble
     }
 
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+/* Upcoming firings as [object ID (6 bytes), epoch seconds (4 bytes)] records in time order.
+ * The list is longer than a default MTU, a long read continues from the copy its first part took.
+ */
+static esp_err_t ObjectTransfer_read_alarm_timeline(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    ESP_LOGI(TAG, "Alarm timeline READ EVENT, offset: %u", param->read.offset);
+
+    static uint8_t timeline[ALARM_TIMELINE_LEN * ALARM_TIMELINE_RECORD_SIZE];
+    static uint16_t timeline_len = 0;
+
+    if(param->read.need_rsp)
+    {
+        esp_gatt_rsp_t rsp;
+        rsp.attr_value.handle = handle_table[OPT_IDX_CHAR_ALARM_TIMELINE_VAL];
+
+        if(param->read.offset == 0)
+        {
+            alarm_timeline_entry_t entries[ALARM_TIMELINE_LEN];
+            uint8_t count = alarm_scheduler_timeline(entries, ALARM_TIMELINE_LEN);
+
+            uint8_t *p = timeline;
+            for(uint8_t i=0; i<count; i++)
+            {
+                uint32_t fire = entries[i].fire;
+                memcpy(p, &entries[i].id, ALARM_TIMELINE_ID_SIZE);
+                p += ALARM_TIMELINE_ID_SIZE;
+                memcpy(p, &fire, ALARM_TIMELINE_FIRE_SIZE);
+                p += ALARM_TIMELINE_FIRE_SIZE;
+            }
+            timeline_len = p - timeline;
+        }
+
+        if(param->read.offset > timeline_len)
+        {
+            esp_err_t err = esp_ble_gatts_send_response(gatts_if, param->read.conn_id, param->read.trans_id, ESP_GATT_INVALID_OFFSET, &rsp);
+            return err;
+        }
+
+        rsp.attr_value.len = timeline_len - param->read.offset;
+        memcpy(rsp.attr_value.value, &timeline[param->read.offset], rsp.attr_value.len);
+        rsp.attr_value.offset = param->read.offset;
+        rsp.attr_value.auth_req = ESP_GATT_AUTH_REQ_NONE;
+
+        esp_err_t err = esp_ble_gatts_send_response(gatts_if, param->read.conn_id, param->read.trans_id, STATUS_OK, &rsp);
+        if(err) return err;
+    }
+
+    return ESP_OK;
+}
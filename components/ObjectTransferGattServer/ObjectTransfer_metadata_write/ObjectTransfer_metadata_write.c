@@ -2,6 +2,8 @@
 #include "ObjectManager.h"
 #include "ObjectTransfer_attr_ids.h"
 #include "ObjectTransfer_defs.h"
+#include "ObjectTransfer_channel.h"
+#include "ObjectTransfer_transaction.h"
 #include "ObjectManagerIdList.h"
 #include "FilterOrder.h"
 #include "esp_err.h"
@@ -27,8 +29,21 @@ static esp_err_t ObjectTransfer_write_OACP(esp_gatt_if_t gatts_if, esp_ble_gatts
 static esp_err_t ObjectTransfer_write_OACP_CCC(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
 static esp_err_t ObjectTransfer_write_OACP_Create(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
 static esp_err_t ObjectTransfer_write_OACP_Delete(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+static esp_err_t ObjectTransfer_write_OACP_Create_By_Hash(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+static esp_err_t ObjectTransfer_write_OACP_Upload_State(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+static esp_err_t ObjectTransfer_write_OACP_Bulk_Enable(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+static esp_err_t ObjectTransfer_write_OACP_Calc_Sum(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+static esp_err_t ObjectTransfer_write_OACP_Read(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+static esp_err_t ObjectTransfer_write_OACP_Write(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+static esp_err_t ObjectTransfer_write_OACP_Abort(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
 static esp_err_t ObjectTransfer_write_OACP_OP_NS(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
 
+static esp_err_t ObjectTransfer_write_channel(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+static esp_err_t ObjectTransfer_write_channel_CCC(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+
+static esp_err_t ObjectTransfer_write_transaction(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+static esp_err_t ObjectTransfer_write_transaction_CCC(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
+
 static esp_err_t ObjectTransfer_write_OLCP(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
 static esp_err_t ObjectTransfer_write_OLCP_CCC(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
 static esp_err_t ObjectTransfer_write_OLCP_First(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table);
@@ -63,6 +78,10 @@ esp_err_t ObjectTranfer_metadata_write_event(esp_gatt_if_t gatts_if, esp_ble_gat
     // else if(param->write.handle == handle_table[OPT_IDX_CHAR_OBJECT_RINGTONE_ACTION_VAL]) ObjectTransfer_write_Ringtone_Action(gatts_if, param, handle_table);
     else if(param->write.handle == handle_table[OPT_IDX_CHAR_OBJECT_WIFI_ACTION_VAL]) ObjectTransfer_write_wifi_action(gatts_if, param, handle_table);
     else if(param->write.handle == handle_table[OPT_IDX_CHAR_OBJECT_WIFI_ACTION_CFG]) ObjectTransfer_write_wifi_CCC(gatts_if, param, handle_table);
+    else if(param->write.handle == handle_table[OPT_IDX_CHAR_OBJECT_CHANNEL_VAL]) ObjectTransfer_write_channel(gatts_if, param, handle_table);
+    else if(param->write.handle == handle_table[OPT_IDX_CHAR_OBJECT_CHANNEL_CFG]) ObjectTransfer_write_channel_CCC(gatts_if, param, handle_table);
+    else if(param->write.handle == handle_table[OPT_IDX_CHAR_OBJECT_TRANSACTION_VAL]) ObjectTransfer_write_transaction(gatts_if, param, handle_table);
+    else if(param->write.handle == handle_table[OPT_IDX_CHAR_OBJECT_TRANSACTION_CFG]) ObjectTransfer_write_transaction_CCC(gatts_if, param, handle_table);
 
     return ESP_OK;
 }
@@ -324,7 +343,7 @@ static esp_err_t ObjectTransfer_write_OACP(esp_gatt_if_t gatts_if, esp_ble_gatts
             break;
 
         case OACP_OP_CODE_CALC_SUM:
-            ObjectTransfer_write_OACP_OP_NS(gatts_if, param, handle_table);
+            ObjectTransfer_write_OACP_Calc_Sum(gatts_if, param, handle_table);
             break;
 
         case OACP_OP_CODE_EXECUTE:
@@ -332,15 +351,27 @@ static esp_err_t ObjectTransfer_write_OACP(esp_gatt_if_t gatts_if, esp_ble_gatts
             break;
 
         case OACP_OP_CODE_READ:
-            ObjectTransfer_write_OACP_OP_NS(gatts_if, param, handle_table);
+            ObjectTransfer_write_OACP_Read(gatts_if, param, handle_table);
             break;
 
         case OACP_OP_CODE_WRITE:
-            ObjectTransfer_write_OACP_OP_NS(gatts_if, param, handle_table);
+            ObjectTransfer_write_OACP_Write(gatts_if, param, handle_table);
             break;
 
         case OACP_OP_CODE_ABORT:
-            ObjectTransfer_write_OACP_OP_NS(gatts_if, param, handle_table);
+            ObjectTransfer_write_OACP_Abort(gatts_if, param, handle_table);
+            break;
+
+        case OACP_OP_CODE_CREATE_BY_HASH:
+            ObjectTransfer_write_OACP_Create_By_Hash(gatts_if, param, handle_table);
+            break;
+
+        case OACP_OP_CODE_UPLOAD_STATE:
+            ObjectTransfer_write_OACP_Upload_State(gatts_if, param, handle_table);
+            break;
+
+        case OACP_OP_CODE_BULK_ENABLE:
+            ObjectTransfer_write_OACP_Bulk_Enable(gatts_if, param, handle_table);
             break;
 
         default:
@@ -400,6 +431,141 @@ static esp_err_t ObjectTransfer_write_OACP_Create(esp_gatt_if_t gatts_if, esp_bl
     return ESP_OK;
 }
 
+/* Create with the SHA-256 of the content offered up front: [op code, size, type UUID128, hash].
+ * Response carries one more byte - 1 when the object got already stored content and no upload is needed.
+ */
+static esp_err_t ObjectTransfer_write_OACP_Create_By_Hash(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    esp_gatt_rsp_t rsp;
+    rsp.handle = handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL];
+
+    uint8_t status = STATUS_OK;
+    uint8_t indicate_data[4];
+    uint8_t indicate_data_len = 0;
+    indicate_data[0] = OACP_OP_CODE_RESPONSE;
+    indicate_data[1] = OACP_OP_CODE_CREATE_BY_HASH;
+
+    if(param->write.len != DATA_LEN_CREATE_BY_HASH)
+    {
+        ESP_LOGE(TAG, "INVALID ATTR VAL LENGTH");
+        ESP_LOGE(TAG, "LEN: %d", param->write.len);
+
+        status = INVALID_ATTR_VAL_LENGTH;
+    }
+
+    if(param->write.need_rsp)
+    {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, &rsp);
+    }
+    if(status != STATUS_OK) return ESP_OK;
+
+    uint32_t size;
+    memcpy(&size, &param->write.value[1], 4);
+
+    esp_bt_uuid_t type;
+    type.len = ESP_UUID_LEN_128;
+    memcpy(type.uuid.uuid128, &param->write.value[5], ESP_UUID_LEN_128);
+
+    oacp_op_code_result_t result;
+    bool shared;
+    ObjectManager_create_object_by_hash(size, type, &param->write.value[5 + ESP_UUID_LEN_128], &shared, &result);
+
+    indicate_data_len = 4;
+    indicate_data[2] = result;
+    indicate_data[3] = shared;
+    esp_ble_gatts_send_indicate(gatts_if, param->write.conn_id, handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL], indicate_data_len, indicate_data, true);
+
+    return ESP_OK;
+}
+
+/* Committed part of an interrupted upload of the current object - the client resumes with OACP Write from there */
+static esp_err_t ObjectTransfer_write_OACP_Upload_State(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    esp_gatt_rsp_t rsp;
+    rsp.handle = handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL];
+
+    uint8_t status = STATUS_OK;
+    uint8_t indicate_data[7];
+    uint8_t indicate_data_len = 0;
+    indicate_data[0] = OACP_OP_CODE_RESPONSE;
+    indicate_data[1] = OACP_OP_CODE_UPLOAD_STATE;
+
+    if(param->write.len != 1)
+    {
+        ESP_LOGE(TAG, "INVALID ATTR VAL LENGTH");
+        ESP_LOGE(TAG, "LEN: %d", param->write.len);
+
+        status = INVALID_ATTR_VAL_LENGTH;
+    }
+
+    if(param->write.need_rsp)
+    {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, &rsp);
+    }
+    if(status != STATUS_OK) return ESP_OK;
+
+    oacp_op_code_result_t result;
+    uint32_t watermark = 0;
+
+    if(ObjectTransfer_channel_get_state() != CHANNEL_IDLE)
+    {
+        result = OACP_RES_OBJECT_LOCKED;
+    }
+    else
+    {
+        ObjectManager_upload_watermark(&watermark, &result);
+    }
+
+    indicate_data_len = 7;
+    indicate_data[2] = result;
+    memcpy(&indicate_data[3], &watermark, 4);
+    esp_ble_gatts_send_indicate(gatts_if, param->write.conn_id, handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL], indicate_data_len, indicate_data, true);
+
+    return ESP_OK;
+}
+
+/* Enable or disable many alarms at once: [op code, scope, group, enable].
+ * Response carries the number of alarms that changed state.
+ */
+static esp_err_t ObjectTransfer_write_OACP_Bulk_Enable(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    esp_gatt_rsp_t rsp;
+    rsp.handle = handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL];
+
+    uint8_t status = STATUS_OK;
+    uint8_t indicate_data[5];
+    uint8_t indicate_data_len = 0;
+    indicate_data[0] = OACP_OP_CODE_RESPONSE;
+    indicate_data[1] = OACP_OP_CODE_BULK_ENABLE;
+
+    if(param->write.len != DATA_LEN_OACP_BULK_ENABLE)
+    {
+        ESP_LOGE(TAG, "INVALID ATTR VAL LENGTH");
+        ESP_LOGE(TAG, "LEN: %d", param->write.len);
+
+        status = INVALID_ATTR_VAL_LENGTH;
+    }
+
+    if(param->write.need_rsp)
+    {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, &rsp);
+    }
+    if(status != STATUS_OK) return ESP_OK;
+
+    oacp_op_code_result_t result;
+    uint16_t changed;
+    ObjectManager_bulk_enable(param->write.value[1], param->write.value[2], param->write.value[3], &changed, &result);
+
+    indicate_data_len = 5;
+    indicate_data[2] = result;
+    memcpy(&indicate_data[3], &changed, 2);
+    esp_ble_gatts_send_indicate(gatts_if, param->write.conn_id, handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL], indicate_data_len, indicate_data, true);
+
+    if(changed) set_next_alarm();
+
+    return ESP_OK;
+}
+
 static esp_err_t ObjectTransfer_write_OACP_Delete(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
 {
     esp_gatt_rsp_t rsp;
@@ -438,6 +604,186 @@ static esp_err_t ObjectTransfer_write_OACP_Delete(esp_gatt_if_t gatts_if, esp_bl
     return ESP_OK;
 }
 
+static esp_err_t ObjectTransfer_write_OACP_Calc_Sum(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    esp_gatt_rsp_t rsp;
+    rsp.handle = handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL];
+
+    uint8_t status = STATUS_OK;
+    uint8_t indicate_data[7];
+    uint8_t indicate_data_len = 0;
+    indicate_data[0] = OACP_OP_CODE_RESPONSE;
+    indicate_data[1] = OACP_OP_CODE_CALC_SUM;
+
+    if(param->write.len != DATA_LEN_OACP_CALC_SUM)
+    {
+        ESP_LOGE(TAG, "INVALID ATTR VAL LENGTH");
+        ESP_LOGE(TAG, "LEN: %d", param->write.len);
+
+        status = INVALID_ATTR_VAL_LENGTH;
+    }
+
+    if(param->write.need_rsp)
+    {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, &rsp);
+    }
+    if(status != STATUS_OK) return ESP_OK;
+
+    uint32_t offset, length;
+    memcpy(&offset, &param->write.value[1], 4);
+    memcpy(&length, &param->write.value[5], 4);
+
+    oacp_op_code_result_t result;
+    ObjectManager_prepare_checksum(offset, length, &result);
+    if(result == OACP_RES_SUCCESS)
+    {
+        object_t *object = ObjectManager_get_object();
+        bool whole_object = (offset == 0 && length == object->size);
+
+        ringtone_properties_t props;
+        if(whole_object && ObjectManager_get_ringtone_properties(object->id, &props) == ESP_OK && props.checksum_valid)
+        {
+            ESP_LOGI(TAG, "Cached checksum: %08" PRIx32, props.checksum);
+            memcpy(&indicate_data[3], &props.checksum, 4);
+            indicate_data_len = 7;
+        }
+        else
+        {
+            // Worker task indicates the checksum when the calculation is done
+            result = ObjectTransfer_channel_start_checksum(gatts_if, param->write.conn_id, handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL], object->id, offset, length, whole_object);
+            if(result == OACP_RES_SUCCESS) return ESP_OK;
+        }
+    }
+
+    if(indicate_data_len == 0) indicate_data_len = 3;
+    indicate_data[2] = result;
+    esp_ble_gatts_send_indicate(gatts_if, param->write.conn_id, handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL], indicate_data_len, indicate_data, true);
+
+    return ESP_OK;
+}
+
+static esp_err_t ObjectTransfer_write_OACP_Read(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    esp_gatt_rsp_t rsp;
+    rsp.handle = handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL];
+
+    uint8_t status = STATUS_OK;
+    uint8_t indicate_data[3];
+    uint8_t indicate_data_len = 0;
+    indicate_data[0] = OACP_OP_CODE_RESPONSE;
+    indicate_data[1] = OACP_OP_CODE_READ;
+
+    if(param->write.len != DATA_LEN_OACP_READ)
+    {
+        ESP_LOGE(TAG, "INVALID ATTR VAL LENGTH");
+        ESP_LOGE(TAG, "LEN: %d", param->write.len);
+
+        status = INVALID_ATTR_VAL_LENGTH;
+    }
+
+    if(param->write.need_rsp)
+    {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, &rsp);
+    }
+    if(status != STATUS_OK) return ESP_OK;
+
+    uint32_t offset, length;
+    memcpy(&offset, &param->write.value[1], 4);
+    memcpy(&length, &param->write.value[5], 4);
+
+    oacp_op_code_result_t result;
+    ObjectManager_prepare_read(offset, length, &result);
+    if(result == OACP_RES_SUCCESS)
+    {
+        result = ObjectTransfer_channel_start_read(gatts_if, param->write.conn_id, handle_table[OPT_IDX_CHAR_OBJECT_CHANNEL_VAL], ObjectManager_get_object()->id, offset, length);
+    }
+
+    indicate_data_len = 3;
+    indicate_data[2] = result;
+    esp_ble_gatts_send_indicate(gatts_if, param->write.conn_id, handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL], indicate_data_len, indicate_data, true);
+
+    // Content goes out only after the client got the OACP response
+    ObjectTransfer_channel_run_read();
+
+    return ESP_OK;
+}
+
+static esp_err_t ObjectTransfer_write_OACP_Write(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    esp_gatt_rsp_t rsp;
+    rsp.handle = handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL];
+
+    uint8_t status = STATUS_OK;
+    uint8_t indicate_data[3];
+    uint8_t indicate_data_len = 0;
+    indicate_data[0] = OACP_OP_CODE_RESPONSE;
+    indicate_data[1] = OACP_OP_CODE_WRITE;
+
+    if(param->write.len != DATA_LEN_OACP_WRITE)
+    {
+        ESP_LOGE(TAG, "INVALID ATTR VAL LENGTH");
+        ESP_LOGE(TAG, "LEN: %d", param->write.len);
+
+        status = INVALID_ATTR_VAL_LENGTH;
+    }
+
+    if(param->write.need_rsp)
+    {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, &rsp);
+    }
+    if(status != STATUS_OK) return ESP_OK;
+
+    uint32_t offset, length;
+    memcpy(&offset, &param->write.value[1], 4);
+    memcpy(&length, &param->write.value[5], 4);
+    uint8_t mode = param->write.value[9];
+
+    oacp_op_code_result_t result;
+    ObjectManager_prepare_write(offset, length, mode, &result);
+    if(result == OACP_RES_SUCCESS)
+    {
+        result = ObjectTransfer_channel_start_write(ObjectManager_get_object()->id, offset, length, mode & OACP_WRITE_MODE_TRUNCATE);
+    }
+
+    indicate_data_len = 3;
+    indicate_data[2] = result;
+    esp_ble_gatts_send_indicate(gatts_if, param->write.conn_id, handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL], indicate_data_len, indicate_data, true);
+
+    return ESP_OK;
+}
+
+static esp_err_t ObjectTransfer_write_OACP_Abort(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    esp_gatt_rsp_t rsp;
+    rsp.handle = handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL];
+
+    uint8_t status = STATUS_OK;
+    uint8_t indicate_data[3];
+    uint8_t indicate_data_len = 0;
+    indicate_data[0] = OACP_OP_CODE_RESPONSE;
+    indicate_data[1] = OACP_OP_CODE_ABORT;
+
+    if(param->write.len != 1)
+    {
+        ESP_LOGE(TAG, "INVALID ATTR VAL LENGTH");
+        ESP_LOGE(TAG, "LEN: %d", param->write.len);
+
+        status = INVALID_ATTR_VAL_LENGTH;
+    }
+
+    if(param->write.need_rsp)
+    {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, &rsp);
+    }
+    if(status != STATUS_OK) return ESP_OK;
+
+    indicate_data_len = 3;
+    indicate_data[2] = ObjectTransfer_channel_abort();
+    esp_ble_gatts_send_indicate(gatts_if, param->write.conn_id, handle_table[OPT_IDX_CHAR_OBJECT_OACP_VAL], indicate_data_len, indicate_data, true);
+
+    return ESP_OK;
+}
+
 static esp_err_t ObjectTransfer_write_OACP_OP_NS(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
 {
     esp_gatt_rsp_t rsp;
@@ -478,6 +824,78 @@ static esp_err_t ObjectTransfer_write_OACP_CCC(esp_gatt_if_t gatts_if, esp_ble_g
     return ESP_OK;
 }
 
+static esp_err_t ObjectTransfer_write_channel(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    // Written without response, so a full SD card or a stray packet is only logged
+    ObjectTransfer_channel_receive(param->write.value, param->write.len);
+
+    if(param->write.need_rsp)
+    {
+        esp_gatt_rsp_t rsp;
+        rsp.handle = handle_table[OPT_IDX_CHAR_OBJECT_CHANNEL_VAL];
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, STATUS_OK, &rsp);
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t ObjectTransfer_write_channel_CCC(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    if(param->write.len == 2){
+        uint16_t descr_value = param->write.value[1]<<8 | param->write.value[0];
+        if (descr_value == 0x0001){
+            ESP_LOGI(TAG, "Object channel notify enable");
+            ObjectTransfer_channel_set_notify(true);
+        }
+        else if (descr_value == 0x0000){
+            ESP_LOGI(TAG, "Object channel notify disable");
+            ObjectTransfer_channel_set_notify(false);
+        }else{
+            ESP_LOGE(TAG, "unknown descr value");
+        }
+    }
+    return ESP_OK;
+}
+
+/* Batch of object operations applied as a whole, see ObjectTransfer_transaction.h for the TLV op codes */
+static esp_err_t ObjectTransfer_write_transaction(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    ESP_LOGI(TAG, "Object Transaction WRITE EVENT, payload length: %u", param->write.len);
+
+    esp_gatt_rsp_t rsp;
+    rsp.handle = handle_table[OPT_IDX_CHAR_OBJECT_TRANSACTION_VAL];
+
+    uint8_t status = ObjectTransfer_transaction_stage(param->write.value, param->write.len);
+
+    if(param->write.need_rsp)
+    {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, &rsp);
+    }
+    if(status != STATUS_OK) return ESP_OK;
+
+    uint8_t indicate_data[TRANSACTION_IND_LEN_MAX];
+    uint16_t indicate_data_len = ObjectTransfer_transaction_commit(indicate_data);
+    esp_ble_gatts_send_indicate(gatts_if, param->write.conn_id, handle_table[OPT_IDX_CHAR_OBJECT_TRANSACTION_VAL], indicate_data_len, indicate_data, true);
+
+    return ESP_OK;
+}
+
+static esp_err_t ObjectTransfer_write_transaction_CCC(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
+{
+    if(param->write.len == 2){
+        uint16_t descr_value = param->write.value[1]<<8 | param->write.value[0];
+        if (descr_value == 0x0002){
+            ESP_LOGI(TAG, "Object transaction indicate enable");
+        }
+        else if (descr_value == 0x0000){
+            ESP_LOGI(TAG, "Object transaction indicate disable");
+        }else{
+            ESP_LOGE(TAG, "unknown descr value");
+        }
+    }
+    return ESP_OK;
+}
+
 static esp_err_t ObjectTransfer_write_OLCP(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param, uint16_t *handle_table)
 {
     ESP_LOGD(TAG, "Object OLCP WRITE EVENT");
@@ -0,0 +1,70 @@
+#include "ObjectTransfer_stream.h"
+
+#include <string.h>
+
+void ObjectTransfer_stream_init(object_stream_t *stream, uint8_t *buffer, uint32_t size, uint32_t offset, uint32_t length)
+{
+    stream->buffer = buffer;
+    stream->size = size;
+    stream->len = 0;
+    stream->offset = offset;
+    stream->remaining = length;
+}
+
+/* Bytes of the next chunk: up to the sector boundary where the buffer ends, or up to the end of the transfer */
+uint32_t ObjectTransfer_stream_chunk(const object_stream_t *stream)
+{
+    uint32_t chunk = stream->size - (stream->offset % OBJECT_STREAM_SECTOR_SIZE);
+    uint32_t left = stream->len + stream->remaining;
+
+    return (chunk > left) ? left : chunk;
+}
+
+/* Stages incoming data, returns how much of it fit into the current chunk */
+uint32_t ObjectTransfer_stream_fill(object_stream_t *stream, const uint8_t *data, uint32_t len)
+{
+    uint32_t space = ObjectTransfer_stream_chunk(stream) - stream->len;
+    uint32_t chunk = (len > space) ? space : len;
+
+    memcpy(&stream->buffer[stream->len], data, chunk);
+    stream->len += chunk;
+    stream->remaining -= chunk;
+
+    return chunk;
+}
+
+bool ObjectTransfer_stream_full(const object_stream_t *stream)
+{
+    return stream->len && stream->len == ObjectTransfer_stream_chunk(stream);
+}
+
+/* Staged chunk reached the card */
+void ObjectTransfer_stream_drained(object_stream_t *stream)
+{
+    stream->offset += stream->len;
+    stream->len = 0;
+}
+
+/* Chunk read from the card went out */
+void ObjectTransfer_stream_advance(object_stream_t *stream, uint32_t len)
+{
+    stream->offset += len;
+    stream->remaining -= len;
+}
+
+/* Whole requested length reached the card, a chunk whose write failed stays staged */
+bool ObjectTransfer_stream_complete(const object_stream_t *stream)
+{
+    return stream->remaining == 0 && stream->len == 0;
+}
+
+/* Object size after a write ending at end_offset: truncation cuts the object there, otherwise it only grows */
+uint32_t ObjectTransfer_stream_end_size(uint32_t size, uint32_t end_offset, bool truncate_rest)
+{
+    return (truncate_rest || end_offset > size) ? end_offset : size;
+}
+
+uint16_t ObjectTransfer_stream_payload_max(uint16_t mtu)
+{
+    return mtu - OBJECT_STREAM_ATT_HEADER;
+}
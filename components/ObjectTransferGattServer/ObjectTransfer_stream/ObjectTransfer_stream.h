@@ -0,0 +1,36 @@
+#ifndef __OBJECT_TRANSFER_STREAM_H__
+#define __OBJECT_TRANSFER_STREAM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Object content cut into chunks of a staging buffer which end on sector boundaries of the object.
+ * Plain C, the channel does the file and Bluetooth I/O around it. Only the first chunk of a transfer
+ * may start inside a sector and only the last one may end inside one.
+ */
+#define OBJECT_STREAM_SECTOR_SIZE       512
+#define OBJECT_STREAM_BUFFER_SIZE       (8 * OBJECT_STREAM_SECTOR_SIZE)     // reads and writes of the channel
+#define OBJECT_STREAM_CHECKSUM_CHUNK    (32 * OBJECT_STREAM_SECTOR_SIZE)    // reads of a checksum calculation
+#define OBJECT_STREAM_ATT_HEADER        3
+
+typedef struct {
+    uint8_t *buffer;
+    uint32_t size;          // whole sectors
+    uint32_t len;           // bytes staged for the next write
+    uint32_t offset;        // object offset of buffer[0]
+    uint32_t remaining;     // bytes of the requested length neither staged nor read yet
+} object_stream_t;
+
+void ObjectTransfer_stream_init(object_stream_t *stream, uint8_t *buffer, uint32_t size, uint32_t offset, uint32_t length);
+uint32_t ObjectTransfer_stream_chunk(const object_stream_t *stream);
+
+uint32_t ObjectTransfer_stream_fill(object_stream_t *stream, const uint8_t *data, uint32_t len);
+bool ObjectTransfer_stream_full(const object_stream_t *stream);
+void ObjectTransfer_stream_drained(object_stream_t *stream);
+
+void ObjectTransfer_stream_advance(object_stream_t *stream, uint32_t len);
+bool ObjectTransfer_stream_complete(const object_stream_t *stream);
+uint32_t ObjectTransfer_stream_end_size(uint32_t size, uint32_t end_offset, bool truncate_rest);
+uint16_t ObjectTransfer_stream_payload_max(uint16_t mtu);
+
+#endif
@@ -0,0 +1,389 @@
+#include "ObjectTransfer_transaction.h"
+#include "ObjectTransfer_channel.h"
+#include "ObjectManager.h"
+#include "ObjectManagerIdList.h"
+#include "FilterOrder.h"
+#include "alarm.h"
+#include "esp_log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define TAG "TRANSACTION"
+
+#define TRANSACTION_TEMP_PATH   MOUNT_POINT "/temp%u"
+#define TRANSACTION_LIST_PATH   MOUNT_POINT "/templist"
+#define TRANSACTION_PATH_LEN    24
+
+/* Object Transaction.
+ * A batch is first staged against copies of the touched objects, nothing reaches the SD card
+ * until every operation has passed. The commit then writes every metadata file and the new ID list
+ * to temporary files, a failure there deletes them and leaves the objects as they were. Only when all
+ * of them are written they replace the originals, deleted objects go last and the next alarm is
+ * recomputed once for the whole batch.
+ */
+typedef struct {
+    object_t object;
+    alarm_mode_args_t alarm;
+    bool created;
+    bool deleted;
+    bool dirty;
+} transaction_slot_t;
+
+typedef struct {
+    uint8_t op;
+    oacp_op_code_result_t result;
+    int8_t slot;
+} transaction_op_t;
+
+static transaction_slot_t slots[TRANSACTION_OBJECTS_MAX];
+static uint8_t slots_count = 0;
+static transaction_op_t ops[TRANSACTION_OPS_MAX];
+static uint8_t ops_count = 0;
+static bool staged_ok = false;
+
+static transaction_slot_t* ObjectTransfer_transaction_find(uint64_t id)
+{
+    for(uint8_t i=0; i<slots_count; i++)
+    {
+        if(!slots[i].created && slots[i].object.id == id) return &slots[i];
+    }
+
+    return NULL;
+}
+
+static oacp_op_code_result_t ObjectTransfer_transaction_select(uint64_t id, int8_t *slot)
+{
+    transaction_slot_t *staged = ObjectTransfer_transaction_find(id);
+    if(staged != NULL)
+    {
+        if(staged->deleted) return OACP_RES_INVALID_OBJECT;
+        *slot = staged - slots;
+        return OACP_RES_SUCCESS;
+    }
+
+    if(ObjectManager_list_search(false, id) == NULL) return OACP_RES_INVALID_OBJECT;
+    if(slots_count == TRANSACTION_OBJECTS_MAX) return OACP_RES_INSUF_RSR;
+
+    staged = &slots[slots_count];
+    memset(staged, 0, sizeof(transaction_slot_t));
+    if(ObjectManager_read_object(id, &staged->object, &staged->alarm) != ESP_OK) return OACP_RES_INVALID_OBJECT;
+
+    *slot = slots_count++;
+    return OACP_RES_SUCCESS;
+}
+
+static oacp_op_code_result_t ObjectTransfer_transaction_create(const uint8_t *uuid, int8_t *slot)
+{
+    // Ringtones need their content uploaded through OACP Write anyway, so a batch only creates alarms
+    if(ObjectManager_check_type((uint8_t*)uuid) != ALARM_TYPE) return OACP_RES_UNSUPPORTED_TYPE;
+    if(slots_count == TRANSACTION_OBJECTS_MAX) return OACP_RES_INSUF_RSR;
+
+    transaction_slot_t *staged = &slots[slots_count];
+    memset(staged, 0, sizeof(transaction_slot_t));
+    staged->object.type.len = ESP_UUID_LEN_128;
+    memcpy(staged->object.type.uuid.uuid128, uuid, ESP_UUID_LEN_128);
+    staged->object.properties = PROPERTY_ALL_WITHOUT_MARK;
+    staged->created = true;
+    staged->dirty = true;
+
+    *slot = slots_count++;
+    return OACP_RES_SUCCESS;
+}
+
+static oacp_op_code_result_t ObjectTransfer_transaction_stage_op(uint8_t op, const uint8_t *value, uint8_t len, int8_t *target, int8_t *created)
+{
+    transaction_slot_t *staged = (*target >= 0) ? &slots[*target] : NULL;
+
+    switch(op)
+    {
+        case TRANSACTION_OP_SELECT:
+        {
+            if(len != TRANSACTION_ID_SIZE) return OACP_RES_INVALID_PAR;
+
+            uint64_t id = 0;
+            memcpy(&id, value, TRANSACTION_ID_SIZE);
+            return ObjectTransfer_transaction_select(id, target);
+        }
+
+        case TRANSACTION_OP_CREATE:
+        {
+            if(len != ESP_UUID_LEN_128) return OACP_RES_INVALID_PAR;
+
+            oacp_op_code_result_t result = ObjectTransfer_transaction_create(value, target);
+            if(result == OACP_RES_SUCCESS) *created = *target;
+            return result;
+        }
+
+        case TRANSACTION_OP_SET_NAME:
+        {
+            if(staged == NULL) return OACP_RES_INVALID_OBJECT;
+            if(len == 0 || len > NAME_LEN_MAX-1) return OACP_RES_INVALID_PAR;
+
+            memcpy(staged->object.name, value, len);
+            staged->object.name[len] = '\0';
+            staged->object.name_len = len;
+            staged->dirty = true;
+            return OACP_RES_SUCCESS;
+        }
+
+        case TRANSACTION_OP_SET_PROPERTIES:
+        {
+            if(staged == NULL) return OACP_RES_INVALID_OBJECT;
+            if(len != 4) return OACP_RES_INVALID_PAR;
+
+            uint32_t properties;
+            memcpy(&properties, value, 4);
+            if(properties > 0xFF) return OACP_RES_INVALID_PAR;
+
+            staged->object.properties = properties;
+            staged->dirty = true;
+            return OACP_RES_SUCCESS;
+        }
+
+        case TRANSACTION_OP_SET_ALARM:
+        {
+            if(staged == NULL) return OACP_RES_INVALID_OBJECT;
+            if(ObjectManager_check_type(staged->object.type.uuid.uuid128) != ALARM_TYPE) return OACP_RES_UNSUPPORTED_TYPE;
+
+            alarm_mode_args_t alarm;
+            if(parse_alarm_values((uint8_t*)value, len, &alarm) != STATUS_OK) return OACP_RES_INVALID_PAR;
+
+            staged->alarm = alarm;
+            staged->object.set_custom_object = true;
+            staged->dirty = true;
+            return OACP_RES_SUCCESS;
+        }
+
+        case TRANSACTION_OP_ENABLE:
+        {
+            if(staged == NULL) return OACP_RES_INVALID_OBJECT;
+            if(len != 1 || value[0] > 1) return OACP_RES_INVALID_PAR;
+            if(!staged->object.set_custom_object) return OACP_RES_PROCEDURE_NOT_PERMIT;
+
+            staged->alarm.enable = value[0];
+            staged->dirty = true;
+            return OACP_RES_SUCCESS;
+        }
+
+        case TRANSACTION_OP_DELETE:
+        {
+            if(staged == NULL) return OACP_RES_INVALID_OBJECT;
+            if(len != 0) return OACP_RES_INVALID_PAR;
+            if((staged->object.properties & PROPERTY_DELETE) == 0) return OACP_RES_PROCEDURE_NOT_PERMIT;
+            if(!staged->created && ObjectTransfer_channel_get_state() != CHANNEL_IDLE) return OACP_RES_OBJECT_LOCKED;
+
+            staged->deleted = true;
+            *target = -1;
+            return OACP_RES_SUCCESS;
+        }
+
+        default:
+            return OACP_RES_OP_CODE_NOT_SUPPORTED;
+    }
+}
+
+/* Checks the TLV framing and stages the operations. The returned ATT status only covers the framing,
+ * results of the operations themselves are reported by the indication built in commit.
+ */
+uint8_t ObjectTransfer_transaction_stage(const uint8_t *data, uint16_t len)
+{
+    slots_count = 0;
+    ops_count = 0;
+    staged_ok = false;
+
+    uint16_t pos = 0;
+    while(pos < len)
+    {
+        if(len - pos < TRANSACTION_TLV_HEADER || len - pos - TRANSACTION_TLV_HEADER < data[pos+1] || ops_count == TRANSACTION_OPS_MAX)
+        {
+            ESP_LOGE(TAG, "Malformed batch at byte %u", pos);
+            ops_count = 0;
+            return INVALID_ATTR_VAL_LENGTH;
+        }
+
+        pos += TRANSACTION_TLV_HEADER + data[pos+1];
+        ops_count++;
+    }
+
+    if(ops_count == 0) return INVALID_ATTR_VAL_LENGTH;
+
+    int8_t target = -1;
+    object_t *current = ObjectManager_get_object();
+    if(current != NULL)
+    {
+        ObjectTransfer_transaction_select(current->id, &target);
+    }
+
+    staged_ok = true;
+    pos = 0;
+    for(uint8_t i=0; i<ops_count; i++)
+    {
+        ops[i].op = data[pos];
+        ops[i].slot = -1;
+        ops[i].result = ObjectTransfer_transaction_stage_op(data[pos], &data[pos+TRANSACTION_TLV_HEADER], data[pos+1], &target, &ops[i].slot);
+        pos += TRANSACTION_TLV_HEADER + data[pos+1];
+
+        if(ops[i].result != OACP_RES_SUCCESS)
+        {
+            ESP_LOGE(TAG, "Operation %u (0x%02x) failed: %d", i, ops[i].op, ops[i].result);
+            ops_count = i + 1;
+            staged_ok = false;
+            break;
+        }
+    }
+
+    return STATUS_OK;
+}
+
+static void ObjectTransfer_transaction_temp_path(char *path, uint8_t slot)
+{
+    snprintf(path, TRANSACTION_PATH_LEN, TRANSACTION_TEMP_PATH, slot);
+}
+
+/* Drops the temporary files and the IDs given to new objects by a prepare that did not finish */
+static void ObjectTransfer_transaction_rollback(void)
+{
+    char path[TRANSACTION_PATH_LEN];
+
+    for(uint8_t i=0; i<slots_count; i++)
+    {
+        transaction_slot_t *staged = &slots[i];
+        if(staged->deleted || !staged->dirty) continue;
+
+        ObjectTransfer_transaction_temp_path(path, i);
+        remove(path);
+
+        if(staged->created && staged->object.id != 0)
+        {
+            ObjectManager_list_delete_by_id(staged->object.id);
+            staged->object.id = 0;
+        }
+    }
+
+    remove(TRANSACTION_LIST_PATH);
+}
+
+/* Writes everything the commit changes to temporary files, no object is touched yet */
+static esp_err_t ObjectTransfer_transaction_prepare(bool *list_changed)
+{
+    uint64_t removed[TRANSACTION_OBJECTS_MAX];
+    uint8_t removed_count = 0;
+    char path[TRANSACTION_PATH_LEN];
+
+    for(uint8_t i=0; i<slots_count; i++)
+    {
+        transaction_slot_t *staged = &slots[i];
+        alarm_mode_args_t *alarm = staged->object.set_custom_object ? &staged->alarm : NULL;
+
+        if(staged->deleted)
+        {
+            if(!staged->created) removed[removed_count++] = staged->object.id;
+            continue;
+        }
+
+        if(!staged->dirty) continue;
+
+        // New objects get their IDs in memory only, the list file is written once below
+        if(staged->created)
+        {
+            staged->object.id = ObjectManager_list_add()->id;
+            *list_changed = true;
+        }
+
+        ObjectTransfer_transaction_temp_path(path, i);
+        if(ObjectManager_stage_object(&staged->object, alarm, path) != ESP_OK) return ESP_FAIL;
+    }
+
+    if(removed_count) *list_changed = true;
+    if(*list_changed && ObjectManager_stage_list(TRANSACTION_LIST_PATH, removed, removed_count) != ESP_OK) return ESP_FAIL;
+
+    return ESP_OK;
+}
+
+/* Indication: [batch result, operations count, per operation: op code, result, (ID of created object)] */
+uint16_t ObjectTransfer_transaction_commit(uint8_t *ind)
+{
+    oacp_op_code_result_t batch_result = staged_ok ? OACP_RES_SUCCESS : ops[ops_count-1].result;
+    bool list_changed = false;
+    object_t *current = ObjectManager_get_object();
+    bool prepared = staged_ok;
+    char path[TRANSACTION_PATH_LEN];
+
+    if(prepared && ObjectTransfer_transaction_prepare(&list_changed) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Writing the batch failed, no object changed");
+        ObjectTransfer_transaction_rollback();
+        batch_result = OACP_RES_OPERATION_FAILED;
+        prepared = false;
+        list_changed = false;
+    }
+
+    // Every file is written, from here on the batch only replaces them. A failing rename cannot be undone,
+    // so the rest of the batch is still applied and the failure reported.
+    for(uint8_t i=0; i<slots_count && prepared; i++)
+    {
+        transaction_slot_t *staged = &slots[i];
+        alarm_mode_args_t *alarm = staged->object.set_custom_object ? &staged->alarm : NULL;
+
+        if(staged->deleted || !staged->dirty) continue;
+
+        ObjectTransfer_transaction_temp_path(path, i);
+        if(ObjectManager_install_object(&staged->object, alarm, path) != ESP_OK)
+        {
+            batch_result = OACP_RES_OPERATION_FAILED;
+            continue;
+        }
+
+        if(current != NULL && current->id == staged->object.id)
+        {
+            *current = staged->object;
+            if(alarm) *get_alarm_pointer() = staged->alarm;
+        }
+    }
+
+    if(list_changed)
+    {
+        if(ObjectManager_install_list(TRANSACTION_LIST_PATH) != ESP_OK) batch_result = OACP_RES_OPERATION_FAILED;
+
+        for(uint8_t i=0; i<slots_count; i++)
+        {
+            transaction_slot_t *staged = &slots[i];
+            if(!staged->deleted || staged->created) continue;
+
+            if(current != NULL && current->id == staged->object.id)
+            {
+                ObjectManager_null_current_object();
+                current = NULL;
+            }
+            ObjectManager_discard_object(&staged->object);
+        }
+
+        FilterOrder_make_list();
+    }
+
+    if(staged_ok) set_next_alarm();
+
+    uint16_t ind_len = 0;
+    ind[ind_len++] = batch_result;
+    ind[ind_len++] = ops_count;
+
+    for(uint8_t i=0; i<ops_count; i++)
+    {
+        ind[ind_len++] = ops[i].op;
+        ind[ind_len++] = ops[i].result;
+
+        if(ops[i].slot >= 0 && batch_result == OACP_RES_SUCCESS)
+        {
+            memcpy(&ind[ind_len], &slots[ops[i].slot].object.id, TRANSACTION_ID_SIZE);
+            ind_len += TRANSACTION_ID_SIZE;
+        }
+    }
+
+    ESP_LOGI(TAG, "Batch of %u operations, %u objects: %d", ops_count, slots_count, batch_result);
+    slots_count = 0;
+    ops_count = 0;
+
+    return ind_len;
+}
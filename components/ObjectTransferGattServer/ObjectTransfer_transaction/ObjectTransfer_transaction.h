@@ -0,0 +1,26 @@
+#ifndef __OBJECT_TRANSFER_TRANSACTION_H__
+#define __OBJECT_TRANSFER_TRANSACTION_H__
+
+#include "esp_err.h"
+#include "ObjectTransfer_defs.h"
+#include <stdbool.h>
+
+/* Batch entries are TLVs: [op code, value length, value] */
+#define TRANSACTION_OP_SELECT           ((uint8_t)0x01)     // 6-byte object ID
+#define TRANSACTION_OP_CREATE           ((uint8_t)0x02)     // 16-byte type UUID
+#define TRANSACTION_OP_SET_NAME         ((uint8_t)0x03)     // name without terminator
+#define TRANSACTION_OP_SET_PROPERTIES   ((uint8_t)0x04)     // 4-byte properties
+#define TRANSACTION_OP_SET_ALARM        ((uint8_t)0x05)     // Alarm Action payload
+#define TRANSACTION_OP_ENABLE           ((uint8_t)0x06)     // 1 - enable, 0 - disable
+#define TRANSACTION_OP_DELETE           ((uint8_t)0x07)     // no value
+
+#define TRANSACTION_TLV_HEADER          2
+#define TRANSACTION_ID_SIZE             6
+#define TRANSACTION_OBJECTS_MAX         8
+#define TRANSACTION_OPS_MAX             16
+#define TRANSACTION_IND_LEN_MAX         (2 + TRANSACTION_OPS_MAX * (2 + TRANSACTION_ID_SIZE))
+
+uint8_t ObjectTransfer_transaction_stage(const uint8_t *data, uint16_t len);
+uint16_t ObjectTransfer_transaction_commit(uint8_t *ind);
+
+#endif
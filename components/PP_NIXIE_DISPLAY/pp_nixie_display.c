@@ -6,6 +6,7 @@
 #include "pp_nixie_display.h"
 #include "pp_wave_player.h"
 #include "alarm.h"
+#include "pp_timebase.h"
 #include "esp_log.h"
 
 #include "freertos/FreeRTOS.h"
@@ -85,11 +86,9 @@ void set_display_passkey(uint32_t passkey)
 
 static void set_nixie_state()
 {
-    time_t now;
     struct tm timeinfo;
 
-    time(&now);
-    localtime_r(&now, &timeinfo);
+    pp_timebase_now(NULL, &timeinfo);
 
     for (uint8_t i=0; i<16; i++)
     {
@@ -6,6 +6,8 @@
 #include "mk_i2c.h"
 #include "pp_rtc.h"
 #include "alarm.h"
+#include "alarm_scheduler.h"
+#include "pp_timebase.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -64,7 +66,7 @@ esp_err_t pp_rtc_read_time(struct timeval *tv)
         tm.tm_sec 	= seconds;
         tm.tm_isdst = -1;
 
-        time_t t = mktime(&tm);
+        time_t t = pp_timebase_mktime(&tm);
         tv->tv_sec = t;
     }
     
@@ -76,11 +78,22 @@ void pp_rtc_main(void* arg)
     while (true)
     {
         struct timeval now;
+        struct timeval was;
+        gettimeofday(&was, NULL);
         pp_rtc_read_time(&now);
         settimeofday(&now, NULL);
         ESP_LOGI(TAG, "Time updated from RTC");
 
-        set_next_alarm();
+        // Only a real jump reschedules every alarm, the hourly drift correction just rearms the next one
+        time_t drift = now.tv_sec - was.tv_sec;
+        if (drift > ALARM_SCHEDULER_JUMP_SEC || drift < -ALARM_SCHEDULER_JUMP_SEC)
+        {
+            alarm_time_changed();
+        }
+        else
+        {
+            set_next_alarm();
+        }
         vTaskDelay(3600000 / portTICK_PERIOD_MS);
     }
 }
@@ -89,6 +102,7 @@ esp_err_t pp_rtc_init()
 {
     setenv("TZ", CENTRAL_EUROPEAN_TIME_ZONE, 1);
 	tzset();
+    pp_timebase_init(CENTRAL_EUROPEAN_TIME_ZONE);
     
     uint8_t regVal = 0x1C;
     ESP_ERROR_CHECK(i2c_dev_write_reg(I2C_MASTER_NUM, DS_RTC_ADDR, DS_RTC_CONTROL_REG_ADDR, &regVal, 1));
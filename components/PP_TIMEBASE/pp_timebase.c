@@ -0,0 +1,328 @@
+#include "pp_timebase.h"
+#include <ctype.h>
+#include <stdlib.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+static const char *TAG = "timebase";
+static portMUX_TYPE timebase_lock = portMUX_INITIALIZER_UNLOCKED;
+#define TIMEBASE_LOCK()     portENTER_CRITICAL(&timebase_lock)
+#define TIMEBASE_UNLOCK()   portEXIT_CRITICAL(&timebase_lock)
+#else
+#define TIMEBASE_LOCK()
+#define TIMEBASE_UNLOCK()
+#endif
+
+typedef struct
+{
+    uint8_t month;      // 1-12
+    uint8_t week;       // 1-5, 5 - last
+    uint8_t wday;       // 0 - Sunday
+    int32_t time;       // seconds after local midnight
+} timebase_rule_t;
+
+static int32_t std_offset = 0;      // seconds east of UTC
+static int32_t dst_offset = 0;
+static bool has_dst = false;
+static timebase_rule_t dst_start_rule;
+static timebase_rule_t dst_end_rule;
+
+// Transition instants of cached_year and the year after it
+static int32_t cached_year = INT32_MIN;
+static time_t dst_start[2];
+static time_t dst_end[2];
+
+static time_t cached_now = -1;
+static struct tm cached_tm;
+
+/* Days since 1970-01-01 of a proleptic Gregorian date. Linear in day, so days past the end of
+ * the month carry over into the following ones.
+ */
+int32_t pp_timebase_days_from_civil(int32_t year, uint32_t month, uint32_t day)
+{
+    year -= month <= 2;
+    int32_t era = (year >= 0 ? year : year - 399) / 400;
+    uint32_t yoe = (uint32_t)(year - era * 400);
+    uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+void pp_timebase_civil_from_days(int32_t days, int32_t *year, uint32_t *month, uint32_t *day)
+{
+    days += 719468;
+    int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+    uint32_t doe = (uint32_t)(days - era * 146097);
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = (int32_t)yoe + era * 400 + (*month <= 2);
+}
+
+static int32_t pp_timebase_weekday(int32_t days)
+{
+    // 1970-01-01 was a Thursday
+    return days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6;
+}
+
+static int32_t pp_timebase_floor_div(int64_t a, int32_t b)
+{
+    return (int32_t)(a >= 0 ? a / b : (a - b + 1) / b);
+}
+
+static time_t pp_timebase_transition(const timebase_rule_t *rule, int32_t year, int32_t offset)
+{
+    int32_t first = pp_timebase_days_from_civil(year, rule->month, 1);
+    int32_t mday = 1 + (rule->wday - pp_timebase_weekday(first) + 7) % 7 + 7 * (rule->week - 1);
+    int32_t next_month = rule->month == 12 ? pp_timebase_days_from_civil(year + 1, 1, 1) : pp_timebase_days_from_civil(year, rule->month + 1, 1);
+
+    while (first + mday - 1 >= next_month)
+    {
+        mday -= 7;
+    }
+
+    return (time_t)(first + mday - 1) * PP_TIMEBASE_SEC_PER_DAY + rule->time - offset;
+}
+
+static void pp_timebase_cache_year(int32_t year)
+{
+    cached_year = year;
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        dst_start[i] = pp_timebase_transition(&dst_start_rule, year + i, std_offset);
+        dst_end[i] = pp_timebase_transition(&dst_end_rule, year + i, dst_offset);
+    }
+}
+
+static bool pp_timebase_is_dst(time_t t)
+{
+    if (!has_dst)
+    {
+        return false;
+    }
+
+    int32_t year;
+    uint32_t month, day;
+    pp_timebase_civil_from_days(pp_timebase_floor_div(t, PP_TIMEBASE_SEC_PER_DAY), &year, &month, &day);
+
+    if (year != cached_year && year != cached_year + 1)
+    {
+        pp_timebase_cache_year(year);
+    }
+
+    uint8_t i = year - cached_year;
+    if (dst_start[i] < dst_end[i])
+    {
+        return t >= dst_start[i] && t < dst_end[i];
+    }
+
+    // Southern hemisphere, DST spans the turn of the year
+    return t >= dst_start[i] || t < dst_end[i];
+}
+
+static const char* pp_timebase_parse_name(const char *p)
+{
+    if (*p == '<')
+    {
+        while (*p && *p != '>') p++;
+        return *p ? p + 1 : NULL;
+    }
+
+    const char *start = p;
+    while (isalpha((unsigned char)*p)) p++;
+
+    return (p - start >= 3) ? p : NULL;
+}
+
+static const char* pp_timebase_parse_time(const char *p, int32_t *seconds)
+{
+    int32_t sign = 1;
+    if (*p == '+' || *p == '-')
+    {
+        sign = (*p == '-') ? -1 : 1;
+        p++;
+    }
+
+    if (!isdigit((unsigned char)*p))
+    {
+        return NULL;
+    }
+
+    char *end;
+    int32_t value = strtol(p, &end, 10) * 3600;
+    for (int32_t unit = 60; *end == ':' && unit >= 1; unit /= 60)
+    {
+        value += strtol(end + 1, &end, 10) * unit;
+    }
+
+    *seconds = sign * value;
+    return end;
+}
+
+static const char* pp_timebase_parse_rule(const char *p, timebase_rule_t *rule)
+{
+    if (*p++ != ',' || *p++ != 'M')
+    {
+        return NULL;
+    }
+
+    char *end;
+    rule->month = strtoul(p, &end, 10);
+    if (*end != '.') return NULL;
+    rule->week = strtoul(end + 1, &end, 10);
+    if (*end != '.') return NULL;
+    rule->wday = strtoul(end + 1, &end, 10);
+    rule->time = 2 * 3600;
+
+    if (rule->month < 1 || rule->month > 12 || rule->week < 1 || rule->week > 5 || rule->wday > 6)
+    {
+        return NULL;
+    }
+
+    if (*end == '/')
+    {
+        return pp_timebase_parse_time(end + 1, &rule->time);
+    }
+
+    return end;
+}
+
+/* Parses a POSIX TZ string, e.g. "CET-1CEST,M3.5.0/2,M10.5.0/3". Returns false and falls back to
+ * UTC when the string uses anything else than Mm.w.d rules.
+ */
+bool pp_timebase_init(const char *tz)
+{
+    int32_t std = 0;
+    int32_t dst = 0;
+    timebase_rule_t start, end;
+    bool dst_used = false;
+
+    const char *p = pp_timebase_parse_name(tz);
+    p = p ? pp_timebase_parse_time(p, &std) : NULL;
+    std = -std;     // POSIX offsets are west of UTC
+
+    if (p && *p)
+    {
+        p = pp_timebase_parse_name(p);
+        dst = std + 3600;
+        if (p && *p != ',')
+        {
+            p = pp_timebase_parse_time(p, &dst);
+            dst = -dst;
+        }
+        p = p ? pp_timebase_parse_rule(p, &start) : NULL;
+        p = p ? pp_timebase_parse_rule(p, &end) : NULL;
+        dst_used = true;
+    }
+
+    TIMEBASE_LOCK();
+    if (p == NULL || *p)
+    {
+        std_offset = 0;
+        has_dst = false;
+    }
+    else
+    {
+        std_offset = std;
+        dst_offset = dst;
+        has_dst = dst_used;
+        dst_start_rule = start;
+        dst_end_rule = end;
+    }
+    cached_year = INT32_MIN;
+    cached_now = -1;
+    TIMEBASE_UNLOCK();
+
+#ifdef ESP_PLATFORM
+    if (p == NULL || *p)
+    {
+        ESP_LOGE(TAG, "Unsupported TZ \"%s\", using UTC", tz);
+    }
+#endif
+
+    return p != NULL && *p == '\0';
+}
+
+int32_t pp_timebase_utc_offset(time_t t)
+{
+    TIMEBASE_LOCK();
+    int32_t offset = pp_timebase_is_dst(t) ? dst_offset : std_offset;
+    TIMEBASE_UNLOCK();
+
+    return offset;
+}
+
+static void pp_timebase_decompose(time_t t, struct tm *local)
+{
+    bool dst = pp_timebase_is_dst(t);
+    int64_t wall = (int64_t)t + (dst ? dst_offset : std_offset);
+    int32_t days = pp_timebase_floor_div(wall, PP_TIMEBASE_SEC_PER_DAY);
+    int32_t secs = (int32_t)(wall - (int64_t)days * PP_TIMEBASE_SEC_PER_DAY);
+
+    int32_t year;
+    uint32_t month, day;
+    pp_timebase_civil_from_days(days, &year, &month, &day);
+
+    local->tm_sec   = secs % 60;
+    local->tm_min   = (secs / 60) % 60;
+    local->tm_hour  = secs / 3600;
+    local->tm_mday  = day;
+    local->tm_mon   = month - 1;
+    local->tm_year  = year - 1900;
+    local->tm_wday  = pp_timebase_weekday(days);
+    local->tm_yday  = days - pp_timebase_days_from_civil(year, 1, 1);
+    local->tm_isdst = dst;
+}
+
+void pp_timebase_localtime(time_t t, struct tm *local)
+{
+    TIMEBASE_LOCK();
+    pp_timebase_decompose(t, local);
+    TIMEBASE_UNLOCK();
+}
+
+/* Inverse of pp_timebase_localtime, fields may be out of range like in mktime and tm_isdst is ignored.
+ * A wall time repeated when DST ends resolves to the first instant, a skipped one is read as standard time.
+ */
+time_t pp_timebase_mktime(const struct tm *local)
+{
+    int32_t month = local->tm_mon;
+    int32_t year = local->tm_year + 1900 + pp_timebase_floor_div(month, 12);
+    month -= pp_timebase_floor_div(month, 12) * 12;
+
+    int64_t wall = (int64_t)pp_timebase_days_from_civil(year, month + 1, 1) * PP_TIMEBASE_SEC_PER_DAY
+                 + (int64_t)(local->tm_mday - 1) * PP_TIMEBASE_SEC_PER_DAY
+                 + local->tm_hour * 3600 + local->tm_min * 60 + local->tm_sec;
+
+    TIMEBASE_LOCK();
+    time_t t = wall - dst_offset;
+    if (!pp_timebase_is_dst(t))
+    {
+        t = wall - std_offset;
+    }
+    TIMEBASE_UNLOCK();
+
+    return t;
+}
+
+void pp_timebase_now(time_t *now, struct tm *local)
+{
+    time_t t = time(NULL);
+
+    TIMEBASE_LOCK();
+    if (t != cached_now)
+    {
+        pp_timebase_decompose(t, &cached_tm);
+        cached_now = t;
+    }
+    *local = cached_tm;
+    TIMEBASE_UNLOCK();
+
+    if (now) *now = t;
+}
@@ -0,0 +1,24 @@
+#ifndef __PP_TIMEBASE_H__
+#define __PP_TIMEBASE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+/* Local time without newlib's TZ handling. The POSIX TZ string is parsed once, DST transition
+ * instants are kept for the current and the next year and the decomposition of the current
+ * second is cached. Only Mm.w.d transition rules are supported, the ones used in Europe.
+ */
+#define PP_TIMEBASE_SEC_PER_DAY     86400
+
+bool pp_timebase_init(const char *tz);
+
+int32_t pp_timebase_days_from_civil(int32_t year, uint32_t month, uint32_t day);
+void pp_timebase_civil_from_days(int32_t days, int32_t *year, uint32_t *month, uint32_t *day);
+
+int32_t pp_timebase_utc_offset(time_t t);
+void pp_timebase_localtime(time_t t, struct tm *local);
+time_t pp_timebase_mktime(const struct tm *local);
+void pp_timebase_now(time_t *now, struct tm *local);
+
+#endif
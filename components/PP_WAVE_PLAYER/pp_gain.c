@@ -0,0 +1,129 @@
+#include "pp_gain.h"
+
+#include <math.h>
+
+#define GAIN_SHIFT      16      // fraction bits below the Q15 gain
+#define GAIN_STEADY     0xFFFF  // phase of a gain which no longer moves
+
+void pp_gain_init(pp_gain_t *g, uint16_t target, uint8_t rise, uint32_t rise_samples)
+{
+    if (target > GAIN_UNITY)
+    {
+        target = GAIN_UNITY;
+    }
+
+    g->target = (int32_t)target << GAIN_SHIFT;
+    g->blocks = rise_samples / GAIN_BLOCK;
+    g->rise = (g->blocks && target) ? rise : GAIN_RISE_NONE;
+    g->delta = 0;
+    g->phase = 0;
+    g->next = g->target;
+
+    switch (g->rise)
+    {
+        case GAIN_RISE_LINEAR:
+            g->gain = 0;
+            g->step = g->target / (int32_t)g->blocks;
+            break;
+
+        case GAIN_RISE_EXPONENTIAL:
+        {
+            // Same number of dB every block, the multiplier is computed once in floating point
+            double per_block = pow(10.0, GAIN_RISE_FLOOR_DB / 20.0 / g->blocks);
+            g->gain = (int32_t)(g->target / pow(10.0, GAIN_RISE_FLOOR_DB / 20.0));
+            g->factor = (int64_t)(per_block * (1ll << 30) + 0.5);
+            break;
+        }
+
+        default:
+            g->gain = g->target;
+            g->blocks = 0;
+            break;
+    }
+}
+
+/* Sets the next control point and the per sample change which approaches it. The change is truncated,
+ * so the gain is set to the control point itself at the end of the block and the error never adds up.
+ */
+static void pp_gain_next_block(pp_gain_t *g)
+{
+    if (g->blocks == 0)
+    {
+        g->gain = g->target;
+        g->delta = 0;
+        g->phase = GAIN_STEADY;
+        return;
+    }
+
+    int32_t next;
+    if (g->rise == GAIN_RISE_LINEAR)
+    {
+        next = g->gain + g->step;
+    }
+    else
+    {
+        next = (int32_t)(((int64_t)g->gain * g->factor) >> 30);
+    }
+
+    if (--g->blocks == 0 || next > g->target)
+    {
+        next = g->target;
+        g->blocks = 0;
+    }
+
+    g->next = next;
+    g->delta = (next - g->gain) / GAIN_BLOCK;
+    g->phase = GAIN_BLOCK;
+}
+
+static inline int16_t pp_gain_sat16(int32_t x)
+{
+    return (x > INT16_MAX) ? INT16_MAX : (x < INT16_MIN) ? INT16_MIN : x;
+}
+
+void pp_gain_apply(pp_gain_t *g, int16_t *buf, size_t n)
+{
+    while (n)
+    {
+        if (g->phase == 0)
+        {
+            pp_gain_next_block(g);
+        }
+
+        size_t k = (n < g->phase) ? n : g->phase;
+        int32_t gain = g->gain;
+
+        if (g->delta == 0)
+        {
+            int32_t q15 = gain >> GAIN_SHIFT;
+            if (q15 != GAIN_UNITY)
+            {
+                for (size_t i = 0; i < k; i++)
+                {
+                    buf[i] = pp_gain_sat16((buf[i] * q15) >> 15);
+                }
+            }
+        }
+        else
+        {
+            int32_t delta = g->delta;
+            for (size_t i = 0; i < k; i++)
+            {
+                gain += delta;
+                buf[i] = pp_gain_sat16((buf[i] * (gain >> GAIN_SHIFT)) >> 15);
+            }
+        }
+
+        g->gain = gain;
+        if (g->phase != GAIN_STEADY)
+        {
+            g->phase -= k;
+            if (g->phase == 0)
+            {
+                g->gain = g->next;
+            }
+        }
+        buf += k;
+        n -= k;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef __PP_GAIN_H__
+#define __PP_GAIN_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Q15 gain stage for 16-bit samples. Plain C, no ESP-IDF dependencies. The gain moves between
+ * control points every GAIN_BLOCK samples and is interpolated per sample in between, so a
+ * rising volume has no audible steps.
+ */
+#define GAIN_UNITY              32767   // Q15
+#define GAIN_BLOCK              64      // samples between control points
+#define GAIN_RISE_FLOOR_DB      50      // exponential rise starts this far below the target
+
+#define GAIN_RISE_NONE          0
+#define GAIN_RISE_LINEAR        1
+#define GAIN_RISE_EXPONENTIAL   2
+
+typedef struct
+{
+    int32_t gain;           // Q15.16, the Q15 gain in the upper half
+    int32_t target;         // Q15.16
+    int32_t next;           // Q15.16, gain at the next control point
+    int32_t delta;          // per sample change up to the next control point
+    int32_t step;           // linear rise: change per control block
+    int64_t factor;         // exponential rise: Q30 multiplier per control block
+    uint32_t blocks;        // control blocks left in the rise
+    uint16_t phase;         // samples left to the next control point
+    uint8_t rise;
+} pp_gain_t;
+
+void pp_gain_init(pp_gain_t *g, uint16_t target, uint8_t rise, uint32_t rise_samples);
+void pp_gain_apply(pp_gain_t *g, int16_t *buf, size_t n);
+
+#endif
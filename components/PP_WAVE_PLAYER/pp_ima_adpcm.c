@@ -0,0 +1,87 @@
+#include "pp_ima_adpcm.h"
+
+static const int16_t ima_step_table[IMA_ADPCM_STEP_INDEX_MAX + 1] =
+{
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t ima_index_table[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+typedef struct
+{
+    int32_t predictor;
+    int32_t index;
+} ima_state_t;
+
+static inline int16_t ima_decode(ima_state_t *s, uint8_t code)
+{
+    int32_t step = ima_step_table[s->index];
+    int32_t diff = step >> 3;
+
+    if (code & 1) diff += step >> 2;
+    if (code & 2) diff += step >> 1;
+    if (code & 4) diff += step;
+
+    s->predictor += (code & 8) ? -diff : diff;
+    s->predictor = (s->predictor > INT16_MAX) ? INT16_MAX : (s->predictor < INT16_MIN) ? INT16_MIN : s->predictor;
+
+    s->index += ima_index_table[code & 7];
+    s->index = (s->index < 0) ? 0 : (s->index > IMA_ADPCM_STEP_INDEX_MAX) ? IMA_ADPCM_STEP_INDEX_MAX : s->index;
+
+    return (int16_t)s->predictor;
+}
+
+static inline void ima_header(ima_state_t *s, const uint8_t *p)
+{
+    s->predictor = (int16_t)(p[0] | (p[1] << 8));
+    s->index = (p[2] > IMA_ADPCM_STEP_INDEX_MAX) ? IMA_ADPCM_STEP_INDEX_MAX : p[2];
+}
+
+/* Decodes one block to 16-bit mono, returns the number of samples. Codes of a channel come in
+ * groups of 4 bytes, low nibble first. Stereo decodes the left channel into out, the right
+ * channel is then averaged into it in place.
+ */
+size_t pp_ima_adpcm_to_mono16(const uint8_t *in, uint16_t block_align, uint8_t channels, int16_t *out)
+{
+    uint32_t stride = IMA_ADPCM_HEADER_SIZE * channels;
+    uint32_t groups = (block_align - stride) / stride;
+    ima_state_t s;
+
+    ima_header(&s, in);
+    out[0] = (int16_t)s.predictor;
+
+    int16_t *o = &out[1];
+    const uint8_t *p = &in[stride];
+    for (uint32_t g = 0; g < groups; g++, p += stride)
+    {
+        for (uint32_t b = 0; b < 4; b++)
+        {
+            *o++ = ima_decode(&s, p[b] & 0x0F);
+            *o++ = ima_decode(&s, p[b] >> 4);
+        }
+    }
+
+    if (channels == 2)
+    {
+        ima_header(&s, &in[IMA_ADPCM_HEADER_SIZE]);
+        out[0] = (int16_t)(((int32_t)out[0] + s.predictor) >> 1);
+
+        o = &out[1];
+        p = &in[stride + 4];
+        for (uint32_t g = 0; g < groups; g++, p += stride)
+        {
+            for (uint32_t b = 0; b < 4; b++)
+            {
+                o[0] = (int16_t)(((int32_t)o[0] + ima_decode(&s, p[b] & 0x0F)) >> 1);
+                o[1] = (int16_t)(((int32_t)o[1] + ima_decode(&s, p[b] >> 4)) >> 1);
+                o += 2;
+            }
+        }
+    }
+
+    return groups * 8 + 1;
+}
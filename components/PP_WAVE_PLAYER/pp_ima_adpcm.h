@@ -0,0 +1,20 @@
+#ifndef __PP_IMA_ADPCM_H__
+#define __PP_IMA_ADPCM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* IMA ADPCM block decoder for WAV format tag 0x0011. Plain C, no ESP-IDF dependencies. Every
+ * block starts with a 4-byte header per channel, the first sample and step index, followed by
+ * 4-bit codes interleaved in 4-byte groups per channel. Blocks decode independently.
+ */
+#define IMA_ADPCM_HEADER_SIZE   4       // bytes per channel
+#define IMA_ADPCM_STEP_INDEX_MAX 88
+
+// Frames of one block, the header sample included
+#define IMA_ADPCM_SAMPLES_PER_BLOCK(block_align, channels)  \
+    (((block_align) - IMA_ADPCM_HEADER_SIZE * (channels)) * 2 / (channels) + 1)
+
+size_t pp_ima_adpcm_to_mono16(const uint8_t *in, uint16_t block_align, uint8_t channels, int16_t *out);
+
+#endif
@@ -0,0 +1,164 @@
+#include "pp_resampler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t pp_resampler_gcd(uint32_t a, uint32_t b)
+{
+    while (b)
+    {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static float pp_resampler_bessel_i0(float x)
+{
+    float sum = 1.0f;
+    float term = 1.0f;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0f * k)) * (x / (2.0f * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/* Kaiser windowed sinc at L times the input rate, split into L phases. Taps of a phase are
+ * stored oldest sample first, so the inner loop runs forward over both arrays. Each phase is
+ * rounded to sum to exactly 1.0, so no phase changes the DC level. Single precision is enough
+ * for Q15 taps and runs on the FPU, double would be emulated.
+ */
+static void pp_resampler_design(pp_resampler_filter_t *f, uint16_t up, uint32_t down)
+{
+    uint32_t len = RESAMPLER_TAPS * up;
+    float center = (len - 1) / 2.0f;
+    float fc = RESAMPLER_CUTOFF / (2.0f * (up > down ? up : down));
+    float i0_beta = pp_resampler_bessel_i0(RESAMPLER_KAISER_BETA);
+
+    for (uint32_t ph = 0; ph < up; ph++)
+    {
+        float taps[RESAMPLER_TAPS];
+        float sum = 0.0f;
+
+        for (uint32_t k = 0; k < RESAMPLER_TAPS; k++)
+        {
+            float t = (float)(ph + k * up) - center;
+            float arg = 2.0f * (float)M_PI * fc * t;
+            float sinc = (t == 0.0f) ? 1.0f : sinf(arg) / arg;
+            float w = t / (center + 1.0f);
+            float window = pp_resampler_bessel_i0(RESAMPLER_KAISER_BETA * sqrtf(1.0f - w * w)) / i0_beta;
+
+            taps[RESAMPLER_TAPS - 1 - k] = sinc * window;
+            sum += sinc * window;
+        }
+
+        int16_t *coef = &f->coef[ph * RESAMPLER_TAPS];
+        int32_t total = 0;
+        uint32_t largest = 0;
+        for (uint32_t k = 0; k < RESAMPLER_TAPS; k++)
+        {
+            float q = taps[k] / sum * 32768.0f;
+            q = q > INT16_MAX ? INT16_MAX : q < INT16_MIN ? INT16_MIN : q;
+            coef[k] = (int16_t)lroundf(q);
+            total += coef[k];
+            if (abs(coef[k]) > abs(coef[largest])) largest = k;
+        }
+
+        // Rounding error goes to the largest tap, where it matters least
+        int32_t fixed = coef[largest] + (32768 - total);
+        coef[largest] = fixed > INT16_MAX ? INT16_MAX : fixed;
+    }
+
+    f->up = up;
+    f->down = down;
+}
+
+bool pp_resampler_init(pp_resampler_t *r, pp_resampler_filter_t *filter, uint32_t in_rate, uint32_t out_rate)
+{
+    memset(r, 0, sizeof(pp_resampler_t));
+
+    if (in_rate == 0 || out_rate == 0)
+    {
+        return false;
+    }
+
+    uint32_t g = pp_resampler_gcd(in_rate, out_rate);
+    if (out_rate / g > RESAMPLER_PHASES_MAX)
+    {
+        return false;
+    }
+
+    r->up = out_rate / g;
+    r->down = in_rate / g;
+
+    if (in_rate == out_rate)
+    {
+        return true;
+    }
+
+    // Same ratio as the last ring, the coefficients are still valid
+    if (filter->up != r->up || filter->down != r->down)
+    {
+        pp_resampler_design(filter, r->up, r->down);
+    }
+
+    r->filter = filter;
+    return true;
+}
+
+void pp_resampler_reset(pp_resampler_t *r)
+{
+    r->phase = 0;
+    r->pos = 0;
+    memset(r->buf, 0, sizeof(r->buf));
+}
+
+static inline int16_t pp_resampler_sat16(int32_t x)
+{
+    return (x > INT16_MAX) ? INT16_MAX : (x < INT16_MIN) ? INT16_MIN : x;
+}
+
+/* Converts one chunk, returns the number of output samples. The newest input sample of an
+ * output is in[pos], its taps reach RESAMPLER_TAPS - 1 samples back into the history.
+ */
+size_t pp_resampler_process(pp_resampler_t *r, const int16_t *in, size_t n, int16_t *out)
+{
+    if (r->filter == NULL)
+    {
+        memcpy(out, in, n * sizeof(int16_t));
+        return n;
+    }
+
+    memcpy(&r->buf[RESAMPLER_TAPS - 1], in, n * sizeof(int16_t));
+
+    size_t produced = 0;
+    uint32_t pos = r->pos;
+    uint32_t phase = r->phase;
+
+    while (pos < n)
+    {
+        const int16_t *x = &r->buf[pos];
+        const int16_t *h = &r->filter->coef[phase * RESAMPLER_TAPS];
+
+        int32_t acc = 1 << 14;
+        for (uint32_t k = 0; k < RESAMPLER_TAPS; k += 4)
+        {
+            acc += x[k] * h[k] + x[k + 1] * h[k + 1] + x[k + 2] * h[k + 2] + x[k + 3] * h[k + 3];
+        }
+        out[produced++] = pp_resampler_sat16(acc >> 15);
+
+        phase += r->down;
+        pos += phase / r->up;
+        phase %= r->up;
+    }
+
+    r->pos = pos - n;
+    r->phase = phase;
+    memmove(r->buf, &r->buf[n], (RESAMPLER_TAPS - 1) * sizeof(int16_t));
+
+    return produced;
+}
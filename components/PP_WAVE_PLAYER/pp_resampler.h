@@ -0,0 +1,44 @@
+#ifndef __PP_RESAMPLER_H__
+#define __PP_RESAMPLER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Polyphase FIR sample rate converter for 16-bit mono. Plain C, no ESP-IDF dependencies.
+ * The ratio is kept exact as out/in reduced to L/M, one Q15 filter phase per L. Input is
+ * taken in chunks of at most RESAMPLER_CHUNK samples, the filter history carries over.
+ * Coefficients live in a filter owned by the caller and are designed only when the ratio
+ * differs from the one it holds, so a ring at a known rate neither allocates nor designs.
+ */
+#define RESAMPLER_TAPS          32      // taps per phase
+#define RESAMPLER_PHASES_MAX    512     // largest L, covers 8000-96000 Hz to 44100 Hz
+#define RESAMPLER_CHUNK         256     // input samples per call
+#define RESAMPLER_KAISER_BETA   7.0f    // about 70 dB stopband
+#define RESAMPLER_CUTOFF        0.88f   // passband edge relative to the lower Nyquist frequency
+
+// Output samples of one call, at most
+#define RESAMPLER_OUT_MAX(in_rate, out_rate)    ((RESAMPLER_CHUNK * (out_rate) + (in_rate) - 1) / (in_rate) + 1)
+
+typedef struct
+{
+    int16_t coef[RESAMPLER_PHASES_MAX * RESAMPLER_TAPS];    // L phases of RESAMPLER_TAPS
+    uint16_t up;            // ratio the coefficients are designed for, 0 - none yet
+    uint32_t down;
+} pp_resampler_filter_t;
+
+typedef struct
+{
+    const pp_resampler_filter_t *filter;    // NULL - rates equal, samples pass through
+    uint16_t up;            // L
+    uint32_t down;          // M
+    uint32_t phase;         // 0..L-1, position between two input samples
+    uint32_t pos;           // next input sample an output is computed at, relative to the chunk
+    int16_t buf[RESAMPLER_TAPS - 1 + RESAMPLER_CHUNK];
+} pp_resampler_t;
+
+bool pp_resampler_init(pp_resampler_t *r, pp_resampler_filter_t *filter, uint32_t in_rate, uint32_t out_rate);
+void pp_resampler_reset(pp_resampler_t *r);
+size_t pp_resampler_process(pp_resampler_t *r, const int16_t *in, size_t n, int16_t *out);
+
+#endif
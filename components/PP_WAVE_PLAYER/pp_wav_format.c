@@ -0,0 +1,298 @@
+#include "pp_wav_format.h"
+#include "pp_ima_adpcm.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#define WAV_RIFF_HEADER_SIZE    12
+#define WAV_CHUNK_HEADER_SIZE   8
+#define WAV_FMT_SIZE_MIN        16
+#define WAV_FMT_SIZE_MAX        40      // WAVE_FORMAT_EXTENSIBLE
+#define WAV_FMT_SUBFORMAT       24      // offset of the subformat GUID, its first two bytes are the format tag
+#define WAV_FMT_ADPCM_SIZE      20      // IMA ADPCM fmt with cbSize and wSamplesPerBlock
+#define WAV_FMT_SAMPLES_PER_BLOCK 18
+
+static uint16_t wav_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t wav_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// File or memory the header is parsed from, mem NULL - file
+typedef struct
+{
+    int fd;
+    const uint8_t *mem;
+    uint32_t size;
+} pp_wav_source_t;
+
+static bool pp_wav_read_at(const pp_wav_source_t *src, uint32_t pos, uint8_t *buf, uint32_t len)
+{
+    if (src->mem)
+    {
+        if (pos > src->size || len > src->size - pos)
+        {
+            return false;
+        }
+        memcpy(buf, &src->mem[pos], len);
+        return true;
+    }
+
+    return lseek(src->fd, pos, SEEK_SET) == (off_t)pos && read(src->fd, buf, len) == (ssize_t)len;
+}
+
+static bool pp_wav_parse_fmt(const uint8_t *p, uint32_t size, pp_wav_format_t *fmt)
+{
+    fmt->format         = wav_le16(&p[0]);
+    fmt->channels       = wav_le16(&p[2]);
+    fmt->sample_rate    = wav_le32(&p[4]);
+    fmt->block_align    = wav_le16(&p[12]);
+    fmt->bits           = wav_le16(&p[14]);
+
+    if (fmt->format == WAV_FORMAT_EXTENSIBLE)
+    {
+        if (size < WAV_FMT_SIZE_MAX)
+        {
+            return false;
+        }
+        fmt->format = wav_le16(&p[WAV_FMT_SUBFORMAT]);
+    }
+
+    if (fmt->format == WAV_FORMAT_IMA_ADPCM && size >= WAV_FMT_ADPCM_SIZE)
+    {
+        fmt->samples_per_block = wav_le16(&p[WAV_FMT_SAMPLES_PER_BLOCK]);
+    }
+
+    return true;
+}
+
+/* Blocks are a power of 2, so a stream block of whole sectors holds whole ADPCM blocks and
+ * decodes to less than two samples per byte. The block size follows from block_align, a
+ * different wSamplesPerBlock means a layout this decoder doesn't know.
+ */
+static bool pp_wav_check_adpcm(pp_wav_format_t *fmt)
+{
+    uint16_t align = fmt->block_align;
+
+    if (fmt->bits != 4 || align > WAV_ADPCM_BLOCK_MAX || (align & (align - 1)) != 0 ||
+        align <= IMA_ADPCM_HEADER_SIZE * fmt->channels)
+    {
+        return false;
+    }
+
+    uint16_t samples = IMA_ADPCM_SAMPLES_PER_BLOCK(align, fmt->channels);
+    if (fmt->samples_per_block != 0 && fmt->samples_per_block != samples)
+    {
+        return false;
+    }
+    fmt->samples_per_block = samples;
+
+    // Last block is padded, the fact chunk tells how many frames are real
+    if (fmt->fact_frames)
+    {
+        uint32_t blocks = (fmt->fact_frames + samples - 1) / samples;
+        if (blocks < fmt->data_size / align)
+        {
+            fmt->data_size = blocks * align;
+        }
+    }
+
+    return true;
+}
+
+/* Walks the chunks until both fmt and data are found. LIST and unknown chunks are skipped.
+ * IMA ADPCM needs the frame count of fact, which may follow data, so for it the walk goes on
+ * to the RIFF end. A data chunk longer than the file, as left by an interrupted recording,
+ * is cut at the end of the file.
+ */
+static bool pp_wav_parse_source(const pp_wav_source_t *src, uint32_t end, pp_wav_format_t *fmt)
+{
+    uint8_t buf[WAV_FMT_SIZE_MAX];
+    bool have_fmt = false;
+    bool have_data = false;
+    bool have_fact = false;
+
+    memset(fmt, 0, sizeof(pp_wav_format_t));
+
+    if (end < WAV_RIFF_HEADER_SIZE || !pp_wav_read_at(src, 0, buf, WAV_RIFF_HEADER_SIZE))
+    {
+        return false;
+    }
+
+    if (memcmp(buf, "RIFF", 4) != 0 || memcmp(&buf[8], "WAVE", 4) != 0)
+    {
+        return false;
+    }
+
+    uint32_t riff_end = wav_le32(&buf[4]);
+    if (riff_end <= end - WAV_CHUNK_HEADER_SIZE && riff_end >= WAV_RIFF_HEADER_SIZE - WAV_CHUNK_HEADER_SIZE)
+    {
+        end = riff_end + WAV_CHUNK_HEADER_SIZE;
+    }
+
+    uint32_t pos = WAV_RIFF_HEADER_SIZE;
+    while (end - pos >= WAV_CHUNK_HEADER_SIZE)
+    {
+        if (have_fmt && have_data && (have_fact || fmt->format != WAV_FORMAT_IMA_ADPCM))
+        {
+            break;
+        }
+
+        if (!pp_wav_read_at(src, pos, buf, WAV_CHUNK_HEADER_SIZE))
+        {
+            return false;
+        }
+
+        uint32_t size = wav_le32(&buf[4]);
+        pos += WAV_CHUNK_HEADER_SIZE;
+
+        if (memcmp(buf, "fmt ", 4) == 0)
+        {
+            uint32_t len = (size < WAV_FMT_SIZE_MAX) ? size : WAV_FMT_SIZE_MAX;
+            if (size < WAV_FMT_SIZE_MIN || size > end - pos || !pp_wav_read_at(src, pos, buf, len))
+            {
+                return false;
+            }
+            if (!pp_wav_parse_fmt(buf, len, fmt))
+            {
+                return false;
+            }
+            have_fmt = true;
+        }
+        else if (memcmp(buf, "data", 4) == 0)
+        {
+            fmt->data_offset = pos;
+            fmt->data_size = (size < end - pos) ? size : end - pos;
+            have_data = true;
+        }
+        else if (memcmp(buf, "fact", 4) == 0 && size >= 4)
+        {
+            if (size > end - pos || !pp_wav_read_at(src, pos, buf, 4))
+            {
+                return false;
+            }
+            fmt->fact_frames = wav_le32(buf);
+            have_fact = true;
+        }
+
+        // Chunks are padded to an even size
+        if (size > end - pos || (size & 1) > end - pos - size)
+        {
+            break;
+        }
+        pos += size + (size & 1);
+    }
+
+    if (!have_fmt || !have_data)
+    {
+        return false;
+    }
+
+    if ((fmt->format != WAV_FORMAT_PCM && fmt->format != WAV_FORMAT_IMA_ADPCM) ||
+        fmt->channels == 0 || fmt->channels > WAV_CHANNELS_MAX ||
+        fmt->sample_rate < WAV_SAMPLE_RATE_MIN || fmt->sample_rate > WAV_SAMPLE_RATE_MAX)
+    {
+        return false;
+    }
+
+    if (fmt->format == WAV_FORMAT_IMA_ADPCM)
+    {
+        if (!pp_wav_check_adpcm(fmt))
+        {
+            return false;
+        }
+    }
+    else if ((fmt->bits != 8 && fmt->bits != 16 && fmt->bits != 24 && fmt->bits != 32) ||
+        fmt->block_align != fmt->channels * fmt->bits / 8)
+    {
+        return false;
+    }
+    else
+    {
+        fmt->samples_per_block = 1;
+    }
+
+    fmt->data_size -= fmt->data_size % fmt->block_align;
+    return fmt->data_size > 0;
+}
+
+bool pp_wav_parse(int fd, uint32_t end, pp_wav_format_t *fmt)
+{
+    pp_wav_source_t src = { .fd = fd };
+    return pp_wav_parse_source(&src, end, fmt);
+}
+
+// For a file already in memory, data_offset is then relative to data
+bool pp_wav_parse_mem(const uint8_t *data, uint32_t size, pp_wav_format_t *fmt)
+{
+    pp_wav_source_t src = { .fd = -1, .mem = data, .size = size };
+    return pp_wav_parse_source(&src, size, fmt);
+}
+
+/* Top 16 bits of a little endian sample of the given size, 8-bit samples are unsigned */
+static inline int16_t pp_wav_sample16(const uint8_t *p, uint8_t bytes)
+{
+    switch (bytes)
+    {
+        case 1:
+            return (int16_t)((p[0] - 128) << 8);
+        case 2:
+            return (int16_t)(p[0] | (p[1] << 8));
+        case 3:
+            return (int16_t)(p[1] | (p[2] << 8));
+        default:
+            return (int16_t)(p[2] | (p[3] << 8));
+    }
+}
+
+/* Stereo is downmixed as the average of both channels */
+static inline void pp_wav_convert(const uint8_t *in, size_t frames, int16_t *out, uint8_t bytes, uint8_t channels)
+{
+    for (size_t i = 0; i < frames; i++)
+    {
+        const uint8_t *frame = &in[i * bytes * channels];
+        if (channels == 1)
+        {
+            out[i] = pp_wav_sample16(frame, bytes);
+        }
+        else
+        {
+            out[i] = (int16_t)(((int32_t)pp_wav_sample16(frame, bytes) + pp_wav_sample16(frame + bytes, bytes)) >> 1);
+        }
+    }
+}
+
+/* Converts whole frames, or whole blocks for ADPCM, to 16-bit mono. Every PCM layout gets its
+ * own call with constant sizes, so the sample switch and the channel test fold away in each loop.
+ */
+size_t pp_wav_to_mono16(const pp_wav_format_t *fmt, const uint8_t *in, size_t frames, int16_t *out)
+{
+    if (fmt->format == WAV_FORMAT_IMA_ADPCM)
+    {
+        size_t samples = 0;
+        for (size_t i = 0; i < frames; i++)
+        {
+            samples += pp_ima_adpcm_to_mono16(&in[i * fmt->block_align], fmt->block_align, fmt->channels, &out[samples]);
+        }
+        return samples;
+    }
+
+    switch ((fmt->bits / 8) | (fmt->channels << 4))
+    {
+        case 0x11: pp_wav_convert(in, frames, out, 1, 1); break;
+        case 0x12: memcpy(out, in, frames * sizeof(int16_t)); break;
+        case 0x13: pp_wav_convert(in, frames, out, 3, 1); break;
+        case 0x14: pp_wav_convert(in, frames, out, 4, 1); break;
+        case 0x21: pp_wav_convert(in, frames, out, 1, 2); break;
+        case 0x22: pp_wav_convert(in, frames, out, 2, 2); break;
+        case 0x23: pp_wav_convert(in, frames, out, 3, 2); break;
+        case 0x24: pp_wav_convert(in, frames, out, 4, 2); break;
+        default: return 0;
+    }
+
+    return frames;
+}
@@ -0,0 +1,38 @@
+#ifndef __PP_WAV_FORMAT_H__
+#define __PP_WAV_FORMAT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* RIFF/WAVE parsing and sample conversion. Plain C on POSIX file descriptors or memory, no
+ * ESP-IDF dependencies. The player outputs 16-bit mono, every supported layout is converted to it.
+ */
+#define WAV_FORMAT_PCM          0x0001
+#define WAV_FORMAT_IMA_ADPCM    0x0011
+#define WAV_FORMAT_EXTENSIBLE   0xFFFE
+
+#define WAV_CHANNELS_MAX        2
+#define WAV_FRAME_SIZE_MAX      (WAV_CHANNELS_MAX * 4)  // bytes of one frame, 32-bit stereo
+#define WAV_ADPCM_BLOCK_MAX     2048    // bytes of one ADPCM block, 44.1 kHz stereo as written by common encoders
+#define WAV_SAMPLE_RATE_MIN     8000
+#define WAV_SAMPLE_RATE_MAX     96000
+
+typedef struct
+{
+    uint16_t format;        // WAV_FORMAT_PCM, also for WAVE_FORMAT_EXTENSIBLE with a PCM subformat, or WAV_FORMAT_IMA_ADPCM
+    uint16_t channels;      // 1-2
+    uint32_t sample_rate;
+    uint16_t bits;          // 8, 16, 24, 32, ADPCM: 4
+    uint16_t block_align;   // bytes of one frame, ADPCM: of one block, a power of 2
+    uint16_t samples_per_block; // frames decoded from block_align bytes, 1 for PCM
+    uint32_t data_offset;   // file offset of the first frame
+    uint32_t data_size;     // whole frames only, cut at the end of the file
+    uint32_t fact_frames;   // from the fact chunk, 0 - no fact chunk
+} pp_wav_format_t;
+
+bool pp_wav_parse(int fd, uint32_t end, pp_wav_format_t *fmt);
+bool pp_wav_parse_mem(const uint8_t *data, uint32_t size, pp_wav_format_t *fmt);
+size_t pp_wav_to_mono16(const pp_wav_format_t *fmt, const uint8_t *in, size_t frames, int16_t *out);
+
+#endif
@@ -1,7 +1,17 @@
 #include "pp_wave_player.h"
+#include "pp_wav_format.h"
+#include "pp_gain.h"
+#include "pp_resampler.h"
 
 #include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -9,29 +19,25 @@
 
 #include "driver/i2s_std.h" // i2s setup
 #include "alarm.h"
+#include "alarm_history.h"
+#include "ObjectManager.h"
 #include "driver/gpio.h"
 
 static const char *TAG = "WAV PLAYER";
 
 i2s_chan_handle_t tx_handle;
 
-volatile bool play_alarm_flag = false;
-
-void set_play_alarm_flag(bool new_val)
-{
-  play_alarm_flag = new_val;
-}
-
 static esp_err_t i2s_setup()
 {
   // setup a standard config and the channel
   i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+  chan_cfg.auto_clear = true; // an underrun plays silence instead of repeating the last DMA buffer
   ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &tx_handle, NULL));
 
   // setup the i2s config
   i2s_std_config_t std_cfg = {
-      .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(44100),                                                    // the wav file sample rate
-      .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO), // the wav faile bit and channel config
+      .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(PLAYER_SAMPLE_RATE),                                       // files of other rates are resampled
+      .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO), // samples are converted to 16-bit mono
       .gpio_cfg = {
           // refer to configuration.h for pin setup
           .mclk = I2S_GPIO_UNUSED,
@@ -49,76 +55,599 @@ static esp_err_t i2s_setup()
   return i2s_channel_init_std_mode(tx_handle, &std_cfg);
 }
 
-static esp_err_t play_wave()
+/* Reader task fills a single producer, single consumer ring of blocks, the player task drains
+ * it into I2S. Each side only writes its own index, so the ring needs no lock. The loop point
+ * is handled by the reader inside a block, the repeat of the ringtone has no gap.
+ */
+typedef struct
+{
+  uint8_t data[STREAM_BLOCK_SIZE];
+  uint32_t len;       // more than STREAM_BLOCK_SIZE - STREAM_SECTOR_SIZE
+} stream_block_t;
+
+static stream_block_t stream_ring[STREAM_BLOCKS];
+static uint32_t stream_head = 0;    // blocks filled, written by the reader
+static uint32_t stream_tail = 0;    // blocks played, written by the player
+static volatile bool stream_run = false;
+static volatile bool stream_failed = false;
+static volatile bool stream_stop = false;   // set by the alarm module when the ring ends
+static int stream_fd = -1;          // -1 at the start of a prefetched ring, the reader opens the file
+static char stream_path[CONTENT_PATH_LEN_MAX];
+static uint32_t stream_read_pos = 0; // where the reader starts
+static uint32_t stream_start = 0;   // first byte of the samples, the loop point
+static uint32_t stream_end = 0;
+static pp_wav_format_t stream_fmt;
+static TaskHandle_t reader_task_hdl = NULL;
+static TaskHandle_t player_task_hdl = NULL;
+static SemaphoreHandle_t stream_done = NULL;
+static pp_wave_player_stats_t stats;
+
+static int16_t stream_out[2 * STREAM_BLOCK_SIZE];   // one block of ADPCM decodes to less than two samples per byte
+static uint8_t stream_carry[WAV_ADPCM_BLOCK_MAX];   // a frame, or an ADPCM block
+static uint16_t stream_carry_len = 0;
+
+/* Start of the next alarm's ringtone, read ahead so the ring starts without waiting for the
+ * card. Blocks are read exactly as the reader would, so the reader just continues after them.
+ */
+typedef struct
+{
+  stream_block_t blocks[PREFETCH_BLOCKS];
+  pp_wav_format_t fmt;
+  uint32_t end;
+  uint32_t pos;       // file position after the last block
+  char path[CONTENT_PATH_LEN_MAX];
+  uint64_t ringtone_id;
+  uint32_t generation;
+  bool valid;
+} stream_prefetch_t;
+
+static stream_prefetch_t prefetch;
+
+/* Built-in ringtone for a missing, broken or too slow card. EMBED_FILES keeps it in the
+ * flash image, the samples are converted straight from memory-mapped flash.
+ */
+extern const uint8_t builtin_ringtone_start[] asm("_binary_builtin_ringtone_wav_start");
+extern const uint8_t builtin_ringtone_end[] asm("_binary_builtin_ringtone_wav_end");
+
+static bool stream_started = false;   // first sample of the ring written
+static int64_t stream_fire_us = 0;    // scheduled time of the ring
+
+static pp_gain_t stream_gain;
+static pp_resampler_t stream_resampler;
+static pp_resampler_filter_t stream_filter;   // kept between rings, redesigned only for a new rate
+static int16_t stream_resampled[RESAMPLER_OUT_MAX(WAV_SAMPLE_RATE_MIN, PLAYER_SAMPLE_RATE)];
+
+_Static_assert(WAV_ADPCM_BLOCK_MAX <= STREAM_BLOCK_SIZE && WAV_FRAME_SIZE_MAX <= WAV_ADPCM_BLOCK_MAX, "carry size");
+_Static_assert(GAIN_RISE_LINEAR == ALARM_RISE_LINEAR && GAIN_RISE_EXPONENTIAL == ALARM_RISE_EXPONENTIAL, "rise modes");
+
+static int64_t wall_time_us(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Button, deadline and snooze end the ring from other tasks, a notification wakes the player wherever it waits
+static void pp_wave_player_stop(void)
+{
+  stream_stop = true;
+  xTaskNotifyGive(player_task_hdl);
+}
+
+static uint32_t stream_fill(void)
 {
-  FILE *fh = fopen("/sdcard/ringtone0.wav", "r");
-  if (fh == NULL)
+  return __atomic_load_n(&stream_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&stream_tail, __ATOMIC_ACQUIRE);
+}
+
+// Ringtone object file is preallocated and longer than its content, so reading stops at stream_end
+static bool stream_fill_block(stream_block_t *block, uint32_t *pos)
+{
+  block->len = 0;
+
+  while (block->len < STREAM_BLOCK_SIZE)
+  {
+    if (*pos >= stream_end)
+    {
+      if (lseek(stream_fd, stream_start, SEEK_SET) != stream_start)
+      {
+        return false;
+      }
+      *pos = stream_start;
+      stats.loops++;
+    }
+
+    uint32_t chunk = STREAM_BLOCK_SIZE - block->len;
+    if (chunk > stream_end - *pos)
+    {
+      chunk = stream_end - *pos;
+    }
+
+    // Reads end on a sector boundary, a block too short for the rest of a sector ends early
+    uint32_t over = (*pos + chunk) % STREAM_SECTOR_SIZE;
+    if (*pos + chunk < stream_end && over)
+    {
+      if (chunk <= over)
+      {
+        break;
+      }
+      chunk -= over;
+    }
+
+    int64_t start = esp_timer_get_time();
+    ssize_t got = read(stream_fd, &block->data[block->len], chunk);
+    uint32_t took = esp_timer_get_time() - start;
+    if (took > stats.read_max_us)
+    {
+      stats.read_max_us = took;
+    }
+
+    if (got <= 0)
+    {
+      return false;
+    }
+
+    block->len += got;
+    *pos += got;
+  }
+
+  return true;
+}
+
+static void pp_wave_reader_main(void *arg)
+{
+  while (true)
+  {
+    do
+    {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    } while (!stream_run);
+
+    uint32_t pos = stream_read_pos;
+    if (stream_fd < 0)
+    {
+      stream_fd = open(stream_path, O_RDONLY);
+      if (stream_fd >= 0 && lseek(stream_fd, pos, SEEK_SET) != pos)
+      {
+        close(stream_fd);
+        stream_fd = -1;
+      }
+    }
+
+    while (stream_run)
+    {
+      uint32_t head = stream_head;
+      if (stream_fill() == STREAM_BLOCKS)
+      {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        continue;
+      }
+
+      if (stream_fd < 0 || !stream_fill_block(&stream_ring[head % STREAM_BLOCKS], &pos))
+      {
+        ESP_LOGE(TAG, "Ringtone read failed");
+        stream_failed = true;
+        xTaskNotifyGive(player_task_hdl);
+
+        // Player stops the stream when it sees the failure
+        while (stream_run)
+        {
+          ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        break;
+      }
+
+      __atomic_store_n(&stream_head, head + 1, __ATOMIC_RELEASE);
+      xTaskNotifyGive(player_task_hdl);
+    }
+
+    xSemaphoreGive(stream_done);
+  }
+}
+
+/* Blocks don't end on frame boundaries for 24-bit and stereo files, nor on ADPCM block
+ * boundaries, the part of a frame left at the end of a block is kept for the next one
+ */
+static size_t stream_convert(const uint8_t *in, uint32_t len)
+{
+  uint16_t align = stream_fmt.block_align;
+  size_t samples = 0;
+
+  if (stream_carry_len)
+  {
+    uint16_t need = align - stream_carry_len;
+    memcpy(&stream_carry[stream_carry_len], in, need);
+    samples = pp_wav_to_mono16(&stream_fmt, stream_carry, 1, stream_out);
+    in += need;
+    len -= need;
+  }
+
+  uint32_t frames = len / align;
+  samples += pp_wav_to_mono16(&stream_fmt, in, frames, &stream_out[samples]);
+
+  stream_carry_len = len - frames * align;
+  memcpy(stream_carry, &in[frames * align], stream_carry_len);
+
+  return samples;
+}
+
+// Opens the file and finds its samples, the file is left at the first of them
+static int stream_open(const char *path, uint32_t end, pp_wav_format_t *fmt)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
   {
     ESP_LOGE(TAG, "Failed to open file");
-    return ESP_ERR_INVALID_ARG;
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size < end)
+  {
+    end = st.st_size;
+  }
+
+  if (!pp_wav_parse(fd, end, fmt) || lseek(fd, fmt->data_offset, SEEK_SET) != fmt->data_offset)
+  {
+    ESP_LOGE(TAG, "Unsupported or broken wav file");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/* Reads the start of the next alarm's ringtone once it is due within PREFETCH_LEAD_SEC. The
+ * generation of the armed alarm tells when the next alarm changed and the buffer is stale.
+ */
+static void stream_prefetch_update(void)
+{
+  alarm_next_ring_t next;
+  if (!alarm_get_next_ring(&next))
+  {
+    prefetch.valid = false;
+    return;
+  }
+
+  if (prefetch.valid && prefetch.generation == next.generation)
+  {
+    return;
+  }
+  prefetch.valid = false;
+
+  time_t now;
+  time(&now);
+  if (next.fire > now + PREFETCH_LEAD_SEC)
+  {
+    return;
+  }
+
+  uint32_t size;
+  if (ObjectManager_get_ringtone_path(next.ringtone_id, prefetch.path, &size) != ESP_OK)
+  {
+    strcpy(prefetch.path, WAV_FILE);
+    size = UINT32_MAX;
+  }
+
+  int fd = stream_open(prefetch.path, size, &prefetch.fmt);
+  if (fd < 0)
+  {
+    return;
+  }
+
+  // No ring is playing, the stream state is free to use
+  stream_fd = fd;
+  stream_start = prefetch.fmt.data_offset;
+  stream_end = prefetch.fmt.data_offset + prefetch.fmt.data_size;
+
+  uint32_t pos = stream_start;
+  bool ok = true;
+  for (uint8_t i = 0; i < PREFETCH_BLOCKS && ok; i++)
+  {
+    ok = stream_fill_block(&prefetch.blocks[i], &pos);
+  }
+
+  close(fd);
+  stream_fd = -1;
+
+  if (ok)
+  {
+    prefetch.end = stream_end;
+    prefetch.pos = pos;
+    prefetch.ringtone_id = next.ringtone_id;
+    prefetch.generation = next.generation;
+    prefetch.valid = true;
+
+    // Filter for the ringtone's rate is designed now as well, the ring finds it ready
+    pp_resampler_init(&stream_resampler, &stream_filter, prefetch.fmt.sample_rate, PLAYER_SAMPLE_RATE);
+    ESP_LOGI(TAG, "Prefetched %s for the alarm in %" PRId64 " s", prefetch.path, (int64_t)(next.fire - now));
+  }
+}
+
+// Logs the format and sets the writer up for it, the I2S rate stays fixed
+static bool stream_begin(const char *name)
+{
+  ESP_LOGI(TAG, "%s: %s, %" PRIu32 " Hz, %u bit, %u channels, %" PRIu32 " bytes of samples at %" PRIu32, name,
+    stream_fmt.format == WAV_FORMAT_IMA_ADPCM ? "IMA ADPCM" : "PCM", stream_fmt.sample_rate, stream_fmt.bits, stream_fmt.channels,
+    stream_fmt.data_size, stream_fmt.data_offset);
+
+  if (!pp_resampler_init(&stream_resampler, &stream_filter, stream_fmt.sample_rate, PLAYER_SAMPLE_RATE))
+  {
+    ESP_LOGE(TAG, "No resampler for %" PRIu32 " Hz", stream_fmt.sample_rate);
+    return false;
   }
 
-  // create a writer buffer
-  int16_t *buf = calloc(AUDIO_BUFFER, sizeof(int16_t));
-  size_t bytes_read = 0;
+  pp_resampler_reset(&stream_resampler);
+  stream_carry_len = 0;
+  return true;
+}
+
+// Resamples, applies the gain and writes the samples of one converted block to I2S
+static void stream_send(size_t samples)
+{
   size_t bytes_written = 0;
 
-  while (get_device_mode() == ALARM_RING_MODE)
+  for (size_t done = 0; done < samples; done += RESAMPLER_CHUNK)
   {
-    // skip the header...
-    fseek(fh, 44, SEEK_SET);
+    size_t chunk = (samples - done < RESAMPLER_CHUNK) ? samples - done : RESAMPLER_CHUNK;
+
+    uint32_t cycles = esp_cpu_get_cycle_count();
+    size_t out = pp_resampler_process(&stream_resampler, &stream_out[done], chunk, stream_resampled);
+    pp_gain_apply(&stream_gain, stream_resampled, out);
+    stats.dsp_cycles += esp_cpu_get_cycle_count() - cycles;
+    stats.samples += out;
+
+    i2s_channel_write(tx_handle, stream_resampled, out * sizeof(int16_t), &bytes_written, portMAX_DELAY);
 
-    bytes_read = fread(buf, sizeof(int16_t), AUDIO_BUFFER, fh);
-    for (int i=0; i<bytes_read; i++)
+    if (!stream_started)
     {
-        buf[i] = buf[i]>>0;
+      stream_started = true;
+      stats.start_latency_us = wall_time_us() - stream_fire_us;
+      ESP_LOGI(TAG, "First sample %" PRId64 " us after the alarm fired", stats.start_latency_us);
     }
+  }
+}
 
-    i2s_channel_enable(tx_handle);
+/* Plays the built-in ringtone in place from flash until the ring is stopped. It is 22050 Hz, so
+ * its filter is a 2-phase one and a ring falling back to it hardly delays the first sample.
+ */
+static void play_builtin(void)
+{
+  uint32_t size = builtin_ringtone_end - builtin_ringtone_start;
+
+  if (!pp_wav_parse_mem(builtin_ringtone_start, size, &stream_fmt) || !stream_begin("built-in ringtone"))
+  {
+    // Silent ring would hold the device in the ring mode until its deadline
+    ESP_LOGE(TAG, "Built-in ringtone unusable");
+    alarm_ring_stop(ALARM_STOP_FAILED);
+    return;
+  }
 
-    while (bytes_read > 0)
+  stats.builtin = true;
+  uint32_t start = stream_fmt.data_offset;
+  uint32_t end = start + stream_fmt.data_size;
+  uint32_t pos = start;
+
+  while (!stream_stop)
+  {
+    uint32_t len = (end - pos < STREAM_BLOCK_SIZE) ? end - pos : STREAM_BLOCK_SIZE;
+
+    uint32_t cycles = esp_cpu_get_cycle_count();
+    size_t samples = stream_convert(&builtin_ringtone_start[pos], len);
+    stats.dsp_cycles += esp_cpu_get_cycle_count() - cycles;
+    stats.blocks++;
+
+    pos += len;
+    if (pos == end)
+    {
+      pos = start;
+      stats.loops++;
+    }
+
+    stream_send(samples);
+  }
+}
+
+/* Streams a ringtone file. Fails only when the file can't be opened or isn't playable, a card
+ * which fails or falls behind later hands the rest of the ring to the built-in ringtone.
+ */
+static esp_err_t play_wave(const char *path, uint32_t end, const alarm_ring_event_t *event)
+{
+  // A prefetched ring starts from RAM, the reader opens the file and continues behind it
+  bool prefetched = prefetch.valid && prefetch.generation == event->generation &&
+    prefetch.ringtone_id == event->ringtone_id && strcmp(prefetch.path, path) == 0;
+  prefetch.valid = false;
+
+  if (prefetched)
+  {
+    stream_fmt = prefetch.fmt;
+    stream_fd = -1;
+    stream_end = prefetch.end;
+    stream_read_pos = prefetch.pos;
+    strcpy(stream_path, path);
+    ESP_LOGI(TAG, "Starting from the prefetched blocks");
+  }
+  else
+  {
+    stream_fd = stream_open(path, end, &stream_fmt);
+    if (stream_fd < 0)
+    {
+      return ESP_ERR_NOT_SUPPORTED;
+    }
+    stream_end = stream_fmt.data_offset + stream_fmt.data_size;
+    stream_read_pos = stream_fmt.data_offset;
+  }
+  stream_start = stream_fmt.data_offset;
+
+  if (!stream_begin(path))
+  {
+    if (stream_fd >= 0)
+    {
+      close(stream_fd);
+      stream_fd = -1;
+    }
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  stream_head = 0;
+  stream_tail = 0;
+  stream_failed = false;
+  stats.fill_min = STREAM_BLOCKS;
+
+  stream_run = true;
+  xTaskNotifyGive(reader_task_hdl);
+
+  // Start with a full ring, so an SD stall right at the start doesn't starve the writer
+  while (!prefetched && !stream_stop && !stream_failed && stream_fill() < STREAM_BLOCKS)
+  {
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STREAM_STALL_MS)) == 0)
     {
-      if (get_device_mode() == ALARM_RING_MODE)
+      break;
+    }
+  }
+
+  bool starved = false;
+  bool stalled = false;
+  uint8_t prefetch_next = prefetched ? 0 : PREFETCH_BLOCKS;
+
+  while (!stream_stop)
+  {
+    const stream_block_t *block;
+    bool from_ring = prefetch_next >= PREFETCH_BLOCKS;
+
+    if (!from_ring)
+    {
+      block = &prefetch.blocks[prefetch_next++];
+    }
+    else
+    {
+      uint32_t fill = stream_fill();
+      if (fill == 0)
       {
-        // write the buffer to the i2s
-        i2s_channel_write(tx_handle, buf, bytes_read * sizeof(int16_t), &bytes_written, portMAX_DELAY);
-        bytes_read = fread(buf, sizeof(int16_t), AUDIO_BUFFER, fh);
-        for (int i=0; i<bytes_read; i++)
+        if (stream_failed)
         {
-            buf[i] = buf[i]>>0;
+          break;
         }
-        ESP_LOGV(TAG, "Bytes read: %d", bytes_read);
+
+        if (!starved)
+        {
+          stats.underruns++;
+          starved = true;
+        }
+
+        // A card which can't keep up loses the rest of the ring to the built-in ringtone
+        if (stats.underruns > STREAM_UNDERRUNS_MAX ||
+            (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STREAM_STALL_MS)) == 0 && stream_fill() == 0))
+        {
+          stalled = true;
+          break;
+        }
+        continue;
       }
-      else
+
+      starved = false;
+      if (fill < stats.fill_min)
       {
-        break;
+        stats.fill_min = fill;
       }
+      block = &stream_ring[stream_tail % STREAM_BLOCKS];
+    }
+
+    uint32_t cycles = esp_cpu_get_cycle_count();
+    size_t samples = stream_convert(block->data, block->len);
+    stats.dsp_cycles += esp_cpu_get_cycle_count() - cycles;
+    stats.blocks++;
+
+    if (from_ring)
+    {
+      __atomic_store_n(&stream_tail, stream_tail + 1, __ATOMIC_RELEASE);
+      xTaskNotifyGive(reader_task_hdl);
     }
+
+    stream_send(samples);
+  }
+
+  stream_run = false;
+  xTaskNotifyGive(reader_task_hdl);
+
+  // Built-in ringtone needs neither the reader nor the ring, a read stuck on the card can finish meanwhile
+  if (!stream_stop && (stalled || stream_failed))
+  {
+    ESP_LOGW(TAG, "Ringtone %s, switching to the built-in one", stalled ? "too slow" : "unreadable");
+    play_builtin();
   }
 
-  ESP_LOGI(TAG, "End of ringtone");
-  fclose(fh);
+  xSemaphoreTake(stream_done, portMAX_DELAY);
 
-  i2s_channel_disable(tx_handle);
-  free(buf);
+  if (stream_fd >= 0)
+  {
+    close(stream_fd);
+    stream_fd = -1;
+  }
 
   return ESP_OK;
 }
 
+void pp_wave_player_get_stats(pp_wave_player_stats_t *out)
+{
+  *out = stats;
+  out->fill = stream_run ? stream_fill() : 0;
+}
+
 void pp_wav_player_main(void* arg)
 {
+  alarm_ring_event_t event;
+
+  // Ring events queue up while one is playing, the next alarm is already armed by the alarm task
   while (true)
   {
-    if (play_alarm_flag)
+    if (!alarm_ring_receive(&event, PREFETCH_CHECK_MS))
+    {
+      stream_prefetch_update();
+      continue;
+    }
+
+    char path[CONTENT_PATH_LEN_MAX];
+    uint32_t size;
+    if (ObjectManager_get_ringtone_path(event.ringtone_id, path, &size) != ESP_OK)
     {
-      play_alarm_flag = false;
-      ESP_LOGI(TAG, "Playing wav file");
-      set_timer_for_playing_alarm();
-      ESP_ERROR_CHECK(play_wave(WAV_FILE));
-      set_next_alarm();
+      strcpy(path, WAV_FILE);
+      size = UINT32_MAX;
     }
 
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    ESP_LOGI(TAG, "Ringing %u alarms, volume %u, wav file: %s", event.count, event.volume, path);
+    stream_stop = false;
+    stream_started = false;
+    stream_fire_us = (int64_t)event.fire * 1000000;
+    memset(&stats, 0, sizeof(stats));
+
+    // One gain for the whole ring, a switch to another ringtone doesn't restart the rise
+    pp_gain_init(&stream_gain, event.volume * GAIN_UNITY / ALARM_VOLUME_MAX, event.rise, event.rise_time * PLAYER_SAMPLE_RATE);
+
+    set_device_mode(ALARM_RING_MODE);
+    set_timer_for_playing_alarm(event.duration);
+    i2s_channel_enable(tx_handle);
+
+    esp_err_t res = play_wave(path, size, &event);
+    if (res != ESP_OK && strcmp(path, WAV_FILE) != 0)
+    {
+      res = play_wave(WAV_FILE, UINT32_MAX, &event);
+    }
+
+    // Without a card, or with nothing playable on it, the alarm still rings
+    if (res != ESP_OK)
+    {
+      ESP_LOGE(TAG, "No playable ringtone on the card, playing the built-in one");
+      play_builtin();
+    }
+
+    i2s_channel_disable(tx_handle);
+
+    ESP_LOGI(TAG, "End of ringtone, %" PRIu32 " blocks, %" PRIu32 " loops, %" PRIu32 " underruns, min fill %u, longest read %" PRIu32 " us, %" PRIu64 " cycles per sample%s",
+      stats.blocks, stats.loops, stats.underruns, stats.fill_min, stats.read_max_us, stats.samples ? stats.dsp_cycles / stats.samples : 0,
+      stats.builtin ? ", built-in ringtone" : "");
+
+    // History is kept in RAM here, the card is written later by the history task
+    alarm_ring_end();
   }
 }
 
@@ -134,12 +663,24 @@ esp_err_t pp_wave_player_init()
       return res;
   }
 
-  BaseType_t resTask = xTaskCreate(pp_wav_player_main, "WAV PLAYER", 4096, NULL, 1, NULL);
+  stream_done = xSemaphoreCreateBinary();
+
+  // Reader runs above the player, a refill is never held back by the writer
+  BaseType_t resTask = xTaskCreate(pp_wave_reader_main, "WAV READER", 3072, NULL, 2, &reader_task_hdl);
+  if(resTask != pdPASS)
+  {
+      ESP_LOGE(TAG, "Creating wave reader task failed, err: %x", resTask);
+      return resTask;
+  }
+
+  resTask = xTaskCreate(pp_wav_player_main, "WAV PLAYER", 4096, NULL, 1, &player_task_hdl);
   if(resTask != pdPASS)
   {
       ESP_LOGE(TAG, "Creating wave player task failed, err: %x", resTask);
       return resTask;
   }
 
+  alarm_ring_set_stop_cb(pp_wave_player_stop);
+
   return ESP_OK;
 }
\ No newline at end of file
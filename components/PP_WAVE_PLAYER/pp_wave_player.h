@@ -1,9 +1,40 @@
+#ifndef __PP_WAVE_PLAYER_H__
+#define __PP_WAVE_PLAYER_H__
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 
-#define AUDIO_BUFFER 2048           // buffer size for reading the wav file and sending to i2s
-#define WAV_FILE "/sdcard/ringtone0.wav" // wav file to play
+#define WAV_FILE "/sdcard/ringtone0.wav" // default wav file, played when the alarm has no ringtone object
+#define PLAYER_SAMPLE_RATE 44100         // I2S output rate, ringtones of other rates are resampled to it
+
+/* The reader task streams the file into a ring of blocks ahead of the I2S writer */
+#define STREAM_SECTOR_SIZE   512
+#define STREAM_BLOCK_SIZE    (8 * STREAM_SECTOR_SIZE)  // bytes of one block, read in sector aligned chunks
+#define STREAM_BLOCKS        4                         // power of 2
+#define STREAM_STALL_MS      1000                      // ring empty this long, the built-in ringtone takes over
+#define STREAM_UNDERRUNS_MAX 8                         // more underruns in one ring, the built-in ringtone takes over
+
+/* Start of the next alarm's ringtone is read into RAM ahead of the alarm */
+#define PREFETCH_BLOCKS      8                         // stream blocks, 32 KB
+#define PREFETCH_LEAD_SEC    60                        // read this long before the alarm is due
+#define PREFETCH_CHECK_MS    10000                     // player looks at the next alarm this often between rings
+
+typedef struct
+{
+  uint32_t underruns;     // times the writer found the ring empty after playback started
+  uint32_t blocks;        // blocks played
+  uint32_t loops;         // times the ringtone wrapped to its start
+  uint8_t fill;           // blocks ready in the ring right now
+  uint8_t fill_min;       // fewest blocks ready seen by the writer since playback started
+  uint32_t read_max_us;   // longest single SD read
+  uint32_t samples;       // samples sent to I2S
+  uint64_t dsp_cycles;    // CPU cycles spent on conversion, resampling and gain
+  int64_t start_latency_us; // from the scheduled alarm time to the first sample handed to I2S
+  bool builtin;           // the built-in ringtone played for part or all of the ring
+} pp_wave_player_stats_t;
 
 esp_err_t pp_wave_player_init();
-void set_play_alarm_flag(bool new_val);
\ No newline at end of file
+void pp_wave_player_get_stats(pp_wave_player_stats_t *stats);
+
+#endif
@@ -25,6 +25,7 @@
 #include "ObjectManager.h"
 #include "project_defs.h"
 #include "pp_wave_player.h"
+#include "alarm_history.h"
 
 #include "esp_bt.h"
 #include "esp_gap_ble_api.h"
@@ -632,7 +633,17 @@ static void button_functions(button_action_t action_handler)
                 ESP_LOGI(MAIN_TAG, "ALARM DISABLED");
 
                 ESP_LOGI(MAIN_TAG, "ALARM RING MODE -> DEFAULT MODE");
-                device_mode = DEFAULT_MODE;
+                alarm_ring_stop(ALARM_STOP_BUTTON);
+                break;
+            }
+
+            if (action_handler.action == LONG_PRESS)
+            {
+                if (!alarm_snooze())
+                {
+                    ESP_LOGI(MAIN_TAG, "ALARM HAS NO NAP LEFT");
+                    alarm_ring_stop(ALARM_STOP_BUTTON);
+                }
                 break;
             }
             break;
@@ -1018,6 +1029,7 @@ void time_change_mode(button_action_t action_handler, bool start)
                         settimeofday(&tv, NULL);
 
                         pp_rtc_set_time( tm.tm_sec, tm.tm_min, tm.tm_hour, 1, tm.tm_mday, tm.tm_mon + 1, tm.tm_year - 100 );
+                        alarm_time_changed();
                         break;
                     }
 
@@ -10,7 +10,10 @@
 #define MOUNT_POINT "/sdcard"
 #define FILE_LIST_NAME MOUNT_POINT "/file_id_list.txt"
 #define ALARMS_PATH MOUNT_POINT "/alarms"
-#define RIGNTONES_PATH MOUNT_POINT "/ringtones"
+#define RINGTONES_DIR "/ringtones"
+#define RIGNTONES_PATH MOUNT_POINT RINGTONES_DIR
+
+#define FATFS_DRIVE "0:"     // SD card is the only FatFs volume
 
 #define TEMP_FILE_PATH MOUNT_POINT "/temp"
 
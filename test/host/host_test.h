@@ -0,0 +1,39 @@
+#ifndef __HOST_TEST_H__
+#define __HOST_TEST_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Checks and timing shared by the host tests. A failed check is printed and counted,
+ * the test returns the count so ctest sees any failure.
+ */
+static int host_test_failures = 0;
+
+#define HOST_CHECK(cond, ...)                                           \
+    do                                                                  \
+    {                                                                   \
+        if (!(cond))                                                    \
+        {                                                               \
+            if (host_test_failures++ < 20)                              \
+            {                                                           \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);             \
+                printf(__VA_ARGS__);                                    \
+                printf("\n");                                           \
+            }                                                           \
+        }                                                               \
+    } while (0)
+
+#define HOST_RESULT()   (printf("%s: %d failures\n", host_test_failures ? "FAILED" : "PASSED", host_test_failures), host_test_failures != 0)
+
+static inline int64_t host_test_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Keeps the compiler from dropping a benchmarked result
+static volatile int64_t host_test_sink;
+
+#endif
@@ -0,0 +1,187 @@
+#include "host_test.h"
+#include "alarm_occurrence.h"
+#include "pp_timebase.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* Excluded days of a calendar against a reference which takes the occurrences of the same rule
+ * without the calendar one after another and drops those on an excluded day.
+ */
+#define RANDOM_RULES    20000
+#define REFERENCE_STEPS 3000
+
+static const char *tz = "CET-1CEST,M3.5.0/2,M10.5.0/3";
+
+static bool excluded(const alarm_occurrence_calendar_t *cal, time_t t)
+{
+    struct tm local;
+    pp_timebase_localtime(t, &local);
+
+    for (uint8_t i = 0; i < cal->years; i++)
+    {
+        if (cal->year[i].year == local.tm_year + 1900)
+        {
+            return (cal->year[i].skip[local.tm_yday / 32] >> (local.tm_yday % 32)) & 1;
+        }
+    }
+
+    return false;
+}
+
+static time_t reference_next(const alarm_occurrence_rule_t *rule, time_t now)
+{
+    alarm_occurrence_rule_t plain = *rule;
+    plain.skip = NULL;
+
+    for (int i = 0; i < REFERENCE_STEPS; i++)
+    {
+        struct tm local;
+        time_t fire;
+        pp_timebase_localtime(now, &local);
+        if (!alarm_occurrence_next(&plain, now, &local, &fire))
+        {
+            return -1;
+        }
+
+        if (!excluded(rule->skip, fire))
+        {
+            return fire;
+        }
+        now = fire + 1;
+    }
+
+    return -1;
+}
+
+static time_t next(const alarm_occurrence_rule_t *rule, time_t now)
+{
+    struct tm local;
+    time_t fire;
+    pp_timebase_localtime(now, &local);
+    return alarm_occurrence_next(rule, now, &local, &fire) ? fire : -1;
+}
+
+static time_t local_time(int year, int month, int day, int hour, int minute)
+{
+    struct tm tm = { .tm_year = year - 1900, .tm_mon = month - 1, .tm_mday = day, .tm_hour = hour, .tm_min = minute };
+    return pp_timebase_mktime(&tm);
+}
+
+static void skip_day(alarm_occurrence_calendar_t *cal, uint8_t index, int year, int month, int day)
+{
+    uint16_t yday = pp_timebase_days_from_civil(year, month, day) - pp_timebase_days_from_civil(year, 1, 1);
+    cal->year[index].year = year;
+    cal->year[index].skip[yday / 32] |= 1u << (yday % 32);
+}
+
+static void skip_year(alarm_occurrence_calendar_t *cal, uint8_t index, int year)
+{
+    cal->year[index].year = year;
+    memset(cal->year[index].skip, 0xFF, sizeof(cal->year[index].skip));
+}
+
+static void test_edges(void)
+{
+    alarm_occurrence_calendar_t cal;
+    alarm_occurrence_rule_t daily = { .mode = OCCURRENCE_WEEKLY, .hour = 7, .minute = 0, .days = OCCURRENCE_WEEK_MASK, .skip = &cal };
+
+    // Last day of a leap year is bit 365, the next one is 1 January
+    memset(&cal, 0, sizeof(cal));
+    cal.years = 1;
+    skip_day(&cal, 0, 2024, 12, 31);
+    HOST_CHECK(next(&daily, local_time(2024, 12, 30, 8, 0)) == local_time(2025, 1, 1, 7, 0), "31 December 2024 not skipped");
+
+    // Last day of a common year is bit 364, bit 365 doesn't exist
+    memset(&cal, 0, sizeof(cal));
+    cal.years = 1;
+    skip_day(&cal, 0, 2025, 12, 31);
+    HOST_CHECK(next(&daily, local_time(2025, 12, 30, 8, 0)) == local_time(2026, 1, 1, 7, 0), "31 December 2025 not skipped");
+
+    // 29 February is bit 59 only in a leap year, in other years bit 59 is 1 March
+    memset(&cal, 0, sizeof(cal));
+    cal.years = 2;
+    skip_day(&cal, 0, 2024, 2, 29);
+    skip_day(&cal, 1, 2025, 3, 1);
+    HOST_CHECK(next(&daily, local_time(2024, 2, 28, 8, 0)) == local_time(2024, 3, 1, 7, 0), "29 February 2024 not skipped");
+    HOST_CHECK(next(&daily, local_time(2025, 2, 28, 8, 0)) == local_time(2025, 3, 2, 7, 0), "1 March 2025 not skipped");
+
+    // Whole years excluded, the search goes on into the first year with no entry
+    memset(&cal, 0, sizeof(cal));
+    cal.years = 2;
+    skip_year(&cal, 0, 2025);
+    skip_year(&cal, 1, 2026);
+    HOST_CHECK(next(&daily, local_time(2025, 3, 10, 12, 0)) == local_time(2027, 1, 1, 7, 0), "2025 and 2026 not skipped");
+
+    // Yearly 29 February falls on the 28th in common years, excluding the 28th moves it a year on
+    alarm_occurrence_rule_t yearly = { .mode = OCCURRENCE_YEARLY, .hour = 9, .minute = 15, .month = 2, .day = 29, .skip = &cal };
+    memset(&cal, 0, sizeof(cal));
+    cal.years = 1;
+    skip_day(&cal, 0, 2025, 2, 28);
+    HOST_CHECK(next(&yearly, local_time(2025, 1, 1, 0, 0)) == local_time(2026, 2, 28, 9, 15), "28 February 2025 not skipped");
+
+    // Single date on an excluded day never fires
+    alarm_occurrence_rule_t single = { .mode = OCCURRENCE_SINGLE, .hour = 9, .minute = 0, .year = 2025, .month = 2, .day = 28, .skip = &cal };
+    HOST_CHECK(next(&single, local_time(2025, 1, 1, 0, 0)) == -1, "excluded single date fires");
+}
+
+static void random_calendar(alarm_occurrence_calendar_t *cal)
+{
+    memset(cal, 0, sizeof(*cal));
+    cal->years = 1 + rand() % 3;
+
+    for (uint8_t i = 0; i < cal->years; i++)
+    {
+        cal->year[i].year = 2023 + i;
+        for (uint8_t w = 0; w < OCCURRENCE_CALENDAR_WORDS; w++)
+        {
+            // Whole words excluded now and then, so runs of excluded days cross word and year ends
+            cal->year[i].skip[w] = (rand() % 3 == 0) ? 0xFFFFFFFFu : (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+        }
+    }
+}
+
+static void test_random(void)
+{
+    alarm_occurrence_calendar_t cal;
+
+    for (int k = 0; k < RANDOM_RULES; k++)
+    {
+        random_calendar(&cal);
+
+        alarm_occurrence_rule_t rule = { 0 };
+        rule.mode = 1 + rand() % 3;
+        rule.hour = 5 + rand() % 18;
+        rule.minute = rand() % 60;
+        rule.days = 1 + rand() % 127;
+        rule.month = 1 + rand() % 12;
+        rule.day = 1 + rand() % 31;
+        rule.skip = &cal;
+
+        if (rule.mode == OCCURRENCE_YEARLY && rule.day > alarm_occurrence_days_in_month(2000, rule.month))
+        {
+            rule.day = alarm_occurrence_days_in_month(2000, rule.month);
+        }
+
+        time_t now = 1672531200 + (time_t)(rand() % (3 * 365)) * 86400 + rand() % 86400;
+        time_t got = next(&rule, now);
+        time_t expected = reference_next(&rule, now);
+
+        HOST_CHECK(got == expected, "mode %u days %02x day %u month %u, now %lld: %lld, reference %lld",
+            rule.mode, rule.days, rule.day, rule.month, (long long)now, (long long)got, (long long)expected);
+    }
+
+    printf("%d random calendars\n", RANDOM_RULES);
+}
+
+int main(void)
+{
+    srand(7);
+    pp_timebase_init(tz);
+
+    test_edges();
+    test_random();
+
+    return HOST_RESULT();
+}
@@ -0,0 +1,254 @@
+#include "host_test.h"
+#include "alarm_occurrence.h"
+#include "pp_timebase.h"
+
+#include <stdlib.h>
+#include <limits.h>
+#include <stdbool.h>
+
+/* alarm_occurrence_next against a brute-force search which steps minute by minute through
+ * glibc's localtime_r. The brute force knows nothing of the closed-form date arithmetic,
+ * it only asks whether the rule matches the wall time of each minute.
+ */
+#define RULES_PER_ZONE      300
+#define SEARCH_DAYS         400         // a repeating rule with any day set fires within a year
+#define BENCH_EVALS         200000
+
+typedef struct
+{
+    const char *tz;
+    int32_t std_offset;     // seconds east of UTC outside DST
+} zone_t;
+
+static const zone_t zones[] = {
+    { "CET-1CEST,M3.5.0/2,M10.5.0/3", 3600 },
+    { "EET-2EEST,M3.5.0/3,M10.5.0/4", 7200 },
+    { "GMT0BST,M3.5.0/1,M10.5.0", 0 },
+};
+
+static bool rule_on_date(const alarm_occurrence_rule_t *rule, const struct tm *lt)
+{
+    int year = lt->tm_year + 1900;
+    int month = lt->tm_mon + 1;
+    int last = alarm_occurrence_days_in_month(year, month);
+
+    switch (rule->mode)
+    {
+        case OCCURRENCE_SINGLE:
+            return year == rule->year && month == rule->month && lt->tm_mday == rule->day;
+
+        case OCCURRENCE_WEEKLY:
+            return (rule->days >> ((lt->tm_wday + 6) % 7)) & 1;
+
+        case OCCURRENCE_MONTHLY:
+            return lt->tm_mday == (rule->day < last ? rule->day : last);
+
+        case OCCURRENCE_YEARLY:
+            return month == rule->month && lt->tm_mday == (rule->day < last ? rule->day : last);
+    }
+
+    return false;
+}
+
+static bool rule_at(const alarm_occurrence_rule_t *rule, const struct tm *lt)
+{
+    return lt->tm_hour == rule->hour && lt->tm_min == rule->minute && rule_on_date(rule, lt);
+}
+
+// Whether the wall time of st is shown by any instant from t - 3 h up to the given end
+static bool wall_shown(const struct tm *st, time_t t, time_t end)
+{
+    for (time_t s = t - 3 * 3600; s <= end; s += 60)
+    {
+        struct tm lt;
+        localtime_r(&s, &lt);
+        if (lt.tm_yday == st->tm_yday && lt.tm_hour == st->tm_hour && lt.tm_min == st->tm_min)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* First minute at or after now whose wall time matches. A wall time skipped by the DST start
+ * is read as standard time, a repeated one matches first at its earlier instant.
+ */
+static time_t brute_force_next(const alarm_occurrence_rule_t *rule, time_t now, int32_t std_offset)
+{
+    time_t t = (now + 59) / 60 * 60;
+
+    // Yearly date which exists in no year, 31 November, is refused, only 29 February moves to the 28th
+    if (rule->mode == OCCURRENCE_YEARLY && rule->day > alarm_occurrence_days_in_month(2000, rule->month))
+    {
+        return -1;
+    }
+
+    // Single date can be years ahead, the search ends with its year
+    long minutes = (rule->mode == OCCURRENCE_SINGLE) ? LONG_MAX : SEARCH_DAYS * 24L * 60;
+
+    for (long i = 0; i < minutes; i++, t += 60)
+    {
+        struct tm lt;
+        localtime_r(&t, &lt);
+
+        if (rule->mode == OCCURRENCE_SINGLE && lt.tm_year + 1900 > rule->year)
+        {
+            break;
+        }
+
+        // Second pass of a wall time repeated by the DST end doesn't count
+        if (rule_at(rule, &lt) && !wall_shown(&lt, t, t - 60))
+        {
+            return t;
+        }
+
+        if (lt.tm_isdst)
+        {
+            time_t s = t + std_offset;
+            struct tm st;
+            gmtime_r(&s, &st);
+            if (rule_at(rule, &st) && !wall_shown(&st, t, t + 3 * 3600))
+            {
+                return t;
+            }
+        }
+    }
+
+    return -1;
+}
+
+static void random_rule(alarm_occurrence_rule_t *rule, int year)
+{
+    rule->mode = rand() % 4;
+    rule->hour = rand() % 24;
+    rule->minute = rand() % 60;
+    rule->days = rand() % 128;
+    rule->year = year - 1 + rand() % 3;
+    rule->month = 1 + rand() % 12;
+    rule->day = 1 + rand() % 31;
+    rule->skip = NULL;
+
+    // Around the DST changes in a quarter of the rules
+    if (rand() % 4 == 0)
+    {
+        rule->hour = 1 + rand() % 3;
+    }
+
+    if (rule->mode == OCCURRENCE_SINGLE && rule->day > alarm_occurrence_days_in_month(rule->year, rule->month))
+    {
+        rule->day = alarm_occurrence_days_in_month(rule->year, rule->month);
+    }
+}
+
+static time_t random_now(void)
+{
+    // 2023-01-01 to 2026-12-31, every fifth one on a whole minute
+    time_t now = 1672531200 + (time_t)(rand() % (4 * 365)) * 86400 + rand() % 86400;
+    return (rand() % 5 == 0) ? now / 60 * 60 : now;
+}
+
+static void test_zone(const zone_t *zone)
+{
+    setenv("TZ", zone->tz, 1);
+    tzset();
+    HOST_CHECK(pp_timebase_init(zone->tz), "%s not accepted", zone->tz);
+
+    int tested = 0;
+    for (int k = 0; k < RULES_PER_ZONE; k++)
+    {
+        time_t now = random_now();
+        struct tm local_now;
+        pp_timebase_localtime(now, &local_now);
+
+        alarm_occurrence_rule_t rule;
+        random_rule(&rule, local_now.tm_year + 1900);
+
+        time_t fire;
+        time_t got = alarm_occurrence_next(&rule, now, &local_now, &fire) ? fire : -1;
+        time_t expected = brute_force_next(&rule, now, zone->std_offset);
+
+        HOST_CHECK(got == expected, "%s mode %u %02u:%02u %04u-%02u-%02u days %02x, now %lld: %lld, brute force %lld",
+            zone->tz, rule.mode, rule.hour, rule.minute, rule.year, rule.month, rule.day, rule.days,
+            (long long)now, (long long)got, (long long)expected);
+        tested++;
+    }
+
+    printf("%s: %d rules\n", zone->tz, tested);
+}
+
+// Both DST changes of 2025 in Central Europe, a weekly Sunday alarm at 02:30
+static void test_dst_edges(void)
+{
+    setenv("TZ", zones[0].tz, 1);
+    tzset();
+    pp_timebase_init(zones[0].tz);
+
+    static const struct
+    {
+        time_t now;
+        time_t fire;
+    } cases[] = {
+        { 1743249600, 1743298200 },     // 30 March, 02:30 doesn't exist, 03:30 CEST
+        { 1761393600, 1761438600 },     // 26 October, 02:30 twice, the CEST one
+        { 1761438601, 1762047000 },     // right after it, the repeated 02:30 CET doesn't fire again
+    };
+
+    alarm_occurrence_rule_t rule = { .mode = OCCURRENCE_WEEKLY, .hour = 2, .minute = 30, .days = 1 << 6 };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        struct tm local_now;
+        time_t fire = 0;
+        pp_timebase_localtime(cases[i].now, &local_now);
+        bool ok = alarm_occurrence_next(&rule, cases[i].now, &local_now, &fire);
+
+        HOST_CHECK(ok && fire == cases[i].fire, "DST case %zu: %lld, expected %lld", i, (long long)fire, (long long)cases[i].fire);
+        HOST_CHECK(brute_force_next(&rule, cases[i].now, zones[0].std_offset) == cases[i].fire, "DST case %zu: brute force disagrees", i);
+    }
+}
+
+static void bench(void)
+{
+    static const char *names[] = { "single", "weekly", "monthly", "yearly" };
+
+    pp_timebase_init(zones[0].tz);
+
+    for (uint8_t mode = OCCURRENCE_SINGLE; mode <= OCCURRENCE_YEARLY; mode++)
+    {
+        alarm_occurrence_rule_t rule = { .mode = mode, .hour = 6, .minute = 30, .year = 2026, .month = 2, .day = 29, .days = 0x15 };
+        time_t now = 1700000000;
+        int64_t sum = 0;
+
+        int64_t start = host_test_ns();
+        for (int i = 0; i < BENCH_EVALS; i++)
+        {
+            struct tm local_now;
+            time_t fire = 0;
+            pp_timebase_localtime(now, &local_now);
+            alarm_occurrence_next(&rule, now, &local_now, &fire);
+            sum += fire;
+            now += 3607;
+        }
+        int64_t elapsed = host_test_ns() - start;
+
+        host_test_sink = sum;
+        printf("%-8s %.1f ns per evaluation\n", names[mode], (double)elapsed / BENCH_EVALS);
+    }
+}
+
+int main(void)
+{
+    srand(1);
+
+    for (size_t i = 0; i < sizeof(zones) / sizeof(zones[0]); i++)
+    {
+        test_zone(&zones[i]);
+    }
+
+    test_dst_edges();
+
+    bench();
+
+    return HOST_RESULT();
+}
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""tools/catalog.py against archives laid out as ObjectManagerCatalog writes them: the constants
+match the header, list/unpack/pack round trips byte for byte, and broken archives are rejected.
+"""
+
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..")
+TOOL = os.path.join(ROOT, "tools", "catalog.py")
+HEADER = os.path.join(ROOT, "components", "ObjectManager", "ObjectManagerCatalog", "ObjectManagerCatalog.h")
+
+sys.dont_write_bytecode = True
+sys.path.insert(0, os.path.dirname(TOOL))
+import catalog  # noqa: E402
+
+failures = 0
+
+
+def check(cond, what):
+    global failures
+    if not cond:
+        failures += 1
+        print("FAIL: " + what)
+
+
+def run(*args):
+    return subprocess.run([sys.executable, TOOL] + list(args), capture_output=True, text=True)
+
+
+def record(tag, payload):
+    return struct.pack("<BI", tag, len(payload)) + payload
+
+
+def object_record(ident, first, properties, size, name):
+    uuid = bytes([first]) + catalog.UUID_TAIL
+    return record(0x01, ident.to_bytes(6, "little") + uuid + struct.pack("<IIB", properties, size, len(name)) + name)
+
+
+def fixture():
+    """Ringtones and calendars first, then alarms, as ObjectManager_catalog_walk emits them."""
+    wav = b"RIFF" + bytes(range(256)) * 3
+    cal = bytes([0x55] * 46)
+    alarm = bytes(range(40))
+
+    data = b"NXCA" + bytes([1, 1])
+    data += object_record(0x100, 0x03, 0x7F, len(wav), b"wake.wav") + record(0x03, wav)
+    data += object_record(0x101, 0x06, 0x7F, len(cal), b"holidays") + record(0x03, cal)
+    data += object_record(0x102, 0x02, 0x7D, 0, b"Work days") + record(0x02, alarm)
+    data += object_record(0x103, 0x02, 0x7D, 0, b"Not set")
+    data += record(0x42, b"\x01\x02\x03")
+    data += record(0xFF, b"")
+    return data
+
+
+def test_header():
+    defines = dict(re.findall(r"#define\s+CATALOG_(\w+)\s+(\S+)", open(HEADER).read()))
+    check(defines["MAGIC"] == '"%s"' % catalog.MAGIC.decode(), "magic differs from the header")
+    check(int(defines["VERSION"]) == catalog.VERSION, "version differs from the header")
+    for name, value in (("REC_OBJECT", catalog.REC_OBJECT), ("REC_ALARM", catalog.REC_ALARM),
+                        ("REC_CONTENT", catalog.REC_CONTENT), ("REC_END", catalog.REC_END)):
+        check(int(defines[name], 16) == value, "%s differs from the header" % name)
+
+
+def test_round_trip(tmp):
+    archive = os.path.join(tmp, "catalog_full.nca")
+    with open(archive, "wb") as dst:
+        dst.write(fixture())
+
+    listed = run("list", archive)
+    check(listed.returncode == 0 and listed.stdout.count("\n") == 5, "list: " + listed.stdout + listed.stderr)
+    check("ringtone" in listed.stdout and "calendar" in listed.stdout and "alarm" in listed.stdout, "list misses a type")
+
+    directory = os.path.join(tmp, "backup")
+    check(run("unpack", archive, directory).returncode == 0, "unpack failed")
+    check(sorted(os.listdir(directory)) == ["100.wav", "101.cal", "catalog.json"], "unpacked files %s" % os.listdir(directory))
+    with open(os.path.join(directory, "100.wav"), "rb") as body:
+        check(body.read() == b"RIFF" + bytes(range(256)) * 3, "ringtone body differs")
+
+    repacked = os.path.join(tmp, "import.nca")
+    check(run("pack", directory, repacked).returncode == 0, "pack failed")
+    with open(repacked, "rb") as src:
+        check(src.read() == fixture(), "repacked archive differs")
+
+    # Without bodies the content flag goes and sizes stay as archived
+    objects = [o for o in catalog.parse(fixture()) if o.get("type") == "alarm"]
+    data = catalog.build(objects)
+    check(data[5] == 0 and catalog.parse(data) == objects, "metadata only archive does not round trip")
+
+
+def test_rejected(tmp):
+    good = fixture()
+    broken = {
+        "magic": b"NXCB" + good[4:],
+        "version": good[:4] + b"\x02" + good[5:],
+        "no end record": good[:-5],
+        "record past the end": good[:-9] + struct.pack("<BI", 0x42, 100),
+        "content size": good.replace(struct.pack("<BI", 0x03, 46), struct.pack("<BI", 0x03, 45), 1),
+    }
+    for what, data in broken.items():
+        path = os.path.join(tmp, "broken.nca")
+        with open(path, "wb") as dst:
+            dst.write(data)
+        result = run("list", path)
+        check(result.returncode != 0 and "Traceback" not in result.stderr, "%s accepted: %s" % (what, result.stderr))
+
+    try:
+        catalog.build([{"id": "100", "type": "ringtone", "name": "x" * 32, "properties": "0x7f"}])
+        check(False, "name of 32 bytes packed")
+    except ValueError:
+        pass
+
+
+def main():
+    test_header()
+    with tempfile.TemporaryDirectory() as tmp:
+        test_round_trip(tmp)
+        test_rejected(tmp)
+
+    print("%s: %d failures" % ("FAILED" if failures else "PASSED", failures))
+    return failures != 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
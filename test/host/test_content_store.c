@@ -0,0 +1,318 @@
+#include "host_test.h"
+#include "ObjectManagerContentStore.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Content deduplication on a fake SD card directory: the scenarios ObjectManager goes through on
+ * upload, Create by hash, rewrite and delete, then a random sequence of them against a model of
+ * the objects. After every step each stored content has as many references as objects using it,
+ * its data exists exactly while referenced, and no file is left that nothing refers to.
+ */
+#define OBJECTS     12
+#define CONTENTS    4           // content 3 has the key of content 0 but a different hash
+#define STEPS       5000
+
+typedef struct
+{
+    bool exists;
+    int content;                // content of the object, -1 when empty
+    bool shared;                // refers to <key>.wav, otherwise has its own file
+} object_t;
+
+static char dir[64];
+static uint8_t hashes[CONTENTS][CONTENT_HASH_SIZE];
+static object_t objects[OBJECTS];
+
+static void own_file(char *bfr, int id)
+{
+    sprintf(bfr, "%s/%x%s", dir, id + 1, CONTENT_STORE_DATA_TYPE);
+}
+
+static void content_file(char *bfr, int content, const char *type)
+{
+    char key[CONTENT_KEY_LEN_MAX];
+    ObjectManager_store_key(key, hashes[content]);
+    sprintf(bfr, "%s/%s%s", dir, key, type);
+}
+
+// Data of a content is its number repeated, so a file tells which content it holds
+static void write_file(const char *file, int content)
+{
+    FILE *f = fopen(file, "w");
+    for (int i = 0; i < 100 + content; i++)
+    {
+        fputc('0' + content, f);
+    }
+    fclose(f);
+}
+
+static int file_content(const char *file)
+{
+    FILE *f = fopen(file, "r");
+    if (f == NULL)
+    {
+        return -1;
+    }
+    int c = fgetc(f) - '0';
+    fclose(f);
+    return c;
+}
+
+static uint32_t refs_of(int content)
+{
+    char key[CONTENT_KEY_LEN_MAX];
+    content_ref_t ref;
+    ObjectManager_store_key(key, hashes[content]);
+    if (!ObjectManager_store_read_ref(dir, key, &ref) || memcmp(ref.hash, hashes[content], CONTENT_HASH_SIZE) != 0)
+    {
+        return 0;
+    }
+    return ref.refs;
+}
+
+// Upload of the whole content into the object's own file, then the hash reported by the phone
+static content_store_result_t upload(int id, int content)
+{
+    char file[CONTENT_STORE_PATH_LEN_MAX];
+    char key[CONTENT_KEY_LEN_MAX];
+    own_file(file, id);
+    write_file(file, content);
+
+    content_store_result_t res = ObjectManager_store_add(dir, file, hashes[content], 100 + content, key);
+    objects[id].content = content;
+    objects[id].shared = (res == CONTENT_STORE_ADDED || res == CONTENT_STORE_SHARED);
+    return res;
+}
+
+static bool create_by_hash(int id, int content)
+{
+    char key[CONTENT_KEY_LEN_MAX];
+    uint32_t size = 0;
+
+    objects[id].exists = true;
+    objects[id].content = -1;
+    objects[id].shared = false;
+    if (!ObjectManager_store_reference(dir, hashes[content], key, &size))
+    {
+        return false;
+    }
+
+    HOST_CHECK(size == 100u + content, "content %d referenced with size %" PRIu32, content, size);
+    objects[id].content = content;
+    objects[id].shared = true;
+    return true;
+}
+
+static content_store_result_t detach(int id, bool keep_data)
+{
+    char file[CONTENT_STORE_PATH_LEN_MAX];
+    char key[CONTENT_KEY_LEN_MAX];
+    own_file(file, id);
+    ObjectManager_store_key(key, hashes[objects[id].content]);
+
+    content_store_result_t res = ObjectManager_store_detach(dir, key, file, keep_data);
+    if (res == CONTENT_STORE_DETACHED)
+    {
+        objects[id].shared = false;
+        objects[id].content = keep_data ? objects[id].content : -1;
+    }
+    return res;
+}
+
+static void delete(int id)
+{
+    char file[CONTENT_STORE_PATH_LEN_MAX];
+    char key[CONTENT_KEY_LEN_MAX];
+
+    if (objects[id].shared)
+    {
+        ObjectManager_store_key(key, hashes[objects[id].content]);
+        ObjectManager_store_release(dir, key);
+    }
+    else
+    {
+        own_file(file, id);
+        remove(file);
+    }
+    objects[id].exists = false;
+}
+
+static void check_invariants(const char *step)
+{
+    char file[CONTENT_STORE_PATH_LEN_MAX];
+    int expected_files = 0;
+
+    for (int c = 0; c < CONTENTS; c++)
+    {
+        uint32_t users = 0;
+        for (int id = 0; id < OBJECTS; id++)
+        {
+            users += objects[id].exists && objects[id].shared && objects[id].content == c;
+        }
+
+        HOST_CHECK(refs_of(c) == users, "%s: content %d has %" PRIu32 " references, %" PRIu32 " users", step, c, refs_of(c), users);
+        if (users)
+        {
+            content_file(file, c, CONTENT_STORE_DATA_TYPE);
+            HOST_CHECK(file_content(file) == c, "%s: data of content %d missing", step, c);
+            expected_files += 2;
+        }
+    }
+
+    for (int id = 0; id < OBJECTS; id++)
+    {
+        if (objects[id].exists && !objects[id].shared && objects[id].content >= 0)
+        {
+            own_file(file, id);
+            HOST_CHECK(file_content(file) == objects[id].content, "%s: own data of object %d missing", step, id);
+            expected_files++;
+        }
+    }
+
+    int files = 0;
+    DIR *d = opendir(dir);
+    for (struct dirent *e = readdir(d); e != NULL; e = readdir(d))
+    {
+        files += e->d_name[0] != '.';
+    }
+    closedir(d);
+    HOST_CHECK(files == expected_files, "%s: %d files on the card, %d expected", step, files, expected_files);
+}
+
+static void test_scenarios(void)
+{
+    char file[CONTENT_STORE_PATH_LEN_MAX];
+
+    objects[0].exists = true;
+    HOST_CHECK(upload(0, 0) == CONTENT_STORE_ADDED, "new content not added");
+    check_invariants("added");
+
+    objects[1].exists = true;
+    HOST_CHECK(upload(1, 0) == CONTENT_STORE_SHARED, "same content stored twice");
+    check_invariants("shared");
+
+    HOST_CHECK(create_by_hash(2, 0) && refs_of(0) == 3, "known hash not referenced");
+    HOST_CHECK(!create_by_hash(3, 1), "unknown hash referenced");
+    HOST_CHECK(!create_by_hash(4, 3), "hash referenced by its key only");
+    check_invariants("by hash");
+
+    HOST_CHECK(upload(3, 3) == CONTENT_STORE_COLLISION && !objects[3].shared, "different content shares the key");
+    check_invariants("collision");
+
+    HOST_CHECK(detach(0, true) == CONTENT_STORE_SHARED_BUSY && objects[0].shared, "shared content taken over");
+    HOST_CHECK(detach(1, false) == CONTENT_STORE_DETACHED && refs_of(0) == 2, "reference not dropped");
+    check_invariants("detached");
+
+    delete(0);
+    HOST_CHECK(detach(2, true) == CONTENT_STORE_DETACHED, "last reference not detached");
+    content_file(file, 0, CONTENT_STORE_REF_TYPE);
+    HOST_CHECK(access(file, F_OK) != 0, "reference file left after detaching");
+    check_invariants("taken over");
+
+    for (int id = 0; id < OBJECTS; id++)
+    {
+        if (objects[id].exists)
+        {
+            delete(id);
+        }
+    }
+    check_invariants("released");
+}
+
+static void test_random(void)
+{
+    char step[64];
+
+    for (int i = 0; i < STEPS; i++)
+    {
+        int id = rand() % OBJECTS;
+        int content = rand() % CONTENTS;
+        object_t *o = &objects[id];
+
+        if (!o->exists)
+        {
+            // Created by hash or empty, then uploaded when the hash was not known
+            if (!create_by_hash(id, content) && rand() % 4)
+            {
+                upload(id, content);
+            }
+            sprintf(step, "step %d create %d", i, id);
+        }
+        else if (rand() % 3 == 0)
+        {
+            delete(id);
+            sprintf(step, "step %d delete %d", i, id);
+        }
+        else
+        {
+            // A write: a truncating one drops the content, otherwise it needs the data for itself
+            bool keep_data = rand() % 2;
+            if (o->shared && detach(id, keep_data) == CONTENT_STORE_SHARED_BUSY)
+            {
+                sprintf(step, "step %d busy %d", i, id);
+            }
+            else
+            {
+                if (!keep_data && o->content >= 0 && !o->shared)
+                {
+                    char file[CONTENT_STORE_PATH_LEN_MAX];
+                    own_file(file, id);
+                    remove(file);
+                    o->content = -1;
+                }
+                if (o->content < 0 || rand() % 2)
+                {
+                    // Rewritten data is a new upload, its own file replaces what it had
+                    upload(id, content);
+                }
+                sprintf(step, "step %d write %d", i, id);
+            }
+        }
+
+        check_invariants(step);
+        if (host_test_failures)
+        {
+            return;
+        }
+    }
+}
+
+int main(void)
+{
+    strcpy(dir, "sdcardXXXXXX");
+    if (mkdtemp(dir) == NULL)
+    {
+        printf("FAIL: no temporary directory\n");
+        return 1;
+    }
+
+    for (int c = 0; c < CONTENTS; c++)
+    {
+        for (int i = 0; i < CONTENT_HASH_SIZE; i++)
+        {
+            hashes[c][i] = c * 37 + i;
+        }
+    }
+    memcpy(hashes[3], hashes[0], 8);
+
+    test_scenarios();
+    test_random();
+
+    for (int id = 0; id < OBJECTS; id++)
+    {
+        if (objects[id].exists)
+        {
+            delete(id);
+        }
+    }
+    check_invariants("end");
+    rmdir(dir);
+
+    return HOST_RESULT();
+}
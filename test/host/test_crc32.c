@@ -0,0 +1,159 @@
+#include "host_test.h"
+#include "ObjectTransfer_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* CRC-32 of OACP Calculate Checksum. The target uses esp_rom_crc32_le, a byte at a time table
+ * routine in ROM. Here the same byte-wise kernel is checked against slicing-by-8, both are fed
+ * the chunks ObjectTransfer_stream schedules for the checksum task, and their MB/s is printed.
+ * Chaining follows the ROM call: the CRC goes in and out uninverted, 0 starts a new one.
+ */
+#define SECTOR_SIZE     OBJECT_STREAM_SECTOR_SIZE
+#define CHECKSUM_CHUNK  OBJECT_STREAM_CHECKSUM_CHUNK
+#define OBJECT_SIZE     (3 * 1024 * 1024 + 777)
+#define WINDOWS         300
+#define BENCH_BYTES     (256u * 1024 * 1024)
+
+static uint32_t table[8][256];
+
+static void table_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+        {
+            c = (c >> 1) ^ ((c & 1) ? 0xEDB88320u : 0);
+        }
+        table[0][i] = c;
+    }
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        for (int t = 1; t < 8; t++)
+        {
+            table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+        }
+    }
+}
+
+static uint32_t crc32_bytewise(uint32_t crc, const uint8_t *p, size_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+static uint32_t crc32_slicing8(uint32_t crc, const uint8_t *p, size_t len)
+{
+    crc = ~crc;
+    while (len >= 8)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+    {
+        crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+/* Chunks as ObjectTransfer_channel_checksum_task reads them. The first one has to end on a sector
+ * boundary and the rest have to be whole buffers, so every read after the first is sector aligned.
+ */
+static uint32_t crc32_chunked(const uint8_t *object, uint32_t offset, uint32_t length, uint32_t (*kernel)(uint32_t, const uint8_t *, size_t))
+{
+    static uint8_t buffer[CHECKSUM_CHUNK];
+    object_stream_t stream;
+    uint32_t crc = 0;
+
+    ObjectTransfer_stream_init(&stream, buffer, CHECKSUM_CHUNK, offset, length);
+    while (stream.remaining)
+    {
+        uint32_t chunk = ObjectTransfer_stream_chunk(&stream);
+        bool first = (stream.offset == offset);
+        bool last = (chunk == stream.remaining);
+        HOST_CHECK(chunk > 0 && chunk <= CHECKSUM_CHUNK, "read of %" PRIu32 " bytes", chunk);
+        HOST_CHECK(first || stream.offset % SECTOR_SIZE == 0, "read starts inside a sector at %" PRIu32, stream.offset);
+        HOST_CHECK(last || (stream.offset + chunk) % SECTOR_SIZE == 0, "read ends inside a sector at %" PRIu32, stream.offset + chunk);
+        HOST_CHECK(first || last || chunk == CHECKSUM_CHUNK, "read of %" PRIu32 " bytes is not a whole buffer", chunk);
+        if (chunk == 0)
+        {
+            break;
+        }
+
+        memcpy(buffer, &object[stream.offset], chunk);
+        crc = kernel(crc, buffer, chunk);
+        ObjectTransfer_stream_advance(&stream, chunk);
+    }
+    return crc;
+}
+
+static void test_values(const uint8_t *object)
+{
+    HOST_CHECK(crc32_bytewise(0, (const uint8_t *)"123456789", 9) == 0xCBF43926u, "byte-wise check value");
+    HOST_CHECK(crc32_slicing8(0, (const uint8_t *)"123456789", 9) == 0xCBF43926u, "slicing-by-8 check value");
+    HOST_CHECK(crc32_bytewise(0, object, 0) == 0 && crc32_slicing8(0, object, 0) == 0, "empty range is not 0");
+
+    // Any window of the object, odd offsets and lengths, chunked against in one go
+    for (int i = 0; i < WINDOWS; i++)
+    {
+        uint32_t offset = rand() % OBJECT_SIZE;
+        uint32_t length = (i % 4 == 0) ? OBJECT_SIZE - offset : rand() % (OBJECT_SIZE - offset + 1);
+        if (i % 2)
+        {
+            length %= 3 * SECTOR_SIZE;
+        }
+
+        uint32_t whole = crc32_bytewise(0, &object[offset], length);
+        HOST_CHECK(crc32_slicing8(0, &object[offset], length) == whole, "slicing-by-8 differs at %" PRIu32 "+%" PRIu32, offset, length);
+        HOST_CHECK(crc32_chunked(object, offset, length, crc32_bytewise) == whole, "chunks differ at %" PRIu32 "+%" PRIu32, offset, length);
+        HOST_CHECK(crc32_chunked(object, offset, length, crc32_slicing8) == whole, "slicing-by-8 chunks differ at %" PRIu32 "+%" PRIu32, offset, length);
+    }
+}
+
+static double bench(const uint8_t *buf, uint32_t (*kernel)(uint32_t, const uint8_t *, size_t))
+{
+    uint32_t crc = 0;
+    int64_t start = host_test_ns();
+    for (uint32_t done = 0; done < BENCH_BYTES; done += CHECKSUM_CHUNK)
+    {
+        crc = kernel(crc, buf, CHECKSUM_CHUNK);
+    }
+    int64_t elapsed = host_test_ns() - start;
+
+    host_test_sink = crc;
+    return (double)BENCH_BYTES / (1024 * 1024) / (elapsed / 1e9);
+}
+
+int main(void)
+{
+    static uint8_t object[OBJECT_SIZE];
+
+    srand(9);
+    table_init();
+    for (uint32_t i = 0; i < OBJECT_SIZE; i++)
+    {
+        object[i] = rand();
+    }
+
+    test_values(object);
+
+    printf("CRC-32 of %u byte chunks: byte-wise %.0f MB/s, slicing-by-8 %.0f MB/s\n",
+        CHECKSUM_CHUNK, bench(object, crc32_bytewise), bench(object, crc32_slicing8));
+
+    return HOST_RESULT();
+}
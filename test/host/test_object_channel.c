@@ -0,0 +1,217 @@
+#include "host_test.h"
+#include "ObjectTransfer_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* Loopback of the Object Transfer Channel: the test plays the phone, a server side built on
+ * ObjectTransfer_stream the way ObjectTransfer_channel uses it keeps the object in a RAM card.
+ * Writes at any offset and length come as SDUs of random size for a random MTU, some with
+ * truncation and some aborted halfway, reads come back as notifications. The object has to
+ * match a plain copy, every card access has to end on a sector boundary unless the transfer
+ * ends there, and no notification may exceed the MTU.
+ */
+#define BUFFER_SIZE     OBJECT_STREAM_BUFFER_SIZE
+#define OBJECT_MAX      (64 * 1024)
+#define TRANSFERS       3000
+#define MTU_MIN         23
+#define MTU_MAX         517
+
+static uint8_t card[OBJECT_MAX];
+static uint32_t card_size;
+static uint8_t model[OBJECT_MAX];
+static uint32_t model_size;
+
+static uint8_t buffer[BUFFER_SIZE];
+static object_stream_t stream;
+static uint32_t transfer_start;
+static uint32_t transfer_end;
+static uint32_t card_accesses;
+
+// Card access of a transfer: inside the staging buffer, whole sectors unless at the ends of the transfer
+static void check_access(const char *what, uint32_t offset, uint32_t len)
+{
+    card_accesses++;
+    HOST_CHECK(len > 0 && len <= BUFFER_SIZE, "%s of %" PRIu32 " bytes", what, len);
+    HOST_CHECK(offset == transfer_start || offset % OBJECT_STREAM_SECTOR_SIZE == 0, "%s starts inside a sector at %" PRIu32, what, offset);
+    HOST_CHECK(offset + len == transfer_end || (offset + len) % OBJECT_STREAM_SECTOR_SIZE == 0, "%s ends inside a sector at %" PRIu32, what, offset + len);
+}
+
+// ObjectTransfer_channel_flush
+static void server_flush(void)
+{
+    if (stream.len == 0)
+    {
+        return;
+    }
+
+    check_access("write", stream.offset, stream.len);
+    memcpy(&card[stream.offset], stream.buffer, stream.len);
+    ObjectTransfer_stream_drained(&stream);
+}
+
+// ObjectTransfer_channel_end_write and ObjectManager_finish_write
+static void server_end_write(bool truncate_rest)
+{
+    server_flush();
+
+    bool complete = ObjectTransfer_stream_complete(&stream);
+    card_size = ObjectTransfer_stream_end_size(card_size, stream.offset, truncate_rest && complete);
+}
+
+// ObjectTransfer_channel_receive
+static void server_receive(const uint8_t *data, uint32_t len, bool truncate_rest)
+{
+    HOST_CHECK(len <= stream.remaining, "SDU past the requested length");
+
+    while (len)
+    {
+        uint32_t chunk = ObjectTransfer_stream_fill(&stream, data, len);
+        HOST_CHECK(chunk > 0, "no space in the staging buffer at %" PRIu32, stream.offset + stream.len);
+        data += chunk;
+        len -= chunk;
+
+        if (ObjectTransfer_stream_full(&stream))
+        {
+            server_flush();
+        }
+    }
+
+    if (stream.remaining == 0)
+    {
+        server_end_write(truncate_rest);
+    }
+}
+
+static void phone_write(uint16_t mtu)
+{
+    uint32_t offset = rand() % (card_size + 1);
+    uint32_t length = rand() % (OBJECT_MAX - offset + 1);
+    length = (rand() % 4) ? length % (5 * BUFFER_SIZE) : length;
+    bool truncate_rest = rand() % 2;
+    uint32_t abort_at = (rand() % 5 == 0) ? rand() % (length + 1) : length;
+    uint16_t payload_max = ObjectTransfer_stream_payload_max(mtu);
+
+    uint8_t data[OBJECT_MAX];
+    for (uint32_t i = 0; i < length; i++)
+    {
+        data[i] = rand();
+    }
+
+    // Copy the phone expects: only what was sent before an abort lands, and it is not truncated then
+    memcpy(&model[offset], data, abort_at);
+    if ((truncate_rest && abort_at == length) || offset + abort_at > model_size)
+    {
+        model_size = offset + abort_at;
+    }
+
+    transfer_start = offset;
+    transfer_end = offset + length;
+    ObjectTransfer_stream_init(&stream, buffer, BUFFER_SIZE, offset, length);
+    if (length == 0)
+    {
+        server_end_write(truncate_rest);
+        return;
+    }
+
+    for (uint32_t sent = 0; sent < abort_at;)
+    {
+        uint32_t sdu = (rand() % payload_max) + 1;
+        sdu = (sdu > abort_at - sent) ? abort_at - sent : sdu;
+        server_receive(&data[sent], sdu, truncate_rest);
+        sent += sdu;
+    }
+
+    if (abort_at < length)
+    {
+        transfer_end = offset + abort_at;
+        server_end_write(truncate_rest);
+    }
+}
+
+// ObjectTransfer_channel_read_task, notifications go straight to the phone
+static void phone_read(uint16_t mtu)
+{
+    uint32_t offset = rand() % (card_size + 1);
+    uint32_t length = rand() % (card_size - offset + 1);
+    uint16_t payload_max = ObjectTransfer_stream_payload_max(mtu);
+    uint8_t received[OBJECT_MAX];
+    uint32_t received_len = 0;
+
+    transfer_start = offset;
+    transfer_end = offset + length;
+    ObjectTransfer_stream_init(&stream, buffer, BUFFER_SIZE, offset, length);
+
+    while (stream.remaining)
+    {
+        uint32_t chunk = ObjectTransfer_stream_chunk(&stream);
+        check_access("read", stream.offset, chunk);
+        memcpy(stream.buffer, &card[stream.offset], chunk);
+
+        for (uint32_t sent = 0; sent < chunk;)
+        {
+            uint16_t len = (chunk - sent > payload_max) ? payload_max : chunk - sent;
+            HOST_CHECK(len + OBJECT_STREAM_ATT_HEADER <= mtu, "notification of %u bytes for MTU %u", len, mtu);
+            memcpy(&received[received_len], &stream.buffer[sent], len);
+            received_len += len;
+            sent += len;
+        }
+
+        ObjectTransfer_stream_advance(&stream, chunk);
+    }
+
+    HOST_CHECK(received_len == length && memcmp(received, &model[offset], length) == 0,
+        "read of %" PRIu32 "+%" PRIu32 " differs", offset, length);
+}
+
+static void test_chunks(void)
+{
+    // Write from inside a sector: first chunk up to the sector boundary where the buffer ends, then whole buffers
+    uint8_t data[3 * BUFFER_SIZE] = { 0 };
+    ObjectTransfer_stream_init(&stream, buffer, BUFFER_SIZE, 100, sizeof(data));
+    HOST_CHECK(ObjectTransfer_stream_chunk(&stream) == BUFFER_SIZE - 100, "first chunk of %" PRIu32, ObjectTransfer_stream_chunk(&stream));
+    HOST_CHECK(ObjectTransfer_stream_fill(&stream, data, sizeof(data)) == BUFFER_SIZE - 100 && ObjectTransfer_stream_full(&stream), "first chunk not staged");
+    ObjectTransfer_stream_drained(&stream);
+    HOST_CHECK(stream.offset == BUFFER_SIZE && ObjectTransfer_stream_chunk(&stream) == BUFFER_SIZE, "next chunk not a whole buffer");
+
+    // Short transfer is one chunk, full only once all of it arrived
+    ObjectTransfer_stream_init(&stream, buffer, BUFFER_SIZE, 0, 10);
+    HOST_CHECK(ObjectTransfer_stream_fill(&stream, data, 4) == 4 && !ObjectTransfer_stream_full(&stream), "partial chunk full");
+    HOST_CHECK(ObjectTransfer_stream_fill(&stream, data, 6) == 6 && ObjectTransfer_stream_full(&stream), "complete chunk not full");
+
+    // A chunk whose write failed stays staged, the write is not complete and won't truncate
+    HOST_CHECK(!ObjectTransfer_stream_complete(&stream), "staged chunk counted as written");
+    ObjectTransfer_stream_drained(&stream);
+    HOST_CHECK(ObjectTransfer_stream_complete(&stream), "written transfer not complete");
+    HOST_CHECK(ObjectTransfer_stream_end_size(100, 10, true) == 10 && ObjectTransfer_stream_end_size(100, 10, false) == 100
+        && ObjectTransfer_stream_end_size(5, 10, false) == 10, "size after a write");
+
+    HOST_CHECK(ObjectTransfer_stream_payload_max(MTU_MIN) == 20, "payload of the default MTU");
+}
+
+int main(void)
+{
+    srand(26);
+    test_chunks();
+
+    for (int i = 0; i < TRANSFERS && !host_test_failures; i++)
+    {
+        uint16_t mtu = MTU_MIN + rand() % (MTU_MAX - MTU_MIN + 1);
+        if (rand() % 2)
+        {
+            phone_write(mtu);
+            HOST_CHECK(card_size == model_size && memcmp(card, model, card_size) == 0,
+                "transfer %d: object differs, %" PRIu32 " bytes against %" PRIu32, i, card_size, model_size);
+        }
+        else
+        {
+            phone_read(mtu);
+        }
+    }
+
+    printf("%d transfers, %" PRIu32 " card accesses, object ends at %" PRIu32 " bytes\n", TRANSFERS, card_accesses, card_size);
+
+    return HOST_RESULT();
+}
@@ -0,0 +1,231 @@
+#include "host_test.h"
+#include "pp_gain.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+
+/* pp_gain_apply in random chunks against a per sample reference of the same fixed-point steps,
+ * and the control points of a rise against the ideal curve in dB.
+ */
+#define SAMPLE_RATE     44100
+#define VOLUME_MAX      100
+#define CHUNK_MAX       1000
+#define DB_TOLERANCE    0.2
+#define BENCH_SAMPLES   (60 * SAMPLE_RATE)
+
+static const uint8_t volumes[] = { 10, 50, 100 };
+static const uint32_t rise_seconds[] = { 30, 120 };
+
+typedef struct
+{
+    int32_t point;          // Q15.16, control point the block started at
+    int32_t next;
+    int32_t delta;
+    int32_t step;
+    int64_t factor;
+    int32_t target;
+    uint32_t blocks;
+    uint32_t index;         // sample within the block, 0 starts a new one
+    uint8_t rise;
+} reference_t;
+
+static int16_t sat16(int32_t x)
+{
+    return (x > INT16_MAX) ? INT16_MAX : (x < INT16_MIN) ? INT16_MIN : x;
+}
+
+// Starts from the state pp_gain_init computed, the curve itself is checked in dB separately
+static void reference_init(reference_t *r, const pp_gain_t *g)
+{
+    *r = (reference_t){ .point = g->gain, .step = g->step, .factor = g->factor, .target = g->target, .blocks = g->blocks, .rise = g->rise };
+}
+
+static int16_t reference_sample(reference_t *r, int16_t x)
+{
+    if (r->blocks == 0 && r->index == 0)
+    {
+        int32_t q15 = r->target >> 16;
+        return (q15 == GAIN_UNITY) ? x : sat16((x * q15) >> 15);
+    }
+
+    if (r->index == 0)
+    {
+        r->next = (r->rise == GAIN_RISE_LINEAR) ? r->point + r->step : (int32_t)((r->point * r->factor) >> 30);
+        r->blocks--;
+        if (r->blocks == 0 || r->next > r->target)
+        {
+            r->next = r->target;
+            r->blocks = 0;
+        }
+        r->delta = (r->next - r->point) / GAIN_BLOCK;
+    }
+
+    r->index++;
+    int32_t gain = r->point + (int32_t)r->index * r->delta;
+    if (r->index == GAIN_BLOCK)
+    {
+        r->point = r->next;
+        r->index = 0;
+    }
+
+    return sat16((x * (gain >> 16)) >> 15);
+}
+
+static void test_bit_exact(uint8_t rise, uint8_t volume, uint32_t seconds)
+{
+    static int16_t buf[CHUNK_MAX];
+    pp_gain_t g;
+    reference_t r;
+
+    // A second past the end of the rise, so the steady gain after it is covered too
+    uint32_t total = (seconds + 1) * SAMPLE_RATE;
+    pp_gain_init(&g, volume * GAIN_UNITY / VOLUME_MAX, rise, seconds * SAMPLE_RATE);
+    reference_init(&r, &g);
+
+    uint32_t done = 0;
+    uint32_t mismatches = 0;
+    while (done < total)
+    {
+        uint32_t n = 1 + rand() % CHUNK_MAX;
+        n = (n > total - done) ? total - done : n;
+
+        int16_t in[CHUNK_MAX];
+        for (uint32_t i = 0; i < n; i++)
+        {
+            in[i] = buf[i] = (int16_t)(rand() ^ (rand() << 8));
+        }
+
+        pp_gain_apply(&g, buf, n);
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            int16_t expected = reference_sample(&r, in[i]);
+            if (buf[i] != expected && mismatches++ == 0)
+            {
+                HOST_CHECK(false, "rise %u volume %u %" PRIu32 " s: sample %" PRIu32 " is %d, expected %d",
+                    rise, volume, seconds, done + i, buf[i], expected);
+            }
+        }
+        done += n;
+    }
+
+    HOST_CHECK(mismatches == 0, "rise %u volume %u %" PRIu32 " s: %" PRIu32 " samples differ", rise, volume, seconds, mismatches);
+}
+
+// Gain at a control point relative to the target, whole blocks are applied so g->gain is the point
+static double gain_db_at(uint8_t rise, uint8_t volume, uint32_t seconds, uint32_t samples)
+{
+    static int16_t buf[GAIN_BLOCK];
+    pp_gain_t g;
+    pp_gain_init(&g, volume * GAIN_UNITY / VOLUME_MAX, rise, seconds * SAMPLE_RATE);
+
+    for (uint32_t done = 0; done < samples; done += GAIN_BLOCK)
+    {
+        pp_gain_apply(&g, buf, GAIN_BLOCK);
+    }
+
+    return 20.0 * log10((double)g.gain / g.target);
+}
+
+static void test_curve(void)
+{
+    for (size_t v = 0; v < sizeof(volumes); v++)
+    {
+        for (size_t s = 0; s < sizeof(rise_seconds) / sizeof(rise_seconds[0]); s++)
+        {
+            uint32_t seconds = rise_seconds[s];
+            uint32_t blocks = seconds * SAMPLE_RATE / GAIN_BLOCK;
+
+            for (uint32_t quarter = 1; quarter <= 4; quarter++)
+            {
+                uint32_t samples = blocks * quarter / 4 * GAIN_BLOCK;
+                double fraction = (double)(blocks * quarter / 4) / blocks;
+
+                double ideal = -GAIN_RISE_FLOOR_DB * (1.0 - fraction);
+                double got = gain_db_at(GAIN_RISE_EXPONENTIAL, volumes[v], seconds, samples);
+                HOST_CHECK(fabs(got - ideal) <= DB_TOLERANCE, "exponential volume %u %" PRIu32 " s at %u/4: %.2f dB, ideal %.2f dB",
+                    volumes[v], seconds, quarter, got, ideal);
+
+                // Linear rise is compared in amplitude, dB of a small fraction says little
+                double linear = pow(10.0, gain_db_at(GAIN_RISE_LINEAR, volumes[v], seconds, samples) / 20.0);
+                HOST_CHECK(fabs(linear - fraction) <= 0.001, "linear volume %u %" PRIu32 " s at %u/4: %.4f of the target",
+                    volumes[v], seconds, quarter, linear);
+            }
+
+            printf("volume %u, %" PRIu32 " s rise: %.2f dB at the halfway point\n", volumes[v], seconds,
+                gain_db_at(GAIN_RISE_EXPONENTIAL, volumes[v], seconds, blocks / 2 * GAIN_BLOCK));
+        }
+    }
+}
+
+static void test_steady(void)
+{
+    int16_t buf[3] = { INT16_MIN, -1, INT16_MAX };
+    pp_gain_t g;
+
+    pp_gain_init(&g, GAIN_UNITY, GAIN_RISE_NONE, 0);
+    pp_gain_apply(&g, buf, 3);
+    HOST_CHECK(buf[0] == INT16_MIN && buf[1] == -1 && buf[2] == INT16_MAX, "unity gain changes samples");
+
+    // Rise of zero length and zero volume start steady as well
+    pp_gain_init(&g, 0, GAIN_RISE_EXPONENTIAL, 5 * SAMPLE_RATE);
+    pp_gain_apply(&g, buf, 3);
+    HOST_CHECK(buf[0] == 0 && buf[1] == 0 && buf[2] == 0, "zero volume is not silent");
+
+    pp_gain_init(&g, GAIN_UNITY / 2, GAIN_RISE_LINEAR, 0);
+    HOST_CHECK(g.rise == GAIN_RISE_NONE && g.gain == g.target, "rise of zero samples is not steady");
+}
+
+static double bench_ns(uint8_t rise, uint16_t target)
+{
+    static int16_t buf[512];
+    pp_gain_t g;
+    int64_t sum = 0;
+
+    for (size_t i = 0; i < sizeof(buf) / sizeof(buf[0]); i++)
+    {
+        buf[i] = (int16_t)(rand() ^ (rand() << 8));
+    }
+
+    // Rise longer than the run, so the whole run is spent in it
+    pp_gain_init(&g, target, rise, 2 * BENCH_SAMPLES);
+
+    int64_t start = host_test_ns();
+    for (uint32_t done = 0; done < BENCH_SAMPLES; done += 512)
+    {
+        pp_gain_apply(&g, buf, 512);
+        sum += buf[done % 512];
+    }
+    int64_t elapsed = host_test_ns() - start;
+
+    host_test_sink = sum;
+    return (double)elapsed / BENCH_SAMPLES;
+}
+
+static void bench(void)
+{
+    printf("ns per sample: unity %.2f, steady %.2f, linear rise %.2f, exponential rise %.2f\n",
+        bench_ns(GAIN_RISE_NONE, GAIN_UNITY), bench_ns(GAIN_RISE_NONE, GAIN_UNITY / 2),
+        bench_ns(GAIN_RISE_LINEAR, GAIN_UNITY / 2), bench_ns(GAIN_RISE_EXPONENTIAL, GAIN_UNITY / 2));
+}
+
+int main(void)
+{
+    srand(3);
+
+    for (size_t v = 0; v < sizeof(volumes); v++)
+    {
+        test_bit_exact(GAIN_RISE_EXPONENTIAL, volumes[v], 30);
+        test_bit_exact(GAIN_RISE_LINEAR, volumes[v], 7);
+        test_bit_exact(GAIN_RISE_NONE, volumes[v], 0);
+    }
+
+    test_curve();
+    test_steady();
+
+    bench();
+
+    return HOST_RESULT();
+}
@@ -0,0 +1,313 @@
+#include "host_test.h"
+#include "pp_ima_adpcm.h"
+#include "pp_wav_format.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+/* IMA ADPCM decoder against a reference which decodes one channel at a time and finds each code
+ * by its index, and against the predictor of an encoder doing what tools/wav_to_adpcm.py does.
+ * Random blocks check the clamping, a tone the quality, and the cost per second of audio is
+ * printed next to plain 16-bit PCM.
+ */
+#define BLOCK_MAX       WAV_ADPCM_BLOCK_MAX
+#define FRAMES_MAX      (BLOCK_MAX * 2 + 1)
+#define RANDOM_BLOCKS   20000
+#define SNR_MIN_DB      25.0
+#define BENCH_SECONDS   60
+
+static const int16_t step_table[89] =
+{
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int index_table[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+typedef struct
+{
+    int predictor;
+    int index;
+} channel_t;
+
+static int clamp(int x, int lo, int hi)
+{
+    return x < lo ? lo : x > hi ? hi : x;
+}
+
+static int step_once(channel_t *c, int code)
+{
+    int step = step_table[c->index];
+    int diff = (step >> 3) + ((code & 1) ? step >> 2 : 0) + ((code & 2) ? step >> 1 : 0) + ((code & 4) ? step : 0);
+    c->predictor = clamp(c->predictor + ((code & 8) ? -diff : diff), INT16_MIN, INT16_MAX);
+    c->index = clamp(c->index + index_table[code], 0, 88);
+    return c->predictor;
+}
+
+// Code of frame n >= 1 of a channel: groups of 8 codes in 4 bytes per channel, low nibble first
+static int code_at(const uint8_t *block, int channels, int channel, int n)
+{
+    int g = (n - 1) / 8;
+    int k = (n - 1) % 8;
+    uint8_t byte = block[4 * channels + g * 4 * channels + channel * 4 + k / 2];
+    return (k & 1) ? byte >> 4 : byte & 0x0F;
+}
+
+static int reference_block(const uint8_t *block, uint16_t align, int channels, int16_t *out)
+{
+    int frames = IMA_ADPCM_SAMPLES_PER_BLOCK(align, channels);
+    static int16_t ch[2][FRAMES_MAX];
+
+    for (int c = 0; c < channels; c++)
+    {
+        const uint8_t *h = &block[4 * c];
+        channel_t s = { .predictor = (int16_t)(h[0] | (h[1] << 8)), .index = h[2] > 88 ? 88 : h[2] };
+        ch[c][0] = s.predictor;
+        for (int n = 1; n < frames; n++)
+        {
+            ch[c][n] = step_once(&s, code_at(block, channels, c, n));
+        }
+    }
+
+    for (int n = 0; n < frames; n++)
+    {
+        out[n] = (channels == 1) ? ch[0][n] : (int16_t)((ch[0][n] + ch[1][n]) >> 1);
+    }
+
+    return frames;
+}
+
+static int encode_code(channel_t *c, int sample)
+{
+    int step = step_table[c->index];
+    int diff = sample - c->predictor;
+    int code = 0;
+
+    if (diff < 0)
+    {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step)
+    {
+        code |= 4;
+        diff -= step;
+    }
+    if (diff >= step >> 1)
+    {
+        code |= 2;
+        diff -= step >> 1;
+    }
+    if (diff >= step >> 2)
+    {
+        code |= 1;
+    }
+
+    step_once(c, code);
+    return code;
+}
+
+/* Encodes one block of frames[channel][n] as the tool does. Returns the downmix of what the
+ * encoder's own predictor reconstructed, which the decoder has to reproduce exactly.
+ */
+static void encode_block(channel_t *state, int16_t frames[2][FRAMES_MAX], uint16_t align, int channels, uint8_t *block, int16_t *reconstructed)
+{
+    int per_block = IMA_ADPCM_SAMPLES_PER_BLOCK(align, channels);
+    int16_t rec[2][FRAMES_MAX];
+
+    memset(block, 0, align);
+    for (int c = 0; c < channels; c++)
+    {
+        state[c].predictor = frames[c][0];
+        block[4 * c] = (uint16_t)frames[c][0];
+        block[4 * c + 1] = (uint16_t)frames[c][0] >> 8;
+        block[4 * c + 2] = state[c].index;
+        rec[c][0] = frames[c][0];
+    }
+
+    for (int n = 1; n < per_block; n++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            int code = encode_code(&state[c], frames[c][n]);
+            int g = (n - 1) / 8;
+            int k = (n - 1) % 8;
+            block[4 * channels + g * 4 * channels + c * 4 + k / 2] |= (k & 1) ? code << 4 : code;
+            rec[c][n] = state[c].predictor;
+        }
+    }
+
+    for (int n = 0; n < per_block; n++)
+    {
+        reconstructed[n] = (channels == 1) ? rec[0][n] : (int16_t)((rec[0][n] + rec[1][n]) >> 1);
+    }
+}
+
+static int16_t tone(int channel, uint32_t i, uint32_t rate)
+{
+    return (int16_t)lround(12000.0 * sin(2.0 * M_PI * (440 + 110 * channel) * i / rate) + 3000.0 * sin(2.0 * M_PI * 3000.0 * i / rate));
+}
+
+// A second of a tone, encoded and decoded block by block, checked against the encoder and for SNR
+static void test_tone(uint16_t align, int channels, uint32_t rate)
+{
+    static uint8_t block[BLOCK_MAX];
+    static int16_t frames[2][FRAMES_MAX];
+    static int16_t expected[FRAMES_MAX];
+    static int16_t out[FRAMES_MAX];
+    channel_t state[2] = { 0 };
+    int per_block = IMA_ADPCM_SAMPLES_PER_BLOCK(align, channels);
+    double signal = 0.0, error = 0.0;
+    uint32_t mismatches = 0;
+
+    for (uint32_t first = 0; first < rate; first += per_block)
+    {
+        for (int n = 0; n < per_block; n++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                frames[c][n] = tone(c, first + n, rate);
+            }
+        }
+
+        encode_block(state, frames, align, channels, block, expected);
+        size_t n = pp_ima_adpcm_to_mono16(block, align, channels, out);
+        HOST_CHECK(n == (size_t)per_block, "%u byte block, %d channels: %zu frames, expected %d", align, channels, n, per_block);
+
+        for (int i = 0; i < per_block; i++)
+        {
+            mismatches += out[i] != expected[i];
+
+            double x = (channels == 1) ? frames[0][i] : (frames[0][i] + frames[1][i]) / 2.0;
+            signal += x * x;
+            error += (x - out[i]) * (x - out[i]);
+        }
+    }
+
+    double snr = 10.0 * log10(signal / error);
+    HOST_CHECK(mismatches == 0, "%u byte block, %d channels: %" PRIu32 " frames differ from the encoder", align, channels, mismatches);
+    HOST_CHECK(snr >= SNR_MIN_DB, "%u byte block, %d channels: SNR %.1f dB", align, channels, snr);
+    printf("%4u byte block, %d channel%s, %5" PRIu32 " Hz: %d frames per block, SNR %.1f dB\n",
+        align, channels, channels == 1 ? " " : "s", rate, per_block, snr);
+}
+
+// Any bytes at all, step index in the header above 88 and predictors pushed into both rails
+static void test_random(void)
+{
+    static uint8_t block[BLOCK_MAX];
+    static int16_t expected[FRAMES_MAX];
+    static int16_t out[FRAMES_MAX];
+
+    for (int i = 0; i < RANDOM_BLOCKS; i++)
+    {
+        uint16_t align = 16 << (rand() % 8);
+        int channels = 1 + rand() % 2;
+
+        for (uint16_t b = 0; b < align; b++)
+        {
+            block[b] = rand();
+        }
+
+        // Mostly large codes of one sign now and then, so the predictor runs into the clamp
+        if (rand() % 4 == 0)
+        {
+            memset(&block[4 * channels], (rand() % 2) ? 0x77 : 0xFF, align - 4 * channels);
+        }
+
+        int n = reference_block(block, align, channels, expected);
+        size_t got = pp_ima_adpcm_to_mono16(block, align, channels, out);
+
+        HOST_CHECK(got == (size_t)n && memcmp(out, expected, n * sizeof(int16_t)) == 0,
+            "random %u byte block, %d channels, index %u: decoded differently", align, channels, block[2]);
+    }
+}
+
+// Several blocks through pp_wav_to_mono16, as the player converts them
+static void test_wav_blocks(void)
+{
+    static uint8_t data[4 * 1024];
+    static int16_t expected[4 * FRAMES_MAX];
+    static int16_t out[4 * FRAMES_MAX];
+
+    pp_wav_format_t fmt = { .format = WAV_FORMAT_IMA_ADPCM, .channels = 2, .sample_rate = 22050, .bits = 4, .block_align = 1024 };
+    fmt.samples_per_block = IMA_ADPCM_SAMPLES_PER_BLOCK(fmt.block_align, fmt.channels);
+
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = rand();
+    }
+
+    size_t n = 0;
+    for (int b = 0; b < 4; b++)
+    {
+        n += reference_block(&data[b * fmt.block_align], fmt.block_align, fmt.channels, &expected[n]);
+    }
+
+    size_t got = pp_wav_to_mono16(&fmt, data, 4, out);
+    HOST_CHECK(got == n && memcmp(out, expected, n * sizeof(int16_t)) == 0, "4 blocks through pp_wav_to_mono16: %zu frames, expected %zu", got, n);
+}
+
+/* Host time to decode a second of audio. It doesn't translate to the ESP32-S3 by a fixed factor,
+ * but it shows the decoder against the PCM copy it replaces.
+ */
+static void bench(uint16_t align, int channels, uint32_t rate)
+{
+    static uint8_t data[64 * 1024];
+    static int16_t out[128 * 1024];
+
+    pp_wav_format_t adpcm = { .format = WAV_FORMAT_IMA_ADPCM, .channels = channels, .sample_rate = rate, .bits = 4, .block_align = align };
+    adpcm.samples_per_block = IMA_ADPCM_SAMPLES_PER_BLOCK(align, channels);
+    pp_wav_format_t pcm = { .format = WAV_FORMAT_PCM, .channels = channels, .sample_rate = rate, .bits = 16, .block_align = 2 * channels };
+
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = rand();
+    }
+
+    uint32_t blocks = sizeof(data) / align;
+    uint64_t frames = 0;
+    int64_t start = host_test_ns();
+    while (frames < (uint64_t)BENCH_SECONDS * rate)
+    {
+        frames += pp_wav_to_mono16(&adpcm, data, blocks, out);
+    }
+    double adpcm_ns = (double)(host_test_ns() - start) / frames;
+
+    uint32_t pcm_frames = sizeof(data) / pcm.block_align;
+    frames = 0;
+    start = host_test_ns();
+    while (frames < (uint64_t)BENCH_SECONDS * rate)
+    {
+        frames += pp_wav_to_mono16(&pcm, data, pcm_frames, out);
+    }
+    double pcm_ns = (double)(host_test_ns() - start) / frames;
+
+    host_test_sink = out[frames % 1000];
+    printf("%4u byte block, %d channel%s, %5" PRIu32 " Hz: %.2f ns per frame, %.0f us per second of audio, 16-bit PCM %.0f us\n",
+        align, channels, channels == 1 ? " " : "s", rate, adpcm_ns, adpcm_ns * rate / 1000.0, pcm_ns * rate / 1000.0);
+}
+
+int main(void)
+{
+    srand(5);
+
+    for (uint16_t align = 256; align <= BLOCK_MAX; align *= 2)
+    {
+        test_tone(align, 1, 22050);
+        test_tone(align, 2, 44100);
+    }
+
+    test_random();
+    test_wav_blocks();
+
+    bench(1024, 1, 22050);
+    bench(2048, 1, 44100);
+    bench(2048, 2, 44100);
+
+    return HOST_RESULT();
+}
@@ -0,0 +1,261 @@
+#include "host_test.h"
+#include "pp_resampler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+/* pp_resampler from every supported rate to 44100 Hz: THD+N of a tone, passband ripple, alias
+ * level when downsampling, output independent of the chunk sizes, the single precision design
+ * against a double precision one, and the cost of designing and of running the filter.
+ */
+#define OUT_RATE        44100
+#define AMPLITUDE       16000.0
+#define SETTLE          2000        // output samples left out at both ends of a measurement
+#define THDN_MAX_DB     -60.0
+#define RIPPLE_MAX_DB   0.1
+#define ALIAS_MAX_DB    -65.0
+#define PASSBAND        0.6         // of the lower Nyquist frequency, the rolloff starts above it
+#define STOPBAND        1.2         // of the output Nyquist frequency
+#define BENCH_SECONDS   20
+
+static const uint32_t rates[] = { 8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000, 88200, 96000 };
+
+static pp_resampler_filter_t filter;
+static int16_t out[2 * 96000 + 1000];
+static int16_t out_chunked[2 * 96000 + 1000];
+
+// Two seconds of a tone, in full chunks or in chunks of varying size
+static size_t run(uint32_t in_rate, double freq, int16_t *dst, size_t in_len, bool varying)
+{
+    pp_resampler_t r;
+    int16_t in[RESAMPLER_CHUNK];
+    size_t produced = 0;
+
+    HOST_CHECK(pp_resampler_init(&r, &filter, in_rate, OUT_RATE), "%" PRIu32 " Hz not accepted", in_rate);
+    pp_resampler_reset(&r);
+
+    for (size_t done = 0, i = 0; done < in_len; i++)
+    {
+        size_t k = varying ? (i * 37 % RESAMPLER_CHUNK) + 1 : RESAMPLER_CHUNK;
+        k = (k > in_len - done) ? in_len - done : k;
+
+        for (size_t j = 0; j < k; j++)
+        {
+            in[j] = (int16_t)lround(AMPLITUDE * sin(2.0 * M_PI * freq * (done + j) / in_rate));
+        }
+
+        produced += pp_resampler_process(&r, in, k, &dst[produced]);
+        done += k;
+    }
+
+    return produced;
+}
+
+// Level of a tone in dB relative to AMPLITUDE, and with residual the THD+N of the rest
+static double tone_db(const int16_t *y, size_t n, double freq, double *thdn)
+{
+    double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        double a = sin(2.0 * M_PI * freq * i / OUT_RATE);
+        double b = cos(2.0 * M_PI * freq * i / OUT_RATE);
+        ss += a * a;
+        cc += b * b;
+        sc += a * b;
+        ys += y[i] * a;
+        yc += y[i] * b;
+    }
+
+    // Least squares fit of the tone, its phase is not known
+    double det = ss * cc - sc * sc;
+    double s = (ys * cc - yc * sc) / det;
+    double c = (yc * ss - ys * sc) / det;
+
+    if (thdn)
+    {
+        double signal = 0, residual = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            double m = s * sin(2.0 * M_PI * freq * i / OUT_RATE) + c * cos(2.0 * M_PI * freq * i / OUT_RATE);
+            signal += m * m;
+            residual += (y[i] - m) * (y[i] - m);
+        }
+        *thdn = 10.0 * log10(residual / signal);
+    }
+
+    return 20.0 * log10(sqrt(s * s + c * c) / AMPLITUDE);
+}
+
+static void test_rate(uint32_t in_rate)
+{
+    size_t in_len = 2 * in_rate;
+    size_t n = run(in_rate, 1000.0, out, in_len, false);
+    size_t n_chunked = run(in_rate, 1000.0, out_chunked, in_len, true);
+
+    size_t expected = (size_t)((uint64_t)in_len * OUT_RATE / in_rate);
+    HOST_CHECK(n + 1 >= expected && n <= expected + 1, "%" PRIu32 " Hz: %zu samples out, expected %zu", in_rate, n, expected);
+    HOST_CHECK(n == n_chunked && memcmp(out, out_chunked, n * sizeof(int16_t)) == 0, "%" PRIu32 " Hz: output depends on the chunk size", in_rate);
+
+    double thdn;
+    tone_db(&out[SETTLE], n - 2 * SETTLE, 1000.0, &thdn);
+    HOST_CHECK(thdn <= THDN_MAX_DB, "%" PRIu32 " Hz: THD+N %.1f dB", in_rate, thdn);
+
+    double edge = PASSBAND * 0.5 * (in_rate < OUT_RATE ? in_rate : OUT_RATE);
+    double lo = 1e9, hi = -1e9;
+    for (double f = 100.0; f < edge; f += edge / 20)
+    {
+        n = run(in_rate, f, out, in_len, false);
+        double g = tone_db(&out[SETTLE], n - 2 * SETTLE, f, NULL);
+        lo = g < lo ? g : lo;
+        hi = g > hi ? g : hi;
+    }
+    HOST_CHECK(hi - lo <= RIPPLE_MAX_DB, "%" PRIu32 " Hz: passband ripple %.3f dB", in_rate, hi - lo);
+
+    // Tones in the stopband have to be filtered out, not folded back below 22050 Hz
+    double alias = -INFINITY;
+    for (double f = STOPBAND * OUT_RATE / 2; f < 0.45 * in_rate; f += 1000.0)
+    {
+        n = run(in_rate, f, out, in_len, false);
+        double g = tone_db(&out[SETTLE], n - 2 * SETTLE, OUT_RATE - f, NULL);
+        HOST_CHECK(g <= ALIAS_MAX_DB, "%" PRIu32 " Hz: %.0f Hz folds back at %.1f dB", in_rate, f, g);
+        alias = g > alias ? g : alias;
+    }
+
+    printf("%6" PRIu32 " Hz: THD+N %.1f dB, ripple %.3f dB, alias %.1f dB\n", in_rate, thdn, hi - lo, alias);
+}
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/* Same design in double precision, taps rounded but not yet corrected to sum to 1.0, so a
+ * phase may differ by the correction in its largest tap and by a rounding step in the rest.
+ */
+static void test_design(uint32_t in_rate)
+{
+    pp_resampler_t r;
+    pp_resampler_init(&r, &filter, in_rate, OUT_RATE);
+    if (r.filter == NULL)
+    {
+        return;
+    }
+
+    uint32_t len = RESAMPLER_TAPS * r.up;
+    double center = (len - 1) / 2.0;
+    double fc = RESAMPLER_CUTOFF / (2.0 * (r.up > r.down ? r.up : r.down));
+    int worst = 0;
+
+    for (uint32_t ph = 0; ph < r.up; ph++)
+    {
+        const int16_t *coef = &filter.coef[ph * RESAMPLER_TAPS];
+        double taps[RESAMPLER_TAPS];
+        double sum = 0.0;
+        int32_t total = 0;
+
+        for (uint32_t k = 0; k < RESAMPLER_TAPS; k++)
+        {
+            double t = (ph + k * r.up) - center;
+            double sinc = (t == 0.0) ? 1.0 : sin(2.0 * M_PI * fc * t) / (2.0 * M_PI * fc * t);
+            double w = t / (center + 1.0);
+            taps[RESAMPLER_TAPS - 1 - k] = sinc * bessel_i0(RESAMPLER_KAISER_BETA * sqrt(1.0 - w * w)) / bessel_i0(RESAMPLER_KAISER_BETA);
+            sum += taps[RESAMPLER_TAPS - 1 - k];
+        }
+
+        int largest = 0;
+        for (uint32_t k = 0; k < RESAMPLER_TAPS; k++)
+        {
+            total += coef[k];
+            largest = abs(coef[k]) > abs(coef[largest]) ? (int)k : largest;
+        }
+
+        for (uint32_t k = 0; k < RESAMPLER_TAPS; k++)
+        {
+            int diff = abs(coef[k] - (int)lround(taps[k] / sum * 32768.0));
+            if ((int)k != largest && diff > worst)
+            {
+                worst = diff;
+            }
+        }
+
+        HOST_CHECK(total == 32768 || coef[largest] == INT16_MAX, "%" PRIu32 " Hz: phase %" PRIu32 " sums to %" PRId32, in_rate, ph, total);
+    }
+
+    HOST_CHECK(worst <= 1, "%" PRIu32 " Hz: taps %d off the double precision design", in_rate, worst);
+}
+
+// Designing for a new ratio against finding the filter ready, as a second ring at the same rate does
+static void bench_design(void)
+{
+    pp_resampler_t r;
+
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        if (rates[i] == OUT_RATE)
+        {
+            continue;
+        }
+
+        filter.up = 0;
+        int64_t start = host_test_ns();
+        pp_resampler_init(&r, &filter, rates[i], OUT_RATE);
+        int64_t designed = host_test_ns() - start;
+
+        int16_t first = filter.coef[RESAMPLER_TAPS / 2];
+        start = host_test_ns();
+        pp_resampler_init(&r, &filter, rates[i], OUT_RATE);
+        int64_t cached = host_test_ns() - start;
+
+        HOST_CHECK(r.filter == &filter && filter.coef[RESAMPLER_TAPS / 2] == first, "%" PRIu32 " Hz: cached filter changed", rates[i]);
+        printf("%6" PRIu32 " Hz: L=%u M=%" PRIu32 ", design %.2f ms, cached %.2f us\n",
+            rates[i], r.up, r.down, designed / 1e6, cached / 1e3);
+    }
+}
+
+static void bench_process(void)
+{
+    static const uint32_t bench_rates[] = { 22050, 48000, 32000 };
+
+    for (size_t i = 0; i < sizeof(bench_rates) / sizeof(bench_rates[0]); i++)
+    {
+        size_t n = 0;
+        int64_t start = host_test_ns();
+        for (int s = 0; s < BENCH_SECONDS / 2; s++)
+        {
+            n += run(bench_rates[i], 1000.0, out, 2 * bench_rates[i], false);
+        }
+        int64_t elapsed = host_test_ns() - start;
+
+        host_test_sink = out[n % 1000];
+        printf("%6" PRIu32 " Hz: %.1f ns per output sample, tone generation included\n", bench_rates[i], (double)elapsed / n);
+    }
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        test_rate(rates[i]);
+        test_design(rates[i]);
+    }
+
+    // Equal rates pass the samples through untouched
+    pp_resampler_t r;
+    int16_t in[3] = { INT16_MIN, 1, INT16_MAX };
+    HOST_CHECK(pp_resampler_init(&r, &filter, OUT_RATE, OUT_RATE) && r.filter == NULL, "44100 Hz is not a passthrough");
+    HOST_CHECK(pp_resampler_process(&r, in, 3, out) == 3 && memcmp(in, out, sizeof(in)) == 0, "passthrough changes samples");
+    HOST_CHECK(!pp_resampler_init(&r, &filter, 44099, OUT_RATE), "44099 Hz accepted, L is above RESAMPLER_PHASES_MAX");
+
+    bench_design();
+    bench_process();
+
+    return HOST_RESULT();
+}
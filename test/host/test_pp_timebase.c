@@ -0,0 +1,186 @@
+#include "host_test.h"
+#include "pp_timebase.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* pp_timebase against glibc's localtime_r and mktime in zones with DST north and south of the
+ * equator, a fractional offset and none at all, plus the civil date arithmetic on its own.
+ */
+#define STEP_SEC        1797        // odd step, so every second of the minute and hour comes up
+#define END_SEC         4102444800  // 2100-01-01
+#define BENCH_CALLS     1000000
+
+static const char *zones[] = {
+    "CET-1CEST,M3.5.0/2,M10.5.0/3",
+    "EST5EDT,M3.2.0,M11.1.0",
+    "AEST-10AEDT,M10.1.0,M4.1.0/3",
+    "<+0330>-3:30",
+    "UTC0",
+};
+
+static bool tm_equal(const struct tm *a, const struct tm *b)
+{
+    return a->tm_sec == b->tm_sec && a->tm_min == b->tm_min && a->tm_hour == b->tm_hour &&
+        a->tm_mday == b->tm_mday && a->tm_mon == b->tm_mon && a->tm_year == b->tm_year &&
+        a->tm_wday == b->tm_wday && a->tm_yday == b->tm_yday && a->tm_isdst == b->tm_isdst;
+}
+
+static bool wall_equal(const struct tm *a, const struct tm *b)
+{
+    return a->tm_sec == b->tm_sec && a->tm_min == b->tm_min && a->tm_hour == b->tm_hour &&
+        a->tm_mday == b->tm_mday && a->tm_mon == b->tm_mon && a->tm_year == b->tm_year;
+}
+
+/* glibc's mktime may resolve a wall time repeated when DST ends to either instant, pp_timebase_mktime
+ * takes the first one. All zones tested shift by an hour, so the first is an hour earlier if that
+ * instant shows the same wall time too.
+ */
+static time_t expected_mktime(const struct tm *local)
+{
+    struct tm wall = *local;
+    time_t utc = timegm(&wall);     // normalises the fields
+    gmtime_r(&utc, &wall);
+
+    struct tm resolved = *local;
+    time_t t = mktime(&resolved);
+
+    time_t earlier = t - 3600;
+    struct tm back;
+    localtime_r(&earlier, &back);
+
+    return wall_equal(&back, &wall) ? earlier : t;
+}
+
+static void test_civil(void)
+{
+    // 1600-01-01 to 2400-01-01, every day there and back
+    int32_t first = pp_timebase_days_from_civil(1600, 1, 1);
+    int32_t last = pp_timebase_days_from_civil(2400, 1, 1);
+    HOST_CHECK(pp_timebase_days_from_civil(1970, 1, 1) == 0, "epoch is not day 0");
+    HOST_CHECK(pp_timebase_days_from_civil(2000, 3, 1) - pp_timebase_days_from_civil(2000, 2, 28) == 2, "2000 is not leap");
+    HOST_CHECK(pp_timebase_days_from_civil(2100, 3, 1) - pp_timebase_days_from_civil(2100, 2, 28) == 1, "2100 is leap");
+
+    int32_t year;
+    uint32_t month, day;
+    pp_timebase_civil_from_days(first, &year, &month, &day);
+
+    for (int32_t d = first; d < last; d++)
+    {
+        int32_t y;
+        uint32_t m, dd;
+        pp_timebase_civil_from_days(d, &y, &m, &dd);
+        HOST_CHECK(y == year && m == month && dd == day, "day %d: %d-%u-%u, expected %d-%u-%u", d, y, m, dd, year, month, day);
+        HOST_CHECK(pp_timebase_days_from_civil(y, m, dd) == d, "day %d does not round trip", d);
+
+        // Next date the slow way, days past the month's end carry over
+        int32_t next = pp_timebase_days_from_civil(year, month, day + 1);
+        HOST_CHECK(next == d + 1, "day after %d-%u-%u is %d", year, month, day, next);
+        pp_timebase_civil_from_days(next, &year, &month, &day);
+    }
+}
+
+static void test_zone(const char *tz)
+{
+    setenv("TZ", tz, 1);
+    tzset();
+    HOST_CHECK(pp_timebase_init(tz), "%s not accepted", tz);
+
+    long checked = 0;
+    for (long long s = 400LL * 86400; s < END_SEC; s += STEP_SEC)
+    {
+        time_t t = s;
+        struct tm expected, local;
+        localtime_r(&t, &expected);
+        pp_timebase_localtime(t, &local);
+        HOST_CHECK(tm_equal(&expected, &local), "%s localtime %lld", tz, s);
+
+        // Fields out of range in both directions and DST left to be worked out
+        struct tm a = expected;
+        a.tm_isdst = -1;
+        a.tm_mday += (s % 5) - 2;
+        a.tm_mon += (s % 3) - 1;
+        a.tm_min += s % 7;
+        time_t m1 = expected_mktime(&a);
+        time_t m2 = pp_timebase_mktime(&a);
+        HOST_CHECK(m1 == m2, "%s mktime near %lld: %lld, expected %lld", tz, s, (long long)m2, (long long)m1);
+        checked++;
+    }
+
+    printf("%s: %ld instants\n", tz, checked);
+}
+
+static void bench(void)
+{
+    setenv("TZ", zones[0], 1);
+    tzset();
+    pp_timebase_init(zones[0]);
+
+    time_t base = 1760000000;
+    struct tm x;
+    int64_t sum = 0;
+
+    int64_t start = host_test_ns();
+    for (int i = 0; i < BENCH_CALLS; i++)
+    {
+        time_t t = base + i * 37;
+        localtime_r(&t, &x);
+        sum += x.tm_hour;
+    }
+    int64_t glibc_localtime = host_test_ns() - start;
+
+    start = host_test_ns();
+    for (int i = 0; i < BENCH_CALLS; i++)
+    {
+        pp_timebase_localtime(base + i * 37, &x);
+        sum += x.tm_hour;
+    }
+    int64_t timebase_localtime = host_test_ns() - start;
+
+    // Current time over and over as the display asks for it, the second is decomposed once
+    start = host_test_ns();
+    for (int i = 0; i < BENCH_CALLS; i++)
+    {
+        pp_timebase_now(NULL, &x);
+        sum += x.tm_hour;
+    }
+    int64_t timebase_now = host_test_ns() - start;
+
+    start = host_test_ns();
+    for (int i = 0; i < BENCH_CALLS; i++)
+    {
+        struct tm y = x;
+        y.tm_min += i % 1000;
+        y.tm_isdst = -1;
+        sum += mktime(&y);
+    }
+    int64_t glibc_mktime = host_test_ns() - start;
+
+    start = host_test_ns();
+    for (int i = 0; i < BENCH_CALLS; i++)
+    {
+        struct tm y = x;
+        y.tm_min += i % 1000;
+        sum += pp_timebase_mktime(&y);
+    }
+    int64_t timebase_mktime = host_test_ns() - start;
+
+    host_test_sink = sum;
+    printf("localtime: glibc %.1f ns, timebase %.1f ns, timebase now %.1f ns\n",
+        (double)glibc_localtime / BENCH_CALLS, (double)timebase_localtime / BENCH_CALLS, (double)timebase_now / BENCH_CALLS);
+    printf("mktime: glibc %.1f ns, timebase %.1f ns\n", (double)glibc_mktime / BENCH_CALLS, (double)timebase_mktime / BENCH_CALLS);
+}
+
+int main(void)
+{
+    test_civil();
+
+    for (size_t i = 0; i < sizeof(zones) / sizeof(zones[0]); i++)
+    {
+        test_zone(zones[i]);
+    }
+
+    bench();
+
+    return HOST_RESULT();
+}
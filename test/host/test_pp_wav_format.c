@@ -0,0 +1,297 @@
+#include "host_test.h"
+#include "pp_wav_format.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* WAV fixtures are built here in memory, parsed both from memory and from a file and converted
+ * in odd sized pieces. Expected samples come from the generated values, not from the converter.
+ */
+#define FIXTURE_FRAMES      1001
+#define FIXTURE_SIZE_MAX    (64 * 1024)
+#define CONVERT_PIECE       77
+
+typedef struct
+{
+    uint8_t data[FIXTURE_SIZE_MAX];
+    uint32_t len;
+} fixture_t;
+
+static void put16(fixture_t *f, uint16_t v)
+{
+    f->data[f->len++] = v;
+    f->data[f->len++] = v >> 8;
+}
+
+static void put32(fixture_t *f, uint32_t v)
+{
+    put16(f, v);
+    put16(f, v >> 16);
+}
+
+static void put_bytes(fixture_t *f, const void *p, uint32_t len)
+{
+    memcpy(&f->data[f->len], p, len);
+    f->len += len;
+}
+
+static void put_chunk(fixture_t *f, const char *id, const void *p, uint32_t len)
+{
+    put_bytes(f, id, 4);
+    put32(f, len);
+    put_bytes(f, p, len);
+    if (len & 1)
+    {
+        f->data[f->len++] = 0;
+    }
+}
+
+static void riff_begin(fixture_t *f)
+{
+    f->len = 0;
+    put_bytes(f, "RIFF", 4);
+    put32(f, 0);
+    put_bytes(f, "WAVE", 4);
+}
+
+static void riff_end(fixture_t *f)
+{
+    uint32_t size = f->len - 8;
+    memcpy(&f->data[4], &size, 4);
+}
+
+static uint32_t fmt_chunk(uint8_t *p, uint16_t tag, uint16_t channels, uint32_t rate, uint16_t align, uint16_t bits, bool extensible)
+{
+    fixture_t f = { .len = 0 };
+    put16(&f, extensible ? WAV_FORMAT_EXTENSIBLE : tag);
+    put16(&f, channels);
+    put32(&f, rate);
+    put32(&f, rate * align);
+    put16(&f, align);
+    put16(&f, bits);
+
+    if (extensible)
+    {
+        static const uint8_t guid_tail[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+        put16(&f, 22);
+        put16(&f, bits);
+        put32(&f, 0);
+        put16(&f, tag);
+        put_bytes(&f, guid_tail, sizeof(guid_tail));
+    }
+
+    memcpy(p, f.data, f.len);
+    return f.len;
+}
+
+static int16_t expected_sample(int32_t v, uint16_t bits)
+{
+    return (bits == 8) ? (int16_t)(v << 8) : (int16_t)(v >> (bits - 16));
+}
+
+/* PCM file of random samples. Options put a LIST chunk and an odd sized chunk before fmt, a fact
+ * chunk and cut the end of the data off, as an interrupted recording leaves it.
+ */
+static uint32_t pcm_fixture(fixture_t *f, uint16_t bits, uint16_t channels, bool extensible, bool odd_chunk, bool fact, uint32_t cut, int16_t *expected)
+{
+    uint8_t data[FIXTURE_FRAMES * 8];
+    uint32_t len = 0;
+    uint16_t bytes = bits / 8;
+
+    for (uint32_t i = 0; i < FIXTURE_FRAMES; i++)
+    {
+        int32_t s[2];
+        for (uint16_t c = 0; c < channels; c++)
+        {
+            s[c] = (int32_t)(((uint32_t)rand() << 16) ^ (uint32_t)rand()) >> (32 - bits);
+            uint32_t raw = (bits == 8) ? (uint32_t)(s[c] + 128) : (uint32_t)s[c];
+            for (uint16_t b = 0; b < bytes; b++)
+            {
+                data[len++] = raw >> (8 * b);
+            }
+        }
+
+        int16_t a = expected_sample(s[0], bits);
+        expected[i] = (channels == 1) ? a : (int16_t)(((int32_t)a + expected_sample(s[1], bits)) >> 1);
+    }
+
+    riff_begin(f);
+    if (odd_chunk)
+    {
+        put_chunk(f, "junk", "abc", 3);
+    }
+    put_chunk(f, "LIST", "INFOab", 6);
+
+    uint8_t fmt[40];
+    put_chunk(f, "fmt ", fmt, fmt_chunk(fmt, WAV_FORMAT_PCM, channels, 22050, channels * bytes, bits, extensible));
+
+    if (fact)
+    {
+        uint8_t frames[4];
+        memcpy(frames, &(uint32_t){ FIXTURE_FRAMES }, 4);
+        put_chunk(f, "fact", frames, 4);
+    }
+
+    put_chunk(f, "data", data, len);
+    riff_end(f);
+
+    // Header keeps the full sizes, only the file is shorter
+    f->len -= cut;
+    return (len - cut) / (channels * bytes);
+}
+
+static bool parse_file(const fixture_t *f, pp_wav_format_t *fmt)
+{
+    const char *path = "fixture.wav";
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd < 0 || write(fd, f->data, f->len) != (ssize_t)f->len)
+    {
+        return false;
+    }
+
+    bool ok = pp_wav_parse(fd, f->len, fmt);
+    close(fd);
+    unlink(path);
+    return ok;
+}
+
+static void test_pcm(void)
+{
+    static int16_t expected[FIXTURE_FRAMES];
+    static int16_t out[FIXTURE_FRAMES];
+    static fixture_t f;
+    int n = 0;
+
+    for (uint16_t bits = 8; bits <= 32; bits += 8)
+    {
+        for (uint16_t channels = 1; channels <= 2; channels++, n++)
+        {
+            uint32_t cut = (n == 5) ? 7 : 0;
+            uint32_t frames = pcm_fixture(&f, bits, channels, n % 3 == 0, n % 4 == 1, n % 2 == 0, cut, expected);
+
+            pp_wav_format_t fmt, fmt_file;
+            bool ok = pp_wav_parse_mem(f.data, f.len, &fmt);
+            HOST_CHECK(ok, "%u bit %u channels not parsed", bits, channels);
+            HOST_CHECK(parse_file(&f, &fmt_file) && memcmp(&fmt, &fmt_file, sizeof(fmt)) == 0, "%u bit %u channels: file and memory differ", bits, channels);
+            if (!ok)
+            {
+                continue;
+            }
+
+            HOST_CHECK(fmt.format == WAV_FORMAT_PCM && fmt.bits == bits && fmt.channels == channels && fmt.sample_rate == 22050,
+                "%u bit %u channels: format %04x %u bit %u channels %u Hz", bits, channels, fmt.format, fmt.bits, fmt.channels, fmt.sample_rate);
+            HOST_CHECK(fmt.data_size == frames * fmt.block_align, "%u bit %u channels: %u bytes of data, expected %u",
+                bits, channels, fmt.data_size, frames * fmt.block_align);
+
+            for (uint32_t done = 0; done < frames; done += CONVERT_PIECE)
+            {
+                uint32_t k = (frames - done < CONVERT_PIECE) ? frames - done : CONVERT_PIECE;
+                pp_wav_to_mono16(&fmt, &f.data[fmt.data_offset + done * fmt.block_align], k, &out[done]);
+            }
+
+            uint32_t mismatch = 0;
+            while (mismatch < frames && out[mismatch] == expected[mismatch])
+            {
+                mismatch++;
+            }
+            HOST_CHECK(mismatch == frames, "%u bit %u channels: sample %u is %d, expected %d", bits, channels, mismatch, out[mismatch], expected[mismatch]);
+        }
+    }
+}
+
+/* Three 256-byte mono blocks hold 1515 frames, fact says 600, so only two blocks are real. The
+ * fact chunk is tried before and after data.
+ */
+static void test_adpcm_fact(void)
+{
+    static fixture_t f;
+    uint8_t blocks[3 * 256] = { 0 };
+
+    for (int after = 0; after <= 1; after++)
+    {
+        uint8_t fmt[20];
+        uint32_t len = fmt_chunk(fmt, WAV_FORMAT_IMA_ADPCM, 1, 22050, 256, 4, false);
+        memcpy(&fmt[len], (uint16_t[]){ 2, 505 }, 4);
+
+        uint8_t frames[4];
+        memcpy(frames, &(uint32_t){ 600 }, 4);
+
+        riff_begin(&f);
+        put_chunk(&f, "fmt ", fmt, len + 4);
+        if (!after)
+        {
+            put_chunk(&f, "fact", frames, 4);
+        }
+        put_chunk(&f, "data", blocks, sizeof(blocks));
+        if (after)
+        {
+            put_chunk(&f, "LIST", "INFOab", 6);
+            put_chunk(&f, "fact", frames, 4);
+        }
+        riff_end(&f);
+
+        pp_wav_format_t fmt_mem;
+        bool ok = pp_wav_parse_mem(f.data, f.len, &fmt_mem);
+        HOST_CHECK(ok, "ADPCM with fact %s data not parsed", after ? "after" : "before");
+        HOST_CHECK(!ok || (fmt_mem.fact_frames == 600 && fmt_mem.samples_per_block == 505 && fmt_mem.data_size == 512),
+            "ADPCM with fact %s data: fact %u, %u samples per block, %u bytes of data", after ? "after" : "before",
+            fmt_mem.fact_frames, fmt_mem.samples_per_block, fmt_mem.data_size);
+    }
+}
+
+static void test_rejected(void)
+{
+    static fixture_t f;
+    static int16_t expected[FIXTURE_FRAMES];
+    pp_wav_format_t fmt;
+    uint8_t chunk[40];
+
+    memset(f.data, 0, 44);
+    memcpy(f.data, "RIFX", 4);
+    HOST_CHECK(!pp_wav_parse_mem(f.data, 44, &fmt), "RIFX accepted");
+
+    // Rate below the lowest supported
+    riff_begin(&f);
+    put_chunk(&f, "fmt ", chunk, fmt_chunk(chunk, WAV_FORMAT_PCM, 1, 4000, 2, 16, false));
+    put_chunk(&f, "data", chunk, 20);
+    riff_end(&f);
+    HOST_CHECK(!pp_wav_parse_mem(f.data, f.len, &fmt), "4000 Hz accepted");
+
+    // 12-bit samples
+    riff_begin(&f);
+    put_chunk(&f, "fmt ", chunk, fmt_chunk(chunk, WAV_FORMAT_PCM, 1, 22050, 2, 12, false));
+    put_chunk(&f, "data", chunk, 20);
+    riff_end(&f);
+    HOST_CHECK(!pp_wav_parse_mem(f.data, f.len, &fmt), "12 bit accepted");
+
+    // ADPCM block which is not a power of 2
+    riff_begin(&f);
+    put_chunk(&f, "fmt ", chunk, fmt_chunk(chunk, WAV_FORMAT_IMA_ADPCM, 1, 22050, 300, 4, false));
+    put_chunk(&f, "data", chunk, 20);
+    riff_end(&f);
+    HOST_CHECK(!pp_wav_parse_mem(f.data, f.len, &fmt), "ADPCM block of 300 bytes accepted");
+
+    // No data chunk
+    riff_begin(&f);
+    put_chunk(&f, "fmt ", chunk, fmt_chunk(chunk, WAV_FORMAT_PCM, 1, 22050, 2, 16, false));
+    riff_end(&f);
+    HOST_CHECK(!pp_wav_parse_mem(f.data, f.len, &fmt), "file without data accepted");
+
+    // Cut inside the fmt chunk
+    pcm_fixture(&f, 16, 1, false, false, false, 0, expected);
+    HOST_CHECK(!pp_wav_parse_mem(f.data, 40, &fmt), "file cut in fmt accepted");
+}
+
+int main(void)
+{
+    srand(1);
+
+    test_pcm();
+    test_adpcm_fact();
+    test_rejected();
+
+    return HOST_RESULT();
+}
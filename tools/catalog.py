@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+"""Packs and unpacks the clock's catalog archives (catalog.nca, catalog_full.nca).
+
+An archive read from the clock unpacks into a directory: catalog.json lists the objects in
+archive order, ringtone and calendar bodies go next to it as <id>.wav and <id>.cal. Packing
+the directory gives an archive for the import object, bodies are taken from the files.
+
+    python tools/catalog.py list catalog_full.nca
+    python tools/catalog.py unpack catalog_full.nca backup/
+    python tools/catalog.py pack backup/ import.nca
+
+Format as in components/ObjectManager/ObjectManagerCatalog/ObjectManagerCatalog.h: header
+[magic, version, flags] followed by records [tag, 4-byte length, payload], little endian.
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+
+MAGIC = b"NXCA"
+VERSION = 1
+FLAG_CONTENT = 1 << 0
+
+REC_OBJECT = 0x01       # ID(6), type UUID(16), properties(4), size(4), name length(1), name
+REC_ALARM = 0x02        # Alarm Action payload with the whole trailer
+REC_CONTENT = 0x03      # ringtone or calendar body
+REC_END = 0xFF
+
+ID_SIZE = 6
+UUID_SIZE = 16
+NAME_LEN_MAX = 31       # NAME_LEN_MAX - 1, the name is stored with its terminator on the clock
+
+# Object type UUIDs differ in the first byte only
+UUID_TAIL = bytes([0x00, 0x12, 0xAC, 0x42, 0x02, 0x61, 0xA2, 0xED, 0x11, 0xBA, 0x29, 0xB8, 0x13, 0x08, 0xCC])
+TYPES = {0x02: "alarm", 0x03: "ringtone", 0x06: "calendar"}
+CONTENT_TYPES = {"ringtone": ".wav", "calendar": ".cal"}
+
+
+def type_name(uuid):
+    if uuid[1:] == UUID_TAIL and uuid[0] in TYPES:
+        return TYPES[uuid[0]]
+    return uuid.hex()
+
+
+def type_uuid(name):
+    for first, known in TYPES.items():
+        if known == name:
+            return bytes([first]) + UUID_TAIL
+    uuid = bytes.fromhex(name)
+    if len(uuid) != UUID_SIZE:
+        raise ValueError("unknown object type %s" % name)
+    return uuid
+
+
+def read_records(data):
+    """Yields (tag, payload) up to and including the end record."""
+    if len(data) < len(MAGIC) + 2 or data[:len(MAGIC)] != MAGIC:
+        raise ValueError("not a catalog archive")
+    if data[len(MAGIC)] != VERSION:
+        raise ValueError("archive version %d, only %d is known" % (data[len(MAGIC)], VERSION))
+
+    pos = len(MAGIC) + 2
+    while True:
+        if pos + 5 > len(data):
+            raise ValueError("archive ends without the end record")
+        tag, length = struct.unpack_from("<BI", data, pos)
+        pos += 5
+        if pos + length > len(data):
+            raise ValueError("record 0x%02x at %d runs past the end" % (tag, pos - 5))
+        yield tag, data[pos:pos + length]
+        pos += length
+        if tag == REC_END:
+            return
+
+
+def parse(data):
+    """Objects of an archive as manifest entries, bodies kept as bytes under "body"."""
+    objects = []
+    for tag, payload in read_records(data):
+        if tag == REC_OBJECT:
+            if len(payload) < ID_SIZE + UUID_SIZE + 9:
+                raise ValueError("object record of %d bytes" % len(payload))
+            ident = int.from_bytes(payload[:ID_SIZE], "little")
+            uuid = payload[ID_SIZE:ID_SIZE + UUID_SIZE]
+            properties, size, name_len = struct.unpack_from("<IIB", payload, ID_SIZE + UUID_SIZE)
+            name = payload[ID_SIZE + UUID_SIZE + 9:]
+            if len(name) != name_len:
+                raise ValueError("object %x: name of %d bytes, %d stored" % (ident, name_len, len(name)))
+            objects.append({
+                "id": "%x" % ident,
+                "type": type_name(uuid),
+                "name": name.decode("utf-8", "replace"),
+                "properties": "0x%02x" % properties,
+                "size": size,
+            })
+        elif tag == REC_ALARM:
+            if not objects:
+                raise ValueError("alarm record without an object")
+            objects[-1]["alarm"] = payload.hex()
+        elif tag == REC_CONTENT:
+            if not objects or objects[-1]["size"] != len(payload):
+                raise ValueError("content record does not match its object")
+            objects[-1]["body"] = payload
+        elif tag != REC_END:
+            # Records of newer versions are kept in place, the clock skips them too
+            objects.append({"record": "0x%02x" % tag, "data": payload.hex()})
+    return objects
+
+
+def record(tag, payload):
+    return struct.pack("<BI", tag, len(payload)) + payload
+
+
+def build(objects):
+    with_content = any("body" in o for o in objects)
+    out = bytearray(MAGIC + bytes([VERSION, FLAG_CONTENT if with_content else 0]))
+
+    for o in objects:
+        if "record" in o:
+            out += record(int(o["record"], 16), bytes.fromhex(o["data"]))
+            continue
+
+        name = o["name"].encode("utf-8")
+        if len(name) > NAME_LEN_MAX:
+            raise ValueError("%s: name longer than %d bytes" % (o["name"], NAME_LEN_MAX))
+        if "body" in o and o["type"] not in CONTENT_TYPES:
+            raise ValueError("%s: a %s has no body" % (o["name"], o["type"]))
+
+        size = len(o["body"]) if "body" in o else o.get("size", 0)
+        payload = int(o["id"], 16).to_bytes(ID_SIZE, "little") + type_uuid(o["type"])
+        payload += struct.pack("<IIB", int(o["properties"], 0), size, len(name)) + name
+        out += record(REC_OBJECT, payload)
+
+        if "alarm" in o:
+            out += record(REC_ALARM, bytes.fromhex(o["alarm"]))
+        if "body" in o:
+            out += record(REC_CONTENT, o["body"])
+
+    out += record(REC_END, b"")
+    return bytes(out)
+
+
+def unpack(archive, directory):
+    with open(archive, "rb") as src:
+        objects = parse(src.read())
+
+    os.makedirs(directory, exist_ok=True)
+    for o in objects:
+        body = o.pop("body", None)
+        if body is not None:
+            o["content"] = o["id"] + CONTENT_TYPES[o["type"]]
+            with open(os.path.join(directory, o["content"]), "wb") as dst:
+                dst.write(body)
+
+    with open(os.path.join(directory, "catalog.json"), "w") as dst:
+        json.dump({"objects": objects}, dst, indent=2)
+        dst.write("\n")
+    return objects
+
+
+def pack(directory, archive):
+    with open(os.path.join(directory, "catalog.json")) as src:
+        objects = json.load(src)["objects"]
+
+    for o in objects:
+        if "content" in o:
+            with open(os.path.join(directory, o.pop("content")), "rb") as body:
+                o["body"] = body.read()
+
+    data = build(objects)
+    with open(archive, "wb") as dst:
+        dst.write(data)
+    return objects, len(data)
+
+
+def describe(o):
+    if "record" in o:
+        return "record %s, %d bytes" % (o["record"], len(o["data"]) // 2)
+    text = "%8s  %-9s %-32s properties %s" % (o["id"], o["type"], o["name"], o["properties"])
+    if "body" in o or "content" in o:
+        text += ", %d byte body" % o["size"]
+    if "alarm" in o:
+        text += ", %d byte alarm record" % (len(o["alarm"]) // 2)
+    return text
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    commands = parser.add_subparsers(dest="command", required=True)
+    commands.add_parser("list", help="print the objects of an archive").add_argument("archive")
+    command = commands.add_parser("unpack", help="archive to a directory")
+    command.add_argument("archive")
+    command.add_argument("directory")
+    command = commands.add_parser("pack", help="directory to an archive")
+    command.add_argument("directory")
+    command.add_argument("archive")
+    args = parser.parse_args()
+
+    try:
+        if args.command == "list":
+            with open(args.archive, "rb") as src:
+                objects = parse(src.read())
+            for o in objects:
+                print(describe(o))
+        elif args.command == "unpack":
+            objects = unpack(args.archive, args.directory)
+            print("%s: %d objects unpacked to %s" % (args.archive, len(objects), args.directory))
+        else:
+            objects, size = pack(args.directory, args.archive)
+            print("%s: %d objects, %d bytes" % (args.archive, len(objects), size))
+    except (ValueError, OSError, KeyError) as e:
+        sys.exit("%s: %s" % (args.command, e))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Encodes a PCM WAV file to IMA ADPCM (format tag 0x0011) playable by the clock.
+
+Blocks are a power of 2 of at most 2048 bytes, as the player requires. The output is about
+a quarter of 16-bit PCM, so ringtones upload and stream from the SD card 4x faster.
+
+    python tools/wav_to_adpcm.py ringtone.wav ringtone_adpcm.wav [--mono] [--block BYTES]
+"""
+
+import argparse
+import struct
+import sys
+import wave
+
+STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+]
+INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8]
+BLOCK_MAX = 2048
+
+
+class Channel:
+    def __init__(self):
+        self.predictor = 0
+        self.index = 0
+
+    def encode(self, sample):
+        step = STEP_TABLE[self.index]
+        diff = sample - self.predictor
+        code = 0
+        if diff < 0:
+            code = 8
+            diff = -diff
+        if diff >= step:
+            code |= 4
+            diff -= step
+        if diff >= step >> 1:
+            code |= 2
+            diff -= step >> 1
+        if diff >= step >> 2:
+            code |= 1
+
+        # Same arithmetic as the decoder, so both predictors stay in step
+        delta = step >> 3
+        if code & 1:
+            delta += step >> 2
+        if code & 2:
+            delta += step >> 1
+        if code & 4:
+            delta += step
+        self.predictor += -delta if code & 8 else delta
+        self.predictor = max(-32768, min(32767, self.predictor))
+        self.index = max(0, min(88, self.index + INDEX_TABLE[code & 7]))
+        return code
+
+
+def read_pcm16(path, mono):
+    with wave.open(path, "rb") as src:
+        channels = src.getnchannels()
+        width = src.getsampwidth()
+        rate = src.getframerate()
+        raw = src.readframes(src.getnframes())
+
+    samples = []
+    for i in range(0, len(raw) - width + 1, width):
+        if width == 1:
+            samples.append((raw[i] - 128) << 8)
+        else:
+            samples.append(struct.unpack_from("<h", raw, i + width - 2)[0])
+
+    frames = [samples[i:i + channels] for i in range(0, len(samples) - channels + 1, channels)]
+    if channels > 2 or mono:
+        frames = [[sum(f) // len(f)] for f in frames]
+    return rate, len(frames[0]) if frames else 1, frames
+
+
+def default_block(rate, channels):
+    block = 256 * channels
+    while block < BLOCK_MAX and rate >= 11025 * 2 * block // (256 * channels):
+        block *= 2
+    return block
+
+
+def encode(frames, channels, block):
+    stride = 4 * channels
+    per_block = (block - stride) * 2 // channels + 1
+    state = [Channel() for _ in range(channels)]
+    out = bytearray()
+
+    for start in range(0, len(frames), per_block):
+        chunk = frames[start:start + per_block]
+        chunk += [chunk[-1]] * (per_block - len(chunk))
+
+        for ch in range(channels):
+            state[ch].predictor = chunk[0][ch]
+            out += struct.pack("<hBB", chunk[0][ch], state[ch].index, 0)
+
+        # Codes of each channel in groups of 8 samples, 4 bytes, low nibble first
+        for group in range(1, per_block, 8):
+            for ch in range(channels):
+                codes = [state[ch].encode(chunk[group + k][ch]) for k in range(8)]
+                out += bytes(codes[k] | (codes[k + 1] << 4) for k in range(0, 8, 2))
+
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input")
+    parser.add_argument("output")
+    parser.add_argument("--mono", action="store_true", help="downmix to mono, halves the size again")
+    parser.add_argument("--block", type=int, help="block size in bytes, a power of 2 up to %d" % BLOCK_MAX)
+    args = parser.parse_args()
+
+    rate, channels, frames = read_pcm16(args.input, args.mono)
+    if not frames:
+        sys.exit("no samples in %s" % args.input)
+
+    block = args.block or default_block(rate, channels)
+    if block & (block - 1) or block <= 4 * channels or block > BLOCK_MAX:
+        sys.exit("block size must be a power of 2 above %d and up to %d" % (4 * channels, BLOCK_MAX))
+
+    data = encode(frames, channels, block)
+    per_block = (block - 4 * channels) * 2 // channels + 1
+    fmt = struct.pack("<HHIIHHHH", 0x0011, channels, rate, rate * block // per_block, block, 4, 2, per_block)
+
+    with open(args.output, "wb") as dst:
+        dst.write(b"RIFF" + struct.pack("<I", 4 + 8 + len(fmt) + 12 + 8 + len(data)) + b"WAVE")
+        dst.write(b"fmt " + struct.pack("<I", len(fmt)) + fmt)
+        dst.write(b"fact" + struct.pack("<II", 4, len(frames)))
+        dst.write(b"data" + struct.pack("<I", len(data)) + data)
+
+    print("%s: %d frames, %d Hz, %d channels, %d byte blocks, %d bytes" % (args.output, len(frames), rate, channels, block, len(data)))
+
+
+if __name__ == "__main__":
+    main()